@@ -51,7 +51,7 @@ export const INDUSTRIAL_SENSOR_CHARACTERISTICS = {
   // Node binding information (Read, Write with auth)
   BINDING: '00001004-0000-1000-8000-00805f9b34fb',
   
-  // Diagnostics data (Read, Notify)
+  // Sensor timing of the last reading (Read)
   DIAGNOSTICS: '00001005-0000-1000-8000-00805f9b34fb',
   
   // Log export (Read with chunking)
@@ -129,6 +129,16 @@ export interface NodeAdvertisement {
   // Freshness counter (2 bytes - increments on each sample)
   counter: number;
   
+  // Version 2 only, sent in an extended advertisement: seconds since the
+  // reading before lastReading (2 bytes), reading count (1 byte), battery
+  // voltage in mV (2 bytes), unit (8 bytes, NUL-padded), then the readings
+  // before lastReading, newest first (6 bytes each: value, then seconds
+  // since the reading before it)
+  spacingSeconds?: number;
+  batteryMillivolts?: number;
+  unit?: string;
+  history?: { value: number; spacingSeconds: number }[];
+  
   // RSSI (filled by receiver)
   rssi?: number;
 }
@@ -210,33 +220,24 @@ export const QUALITY_FLAGS = {
 } as const;
 
 /**
- * Diagnostics payload format
+ * Diagnostics payload format, sensor timing of the last reading
+ * (20 bytes, little-endian uint32 each)
  */
 export interface DiagnosticsPayload {
-  // Uptime in seconds
-  uptime: number;
-  
-  // Sample count
-  sampleCount: number;
-  
-  // Fault count
-  faultCount: number;
+  // Sensor rail powered, warm-up included (us)
+  sensorOnUs: number;
   
-  // Last fault code
-  lastFaultCode: number;
+  // Rail on to burst start (us)
+  warmupUs: number;
   
-  // Average battery voltage (mV)
-  avgBatteryMv: number;
+  // ADC burst (us)
+  acquireUs: number;
   
-  // Min/Max readings
-  minReading: number;
-  maxReading: number;
+  // Learned settle time, 0 until one is seen (us)
+  settleUs: number;
   
-  // Connection count (if hub-connected)
-  connectionCount: number;
-  
-  // Last connection timestamp
-  lastConnection: number;
+  // Warm-ups that reached warmupMs unsettled
+  settleTimeouts: number;
 }
 
 /**
@@ -252,10 +253,10 @@ export function createUUID(shortForm: string): string {
 export function parseNodeAdvertisement(data: Uint8Array): NodeAdvertisement | null {
   if (data.length < 17) return null;
   
-  const view = new DataView(data.buffer);
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
   
   try {
-    return {
+    const adv: NodeAdvertisement = {
       companyId: view.getUint16(0, true),
       version: view.getUint8(2),
       nodeId: Array.from(data.slice(3, 9))
@@ -266,16 +267,47 @@ export function parseNodeAdvertisement(data: Uint8Array): NodeAdvertisement | nu
       faultFlags: view.getUint8(14),
       counter: view.getUint16(15, true),
     };
+    
+    if (adv.version === 2 && data.length >= 30) {
+      const count = Math.min(Math.max(view.getUint8(19) - 1, 0), Math.floor((data.length - 30) / 6));
+      adv.spacingSeconds = view.getUint16(17, true);
+      adv.batteryMillivolts = view.getUint16(20, true);
+      adv.unit = new TextDecoder().decode(data.slice(22, 30)).replace(/\0+$/, '');
+      adv.history = Array.from({ length: count }, (_, i) => ({
+        value: view.getFloat32(30 + i * 6, true),
+        spacingSeconds: view.getUint16(34 + i * 6, true),
+      }));
+    }
+    
+    return adv;
   } catch {
     return null;
   }
 }
 
+/**
+ * Helper to parse the Diagnostics characteristic
+ */
+export function parseDiagnostics(data: Uint8Array): DiagnosticsPayload | null {
+  if (data.length < 20) return null;
+  
+  const view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+  
+  return {
+    sensorOnUs: view.getUint32(0, true),
+    warmupUs: view.getUint32(4, true),
+    acquireUs: view.getUint32(8, true),
+    settleUs: view.getUint32(12, true),
+    settleTimeouts: view.getUint32(16, true),
+  };
+}
+
 /**
  * Helper to encode advertisement data
  */
 export function encodeNodeAdvertisement(adv: NodeAdvertisement): Uint8Array {
-  const buffer = new ArrayBuffer(17);
+  const history = adv.version === 2 ? adv.history ?? [] : [];
+  const buffer = new ArrayBuffer(adv.version === 2 ? 30 + history.length * 6 : 17);
   const view = new DataView(buffer);
   const bytes = new Uint8Array(buffer);
   
@@ -290,5 +322,176 @@ export function encodeNodeAdvertisement(adv: NodeAdvertisement): Uint8Array {
   view.setUint8(14, adv.faultFlags);
   view.setUint16(15, adv.counter, true);
   
+  if (adv.version === 2) {
+    view.setUint16(17, adv.spacingSeconds ?? 0, true);
+    view.setUint8(19, history.length + 1);
+    view.setUint16(20, adv.batteryMillivolts ?? 0, true);
+    bytes.set(new TextEncoder().encode(adv.unit ?? '').slice(0, 8), 22);
+    history.forEach((entry, i) => {
+      view.setFloat32(30 + i * 6, entry.value, true);
+      view.setUint16(34 + i * 6, entry.spacingSeconds, true);
+    });
+  }
+  
   return bytes;
 }
+
+/**
+ * Config characteristic record tags (version byte, then tag, length, value).
+ * Mirrors firmware/node_nrf54l15/src/config/config_codec.h
+ */
+export const CONFIG_CODEC_VERSION = 0x01;
+
+export const CONFIG_TAGS = {
+  INTERVAL: 0x01,
+  WARMUP: 0x02,
+  BURST_COUNT: 0x03,
+  AGGREGATION: 0x04,
+  MIN_INTERVAL: 0x05,
+  MAX_INTERVAL: 0x06,
+  WARMUP_MODE: 0x07,
+  CAL_TYPE: 0x10,
+  CAL_OFFSET: 0x11,
+  CAL_SLOPE: 0x12,
+  CAL_POLY_A: 0x13,
+  CAL_POLY_B: 0x14,
+  CAL_POLY: 0x15,
+  CAL_POINTS: 0x16,
+  POLICY: 0x20,
+  HEARTBEAT: 0x21,
+  DEADBAND: 0x22,
+  ALARM_HIGH: 0x30,
+  ALARM_LOW: 0x31,
+  ALARM_HIGH_EN: 0x32,
+  ALARM_LOW_EN: 0x33,
+} as const;
+
+const WARMUP_MODES = ['fixed', 'settle'];
+const AGGREGATIONS = ['mean', 'median', 'min', 'max', 'trimmed_mean'];
+const CALIBRATION_TYPES = ['linear', 'polynomial', 'table'];
+const ADVERTISEMENT_POLICIES = ['each_sample', 'heartbeat', 'on_change'];
+
+/**
+ * The node-config.schema.json fields carried by the Config characteristic
+ */
+export interface NodeConfig {
+  sampling?: {
+    intervalSeconds?: number;
+    minIntervalSeconds?: number;
+    maxIntervalSeconds?: number;
+    warmupMs?: number;
+    warmupMode?: string;
+    burstCount?: number;
+    aggregation?: string;
+  };
+  calibration?: {
+    type: string;
+    points?: { voltage: number; value: number }[];
+    polynomial?: number[];
+  };
+  advertisement?: {
+    policy?: string;
+    heartbeatSeconds?: number;
+    deadband?: number;
+  };
+  faults?: {
+    enabled?: boolean;
+    lowThreshold?: number;
+    highThreshold?: number;
+  };
+}
+
+function enumIndex(names: string[], value: string): number {
+  const index = names.indexOf(value);
+  if (index < 0) throw new Error(`Unknown config value "${value}"`);
+  return index;
+}
+
+/**
+ * Helper to encode a configuration for one Config characteristic write.
+ * Only the fields present are written, the node keeps the others. A
+ * linear calibration is sent as offset and slope through its first two
+ * points, table voltages in millivolts, faults thresholds as the alarms.
+ */
+export function encodeNodeConfig(config: NodeConfig): Uint8Array {
+  const bytes: number[] = [CONFIG_CODEC_VERSION];
+  const scratch = new DataView(new ArrayBuffer(4));
+
+  const put = (tag: number, value: number[]) => bytes.push(tag, value.length, ...value);
+  const u8 = (tag: number, value: number) => put(tag, [value & 0xff]);
+  const u16 = (tag: number, value: number) => put(tag, [value & 0xff, (value >> 8) & 0xff]);
+  const le32 = (set: (view: DataView) => void): number[] => {
+    set(scratch);
+    return Array.from(new Uint8Array(scratch.buffer));
+  };
+  const u32 = (tag: number, value: number) => put(tag, le32(v => v.setUint32(0, value, true)));
+  const f32 = (value: number) => le32(v => v.setFloat32(0, value, true));
+
+  const { sampling, calibration, advertisement, faults } = config;
+
+  if (sampling) {
+    if (sampling.intervalSeconds !== undefined) u32(CONFIG_TAGS.INTERVAL, sampling.intervalSeconds);
+    if (sampling.warmupMs !== undefined) u16(CONFIG_TAGS.WARMUP, sampling.warmupMs);
+    if (sampling.burstCount !== undefined) u8(CONFIG_TAGS.BURST_COUNT, sampling.burstCount);
+    if (sampling.aggregation !== undefined) {
+      u8(CONFIG_TAGS.AGGREGATION, enumIndex(AGGREGATIONS, sampling.aggregation));
+    }
+    if (sampling.minIntervalSeconds !== undefined) {
+      u32(CONFIG_TAGS.MIN_INTERVAL, sampling.minIntervalSeconds);
+    }
+    if (sampling.maxIntervalSeconds !== undefined) {
+      u32(CONFIG_TAGS.MAX_INTERVAL, sampling.maxIntervalSeconds);
+    }
+    if (sampling.warmupMode !== undefined) {
+      u8(CONFIG_TAGS.WARMUP_MODE, enumIndex(WARMUP_MODES, sampling.warmupMode));
+    }
+  }
+
+  if (calibration) {
+    const type = enumIndex(CALIBRATION_TYPES, calibration.type);
+    const points = calibration.points ?? [];
+    u8(CONFIG_TAGS.CAL_TYPE, type);
+
+    if (type === 0) {
+      if (points.length < 2 || points[0].voltage === points[1].voltage) {
+        throw new Error('Linear calibration needs two points');
+      }
+      const slope = (points[1].value - points[0].value) / (points[1].voltage - points[0].voltage);
+      put(CONFIG_TAGS.CAL_OFFSET, f32(points[0].value - slope * points[0].voltage));
+      put(CONFIG_TAGS.CAL_SLOPE, f32(slope));
+      put(CONFIG_TAGS.CAL_POLY_A, f32(0));
+      put(CONFIG_TAGS.CAL_POLY_B, f32(0));
+    } else if (type === 1) {
+      put(CONFIG_TAGS.CAL_POLY, (calibration.polynomial ?? []).flatMap(f32));
+    } else {
+      put(CONFIG_TAGS.CAL_POINTS, points.flatMap(p => {
+        const mv = Math.min(Math.round(p.voltage * 1000), 0xffff);
+        return [mv & 0xff, mv >> 8, ...f32(p.value)];
+      }));
+    }
+  }
+
+  if (advertisement) {
+    if (advertisement.policy !== undefined) {
+      u8(CONFIG_TAGS.POLICY, enumIndex(ADVERTISEMENT_POLICIES, advertisement.policy));
+    }
+    if (advertisement.heartbeatSeconds !== undefined) {
+      u16(CONFIG_TAGS.HEARTBEAT, advertisement.heartbeatSeconds);
+    }
+    if (advertisement.deadband !== undefined) put(CONFIG_TAGS.DEADBAND, f32(advertisement.deadband));
+  }
+
+  if (faults) {
+    const enabled = faults.enabled !== false ? 1 : 0;
+    if (faults.highThreshold !== undefined) {
+      put(CONFIG_TAGS.ALARM_HIGH, f32(faults.highThreshold));
+      u8(CONFIG_TAGS.ALARM_HIGH_EN, enabled);
+    }
+    if (faults.lowThreshold !== undefined) {
+      put(CONFIG_TAGS.ALARM_LOW, f32(faults.lowThreshold));
+      u8(CONFIG_TAGS.ALARM_LOW_EN, enabled);
+    }
+  }
+
+  return Uint8Array.from(bytes);
+}
@@ -98,6 +98,12 @@ export interface NodeTelemetryPayload {
   };
   faults: string[];
   rssi: number;
+  // Set when the hub summarized a window, reading.value is then the mean
+  window?: {
+    count: number;
+    min: number;
+    max: number;
+  };
 }
 
 /**
@@ -1,8 +1,19 @@
 /*
  * BLE Connection Manager Implementation
+ *
+ * A session walks a connection through encryption, data length and MTU
+ * update and characteristic discovery before its owner is told it is
+ * ready. Nodes only take Config writes and subscriptions on an encrypted
+ * link. The hub pairs (Just Works, LE Secure Connections) on every
+ * connection without bonding, since it keeps no keys across resets. The
+ * owner then reads, writes or subscribes through the GATT client and
+ * disconnects when done.
  */
 
 #include "connection_manager.h"
+#include "gatt_client.h"
+#include "node_manager.h"
+#include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 
@@ -11,39 +22,241 @@ LOG_MODULE_REGISTER(conn_mgr, LOG_LEVEL_INF);
 struct connection_entry {
     struct bt_conn *conn;
     bool in_use;
+    bool secured;                       /* Encrypted, setup went on */
+    bool ready;                         /* ready callback ran without error */
+    const struct conn_session_cb *cb;   /* NULL once the owner was told */
+    void *user_data;
 };
 
 static struct connection_entry connections[MAX_CONNECTIONS];
 static struct k_mutex conn_mutex;
+static struct bt_gatt_exchange_params mtu_params[MAX_CONNECTIONS];
+
+static int find_slot(struct bt_conn *conn)
+{
+    for (int i = 0; i < MAX_CONNECTIONS; i++) {
+        if (connections[i].in_use && connections[i].conn == conn) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void slot_free(int slot)
+{
+    bt_conn_unref(connections[slot].conn);
+    memset(&connections[slot], 0, sizeof(connections[slot]));
+}
+
+/* Tell the owner its session failed, and drop the link */
+static void session_fail(struct bt_conn *conn, int err)
+{
+    const struct conn_session_cb *cb = NULL;
+    void *user_data = NULL;
+    int slot;
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot = find_slot(conn);
+    if (slot >= 0) {
+        cb = connections[slot].cb;
+        user_data = connections[slot].user_data;
+        connections[slot].cb = NULL;
+    }
+    k_mutex_unlock(&conn_mutex);
+
+    LOG_WRN("Session setup failed (err %d)", err);
+    bt_conn_disconnect(conn, BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+    if (cb) {
+        cb->ready(NULL, err, user_data);
+    }
+}
+
+static void discovered(struct bt_conn *conn, int status)
+{
+    const struct conn_session_cb *cb = NULL;
+    void *user_data = NULL;
+    int slot;
+
+    if (status) {
+        session_fail(conn, status);
+        return;
+    }
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot = find_slot(conn);
+    if (slot >= 0) {
+        cb = connections[slot].cb;
+        user_data = connections[slot].user_data;
+        connections[slot].ready = true;
+    }
+    k_mutex_unlock(&conn_mutex);
+
+    node_manager_update_connection(bt_conn_get_dst(conn), conn);
+    if (cb) {
+        cb->ready(conn, 0, user_data);
+    }
+}
+
+static void start_discovery(struct bt_conn *conn)
+{
+    int err = gatt_client_discover(conn, discovered);
+
+    if (err) {
+        session_fail(conn, err);
+    }
+}
+
+static void mtu_exchanged(struct bt_conn *conn, uint8_t err, struct bt_gatt_exchange_params *params)
+{
+    if (err) {
+        LOG_WRN("MTU exchange failed (err %u)", err);
+    } else {
+        LOG_INF("ATT MTU %u", bt_gatt_get_mtu(conn));
+    }
+
+    /* Discovery runs at whatever MTU was agreed */
+    start_discovery(conn);
+}
+
+/*
+ * Raise the data length and ATT MTU on every session. Nodes size their
+ * Reading Batch notifications from the MTU, up to 26 readings in one PDU.
+ */
+static void raise_mtu(struct bt_conn *conn)
+{
+    int slot = -1;
+    int err;
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot = find_slot(conn);
+    k_mutex_unlock(&conn_mutex);
+
+    if (slot < 0) {
+        return;
+    }
+
+    err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (err) {
+        LOG_DBG("Data length update failed (err %d)", err);
+    }
+
+    mtu_params[slot].func = mtu_exchanged;
+    err = bt_gatt_exchange_mtu(conn, &mtu_params[slot]);
+    if (err) {
+        LOG_WRN("MTU exchange failed (err %d)", err);
+        start_discovery(conn);
+    }
+}
 
 static void connected_cb(struct bt_conn *conn, uint8_t err)
 {
+    const struct conn_session_cb *cb = NULL;
+    void *user_data = NULL;
+    int slot;
+    int ret;
+
     if (err) {
         LOG_ERR("Connection failed (err %u)", err);
+
+        /* No disconnected callback follows, the slot is freed here */
+        k_mutex_lock(&conn_mutex, K_FOREVER);
+        slot = find_slot(conn);
+        if (slot >= 0) {
+            cb = connections[slot].cb;
+            user_data = connections[slot].user_data;
+            slot_free(slot);
+        }
+        k_mutex_unlock(&conn_mutex);
+
+        if (cb) {
+            cb->ready(NULL, -ECONNREFUSED, user_data);
+        }
         return;
     }
     LOG_INF("Connected");
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot = find_slot(conn);
+    k_mutex_unlock(&conn_mutex);
+    if (slot < 0) {
+        return;
+    }
+
+    ret = bt_conn_set_security(conn, BT_SECURITY_L2);
+    if (ret) {
+        session_fail(conn, ret);
+    }
+}
+
+static void security_changed_cb(struct bt_conn *conn, bt_security_t level,
+                                enum bt_security_err err)
+{
+    bool first = false;
+    int slot;
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot = find_slot(conn);
+    if (slot >= 0 && !connections[slot].secured && !err) {
+        connections[slot].secured = true;
+        first = true;
+    }
+    k_mutex_unlock(&conn_mutex);
+
+    if (slot < 0) {
+        return;
+    }
+    if (err) {
+        LOG_WRN("Pairing failed (err %d)", err);
+        session_fail(conn, -EACCES);
+        return;
+    }
+    if (first) {
+        LOG_INF("Encrypted, level %d", level);
+        raise_mtu(conn);
+    }
 }
 
 static void disconnected_cb(struct bt_conn *conn, uint8_t reason)
 {
+    const struct conn_session_cb *cb = NULL;
+    void *user_data = NULL;
+    bool ready = false;
+    int slot;
+
     LOG_INF("Disconnected (reason %u)", reason);
     
     k_mutex_lock(&conn_mutex, K_FOREVER);
-    for (int i = 0; i < MAX_CONNECTIONS; i++) {
-        if (connections[i].conn == conn) {
-            bt_conn_unref(conn);
-            connections[i].conn = NULL;
-            connections[i].in_use = false;
-            break;
-        }
+    slot = find_slot(conn);
+    if (slot >= 0) {
+        cb = connections[slot].cb;
+        user_data = connections[slot].user_data;
+        ready = connections[slot].ready;
     }
     k_mutex_unlock(&conn_mutex);
+
+    if (slot < 0) {
+        return;
+    }
+
+    gatt_client_release(conn);
+    if (ready) {
+        node_manager_update_connection(bt_conn_get_dst(conn), NULL);
+    }
+    if (cb && ready) {
+        cb->closed(conn, user_data);
+    } else if (cb) {
+        cb->ready(NULL, -ENOTCONN, user_data);
+    }
+
+    k_mutex_lock(&conn_mutex, K_FOREVER);
+    slot_free(slot);
+    k_mutex_unlock(&conn_mutex);
 }
 
 static struct bt_conn_cb conn_callbacks = {
     .connected = connected_cb,
     .disconnected = disconnected_cb,
+    .security_changed = security_changed_cb,
 };
 
 int connection_manager_init(void)
@@ -56,7 +269,8 @@ int connection_manager_init(void)
     return 0;
 }
 
-struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t timeout_sec)
+int connection_manager_open(const bt_addr_le_t *addr, const struct conn_session_cb *cb,
+                            void *user_data)
 {
     struct bt_conn *conn;
     int err, slot = -1;
@@ -66,6 +280,8 @@ struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t ti
         if (!connections[i].in_use) {
             slot = i;
             connections[i].in_use = true;
+            connections[i].cb = cb;
+            connections[i].user_data = user_data;
             break;
         }
     }
@@ -73,7 +289,7 @@ struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t ti
     
     if (slot < 0) {
         LOG_ERR("No free connection slots");
-        return NULL;
+        return -ENOMEM;
     }
     
     struct bt_le_conn_param param = {
@@ -87,9 +303,9 @@ struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t ti
     if (err) {
         LOG_ERR("Create conn failed (err %d)", err);
         k_mutex_lock(&conn_mutex, K_FOREVER);
-        connections[slot].in_use = false;
+        memset(&connections[slot], 0, sizeof(connections[slot]));
         k_mutex_unlock(&conn_mutex);
-        return NULL;
+        return err;
     }
     
     k_mutex_lock(&conn_mutex, K_FOREVER);
@@ -97,7 +313,7 @@ struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t ti
     k_mutex_unlock(&conn_mutex);
     
     LOG_INF("Connection initiated");
-    return conn;
+    return 0;
 }
 
 int connection_manager_disconnect(struct bt_conn *conn)
@@ -9,8 +9,31 @@
 
 #define MAX_CONNECTIONS 3
 
+/* Session callbacks, both run from the Bluetooth thread */
+struct conn_session_cb {
+    /*
+     * The link is up, its MTU raised and the node's characteristics
+     * discovered. On failure err is set and conn is NULL; the link is
+     * already being torn down.
+     */
+    void (*ready)(struct bt_conn *conn, int err, void *user_data);
+
+    /* The link is gone, only after ready ran without error */
+    void (*closed)(struct bt_conn *conn, void *user_data);
+};
+
 int connection_manager_init(void);
-struct bt_conn *connection_manager_connect(const bt_addr_le_t *addr, uint32_t timeout_sec);
+
+/**
+ * Connect to a node and prepare it for GATT client use. cb->ready runs
+ * exactly once.
+ *
+ * @return 0 if the connection was initiated, -ENOMEM if all slots are in
+ *         use, other negative error codes from the stack
+ */
+int connection_manager_open(const bt_addr_le_t *addr, const struct conn_session_cb *cb,
+                            void *user_data);
+
 int connection_manager_disconnect(struct bt_conn *conn);
 int connection_manager_get_count(void);
 
@@ -5,6 +5,7 @@
 
 #include "gatt_client.h"
 #include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 
@@ -22,6 +23,10 @@ static uint8_t read_func(struct bt_conn *conn, uint8_t err,
                         struct bt_gatt_read_params *params, const void *data, uint16_t length);
 static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
                           const void *data, uint16_t length);
+static uint8_t ccc_discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                 struct bt_gatt_discover_params *params);
+static void write_func(struct bt_conn *conn, uint8_t err,
+                       struct bt_gatt_write_params *params);
 
 int gatt_client_init(void)
 {
@@ -76,6 +81,10 @@ static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *at
 	
 	if (!attr) {
 		LOG_INF("Discovery complete");
+		if (ctx && ctx->open_end) {
+			*ctx->open_end = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+			ctx->open_end = NULL;
+		}
 		if (ctx && ctx->discover_cb) {
 			ctx->discover_cb(conn, 0);
 		}
@@ -86,11 +95,18 @@ static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *at
 		return BT_GATT_ITER_STOP;
 	}
 	
+	/* A characteristic ends where the next one is declared */
+	if (ctx->open_end) {
+		*ctx->open_end = attr->handle - 1;
+		ctx->open_end = NULL;
+	}
+	
 	/* Store characteristic handles based on UUID */
 	struct bt_gatt_chrc *chrc = (struct bt_gatt_chrc *)attr->user_data;
 	
 	if (bt_uuid_cmp(chrc->uuid, BT_UUID_DECLARE_128(READING_CHAR_UUID)) == 0) {
 		ctx->reading_handle = chrc->value_handle;
+		ctx->open_end = &ctx->reading_end;
 		LOG_INF("Found reading characteristic handle: %u", ctx->reading_handle);
 	} else if (bt_uuid_cmp(chrc->uuid, BT_UUID_DECLARE_128(BATTERY_CHAR_UUID)) == 0) {
 		ctx->battery_handle = chrc->value_handle;
@@ -104,6 +120,10 @@ static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *at
 	} else if (bt_uuid_cmp(chrc->uuid, BT_UUID_DECLARE_128(DIAGNOSTICS_CHAR_UUID)) == 0) {
 		ctx->diagnostics_handle = chrc->value_handle;
 		LOG_INF("Found diagnostics characteristic handle: %u", ctx->diagnostics_handle);
+	} else if (bt_uuid_cmp(chrc->uuid, BT_UUID_DECLARE_128(READING_BATCH_CHAR_UUID)) == 0) {
+		ctx->reading_batch_handle = chrc->value_handle;
+		ctx->open_end = &ctx->reading_batch_end;
+		LOG_INF("Found reading batch characteristic handle: %u", ctx->reading_batch_handle);
 	}
 	
 	return BT_GATT_ITER_CONTINUE;
@@ -118,8 +138,10 @@ int gatt_client_discover(struct bt_conn *conn, gatt_discover_cb_t cb)
 		return -ENOMEM;
 	}
 	
+	/* All characteristics, so the one after each of ours bounds it */
 	ctx->discover_cb = cb;
-	ctx->discover_params.uuid = BT_UUID_DECLARE_128(SENSOR_SERVICE_UUID);
+	ctx->open_end = NULL;
+	ctx->discover_params.uuid = NULL;
 	ctx->discover_params.func = discover_func;
 	ctx->discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
 	ctx->discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
@@ -226,8 +248,13 @@ int gatt_client_write(struct bt_conn *conn, const struct bt_uuid *uuid,
 		return -ENOENT;
 	}
 	
+	if (handle == ctx->config_handle && length > bt_gatt_get_mtu(conn) - GATT_WRITE_HDR_LEN) {
+		LOG_ERR("Config of %u bytes does not fit one write", length);
+		return -EMSGSIZE;
+	}
+	
 	ctx->write_cb = cb;
-	ctx->write_params.func = NULL; /* Synchronous write */
+	ctx->write_params.func = write_func;
 	ctx->write_params.handle = handle;
 	ctx->write_params.offset = 0;
 	ctx->write_params.data = data;
@@ -239,11 +266,21 @@ int gatt_client_write(struct bt_conn *conn, const struct bt_uuid *uuid,
 		return err;
 	}
 	
-	if (cb) {
-		cb(conn, 0);
+	return 0;
+}
+
+static void write_func(struct bt_conn *conn, uint8_t err,
+                       struct bt_gatt_write_params *params)
+{
+	struct gatt_client_ctx *ctx = get_context(conn);
+	
+	if (err) {
+		LOG_ERR("Write rejected: 0x%02x", err);
 	}
 	
-	return 0;
+	if (ctx && ctx->write_cb) {
+		ctx->write_cb(conn, err);
+	}
 }
 
 static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
@@ -268,8 +305,52 @@ static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params
 	return BT_GATT_ITER_CONTINUE;
 }
 
+static void subscribe_func(struct bt_conn *conn, uint8_t err,
+                           struct bt_gatt_subscribe_params *params)
+{
+	struct gatt_client_ctx *ctx = get_context(conn);
+	
+	if (err) {
+		LOG_ERR("CCC write rejected: 0x%02x", err);
+	}
+	
+	if (ctx && ctx->subscribe_cb) {
+		ctx->subscribe_cb(conn, err);
+	}
+}
+
+static uint8_t ccc_discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                 struct bt_gatt_discover_params *params)
+{
+	struct gatt_client_ctx *ctx = get_context(conn);
+	int err;
+	
+	if (!ctx) {
+		return BT_GATT_ITER_STOP;
+	}
+	
+	if (!attr) {
+		LOG_ERR("No CCC for handle %u", ctx->subscribe_params.value_handle);
+		if (ctx->subscribe_cb) {
+			ctx->subscribe_cb(conn, -ENOENT);
+		}
+		return BT_GATT_ITER_STOP;
+	}
+	
+	ctx->subscribe_params.ccc_handle = attr->handle;
+	err = bt_gatt_subscribe(conn, &ctx->subscribe_params);
+	if (err && err != -EALREADY) {
+		LOG_ERR("Subscribe failed: %d", err);
+		if (ctx->subscribe_cb) {
+			ctx->subscribe_cb(conn, err);
+		}
+	}
+	
+	return BT_GATT_ITER_STOP;
+}
+
 int gatt_client_subscribe(struct bt_conn *conn, const struct bt_uuid *uuid,
-                          gatt_notify_cb_t cb)
+                          gatt_notify_cb_t cb, gatt_write_cb_t done)
 {
 	struct gatt_client_ctx *ctx = get_context(conn);
 	
@@ -278,31 +359,76 @@ int gatt_client_subscribe(struct bt_conn *conn, const struct bt_uuid *uuid,
 	}
 	
 	uint16_t handle = 0;
+	uint16_t end = 0;
 	
 	if (bt_uuid_cmp(uuid, BT_UUID_DECLARE_128(READING_CHAR_UUID)) == 0) {
 		handle = ctx->reading_handle;
+		end = ctx->reading_end;
+	} else if (bt_uuid_cmp(uuid, BT_UUID_DECLARE_128(READING_BATCH_CHAR_UUID)) == 0) {
+		handle = ctx->reading_batch_handle;
+		end = ctx->reading_batch_end;
 	}
 	
-	if (handle == 0) {
+	if (handle == 0 || end <= handle) {
 		LOG_ERR("Characteristic not found or not notifiable");
 		return -ENOENT;
 	}
 	
 	ctx->notify_cb = cb;
+	ctx->subscribe_cb = done;
 	ctx->subscribe_params.notify = notify_func;
+	ctx->subscribe_params.subscribe = subscribe_func;
 	ctx->subscribe_params.value = BT_GATT_CCC_NOTIFY;
 	ctx->subscribe_params.value_handle = handle;
-	ctx->subscribe_params.ccc_handle = handle + 1; /* Assume CCC is next handle */
+	ctx->subscribe_params.ccc_handle = 0;
 	
-	int err = bt_gatt_subscribe(conn, &ctx->subscribe_params);
+	/* The CCC is one of the descriptors after the value */
+	ctx->discover_params.uuid = BT_UUID_GATT_CCC;
+	ctx->discover_params.func = ccc_discover_func;
+	ctx->discover_params.start_handle = handle + 1;
+	ctx->discover_params.end_handle = end;
+	ctx->discover_params.type = BT_GATT_DISCOVER_DESCRIPTOR;
+	
+	int err = bt_gatt_discover(conn, &ctx->discover_params);
 	if (err) {
-		LOG_ERR("Subscribe failed: %d", err);
+		LOG_ERR("CCC discovery failed: %d", err);
 		return err;
 	}
 	
 	return 0;
 }
 
+int gatt_client_parse_batch(const void *data, uint16_t length,
+                            struct gatt_batch_reading *readings, uint8_t max)
+{
+	const uint8_t *p = data;
+	uint8_t count;
+	uint16_t entries;
+	uint16_t counter;
+
+	if (length < GATT_BATCH_HDR_LEN) {
+		return -EINVAL;
+	}
+
+	count = p[0];
+	counter = sys_get_le16(p + 2);
+	entries = GATT_BATCH_HDR_LEN + p[1];
+	if (entries + count * GATT_BATCH_ENTRY_LEN > length) {
+		return -EINVAL;
+	}
+
+	p += entries;
+	count = MIN(count, max);
+	for (uint8_t i = 0; i < count; i++, p += GATT_BATCH_ENTRY_LEN) {
+		readings[i].timestamp = sys_get_le32(p);
+		memcpy(&readings[i].value, p + 4, sizeof(float));
+		readings[i].counter = counter + i;
+		readings[i].quality = p[8];
+	}
+
+	return count;
+}
+
 int gatt_client_unsubscribe(struct bt_conn *conn, const struct bt_uuid *uuid)
 {
 	struct gatt_client_ctx *ctx = get_context(conn);
@@ -320,3 +446,8 @@ int gatt_client_unsubscribe(struct bt_conn *conn, const struct bt_uuid *uuid)
 	release_context(conn);
 	return 0;
 }
+
+void gatt_client_release(struct bt_conn *conn)
+{
+	release_context(conn);
+}
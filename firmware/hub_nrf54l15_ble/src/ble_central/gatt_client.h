@@ -24,10 +24,32 @@
 
 /* Characteristic UUIDs */
 #define READING_CHAR_UUID       BT_UUID_128_ENCODE(0x00001001, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
-#define BATTERY_CHAR_UUID       BT_UUID_128_ENCODE(0x00001002, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
-#define CONFIG_CHAR_UUID        BT_UUID_128_ENCODE(0x00001003, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
-#define CALIBRATION_CHAR_UUID   BT_UUID_128_ENCODE(0x00001004, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
+#define BATTERY_CHAR_UUID       BT_UUID_128_ENCODE(0x00002a19, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
+#define CONFIG_CHAR_UUID        BT_UUID_128_ENCODE(0x00001002, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
+#define CALIBRATION_CHAR_UUID   BT_UUID_128_ENCODE(0x00001003, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
 #define DIAGNOSTICS_CHAR_UUID   BT_UUID_128_ENCODE(0x00001005, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
+#define READING_BATCH_CHAR_UUID BT_UUID_128_ENCODE(0x00001008, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb)
+
+/* ATT write request header: opcode and handle */
+#define GATT_WRITE_HDR_LEN      3
+
+/*
+ * Reading Batch notification: count, unit length, counter of the first
+ * entry, unit, then entries with consecutive counters
+ */
+#define GATT_BATCH_HDR_LEN      4
+#define GATT_BATCH_ENTRY_LEN    9
+
+/* Most readings in one notification, at the largest ATT MTU */
+#define GATT_BATCH_MAX          26
+
+/* One reading of a Reading Batch notification */
+struct gatt_batch_reading {
+	uint32_t timestamp;
+	float value;
+	uint16_t counter;	/* Advertisement counter the reading was sent with */
+	uint8_t quality;
+};
 
 /* Callbacks */
 typedef void (*gatt_discover_cb_t)(struct bt_conn *conn, int status);
@@ -48,11 +70,18 @@ struct gatt_client_ctx {
 	uint16_t config_handle;
 	uint16_t calibration_handle;
 	uint16_t diagnostics_handle;
+	uint16_t reading_batch_handle;
+	
+	/* Last handle of the notifiable characteristics, where CCC search ends */
+	uint16_t reading_end;
+	uint16_t reading_batch_end;
+	uint16_t *open_end;	/* End not known until the next declaration */
 	
 	gatt_discover_cb_t discover_cb;
 	gatt_read_cb_t read_cb;
 	gatt_write_cb_t write_cb;
 	gatt_notify_cb_t notify_cb;
+	gatt_write_cb_t subscribe_cb;
 };
 
 /**
@@ -80,25 +109,51 @@ int gatt_client_read(struct bt_conn *conn, const struct bt_uuid *uuid, gatt_read
 
 /**
  * @brief Write characteristic value
+ *
+ * A Config value is the node's binary encoding, already translated from
+ * JSON by the cellular processor. It must fit one write at the current
+ * ATT MTU, because the node does not accept long writes.
+ *
  * @param conn Connection handle
  * @param uuid Characteristic UUID
- * @param data Data to write
+ * @param data Data to write, valid until cb is called
  * @param length Data length
- * @param cb Callback when write complete
- * @return 0 on success, negative error code on failure
+ * @param cb Callback when the node has answered the write
+ * @return 0 on success, -EMSGSIZE if a Config value does not fit one
+ *         write, other negative error code on failure
  */
 int gatt_client_write(struct bt_conn *conn, const struct bt_uuid *uuid,
                       const void *data, uint16_t length, gatt_write_cb_t cb);
 
 /**
  * @brief Subscribe to characteristic notifications
+ *
+ * The characteristic's CCC descriptor is discovered first, then written.
+ *
  * @param conn Connection handle
  * @param uuid Characteristic UUID
  * @param cb Callback for notification data
+ * @param done Callback once the CCC is written, or -ENOENT if the
+ *             characteristic has none
  * @return 0 on success, negative error code on failure
  */
 int gatt_client_subscribe(struct bt_conn *conn, const struct bt_uuid *uuid,
-                          gatt_notify_cb_t cb);
+                          gatt_notify_cb_t cb, gatt_write_cb_t done);
+
+/**
+ * @brief Parse a Reading Batch notification
+ *
+ * The node packs as many readings into each notification as the ATT MTU
+ * allows, oldest first. Each reading gets its advertisement counter.
+ *
+ * @param data Notification data
+ * @param length Notification length
+ * @param readings Parsed readings
+ * @param max Size of readings
+ * @return Number of readings, or -EINVAL if the notification is malformed
+ */
+int gatt_client_parse_batch(const void *data, uint16_t length,
+                            struct gatt_batch_reading *readings, uint8_t max);
 
 /**
  * @brief Unsubscribe from notifications
@@ -108,4 +163,13 @@ int gatt_client_subscribe(struct bt_conn *conn, const struct bt_uuid *uuid,
  */
 int gatt_client_unsubscribe(struct bt_conn *conn, const struct bt_uuid *uuid);
 
+/**
+ * @brief Free the context of a connection
+ *
+ * Called on disconnect; subscriptions end with the link.
+ *
+ * @param conn Connection handle
+ */
+void gatt_client_release(struct bt_conn *conn);
+
 #endif /* GATT_CLIENT_H */
@@ -1,5 +1,9 @@
 /*
  * BLE Scanner Implementation
+ *
+ * Reports come through a registered scan callback rather than the one
+ * passed to bt_le_scan_start(), so extended advertisements from nodes
+ * arrive with their full report info.
  */
 
 #include "scanner.h"
@@ -17,24 +21,29 @@ static struct bt_le_scan_param scan_param = {
     .window = BT_GAP_SCAN_FAST_WINDOW,
 };
 
-static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
-                        struct net_buf_simple *ad)
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *ad)
 {
     if (!scan_cb) {
         return;
     }
     
-    struct bt_le_scan_recv_info info = {
-        .addr = addr,
-        .rssi = rssi,
-        .adv_type = type,
-    };
-    
-    scan_cb(&info, ad);
+    scan_cb(info, ad);
 }
 
+static struct bt_le_scan_cb scan_callbacks = {
+    .recv = scan_recv,
+};
+
 int scanner_init(void)
 {
+    int ret;
+    
+    ret = bt_le_scan_cb_register(&scan_callbacks);
+    if (ret) {
+        LOG_ERR("Scan callback register failed (err %d)", ret);
+        return ret;
+    }
+    
     LOG_INF("Scanner initialized");
     return 0;
 }
@@ -53,7 +62,7 @@ int scanner_start(scan_callback_t callback)
     
     scan_cb = callback;
     
-    ret = bt_le_scan_start(&scan_param, device_found);
+    ret = bt_le_scan_start(&scan_param, NULL);
     if (ret) {
         LOG_ERR("Scan start failed (err %d)", ret);
         return ret;
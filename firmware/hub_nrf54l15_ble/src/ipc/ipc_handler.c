@@ -16,13 +16,25 @@ int ipc_handler_init(void)
 	return 0;
 }
 
-int ipc_send(enum ipc_message_type type, const uint8_t *payload, uint16_t len)
+static int ipc_send_frame(enum ipc_message_type type, uint32_t correlation_id,
+			  const uint8_t *payload, uint16_t len)
 {
-	LOG_INF("IPC send: type=%d, len=%d", type, len);
+	LOG_INF("IPC send: type=%d, len=%d, correlation=%u", type, len, correlation_id);
 	/* UART send implementation */
 	return 0;
 }
 
+int ipc_send(enum ipc_message_type type, const uint8_t *payload, uint16_t len)
+{
+	return ipc_send_frame(type, IPC_CORRELATION_NONE, payload, len);
+}
+
+int ipc_send_response(uint32_t correlation_id, enum ipc_message_type type,
+		      const uint8_t *payload, uint16_t len)
+{
+	return ipc_send_frame(type, correlation_id, payload, len);
+}
+
 int ipc_receive(struct ipc_message *msg)
 {
 	/* UART receive implementation */
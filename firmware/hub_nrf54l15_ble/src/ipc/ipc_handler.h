@@ -7,25 +7,160 @@
 #define IPC_HANDLER_H
 
 #include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+
+#define IPC_PROTOCOL_VERSION 3
+#define IPC_MAX_PAYLOAD 2048
+#define IPC_NODE_ADDR_LEN 6
+#define IPC_NODE_UNIT_LEN 8
+
+/* Correlation id of messages that are not a response */
+#define IPC_CORRELATION_NONE 0
 
 enum ipc_message_type {
 	IPC_NODE_DISCOVERED,
 	IPC_NODE_TELEMETRY,
 	IPC_JOB_REQUEST,
 	IPC_JOB_RESULT,
-	IPC_TWIN_UPDATE
+	IPC_TWIN_UPDATE,
+	IPC_JOB_BATCH_REQUEST,
+	IPC_NODE_SUMMARY,
+	IPC_NODE_TABLE_VERSION,
+	IPC_NODE_SYNC_REQUEST,
+	IPC_NODE_SYNC_RESPONSE
 };
 
 struct ipc_message {
 	uint16_t length;
 	uint8_t type;
 	uint8_t version;
+	uint32_t correlation_id;	/* Set by the cellular side on requests */
 	uint32_t crc32;
-	uint8_t payload[256];
+	uint8_t payload[IPC_MAX_PAYLOAD];
 };
 
+/*
+ * IPC_NODE_TELEMETRY payload is one or more of these. A timestamp of 0
+ * is stamped by the cellular side on receipt.
+ */
+struct ipc_node_telemetry {
+	uint8_t node_id[IPC_NODE_ADDR_LEN];	/* Most significant byte first */
+	uint32_t timestamp;
+	float value;
+	char unit[IPC_NODE_UNIT_LEN];
+	uint8_t quality;
+	uint16_t battery_mv;
+	uint8_t battery_pct;
+	uint8_t faults;
+	int8_t rssi;
+} __packed;
+
+/* IPC_NODE_SUMMARY payload is one or more of these, one per node and window */
+struct ipc_node_summary {
+	uint8_t node_id[IPC_NODE_ADDR_LEN];
+	uint16_t window_s;			/* Ended when the frame was sent */
+	uint16_t count;
+	float min;
+	float max;
+	float mean;
+	float last;
+	char unit[IPC_NODE_UNIT_LEN];
+	uint16_t battery_mv;			/* 0 if not known */
+	uint8_t faults;				/* Every fault seen in the window */
+	uint8_t battery_pct;
+	int8_t rssi;
+} __packed;
+
+/* IPC_TWIN_UPDATE payload, hub settings from the twin; 0 leaves one as is */
+struct ipc_hub_config {
+	uint16_t rollup_window_s;
+	uint8_t pawr;				/* IPC_HUB_PAWR_* */
+} __packed;
+
+#define IPC_HUB_PAWR_OFF	1
+#define IPC_HUB_PAWR_ON		2
+
+/*
+ * IPC_NODE_TABLE_VERSION payload, sent when the node table changed. The
+ * epoch is drawn at boot; versions only compare within one epoch.
+ */
+struct ipc_node_table_version {
+	uint32_t epoch;
+	uint32_t version;
+} __packed;
+
+/* IPC_NODE_SYNC_REQUEST payload, an unknown epoch gets a full table */
+struct ipc_node_sync_request {
+	uint32_t epoch;
+	uint32_t since_version;
+} __packed;
+
+/* IPC_NODE_SYNC_RESPONSE payload header, followed by count node entries */
+struct ipc_node_sync_response {
+	uint32_t epoch;
+	uint32_t version;
+	uint8_t full;			/* Entries replace the whole table */
+	uint16_t count;
+} __packed;
+
+#define IPC_NODE_PRESENT	BIT(0)	/* Cleared for a removed node */
+#define IPC_NODE_BOUND		BIT(1)
+#define IPC_NODE_CONNECTED	BIT(2)
+
+struct ipc_node_entry {
+	uint8_t node_id[IPC_NODE_ADDR_LEN];
+	uint8_t flags;
+	uint8_t state;
+	uint8_t battery_pct;
+	uint8_t faults;
+	int8_t rssi;
+	float last_reading;
+} __packed;
+
+/* IPC_JOB_REQUEST payload header, followed by the job body */
+struct ipc_job_request {
+	uint32_t job_id;
+	uint8_t type;
+	uint8_t node_id[IPC_NODE_ADDR_LEN];	/* Most significant byte first */
+} __packed;
+
+/*
+ * IPC_JOB_BATCH_REQUEST payload header, followed by node_count node ids
+ * and then the job body shared by all of them
+ */
+struct ipc_job_batch_request {
+	uint32_t job_id;
+	uint8_t type;
+	uint16_t node_count;
+} __packed;
+
+/* IPC_JOB_RESULT payload, sent once a job has run on all its nodes */
+struct ipc_job_result {
+	uint32_t job_id;
+	int32_t result;		/* 0, or the first failed node's negative errno
+				 * or positive ATT error code */
+	uint16_t succeeded;
+	uint16_t failed;
+} __packed;
+
 int ipc_handler_init(void);
 int ipc_send(enum ipc_message_type type, const uint8_t *payload, uint16_t len);
+
+/**
+ * @brief Answer a request from the cellular processor
+ *
+ * The response carries the request's correlation id, which is how the
+ * cellular side matches it to the pending request.
+ */
+int ipc_send_response(uint32_t correlation_id, enum ipc_message_type type,
+		      const uint8_t *payload, uint16_t len);
+
+/**
+ * @brief Take the next message received from the cellular processor
+ *
+ * @return 1 if msg was filled, 0 if nothing is pending
+ */
 int ipc_receive(struct ipc_message *msg);
 
 #endif /* IPC_HANDLER_H */
@@ -1,91 +1,692 @@
 /**
  * @file job_executor.c
  * @brief Job execution implementation
+ *
+ * Jobs from the cellular processor arrive as batches: one body and a
+ * list of target nodes. The body is copied once into a reference counted
+ * buffer and every per-node job points at it. Per-node jobs are expanded
+ * lazily from the batch cursor whenever a job slot is free, so a batch of
+ * hundreds of nodes never needs more than MAX_JOBS slots.
+ *
+ * Batches are journaled to NVS so a reset does not lose them. The request
+ * (targets and body) is written once when it arrives. Progress is a small
+ * bitmap of finished targets, rewritten at most every JOURNAL_FLUSH_MS no
+ * matter how many nodes finish in between. Both are deleted when the
+ * batch completes. After a reset, targets that had not finished run again.
+ *
+ * A config push connects to the node and writes the Config characteristic.
+ * Only one connection job runs at a time; it finishes with the node's ATT
+ * answer once the link is down again.
  */
 
 #include "job_executor.h"
+#include "connection_manager.h"
+#include "gatt_client.h"
+#include "node_manager.h"
+#include "pawr.h"
+#include "storage.h"
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
 #include <string.h>
 
 LOG_MODULE_REGISTER(job_executor, LOG_LEVEL_INF);
 
+BUILD_ASSERT(MAX_JOB_BATCHES <= STORAGE_JOB_SLOTS, "One journal slot per batch");
+
+#define JOURNAL_VERSION		1
+#define JOURNAL_FLUSH_MS	10000
+
+#define DONE_BYTES(n)		DIV_ROUND_UP(n, 8)
+
+/* STORAGE_JOB_REQUEST record, followed by the targets and the body */
+struct journal_request {
+	uint8_t version;
+	uint8_t type;
+	uint16_t node_count;
+	uint32_t job_id;
+	uint32_t correlation_id;
+} __packed;
+
+/* STORAGE_JOB_PROGRESS record, followed by the done bitmap */
+struct journal_progress {
+	uint16_t succeeded;
+	uint16_t failed;
+	int32_t first_error;
+} __packed;
+
 static struct job jobs[MAX_JOBS];
+static struct job_batch batches[MAX_JOB_BATCHES];
 static struct k_mutex job_mutex;
 static uint32_t next_job_id = 1;
+static uint8_t next_batch;
+
+/* Job that holds a connection, and how it ended */
+static struct job *conn_job;
+static int conn_result;
+
+static uint8_t journal_buf[sizeof(struct journal_request) + IPC_MAX_PAYLOAD];
+static struct k_work_delayable journal_work;
+static struct job_journal_stats journal_stats;
+
+static struct job_payload *payload_create(const uint8_t *data, uint16_t len)
+{
+	struct job_payload *p = k_malloc(sizeof(*p) + len);
+
+	if (!p) {
+		return NULL;
+	}
+	atomic_set(&p->refs, 1);
+	p->len = len;
+	memcpy(p->data, data, len);
+	return p;
+}
+
+static struct job_payload *payload_get(struct job_payload *p)
+{
+	if (p) {
+		atomic_inc(&p->refs);
+	}
+	return p;
+}
+
+static void payload_put(struct job_payload *p)
+{
+	/* atomic_dec returns the previous value */
+	if (p && atomic_dec(&p->refs) == 1) {
+		k_free(p);
+	}
+}
+
+/* Node ids on the wire are most significant byte first */
+static void node_id_to_addr(const uint8_t *node_id, bt_addr_le_t *addr)
+{
+	addr->type = BT_ADDR_LE_RANDOM;
+	for (int i = 0; i < IPC_NODE_ADDR_LEN; i++) {
+		addr->a.val[i] = node_id[IPC_NODE_ADDR_LEN - 1 - i];
+	}
+}
+
+static struct job *find_free_slot(void)
+{
+	for (int i = 0; i < MAX_JOBS; i++) {
+		if (!jobs[i].valid) {
+			return &jobs[i];
+		}
+	}
+	return NULL;
+}
+
+static void slot_fill(struct job *job, enum job_type type, const bt_addr_le_t *addr,
+		      struct job_payload *payload, struct job_batch *batch, uint16_t target)
+{
+	memset(job, 0, sizeof(*job));
+	job->valid = true;
+	job->job_id = next_job_id++;
+	job->type = type;
+	job->state = JOB_STATE_QUEUED;
+	bt_addr_le_copy(&job->target_addr, addr);
+	job->payload = payload;
+	job->batch = batch;
+	job->target = target;
+	job->queued_time = k_uptime_get_32();
+}
+
+/* Config pushes go first, diagnostics last */
+static uint8_t job_priority(enum job_type type)
+{
+	switch (type) {
+	case JOB_PUSH_CONFIG:
+		return 3;
+	case JOB_REBOOT_NODE:
+		return 2;
+	case JOB_UPDATE_FIRMWARE:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static uint8_t batch_slot(const struct job_batch *batch)
+{
+	return batch - batches;
+}
+
+static void journal_count(int flash_bytes)
+{
+	if (flash_bytes > 0) {
+		journal_stats.flash_bytes += flash_bytes;
+	}
+}
+
+static void journal_save_request(struct job_batch *batch)
+{
+	struct journal_request rec = {
+		.version = JOURNAL_VERSION,
+		.type = batch->type,
+		.node_count = batch->node_count,
+		.job_id = batch->job_id,
+		.correlation_id = batch->correlation_id,
+	};
+	size_t targets_len = (size_t)batch->node_count * IPC_NODE_ADDR_LEN;
+	size_t len = sizeof(rec) + targets_len + batch->payload->len;
+	int ret;
+
+	memcpy(journal_buf, &rec, sizeof(rec));
+	memcpy(journal_buf + sizeof(rec), batch->targets, targets_len);
+	memcpy(journal_buf + sizeof(rec) + targets_len, batch->payload->data,
+	       batch->payload->len);
+
+	ret = storage_save_job(batch_slot(batch), STORAGE_JOB_REQUEST, journal_buf, len);
+	if (ret < 0) {
+		/* Still run it, it just will not survive a reset */
+		LOG_WRN("Job %08x not journaled: %d", batch->job_id, ret);
+		return;
+	}
+
+	batch->journaled = true;
+	journal_stats.jobs++;
+	journal_stats.request_bytes += len - sizeof(rec);
+	journal_count(ret);
+}
+
+static void journal_save_progress(struct job_batch *batch)
+{
+	struct journal_progress rec = {
+		.succeeded = batch->succeeded,
+		.failed = batch->failed,
+		.first_error = batch->first_error,
+	};
+	size_t done_len = DONE_BYTES(batch->node_count);
+
+	memcpy(journal_buf, &rec, sizeof(rec));
+	memcpy(journal_buf + sizeof(rec), batch->done, done_len);
+
+	journal_count(storage_save_job(batch_slot(batch), STORAGE_JOB_PROGRESS, journal_buf,
+				       sizeof(rec) + done_len));
+	batch->dirty = false;
+}
+
+/* Coalesce progress writes, a pending flush is not pushed back */
+static void journal_schedule(void)
+{
+	k_work_schedule(&journal_work, K_MSEC(JOURNAL_FLUSH_MS));
+}
+
+static void journal_work_handler(struct k_work *work)
+{
+	k_mutex_lock(&job_mutex, K_FOREVER);
+
+	for (int i = 0; i < MAX_JOB_BATCHES; i++) {
+		if (batches[i].valid && batches[i].journaled && batches[i].dirty) {
+			journal_save_progress(&batches[i]);
+		}
+	}
+
+	k_mutex_unlock(&job_mutex);
+}
+
+static bool target_done(const struct job_batch *batch, uint16_t target)
+{
+	return batch->done[target / 8] & BIT(target % 8);
+}
+
+/* Advance the cursor past targets finished before a reset */
+static void batch_skip_done(struct job_batch *batch)
+{
+	while (batch->cursor < batch->node_count && target_done(batch, batch->cursor)) {
+		batch->cursor++;
+	}
+}
+
+/*
+ * Fill a free batch slot. The targets and the done bitmap share one
+ * allocation.
+ */
+static int batch_create(struct job_batch *batch, uint32_t job_id, uint32_t correlation_id,
+			enum job_type type, uint16_t node_count, const uint8_t *targets,
+			const uint8_t *body, uint16_t body_len)
+{
+	size_t targets_len = (size_t)node_count * IPC_NODE_ADDR_LEN;
+
+	batch->targets = k_malloc(targets_len + DONE_BYTES(node_count));
+	batch->payload = payload_create(body, body_len);
+	if (!batch->targets || !batch->payload) {
+		payload_put(batch->payload);
+		k_free(batch->targets);
+		memset(batch, 0, sizeof(*batch));
+		return -ENOMEM;
+	}
+
+	memcpy(batch->targets, targets, targets_len);
+	batch->done = (uint8_t *)batch->targets + targets_len;
+	memset(batch->done, 0, DONE_BYTES(node_count));
+
+	batch->valid = true;
+	batch->job_id = job_id;
+	batch->correlation_id = correlation_id;
+	batch->type = type;
+	batch->priority = job_priority(type);
+	batch->node_count = node_count;
+	return 0;
+}
+
+static void batch_release(struct job_batch *batch)
+{
+	if (batch->journaled) {
+		journal_count(storage_delete_job(batch_slot(batch)));
+	}
+	payload_put(batch->payload);
+	k_free(batch->targets);
+	memset(batch, 0, sizeof(*batch));
+}
+
+/* Answer the cellular processor once every target has finished */
+static void batch_maybe_complete(struct job_batch *batch)
+{
+	struct ipc_job_result res;
+
+	batch_skip_done(batch);
+	if (batch->cursor < batch->node_count || batch->running > 0) {
+		return;
+	}
+
+	res.job_id = batch->job_id;
+	res.result = batch->first_error;
+	res.succeeded = batch->succeeded;
+	res.failed = batch->failed;
+
+	LOG_INF("Job %08x done: %u succeeded, %u failed", batch->job_id,
+		batch->succeeded, batch->failed);
+
+	ipc_send_response(batch->correlation_id, IPC_JOB_RESULT, (const uint8_t *)&res,
+			  sizeof(res));
+	batch_release(batch);
+}
+
+/* Highest priority batch with targets left, equal priorities take turns */
+static struct job_batch *next_pending_batch(void)
+{
+	struct job_batch *best = NULL;
+	int best_idx = 0;
+
+	for (int n = 0; n < MAX_JOB_BATCHES; n++) {
+		int i = (next_batch + n) % MAX_JOB_BATCHES;
+		struct job_batch *batch = &batches[i];
+
+		if (!batch->valid) {
+			continue;
+		}
+		batch_skip_done(batch);
+		if (batch->cursor < batch->node_count &&
+		    (!best || batch->priority > best->priority)) {
+			best = batch;
+			best_idx = i;
+		}
+	}
+
+	if (best) {
+		next_batch = (best_idx + 1) % MAX_JOB_BATCHES;
+	}
+	return best;
+}
+
+/* Turn pending batch targets into per-node jobs while slots are free */
+static void expand_batches(void)
+{
+	struct job_batch *batch;
+	bt_addr_le_t addr;
+	struct job *job;
+
+	while ((job = find_free_slot()) != NULL && (batch = next_pending_batch()) != NULL) {
+		uint16_t target = batch->cursor++;
+
+		node_id_to_addr(batch->targets[target], &addr);
+		slot_fill(job, batch->type, &addr, payload_get(batch->payload), batch, target);
+		batch->running++;
+	}
+}
+
+static void job_finish(struct job *job, int result)
+{
+	struct job_batch *batch = job->batch;
+
+	job->state = result ? JOB_STATE_FAILED : JOB_STATE_COMPLETED;
+	job->end_time = k_uptime_get_32();
+	job->result_code = result;
+
+	payload_put(job->payload);
+	job->payload = NULL;
+	job->valid = false;
+
+	if (batch) {
+		batch->running--;
+		batch->done[job->target / 8] |= BIT(job->target % 8);
+		batch->dirty = true;
+		if (result) {
+			batch->failed++;
+			batch->first_error = batch->first_error ? batch->first_error : result;
+		} else {
+			batch->succeeded++;
+		}
+		batch_maybe_complete(batch);
+		journal_schedule();
+	}
+}
+
+/* Load one journaled batch, a damaged entry is dropped */
+static int journal_restore(uint8_t slot)
+{
+	struct job_batch *batch = &batches[slot];
+	struct journal_progress progress;
+	struct journal_request rec;
+	size_t targets_len;
+	size_t len;
+	ssize_t ret;
+	int err;
+
+	ret = storage_load_job(slot, STORAGE_JOB_REQUEST, journal_buf, sizeof(journal_buf));
+	if (ret < 0) {
+		return ret;
+	}
+	len = ret;
+
+	memcpy(&rec, journal_buf, MIN((size_t)len, sizeof(rec)));
+	targets_len = (size_t)rec.node_count * IPC_NODE_ADDR_LEN;
+	if (len > sizeof(journal_buf) || len < sizeof(rec) || rec.version != JOURNAL_VERSION ||
+	    rec.node_count == 0 || sizeof(rec) + targets_len > len) {
+		LOG_WRN("Dropping journal slot %u", slot);
+		storage_delete_job(slot);
+		return -EINVAL;
+	}
+
+	err = batch_create(batch, rec.job_id, rec.correlation_id, rec.type, rec.node_count,
+			   journal_buf + sizeof(rec), journal_buf + sizeof(rec) + targets_len,
+			   len - sizeof(rec) - targets_len);
+	if (err) {
+		return err;
+	}
+	batch->journaled = true;
+
+	ret = storage_load_job(slot, STORAGE_JOB_PROGRESS, journal_buf, sizeof(journal_buf));
+	if (ret == (ssize_t)(sizeof(progress) + DONE_BYTES(rec.node_count))) {
+		memcpy(&progress, journal_buf, sizeof(progress));
+		memcpy(batch->done, journal_buf + sizeof(progress), DONE_BYTES(rec.node_count));
+		batch->succeeded = progress.succeeded;
+		batch->failed = progress.failed;
+		batch->first_error = progress.first_error;
+	}
+
+	LOG_INF("Restored job %08x: %u of %u nodes done", batch->job_id,
+		batch->succeeded + batch->failed, batch->node_count);
+
+	/* All nodes may have finished just before the reset */
+	batch_maybe_complete(batch);
+	return 0;
+}
 
 int job_executor_init(void)
 {
+	uint32_t start;
+
 	k_mutex_init(&job_mutex);
+	k_work_init_delayable(&journal_work, journal_work_handler);
 	memset(jobs, 0, sizeof(jobs));
-	LOG_INF("Job executor initialized");
+	memset(batches, 0, sizeof(batches));
+
+	start = k_cycle_get_32();
+	for (uint8_t slot = 0; slot < MAX_JOB_BATCHES; slot++) {
+		if (journal_restore(slot) == 0) {
+			journal_stats.restored++;
+		}
+	}
+	journal_stats.restore_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+	/* Expansion picks the restored batches in priority order */
+	expand_batches();
+
+	LOG_INF("Job executor initialized, %u jobs restored in %u us",
+		journal_stats.restored, journal_stats.restore_us);
 	return 0;
 }
 
 int job_executor_queue(enum job_type type, const bt_addr_le_t *addr,
                        const uint8_t *payload, uint16_t len)
 {
+	struct job_payload *shared = NULL;
+	struct job *job;
+	uint32_t job_id;
+
+	if (payload && len > 0) {
+		shared = payload_create(payload, len);
+		if (!shared) {
+			return -ENOMEM;
+		}
+	}
+
 	k_mutex_lock(&job_mutex, K_FOREVER);
-	
-	int index = -1;
-	for (int i = 0; i < MAX_JOBS; i++) {
-		if (!jobs[i].valid) {
-			index = i;
+
+	job = find_free_slot();
+	if (!job) {
+		k_mutex_unlock(&job_mutex);
+		payload_put(shared);
+		return -ENOMEM;
+	}
+
+	slot_fill(job, type, addr, shared, NULL, 0);
+	job_id = job->job_id;
+
+	LOG_INF("Job %d queued (type %d)", job_id, type);
+
+	k_mutex_unlock(&job_mutex);
+	return job_id;
+}
+
+int job_executor_queue_ipc(const struct ipc_message *msg)
+{
+	struct ipc_job_batch_request hdr;
+	const uint8_t *targets;
+	struct job_batch *batch = NULL;
+	size_t body_off;
+	int err;
+
+	if (msg->type == IPC_JOB_REQUEST) {
+		struct ipc_job_request req;
+
+		if (msg->length < sizeof(req)) {
+			return -EINVAL;
+		}
+		/* A single-node request is a batch of one */
+		memcpy(&req, msg->payload, sizeof(req));
+		hdr.job_id = req.job_id;
+		hdr.type = req.type;
+		hdr.node_count = 1;
+		targets = msg->payload + offsetof(struct ipc_job_request, node_id);
+		body_off = sizeof(req);
+	} else if (msg->type == IPC_JOB_BATCH_REQUEST) {
+		if (msg->length < sizeof(hdr)) {
+			return -EINVAL;
+		}
+		memcpy(&hdr, msg->payload, sizeof(hdr));
+		targets = msg->payload + sizeof(hdr);
+		body_off = sizeof(hdr) + (size_t)hdr.node_count * IPC_NODE_ADDR_LEN;
+	} else {
+		return -EINVAL;
+	}
+
+	if (hdr.node_count == 0 || body_off > msg->length) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&job_mutex, K_FOREVER);
+
+	for (int i = 0; i < MAX_JOB_BATCHES; i++) {
+		if (!batches[i].valid) {
+			batch = &batches[i];
 			break;
 		}
 	}
-	
-	if (index < 0) {
+	if (!batch) {
 		k_mutex_unlock(&job_mutex);
+		LOG_WRN("No batch slot for job %08x", hdr.job_id);
 		return -ENOMEM;
 	}
-	
-	memset(&jobs[index], 0, sizeof(struct job));
-	jobs[index].valid = true;
-	jobs[index].job_id = next_job_id++;
-	jobs[index].type = type;
-	jobs[index].state = JOB_STATE_QUEUED;
-	bt_addr_le_copy(&jobs[index].target_addr, addr);
-	jobs[index].queued_time = k_uptime_get_32();
-	
-	if (payload && len > 0) {
-		jobs[index].payload = k_malloc(len);
-		if (jobs[index].payload) {
-			memcpy(jobs[index].payload, payload, len);
-			jobs[index].payload_len = len;
-		}
+
+	err = batch_create(batch, hdr.job_id, msg->correlation_id, hdr.type, hdr.node_count,
+			   targets, msg->payload + body_off, msg->length - body_off);
+	if (err) {
+		k_mutex_unlock(&job_mutex);
+		return err;
 	}
-	
-	LOG_INF("Job %d queued (type %d)", jobs[index].job_id, type);
-	
+	journal_save_request(batch);
+
+	LOG_INF("Job %08x queued for %u nodes (type %d, %u byte body)", hdr.job_id,
+		hdr.node_count, hdr.type, batch->payload->len);
+
+	expand_batches();
+
 	k_mutex_unlock(&job_mutex);
-	return jobs[index].job_id;
+	return 0;
 }
 
-int job_executor_process(void)
+static bool job_needs_conn(const struct job *job)
+{
+	return job->type == JOB_PUSH_CONFIG;
+}
+
+static void config_written(struct bt_conn *conn, int status)
 {
+	/* The ATT error code, 0 if the node took the configuration */
+	conn_result = status;
+	connection_manager_disconnect(conn);
+}
+
+static void config_ready(struct bt_conn *conn, int err, void *user_data)
+{
+	struct job *job = user_data;
+
+	if (err) {
+		LOG_WRN("Job %d: no session with node: %d", job->job_id, err);
+		k_mutex_lock(&job_mutex, K_FOREVER);
+		job_finish(job, err);
+		conn_job = NULL;
+		expand_batches();
+		k_mutex_unlock(&job_mutex);
+		return;
+	}
+
+	err = gatt_client_write(conn, BT_UUID_DECLARE_128(CONFIG_CHAR_UUID), job->payload->data,
+				job->payload->len, config_written);
+	if (err) {
+		conn_result = err;
+		connection_manager_disconnect(conn);
+	}
+}
+
+static void config_closed(struct bt_conn *conn, void *user_data)
+{
+	struct job *job = user_data;
+
 	k_mutex_lock(&job_mutex, K_FOREVER);
-	
+	if (conn_result) {
+		LOG_WRN("Job %d: config push failed: %d", job->job_id, conn_result);
+	}
+	job_finish(job, conn_result);
+	conn_job = NULL;
+	expand_batches();
+	k_mutex_unlock(&job_mutex);
+}
+
+static const struct conn_session_cb config_session_cb = {
+	.ready = config_ready,
+	.closed = config_closed,
+};
+
+/* 0 or a negative error once done, -EINPROGRESS while a session runs */
+static int job_run(struct job *job)
+{
+	int err;
+
+	switch (job->type) {
+	case JOB_SAMPLE_NODE:
+		/* The train repeats the command until the node acknowledges it */
+		return pawr_send_command(&job->target_addr, PAWR_CMD_SAMPLE);
+	case JOB_BIND_NODE:
+		/* A node not heard yet is listed, like a binding restored at boot */
+		if (node_manager_add_node(&job->target_addr, 0, NULL, 0) < 0) {
+			return -ENOMEM;
+		}
+		return node_manager_bind_node(&job->target_addr);
+	case JOB_UNBIND_NODE:
+		return node_manager_unbind_node(&job->target_addr);
+	case JOB_PUSH_CONFIG:
+		if (!job->payload) {
+			return -EINVAL;
+		}
+		conn_job = job;
+		conn_result = -ECONNABORTED;
+		err = connection_manager_open(&job->target_addr, &config_session_cb, job);
+		if (err) {
+			conn_job = NULL;
+			return err;
+		}
+		return -EINPROGRESS;
+	default:
+		return -ENOTSUP;
+	}
+}
+
+/*
+ * Highest priority job that can run, oldest first within a priority.
+ * Slot order alone would let a lower priority job refilled into a low
+ * slot overtake the jobs queued above it.
+ */
+static struct job *next_queued_job(void)
+{
+	struct job *best = NULL;
+
 	for (int i = 0; i < MAX_JOBS; i++) {
-		if (jobs[i].valid && jobs[i].state == JOB_STATE_QUEUED) {
-			jobs[i].state = JOB_STATE_RUNNING;
-			jobs[i].start_time = k_uptime_get_32();
-			
-			/* Execute job (simplified) */
-			LOG_INF("Processing job %d", jobs[i].job_id);
-			
-			/* Simulate job completion */
-			jobs[i].state = JOB_STATE_COMPLETED;
-			jobs[i].end_time = k_uptime_get_32();
-			jobs[i].result_code = 0;
-			
-			k_mutex_unlock(&node_mutex);
-			return jobs[i].job_id;
-		}
-	}
-	
+		struct job *job = &jobs[i];
+
+		if (!job->valid || job->state != JOB_STATE_QUEUED ||
+		    (conn_job && job_needs_conn(job))) {
+			continue;
+		}
+		if (!best || job_priority(job->type) > job_priority(best->type) ||
+		    (job_priority(job->type) == job_priority(best->type) &&
+		     job->job_id < best->job_id)) {
+			best = job;
+		}
+	}
+	return best;
+}
+
+int job_executor_process(void)
+{
+	struct job *job;
+	uint32_t job_id = 0;
+	int ret;
+
+	k_mutex_lock(&job_mutex, K_FOREVER);
+
+	job = next_queued_job();
+	if (job) {
+		job_id = job->job_id;
+		job->state = JOB_STATE_RUNNING;
+		job->start_time = k_uptime_get_32();
+
+		LOG_INF("Processing job %d", job_id);
+
+		/* A connection job finishes from its session callbacks */
+		ret = job_run(job);
+		if (ret != -EINPROGRESS) {
+			job_finish(job, ret);
+			expand_batches();
+		}
+	}
+
 	k_mutex_unlock(&job_mutex);
-	return 0;
+	return job_id;
 }
 
 int job_executor_get_pending_count(void)
@@ -95,9 +696,21 @@ int job_executor_get_pending_count(void)
 	for (int i = 0; i < MAX_JOBS; i++) {
 		if (jobs[i].valid && jobs[i].state == JOB_STATE_QUEUED) count++;
 	}
+	for (int i = 0; i < MAX_JOB_BATCHES; i++) {
+		if (batches[i].valid) {
+			count += batches[i].node_count - batches[i].cursor;
+		}
+	}
 	k_mutex_unlock(&job_mutex);
 	return count;
 }
 
+void job_executor_get_journal_stats(struct job_journal_stats *stats)
+{
+	k_mutex_lock(&job_mutex, K_FOREVER);
+	*stats = journal_stats;
+	k_mutex_unlock(&job_mutex);
+}
+
 int job_executor_cancel(uint32_t job_id) { return 0; }
 struct job *job_executor_get(uint32_t job_id) { return NULL; }
@@ -7,15 +7,21 @@
 #define JOB_EXECUTOR_H
 
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/sys/atomic.h>
 #include <stdint.h>
+#include "ipc_handler.h"
 
 #define MAX_JOBS 16
+#define MAX_JOB_BATCHES 4
 
 enum job_type {
 	JOB_PUSH_CONFIG,
 	JOB_PULL_DIAGNOSTICS,
 	JOB_UPDATE_FIRMWARE,
-	JOB_REBOOT_NODE
+	JOB_REBOOT_NODE,
+	JOB_SAMPLE_NODE,
+	JOB_BIND_NODE,
+	JOB_UNBIND_NODE
 };
 
 enum job_state {
@@ -25,14 +31,45 @@ enum job_state {
 	JOB_STATE_FAILED
 };
 
+/* Job body shared by every job expanded from the same request */
+struct job_payload {
+	atomic_t refs;
+	uint16_t len;
+	uint8_t data[];
+};
+
+/*
+ * A cloud job for one or more nodes. Per-node jobs are expanded from
+ * the target list only as job slots free up.
+ */
+struct job_batch {
+	bool valid;
+	uint32_t job_id;		/* Cloud job id */
+	uint32_t correlation_id;	/* Answered with IPC_JOB_RESULT */
+	enum job_type type;
+	uint8_t priority;
+	struct job_payload *payload;
+	uint8_t (*targets)[IPC_NODE_ADDR_LEN];
+	uint8_t *done;			/* Bitmap of finished targets */
+	uint16_t node_count;
+	uint16_t cursor;		/* Next target to expand */
+	uint16_t running;		/* Expanded and not finished */
+	uint16_t succeeded;
+	uint16_t failed;
+	int first_error;
+	bool journaled;			/* Request is in flash */
+	bool dirty;			/* Progress not yet in flash */
+};
+
 struct job {
 	bool valid;
 	uint32_t job_id;
 	enum job_type type;
 	enum job_state state;
 	bt_addr_le_t target_addr;
-	uint8_t *payload;
-	uint16_t payload_len;
+	struct job_payload *payload;
+	struct job_batch *batch;	/* NULL for local jobs */
+	uint16_t target;		/* Index in the batch */
 	uint32_t queued_time;
 	uint32_t start_time;
 	uint32_t end_time;
@@ -40,12 +77,42 @@ struct job {
 	int result_code;
 };
 
+/* Flash cost of the job journal */
+struct job_journal_stats {
+	uint32_t jobs;			/* Requests journaled */
+	uint32_t request_bytes;		/* Their IPC payload size */
+	uint32_t flash_bytes;		/* Everything written to flash for them */
+	uint16_t restored;		/* Jobs restored at boot */
+	uint32_t restore_us;		/* Time the restore took */
+};
+
+/**
+ * @brief Initialize the executor
+ *
+ * Jobs from the cellular processor that were still queued at the last
+ * reset are restored from the journal. Call storage_init() first.
+ */
 int job_executor_init(void);
 int job_executor_queue(enum job_type type, const bt_addr_le_t *addr,
                        const uint8_t *payload, uint16_t len);
+
+/**
+ * @brief Queue a job from the cellular processor
+ *
+ * Accepts IPC_JOB_REQUEST and IPC_JOB_BATCH_REQUEST. The body is copied
+ * once and shared by all target nodes; one IPC_JOB_RESULT answers the
+ * request when every node is done. The request is journaled to flash
+ * before this returns, so it survives a reset.
+ *
+ * @return 0 on success, -ENOMEM if no batch slot or memory is left,
+ *         -EINVAL if the message is malformed
+ */
+int job_executor_queue_ipc(const struct ipc_message *msg);
+
 int job_executor_process(void);
 int job_executor_cancel(uint32_t job_id);
 struct job *job_executor_get(uint32_t job_id);
 int job_executor_get_pending_count(void);
+void job_executor_get_journal_stats(struct job_journal_stats *stats);
 
 #endif /* JOB_EXECUTOR_H */
@@ -7,12 +7,44 @@
 #include <zephyr/drivers/watchdog.h>
 #include <zephyr/bluetooth/bluetooth.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
 
 #include "scanner.h"
 #include "connection_manager.h"
+#include "gatt_client.h"
+#include "node_manager.h"
+#include "ipc_handler.h"
+#include "job_executor.h"
+#include "storage.h"
+#include "rollup.h"
+#include "pawr.h"
 
 LOG_MODULE_REGISTER(hub_main, LOG_LEVEL_INF);
 
+/* Node manufacturer data, see NodeAdvertisement in common/protocol/ble-protocol.ts */
+#define NODE_ADV_COMPANY_ID 0x0059
+#define NODE_ADV_VERSION    1
+#define NODE_ADV_LEN        17
+
+/*
+ * Version 2 appends spacing, count, battery mV, unit and older readings
+ * to the version 1 fields. An older reading is its value and the seconds
+ * since the reading before it.
+ */
+#define NODE_ADV_VERSION_HISTORY   2
+#define NODE_ADV_BATTERY_MV_OFFSET 20
+#define NODE_ADV_UNIT_OFFSET       22
+#define NODE_ADV_HISTORY_OFFSET    30
+#define NODE_ADV_HISTORY_ENTRY_LEN 6
+#define NODE_ADV_HISTORY_MAX       15
+
+/* Unbound nodes unheard of for this long are dropped from the table */
+#define NODE_STALE_TIMEOUT_MS (10 * 60 * 1000)
+
+/* A backlog collection ends once no batch arrived for this long */
+#define COLLECT_IDLE_MS 2000
+
 typedef enum {
     HUB_STATE_INIT,
     HUB_STATE_SCANNING,
@@ -21,15 +53,221 @@ typedef enum {
 
 static hub_state_t hub_state = HUB_STATE_INIT;
 
+enum collect_state {
+    COLLECT_IDLE,
+    COLLECT_PENDING,    /* Node chosen, waiting for the scan window to end */
+    COLLECT_RUNNING
+};
+
+/*
+ * One bound node at a time that missed readings beyond its advertised
+ * history has its Reading Batch backlog collected between scan windows
+ */
+static atomic_t collect_state;
+static bt_addr_le_t collect_addr;
+static struct bt_conn *collect_conn;
+static struct k_work_delayable collect_idle_work;
+
+/* Too large for the main stack with a full payload */
+static struct ipc_message ipc_msg;
+static uint8_t ipc_reply[IPC_MAX_PAYLOAD];
+
+struct node_adv {
+    struct rollup_sample sample;
+    float history[NODE_ADV_HISTORY_MAX];
+};
+
+static bool parse_node_adv(struct bt_data *data, void *user_data)
+{
+    struct node_adv *adv = user_data;
+    struct rollup_sample *sample = &adv->sample;
+    uint8_t version;
+
+    if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < NODE_ADV_LEN ||
+        sys_get_le16(&data->data[0]) != NODE_ADV_COMPANY_ID) {
+        return true;
+    }
+
+    version = data->data[2];
+    if (version == NODE_ADV_VERSION_HISTORY) {
+        size_t count;
+
+        if (data->data_len < NODE_ADV_HISTORY_OFFSET || data->data[19] == 0) {
+            return true;  /* No reading yet */
+        }
+        count = MIN((size_t)data->data[19] - 1,
+                    (size_t)(data->data_len - NODE_ADV_HISTORY_OFFSET) / NODE_ADV_HISTORY_ENTRY_LEN);
+        sample->history_len = MIN(count, NODE_ADV_HISTORY_MAX);
+        for (size_t i = 0; i < sample->history_len; i++) {
+            memcpy(&adv->history[i],
+                   &data->data[NODE_ADV_HISTORY_OFFSET + i * NODE_ADV_HISTORY_ENTRY_LEN],
+                   sizeof(adv->history[0]));
+        }
+        sample->history = adv->history;
+        sample->battery_mv = sys_get_le16(&data->data[NODE_ADV_BATTERY_MV_OFFSET]);
+        memcpy(sample->unit, &data->data[NODE_ADV_UNIT_OFFSET], sizeof(sample->unit));
+    } else if (version != NODE_ADV_VERSION) {
+        return true;
+    }
+
+    sample->battery_pct = data->data[9];
+    memcpy(&sample->value, &data->data[10], sizeof(sample->value));
+    sample->faults = data->data[14];
+    sample->counter = sys_get_le16(&data->data[15]);
+    return false;
+}
+
+/* Node data from an advertisement or a PAwR response */
+static void handle_node_data(const bt_addr_le_t *addr, int8_t rssi,
+                             struct net_buf_simple *ad_data)
+{
+    struct node_adv adv = {
+        .sample = { .rssi = rssi, .battery_pct = UINT8_MAX },
+    };
+    struct rollup_sample *sample = &adv.sample;
+    struct node_info info;
+    int missed;
+
+    bt_data_parse(ad_data, parse_node_adv, &adv);
+    if (sample->battery_pct == UINT8_MAX) {
+        return;  /* Not one of our nodes */
+    }
+
+    LOG_DBG("Node data received, RSSI: %d", rssi);
+
+    /* Only a bind_node job binds a node, hearing one just lists it */
+    node_manager_add_node(addr, rssi, NULL, 0);
+    node_manager_update_reading(addr, sample->value);
+    node_manager_update_battery(addr, sample->battery_pct);
+    node_manager_update_faults(addr, sample->faults);
+    missed = rollup_add_sample(addr, sample);
+
+    if (missed > 0 && atomic_get(&collect_state) == COLLECT_IDLE &&
+        node_manager_get_by_addr(addr, &info) == 0 && info.bound_to_hub) {
+        LOG_INF("Node missed %d readings, collecting its backlog", missed);
+        bt_addr_le_copy(&collect_addr, addr);
+        atomic_set(&collect_state, COLLECT_PENDING);
+    }
+}
+
+static void collect_batch(struct bt_conn *conn, const void *data, uint16_t length)
+{
+    struct gatt_batch_reading readings[GATT_BATCH_MAX];
+    int count = gatt_client_parse_batch(data, length, readings, ARRAY_SIZE(readings));
+    int left = 0;
+
+    if (count < 0) {
+        LOG_WRN("Malformed reading batch");
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        left = rollup_add_backlog(&collect_addr, readings[i].counter, readings[i].value);
+    }
+    LOG_DBG("Batch of %d, %d readings still missing", count, left);
+
+    k_work_reschedule(&collect_idle_work, K_MSEC(COLLECT_IDLE_MS));
+}
+
+static void collect_subscribed(struct bt_conn *conn, int status)
+{
+    if (status) {
+        connection_manager_disconnect(conn);
+        return;
+    }
+    k_work_reschedule(&collect_idle_work, K_MSEC(COLLECT_IDLE_MS));
+}
+
+static void collect_ready(struct bt_conn *conn, int err, void *user_data)
+{
+    if (err) {
+        LOG_WRN("Backlog collection failed: %d", err);
+        atomic_set(&collect_state, COLLECT_IDLE);
+        return;
+    }
+
+    collect_conn = conn;
+    err = gatt_client_subscribe(conn, BT_UUID_DECLARE_128(READING_BATCH_CHAR_UUID),
+                                collect_batch, collect_subscribed);
+    if (err) {
+        connection_manager_disconnect(conn);
+    }
+}
+
+static void collect_closed(struct bt_conn *conn, void *user_data)
+{
+    k_work_cancel_delayable(&collect_idle_work);
+    collect_conn = NULL;
+    atomic_set(&collect_state, COLLECT_IDLE);
+}
+
+static const struct conn_session_cb collect_cb = {
+    .ready = collect_ready,
+    .closed = collect_closed,
+};
+
+static void collect_idle_work_handler(struct k_work *work)
+{
+    if (collect_conn) {
+        connection_manager_disconnect(collect_conn);
+    }
+}
+
 static void scan_callback(const struct bt_le_scan_recv_info *info, 
                          struct net_buf_simple *ad_data)
 {
-    /* Parse advertisement */
-    LOG_DBG("Node advertisement received, RSSI: %d", info->rssi);
+    handle_node_data(info->addr, info->rssi, ad_data);
 }
 
 static struct k_work_delayable scan_work;
 
+static void handle_ipc(void)
+{
+    int ret;
+
+    while (ipc_receive(&ipc_msg) > 0) {
+        switch (ipc_msg.type) {
+        case IPC_JOB_REQUEST:
+        case IPC_JOB_BATCH_REQUEST:
+            ret = job_executor_queue_ipc(&ipc_msg);
+            if (ret) {
+                LOG_WRN("Job request rejected: %d", ret);
+            }
+            break;
+        case IPC_TWIN_UPDATE: {
+            struct ipc_hub_config cfg = { 0 };
+
+            memcpy(&cfg, ipc_msg.payload, MIN(ipc_msg.length, sizeof(cfg)));
+            if (cfg.rollup_window_s) {
+                ret = rollup_set_window(cfg.rollup_window_s);
+                if (ret) {
+                    LOG_WRN("Rollup window %u s rejected: %d", cfg.rollup_window_s, ret);
+                }
+            }
+            if (cfg.pawr) {
+                ret = pawr_set_enabled(cfg.pawr == IPC_HUB_PAWR_ON);
+                if (ret) {
+                    LOG_WRN("PAwR %s failed: %d",
+                            cfg.pawr == IPC_HUB_PAWR_ON ? "start" : "stop", ret);
+                }
+            }
+            break;
+        }
+        case IPC_NODE_SYNC_REQUEST: {
+            struct ipc_node_sync_request req = { 0 };
+
+            memcpy(&req, ipc_msg.payload, MIN(ipc_msg.length, sizeof(req)));
+            ret = node_manager_build_sync(&req, ipc_reply);
+            ipc_send_response(ipc_msg.correlation_id, IPC_NODE_SYNC_RESPONSE, ipc_reply, ret);
+            break;
+        }
+        default:
+            LOG_DBG("Unhandled IPC message type %d", ipc_msg.type);
+            break;
+        }
+    }
+}
+
 static void scan_work_handler(struct k_work *work)
 {
     int ret;
@@ -47,6 +285,15 @@ static void scan_work_handler(struct k_work *work)
     
     k_sleep(K_SECONDS(5));
     scanner_stop();
+    node_manager_clear_stale(NODE_STALE_TIMEOUT_MS);
+
+    if (atomic_cas(&collect_state, COLLECT_PENDING, COLLECT_RUNNING)) {
+        ret = connection_manager_open(&collect_addr, &collect_cb, NULL);
+        if (ret) {
+            LOG_WRN("Backlog collection not started: %d", ret);
+            atomic_set(&collect_state, COLLECT_IDLE);
+        }
+    }
     
     hub_state = HUB_STATE_IDLE;
     k_work_reschedule(&scan_work, K_SECONDS(30));
@@ -76,14 +323,59 @@ int main(void)
         return ret;
     }
     
+    ret = gatt_client_init();
+    if (ret) {
+        LOG_ERR("GATT client init failed");
+        return ret;
+    }
+    
+    ret = ipc_handler_init();
+    if (ret) {
+        LOG_ERR("IPC init failed");
+        return ret;
+    }
+    
+    /* Without flash the hub still runs, bindings and queued jobs are just not kept */
+    ret = storage_init();
+    if (ret) {
+        LOG_ERR("Storage init failed (err %d)", ret);
+    }
+    
+    ret = node_manager_init();
+    if (ret) {
+        LOG_ERR("Node manager init failed");
+        return ret;
+    }
+    
+    ret = job_executor_init();
+    if (ret) {
+        LOG_ERR("Job executor init failed");
+        return ret;
+    }
+    
+    ret = rollup_init();
+    if (ret) {
+        LOG_ERR("Rollup init failed");
+        return ret;
+    }
+    
+    ret = pawr_init(handle_node_data);
+    if (ret) {
+        LOG_ERR("PAwR init failed");
+        return ret;
+    }
+    
+    k_work_init_delayable(&collect_idle_work, collect_idle_work_handler);
     k_work_init_delayable(&scan_work, scan_work_handler);
     k_work_schedule(&scan_work, K_SECONDS(5));
     
     LOG_INF("Hub BLE Central initialized");
     
     while (1) {
-        k_sleep(K_SECONDS(5));
-        LOG_DBG("Hub state: %d", hub_state);
+        handle_ipc();
+        while (job_executor_process() > 0) {
+        }
+        k_sleep(K_MSEC(100));
     }
     
     return 0;
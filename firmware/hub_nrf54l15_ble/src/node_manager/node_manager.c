@@ -1,23 +1,138 @@
 /**
  * @file node_manager.c
  * @brief Node management implementation
+ *
+ * Writers serialize on node_mutex. Readers never take it: every entry has
+ * a sequence count that is odd while the entry is being written, and a
+ * reader copies the entry and retries if the count was odd or moved
+ * meanwhile. A reader that keeps losing to a preempted writer falls back
+ * to the mutex, which lends it the writer's priority.
+ *
+ * Changes the cellular side mirrors (added, removed, state, battery and
+ * faults) bump the table version and are logged in a small journal. The
+ * cellular side is told the new version, at most once per
+ * NOTIFY_DELAY_MS, and asks for what changed since the version it has.
+ * Only if that has already dropped out of the journal, or this hub has
+ * rebooted since, does it get the whole table.
  */
 
 #include "node_manager.h"
+#include "storage.h"
+#include "ipc_handler.h"
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/random/random.h>
 #include <string.h>
 
 LOG_MODULE_REGISTER(node_manager, LOG_LEVEL_INF);
 
+#define READ_RETRIES 4
+#define JOURNAL_SIZE 64
+#define NOTIFY_DELAY_MS 1000
+
+BUILD_ASSERT(sizeof(struct ipc_node_sync_response) +
+	     MAX(MAX_NODES, JOURNAL_SIZE) * sizeof(struct ipc_node_entry) <= IPC_MAX_PAYLOAD,
+	     "A sync response must fit one frame");
+
+struct journal_entry {
+	uint32_t version;
+	bt_addr_le_t addr;
+};
+
 static struct node_info nodes[MAX_NODES];
+static atomic_t seqs[MAX_NODES];
 static struct k_mutex node_mutex;
 
+static struct journal_entry journal[JOURNAL_SIZE];
+static uint32_t table_version;
+static uint32_t table_epoch;
+static struct k_work_delayable notify_work;
+
+/* Called with node_mutex held */
+static void write_begin(int index)
+{
+	atomic_inc(&seqs[index]);
+	barrier_dmem_fence_full();
+}
+
+static void write_end(int index)
+{
+	barrier_dmem_fence_full();
+	atomic_inc(&seqs[index]);
+}
+
+/* Consistent copy of one entry without blocking writers */
+static void read_entry(int index, struct node_info *out)
+{
+	for (int attempt = 0; attempt < READ_RETRIES; attempt++) {
+		atomic_val_t seq = atomic_get(&seqs[index]);
+
+		if (seq & 1) {
+			k_yield();
+			continue;
+		}
+
+		memcpy(out, &nodes[index], sizeof(*out));
+		barrier_dmem_fence_full();
+
+		if (atomic_get(&seqs[index]) == seq) {
+			return;
+		}
+	}
+
+	k_mutex_lock(&node_mutex, K_FOREVER);
+	memcpy(out, &nodes[index], sizeof(*out));
+	k_mutex_unlock(&node_mutex);
+}
+
+static void notify_work_handler(struct k_work *work)
+{
+	struct ipc_node_table_version msg;
+
+	k_mutex_lock(&node_mutex, K_FOREVER);
+	msg.epoch = table_epoch;
+	msg.version = table_version;
+	k_mutex_unlock(&node_mutex);
+
+	ipc_send(IPC_NODE_TABLE_VERSION, (const uint8_t *)&msg, sizeof(msg));
+}
+
+/* Called with node_mutex held, after the entry changed */
+static void journal_add(const bt_addr_le_t *addr)
+{
+	table_version++;
+	journal[table_version % JOURNAL_SIZE].version = table_version;
+	bt_addr_le_copy(&journal[table_version % JOURNAL_SIZE].addr, addr);
+
+	/* A pending notice is not pushed back, bursts share one */
+	k_work_schedule(&notify_work, K_MSEC(NOTIFY_DELAY_MS));
+}
+
 int node_manager_init(void)
 {
+	bt_addr_le_t bound[MAX_NODES];
+	int count;
+
 	k_mutex_init(&node_mutex);
+	k_work_init_delayable(&notify_work, notify_work_handler);
 	memset(nodes, 0, sizeof(nodes));
-	LOG_INF("Node manager initialized (max nodes: %d)", MAX_NODES);
+	memset(seqs, 0, sizeof(seqs));
+
+	/* Never 0, so a peer that has seen nothing yet always resyncs */
+	table_epoch = sys_rand32_get() | 1;
+
+	/* Bound nodes are known before they are seen again */
+	count = storage_load_node_bindings(bound, MAX_NODES);
+	for (int i = 0; i < count; i++) {
+		nodes[i].valid = true;
+		bt_addr_le_copy(&nodes[i].addr, &bound[i]);
+		nodes[i].state = NODE_STATE_DISCONNECTED;
+		nodes[i].bound_to_hub = true;
+	}
+
+	LOG_INF("Node manager initialized (max nodes: %d, %d bound)", MAX_NODES, count);
 	return 0;
 }
 
@@ -50,13 +165,17 @@ int node_manager_add_node(const bt_addr_le_t *addr, int8_t rssi,
 			return -ENOMEM;
 		}
 		
+		write_begin(index);
 		memset(&nodes[index], 0, sizeof(struct node_info));
 		nodes[index].valid = true;
 		bt_addr_le_copy(&nodes[index].addr, addr);
 		nodes[index].state = NODE_STATE_DISCOVERED;
+		write_end(index);
+		journal_add(addr);
 		LOG_INF("New node at index %d", index);
 	}
 	
+	write_begin(index);
 	nodes[index].rssi = rssi;
 	nodes[index].last_seen = k_uptime_get_32();
 	
@@ -64,23 +183,52 @@ int node_manager_add_node(const bt_addr_le_t *addr, int8_t rssi,
 		uint8_t id_len = MIN(len, NODE_ID_LEN);
 		memcpy(nodes[index].node_id, adv_data, id_len);
 	}
+	write_end(index);
 	
 	k_mutex_unlock(&node_mutex);
 	return index;
 }
 
-struct node_info *node_manager_get_by_addr(const bt_addr_le_t *addr)
+int node_manager_get_by_addr(const bt_addr_le_t *addr, struct node_info *out)
 {
-	k_mutex_lock(&node_mutex, K_FOREVER);
-	int index = find_node_by_addr(addr);
-	k_mutex_unlock(&node_mutex);
-	return (index >= 0) ? &nodes[index] : NULL;
+	for (int i = 0; i < MAX_NODES; i++) {
+		read_entry(i, out);
+		if (out->valid && bt_addr_le_eq(&out->addr, addr)) {
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+int node_manager_get_by_id(const uint8_t *node_id, struct node_info *out)
+{
+	for (int i = 0; i < MAX_NODES; i++) {
+		read_entry(i, out);
+		if (out->valid && memcmp(out->node_id, node_id, NODE_ID_LEN) == 0) {
+			return 0;
+		}
+	}
+	return -ENOENT;
 }
 
-struct node_info *node_manager_get_by_index(int index)
+int node_manager_get_by_index(int index, struct node_info *out)
 {
-	if (index < 0 || index >= MAX_NODES) return NULL;
-	return nodes[index].valid ? &nodes[index] : NULL;
+	if (index < 0 || index >= MAX_NODES) return -EINVAL;
+	read_entry(index, out);
+	return out->valid ? 0 : -ENOENT;
+}
+
+int node_manager_snapshot(struct node_info *out, int max)
+{
+	int count = 0;
+
+	for (int i = 0; i < MAX_NODES && count < max; i++) {
+		read_entry(i, &out[count]);
+		if (out[count].valid) {
+			count++;
+		}
+	}
+	return count;
 }
 
 int node_manager_update_connection(const bt_addr_le_t *addr, struct bt_conn *conn)
@@ -88,8 +236,11 @@ int node_manager_update_connection(const bt_addr_le_t *addr, struct bt_conn *con
 	k_mutex_lock(&node_mutex, K_FOREVER);
 	int index = find_node_by_addr(addr);
 	if (index >= 0) {
+		write_begin(index);
 		nodes[index].conn = conn;
 		nodes[index].state = conn ? NODE_STATE_CONNECTED : NODE_STATE_DISCONNECTED;
+		write_end(index);
+		journal_add(addr);
 	}
 	k_mutex_unlock(&node_mutex);
 	return (index >= 0) ? 0 : -ENOENT;
@@ -100,8 +251,10 @@ int node_manager_update_reading(const bt_addr_le_t *addr, float reading)
 	k_mutex_lock(&node_mutex, K_FOREVER);
 	int index = find_node_by_addr(addr);
 	if (index >= 0) {
+		write_begin(index);
 		nodes[index].latest_reading = reading;
 		nodes[index].last_seen = k_uptime_get_32();
+		write_end(index);
 	}
 	k_mutex_unlock(&node_mutex);
 	return (index >= 0) ? 0 : -ENOENT;
@@ -111,7 +264,12 @@ int node_manager_update_battery(const bt_addr_le_t *addr, uint8_t battery_level)
 {
 	k_mutex_lock(&node_mutex, K_FOREVER);
 	int index = find_node_by_addr(addr);
-	if (index >= 0) nodes[index].battery_level = battery_level;
+	if (index >= 0 && nodes[index].battery_level != battery_level) {
+		write_begin(index);
+		nodes[index].battery_level = battery_level;
+		write_end(index);
+		journal_add(addr);
+	}
 	k_mutex_unlock(&node_mutex);
 	return (index >= 0) ? 0 : -ENOENT;
 }
@@ -121,14 +279,37 @@ int node_manager_bind_node(const bt_addr_le_t *addr)
 	k_mutex_lock(&node_mutex, K_FOREVER);
 	int index = find_node_by_addr(addr);
 	if (index >= 0) {
+		write_begin(index);
 		nodes[index].bound_to_hub = true;
 		nodes[index].state = NODE_STATE_BOUND;
+		write_end(index);
+		journal_add(addr);
+		storage_save_node_binding(addr);
 		LOG_INF("Node %d bound", index);
 	}
 	k_mutex_unlock(&node_mutex);
 	return (index >= 0) ? 0 : -ENOENT;
 }
 
+int node_manager_unbind_node(const bt_addr_le_t *addr)
+{
+	k_mutex_lock(&node_mutex, K_FOREVER);
+	int index = find_node_by_addr(addr);
+	if (index >= 0) {
+		write_begin(index);
+		nodes[index].bound_to_hub = false;
+		if (nodes[index].state == NODE_STATE_BOUND) {
+			nodes[index].state = NODE_STATE_DISCOVERED;
+		}
+		write_end(index);
+		journal_add(addr);
+		storage_delete_node_binding(addr);
+		LOG_INF("Node %d unbound", index);
+	}
+	k_mutex_unlock(&node_mutex);
+	return (index >= 0) ? 0 : -ENOENT;
+}
+
 int node_manager_get_count(void)
 {
 	int count = 0;
@@ -152,7 +333,110 @@ int node_manager_get_connected_count(void)
 }
 
 /* Additional methods abbreviated for space */
-struct node_info *node_manager_get_by_id(const uint8_t *node_id) { return NULL; }
-int node_manager_update_faults(const bt_addr_le_t *addr, uint32_t fault_flags) { return 0; }
-int node_manager_unbind_node(const bt_addr_le_t *addr) { return 0; }
-int node_manager_clear_stale(uint32_t timeout_ms) { return 0; }
+int node_manager_update_faults(const bt_addr_le_t *addr, uint32_t fault_flags)
+{
+	k_mutex_lock(&node_mutex, K_FOREVER);
+	int index = find_node_by_addr(addr);
+	if (index >= 0 && nodes[index].fault_flags != fault_flags) {
+		write_begin(index);
+		nodes[index].fault_flags = fault_flags;
+		write_end(index);
+		journal_add(addr);
+	}
+	k_mutex_unlock(&node_mutex);
+	return (index >= 0) ? 0 : -ENOENT;
+}
+
+/* Forget unbound nodes not heard from for timeout_ms */
+int node_manager_clear_stale(uint32_t timeout_ms)
+{
+	uint32_t now = k_uptime_get_32();
+	int removed = 0;
+
+	k_mutex_lock(&node_mutex, K_FOREVER);
+	for (int i = 0; i < MAX_NODES; i++) {
+		if (nodes[i].valid && !nodes[i].bound_to_hub && !nodes[i].conn &&
+		    now - nodes[i].last_seen > timeout_ms) {
+			write_begin(i);
+			nodes[i].valid = false;
+			write_end(i);
+			journal_add(&nodes[i].addr);
+			removed++;
+		}
+	}
+	k_mutex_unlock(&node_mutex);
+	return removed;
+}
+
+/* Node ids on the wire are most significant byte first */
+static void fill_entry(const struct node_info *node, const bt_addr_le_t *addr,
+		       struct ipc_node_entry *entry)
+{
+	memset(entry, 0, sizeof(*entry));
+	for (int i = 0; i < IPC_NODE_ADDR_LEN; i++) {
+		entry->node_id[i] = addr->a.val[IPC_NODE_ADDR_LEN - 1 - i];
+	}
+	if (!node) {
+		return;
+	}
+
+	entry->flags = IPC_NODE_PRESENT;
+	entry->flags |= node->bound_to_hub ? IPC_NODE_BOUND : 0;
+	entry->flags |= node->state == NODE_STATE_CONNECTED ? IPC_NODE_CONNECTED : 0;
+	entry->state = node->state;
+	entry->battery_pct = node->battery_level;
+	entry->faults = node->fault_flags;
+	entry->rssi = node->rssi;
+	entry->last_reading = node->latest_reading;
+}
+
+static bool delta_has(const struct ipc_node_entry *entries, int count,
+		      const struct ipc_node_entry *entry)
+{
+	for (int i = 0; i < count; i++) {
+		if (memcmp(entries[i].node_id, entry->node_id, IPC_NODE_ADDR_LEN) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+int node_manager_build_sync(const struct ipc_node_sync_request *req, uint8_t *buf)
+{
+	struct ipc_node_sync_response hdr;
+	struct ipc_node_entry *entries = (struct ipc_node_entry *)(buf + sizeof(hdr));
+	int count = 0;
+
+	k_mutex_lock(&node_mutex, K_FOREVER);
+
+	hdr.epoch = table_epoch;
+	hdr.version = table_version;
+	/* Deltas need every version after since_version still in the journal */
+	hdr.full = req->epoch != table_epoch || req->since_version > table_version ||
+		   table_version - req->since_version > JOURNAL_SIZE;
+
+	if (hdr.full) {
+		for (int i = 0; i < MAX_NODES; i++) {
+			if (nodes[i].valid) {
+				fill_entry(&nodes[i], &nodes[i].addr, &entries[count++]);
+			}
+		}
+	} else {
+		/* Newest first, so a node changed several times is sent once */
+		for (uint32_t v = table_version; v > req->since_version; v--) {
+			const bt_addr_le_t *addr = &journal[v % JOURNAL_SIZE].addr;
+			int index = find_node_by_addr(addr);
+
+			fill_entry(index >= 0 ? &nodes[index] : NULL, addr, &entries[count]);
+			if (!delta_has(entries, count, &entries[count])) {
+				count++;
+			}
+		}
+	}
+
+	k_mutex_unlock(&node_mutex);
+
+	hdr.count = count;
+	memcpy(buf, &hdr, sizeof(hdr));
+	return sizeof(hdr) + count * sizeof(struct ipc_node_entry);
+}
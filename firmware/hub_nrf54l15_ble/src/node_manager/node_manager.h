@@ -9,6 +9,7 @@
 #include <zephyr/bluetooth/bluetooth.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "ipc_handler.h"
 
 #define MAX_NODES 32
 #define NODE_ID_LEN 16
@@ -41,9 +42,26 @@ struct node_info {
 int node_manager_init(void);
 int node_manager_add_node(const bt_addr_le_t *addr, int8_t rssi,
                           const uint8_t *adv_data, uint8_t len);
-struct node_info *node_manager_get_by_addr(const bt_addr_le_t *addr);
-struct node_info *node_manager_get_by_id(const uint8_t *node_id);
-struct node_info *node_manager_get_by_index(int index);
+
+/*
+ * Readers get a consistent copy of an entry and never block the writers
+ * on the advertisement path. The lookups return 0, or -ENOENT if there
+ * is no such node.
+ */
+int node_manager_get_by_addr(const bt_addr_le_t *addr, struct node_info *out);
+int node_manager_get_by_id(const uint8_t *node_id, struct node_info *out);
+int node_manager_get_by_index(int index, struct node_info *out);
+
+/**
+ * @brief Copy out up to max known nodes
+ *
+ * Each entry is consistent on its own; the set as a whole is not one
+ * instant, nodes may change between entries.
+ *
+ * @return number of nodes copied
+ */
+int node_manager_snapshot(struct node_info *out, int max);
+
 int node_manager_update_connection(const bt_addr_le_t *addr, struct bt_conn *conn);
 int node_manager_update_reading(const bt_addr_le_t *addr, float reading);
 int node_manager_update_battery(const bt_addr_le_t *addr, uint8_t battery_level);
@@ -54,4 +72,15 @@ int node_manager_get_count(void);
 int node_manager_get_connected_count(void);
 int node_manager_clear_stale(uint32_t timeout_ms);
 
+/**
+ * @brief Answer an IPC_NODE_SYNC_REQUEST
+ *
+ * Writes an IPC_NODE_SYNC_RESPONSE holding the nodes changed since the
+ * requested version, or the whole table if that version is unknown.
+ * buf must hold IPC_MAX_PAYLOAD bytes.
+ *
+ * @return length of the response
+ */
+int node_manager_build_sync(const struct ipc_node_sync_request *req, uint8_t *buf);
+
 #endif /* NODE_MANAGER_H */
@@ -0,0 +1,423 @@
+/**
+ * @file pawr.c
+ * @brief PAwR collection implementation
+ *
+ * A node's subevent is fixed by its address (low address byte modulo
+ * PAWR_NUM_SUBEVENTS), so a node only ever listens to one subevent. Its
+ * slot within the subevent is assigned here from the bound nodes in the
+ * node table and kept for as long as it stays bound. Each subevent's data
+ * lists the node ids in slot order together with any pending command, so
+ * a node finds its slot without a connection. A node answers in its slot
+ * with its version 1 advertisement payload plus the last command it
+ * executed, which acknowledges the command.
+ */
+
+#include "pawr.h"
+#include "node_manager.h"
+#include "storage.h"
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/byteorder.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(pawr, LOG_LEVEL_INF);
+
+#define PAWR_CONFIG_KEY		"pawr"
+
+/* Manufacturer data, see docs/interfaces/ble-protocol.md */
+#define PAWR_COMPANY_ID		0x0059
+#define PAWR_TYPE_BEACON	0x10	/* Extended advertisement of the train */
+#define PAWR_TYPE_SLOTS		0x11	/* Subevent data */
+#define PAWR_SLOTS_HDR_LEN	4	/* Company, type, count */
+#define PAWR_ENTRY_LEN		7	/* Node id, command */
+#define PAWR_RESPONSE_LEN	18	/* Version 1 advertisement, ack */
+
+/* AD header plus the largest slot list */
+#define SUBEVENT_DATA_LEN \
+	(2 + PAWR_SLOTS_HDR_LEN + PAWR_SLOTS_PER_SUBEVENT * PAWR_ENTRY_LEN)
+
+BUILD_ASSERT(SUBEVENT_DATA_LEN <= 251, "Slot list must fit in one subevent");
+
+struct pawr_slot {
+	bool used;
+	bool bound;		/* Seen bound in the last remap */
+	bt_addr_le_t addr;
+	uint8_t command;	/* Sequence in the high nibble, 0 if none */
+	uint8_t seq;
+};
+
+struct node_response {
+	uint8_t node_id[IPC_NODE_ADDR_LEN];
+	uint8_t ack;
+	bool found;
+};
+
+static struct pawr_slot slots[PAWR_NUM_SUBEVENTS][PAWR_SLOTS_PER_SUBEVENT];
+static struct pawr_stats stats;
+static struct k_mutex pawr_mutex;
+static struct k_work_delayable remap_work;
+static pawr_recv_cb_t recv_cb;
+
+static struct bt_le_ext_adv *train;
+static bool enabled;
+
+static struct bt_le_per_adv_subevent_data_params subevent_params[PAWR_NUM_SUBEVENTS];
+static struct net_buf_simple subevent_bufs[PAWR_NUM_SUBEVENTS];
+static uint8_t subevent_data[PAWR_NUM_SUBEVENTS][SUBEVENT_DATA_LEN];
+
+/* Nodes copied out of the node table for a remap */
+static struct node_info nodes[MAX_NODES];
+
+static const uint8_t beacon_data[] = {
+	PAWR_COMPANY_ID & 0xff, PAWR_COMPANY_ID >> 8, PAWR_TYPE_BEACON,
+};
+
+static const struct bt_data beacon_ad[] = {
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, beacon_data, sizeof(beacon_data)),
+};
+
+static uint8_t subevent_of(const bt_addr_le_t *addr)
+{
+	return addr->a.val[0] % PAWR_NUM_SUBEVENTS;
+}
+
+/* Node ids on the wire are most significant byte first */
+static void addr_to_node_id(const bt_addr_le_t *addr, uint8_t *node_id)
+{
+	for (int i = 0; i < IPC_NODE_ADDR_LEN; i++) {
+		node_id[i] = addr->a.val[IPC_NODE_ADDR_LEN - 1 - i];
+	}
+}
+
+static struct pawr_slot *find_slot(const bt_addr_le_t *addr)
+{
+	struct pawr_slot *row = slots[subevent_of(addr)];
+
+	for (int i = 0; i < PAWR_SLOTS_PER_SUBEVENT; i++) {
+		if (row[i].used && bt_addr_le_eq(&row[i].addr, addr)) {
+			return &row[i];
+		}
+	}
+	return NULL;
+}
+
+static int assign_slot(const bt_addr_le_t *addr)
+{
+	struct pawr_slot *slot = find_slot(addr);
+	struct pawr_slot *row;
+
+	if (slot) {
+		slot->bound = true;
+		return 0;
+	}
+
+	row = slots[subevent_of(addr)];
+	for (int i = 0; i < PAWR_SLOTS_PER_SUBEVENT; i++) {
+		if (!row[i].used) {
+			memset(&row[i], 0, sizeof(row[i]));
+			row[i].used = true;
+			row[i].bound = true;
+			bt_addr_le_copy(&row[i].addr, addr);
+			return 0;
+		}
+	}
+	return -ENOMEM;
+}
+
+static void remap_work_handler(struct k_work *work)
+{
+	int count = node_manager_snapshot(nodes, MAX_NODES);
+	uint16_t assigned = 0;
+	uint16_t unassigned = 0;
+
+	k_mutex_lock(&pawr_mutex, K_FOREVER);
+
+	for (int s = 0; s < PAWR_NUM_SUBEVENTS; s++) {
+		for (int i = 0; i < PAWR_SLOTS_PER_SUBEVENT; i++) {
+			slots[s][i].bound = false;
+		}
+	}
+
+	for (int i = 0; i < count; i++) {
+		if (!nodes[i].bound_to_hub) {
+			continue;
+		}
+		if (assign_slot(&nodes[i].addr) == 0) {
+			assigned++;
+		} else {
+			unassigned++;
+		}
+	}
+
+	/* Free the slots of unbound nodes, the others keep their place */
+	for (int s = 0; s < PAWR_NUM_SUBEVENTS; s++) {
+		for (int i = 0; i < PAWR_SLOTS_PER_SUBEVENT; i++) {
+			if (slots[s][i].used && !slots[s][i].bound) {
+				slots[s][i].used = false;
+			}
+		}
+	}
+
+	if (unassigned > stats.unassigned) {
+		LOG_WRN("%u bound nodes without a PAwR slot", unassigned);
+	}
+	stats.nodes = assigned;
+	stats.unassigned = unassigned;
+
+	k_mutex_unlock(&pawr_mutex);
+
+	k_work_reschedule(&remap_work, K_SECONDS(PAWR_REMAP_S));
+}
+
+/* Slot list of one subevent, trailing free slots are left out */
+static uint8_t build_subevent(uint8_t subevent, struct net_buf_simple *buf)
+{
+	const struct pawr_slot *row = slots[subevent];
+	uint8_t count = 0;
+
+	for (int i = 0; i < PAWR_SLOTS_PER_SUBEVENT; i++) {
+		if (row[i].used) {
+			count = i + 1;
+		}
+	}
+
+	net_buf_simple_reset(buf);
+	net_buf_simple_add_u8(buf, 1 + PAWR_SLOTS_HDR_LEN + count * PAWR_ENTRY_LEN);
+	net_buf_simple_add_u8(buf, BT_DATA_MANUFACTURER_DATA);
+	net_buf_simple_add_le16(buf, PAWR_COMPANY_ID);
+	net_buf_simple_add_u8(buf, PAWR_TYPE_SLOTS);
+	net_buf_simple_add_u8(buf, count);
+
+	for (int i = 0; i < count; i++) {
+		uint8_t *entry = net_buf_simple_add(buf, PAWR_ENTRY_LEN);
+
+		if (row[i].used) {
+			addr_to_node_id(&row[i].addr, entry);
+			entry[IPC_NODE_ADDR_LEN] = row[i].command;
+		} else {
+			memset(entry, 0, PAWR_ENTRY_LEN);
+		}
+	}
+
+	return count;
+}
+
+static void pawr_data_request(struct bt_le_ext_adv *adv,
+			      const struct bt_le_per_adv_data_request *request)
+{
+	uint8_t count = MIN(request->count, PAWR_NUM_SUBEVENTS);
+	int err;
+
+	k_mutex_lock(&pawr_mutex, K_FOREVER);
+
+	for (uint8_t i = 0; i < count; i++) {
+		uint8_t subevent = (request->start + i) % PAWR_NUM_SUBEVENTS;
+		struct bt_le_per_adv_subevent_data_params *params = &subevent_params[i];
+
+		params->subevent = subevent;
+		params->response_slot_start = 0;
+		params->response_slot_count = build_subevent(subevent, &subevent_bufs[i]);
+		params->data = &subevent_bufs[i];
+	}
+
+	k_mutex_unlock(&pawr_mutex);
+
+	err = bt_le_per_adv_set_subevent_data(adv, count, subevent_params);
+	if (err) {
+		LOG_WRN("Failed to set subevent data (err %d)", err);
+	}
+}
+
+static bool parse_response(struct bt_data *data, void *user_data)
+{
+	struct node_response *resp = user_data;
+
+	if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < PAWR_RESPONSE_LEN ||
+	    sys_get_le16(&data->data[0]) != PAWR_COMPANY_ID) {
+		return true;
+	}
+
+	memcpy(resp->node_id, &data->data[3], IPC_NODE_ADDR_LEN);
+	resp->ack = data->data[PAWR_RESPONSE_LEN - 1];
+	resp->found = true;
+	return false;
+}
+
+static void pawr_response(struct bt_le_ext_adv *adv, struct bt_le_per_adv_response_info *info,
+			  struct net_buf_simple *buf)
+{
+	struct node_response resp = { 0 };
+	struct net_buf_simple_state state;
+	uint8_t node_id[IPC_NODE_ADDR_LEN];
+	struct pawr_slot *slot;
+	bt_addr_le_t addr;
+
+	if (!buf || info->subevent >= PAWR_NUM_SUBEVENTS ||
+	    info->response_slot >= PAWR_SLOTS_PER_SUBEVENT) {
+		return;
+	}
+
+	net_buf_simple_save(buf, &state);
+	bt_data_parse(buf, parse_response, &resp);
+	net_buf_simple_restore(buf, &state);
+	if (!resp.found) {
+		return;
+	}
+
+	k_mutex_lock(&pawr_mutex, K_FOREVER);
+
+	slot = &slots[info->subevent][info->response_slot];
+	if (slot->used) {
+		addr_to_node_id(&slot->addr, node_id);
+	}
+	if (!slot->used || memcmp(node_id, resp.node_id, sizeof(node_id)) != 0) {
+		/* The node has a stale slot list, it will pick up the new one */
+		stats.mismatched++;
+		k_mutex_unlock(&pawr_mutex);
+		return;
+	}
+
+	if (slot->command && resp.ack == slot->command) {
+		slot->command = 0;
+		stats.commands_acked++;
+	}
+	bt_addr_le_copy(&addr, &slot->addr);
+	stats.responses++;
+
+	k_mutex_unlock(&pawr_mutex);
+
+	recv_cb(&addr, info->rssi, buf);
+}
+
+static const struct bt_le_ext_adv_cb train_cb = {
+	.pawr_data_request = pawr_data_request,
+	.pawr_response = pawr_response,
+};
+
+static int train_start(void)
+{
+	const struct bt_le_per_adv_param param = {
+		.interval_min = PAWR_INTERVAL,
+		.interval_max = PAWR_INTERVAL,
+		.options = 0,
+		.num_subevents = PAWR_NUM_SUBEVENTS,
+		.subevent_interval = PAWR_SUBEVENT_INTERVAL,
+		.response_slot_delay = PAWR_RESPONSE_SLOT_DELAY,
+		.response_slot_spacing = PAWR_RESPONSE_SLOT_SPACING,
+		.num_response_slots = PAWR_SLOTS_PER_SUBEVENT,
+	};
+	int err;
+
+	if (!train) {
+		err = bt_le_ext_adv_create(BT_LE_EXT_ADV_NCONN, &train_cb, &train);
+		if (err) {
+			LOG_ERR("Failed to create advertising set (err %d)", err);
+			return err;
+		}
+
+		err = bt_le_ext_adv_set_data(train, beacon_ad, ARRAY_SIZE(beacon_ad), NULL, 0);
+		if (!err) {
+			err = bt_le_per_adv_set_param(train, &param);
+		}
+		if (err) {
+			LOG_ERR("Failed to configure PAwR train (err %d)", err);
+			bt_le_ext_adv_delete(train);
+			train = NULL;
+			return err;
+		}
+	}
+
+	err = bt_le_per_adv_start(train);
+	if (!err) {
+		err = bt_le_ext_adv_start(train, BT_LE_EXT_ADV_START_DEFAULT);
+	}
+	if (err) {
+		LOG_ERR("Failed to start PAwR train (err %d)", err);
+		return err;
+	}
+
+	k_work_reschedule(&remap_work, K_NO_WAIT);
+
+	LOG_INF("PAwR train started, %u subevents of %u slots",
+		PAWR_NUM_SUBEVENTS, PAWR_SLOTS_PER_SUBEVENT);
+	return 0;
+}
+
+static void train_stop(void)
+{
+	k_work_cancel_delayable(&remap_work);
+
+	if (train) {
+		bt_le_per_adv_stop(train);
+		bt_le_ext_adv_stop(train);
+	}
+
+	LOG_INF("PAwR train stopped");
+}
+
+int pawr_init(pawr_recv_cb_t cb)
+{
+	uint8_t stored;
+
+	recv_cb = cb;
+	k_mutex_init(&pawr_mutex);
+	k_work_init_delayable(&remap_work, remap_work_handler);
+
+	for (int i = 0; i < PAWR_NUM_SUBEVENTS; i++) {
+		net_buf_simple_init_with_data(&subevent_bufs[i], subevent_data[i],
+					      sizeof(subevent_data[i]));
+	}
+
+	if (storage_load_config(PAWR_CONFIG_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+	    stored) {
+		enabled = train_start() == 0;
+	}
+
+	return 0;
+}
+
+int pawr_set_enabled(bool enable)
+{
+	uint8_t stored = enable;
+	int err = 0;
+
+	if (enable && !enabled) {
+		err = train_start();
+	} else if (!enable && enabled) {
+		train_stop();
+	}
+	if (err) {
+		return err;
+	}
+
+	enabled = enable;
+	return storage_save_config(PAWR_CONFIG_KEY, &stored, sizeof(stored));
+}
+
+int pawr_send_command(const bt_addr_le_t *addr, enum pawr_command command)
+{
+	struct pawr_slot *slot;
+
+	k_mutex_lock(&pawr_mutex, K_FOREVER);
+
+	slot = find_slot(addr);
+	if (!slot) {
+		k_mutex_unlock(&pawr_mutex);
+		return -ENOENT;
+	}
+
+	/* A new sequence tells the node this is not a repeat */
+	slot->seq = slot->seq % 15 + 1;
+	slot->command = (slot->seq << 4) | command;
+
+	k_mutex_unlock(&pawr_mutex);
+	return 0;
+}
+
+void pawr_get_stats(struct pawr_stats *out)
+{
+	k_mutex_lock(&pawr_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&pawr_mutex);
+}
@@ -0,0 +1,71 @@
+/**
+ * @file pawr.h
+ * @brief Periodic Advertising with Responses for Hub BLE Central
+ *
+ * Optional collection mode: the hub runs a periodic advertising train
+ * with one response slot per bound node, and nodes answer with their
+ * reading in their own slot instead of contending on the advertising
+ * channels.
+ */
+
+#ifndef PAWR_H
+#define PAWR_H
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#define PAWR_NUM_SUBEVENTS		16
+#define PAWR_SLOTS_PER_SUBEVENT		16
+
+/* Train timing, in controller units */
+#define PAWR_INTERVAL			800	/* 1.25 ms units, 1 s */
+#define PAWR_SUBEVENT_INTERVAL		12	/* 1.25 ms units, 15 ms */
+#define PAWR_RESPONSE_SLOT_DELAY	2	/* 1.25 ms units, 2.5 ms */
+#define PAWR_RESPONSE_SLOT_SPACING	4	/* 0.125 ms units, 0.5 ms */
+
+/* Slots are reassigned from the node table this often */
+#define PAWR_REMAP_S			10
+
+/* Commands carried to a node in its subevent */
+enum pawr_command {
+	PAWR_CMD_NONE,
+	PAWR_CMD_SAMPLE,		/* Take a reading now */
+};
+
+/* Same shape as the scan callback, the buffer holds the node's AD data */
+typedef void (*pawr_recv_cb_t)(const bt_addr_le_t *addr, int8_t rssi,
+			       struct net_buf_simple *ad);
+
+struct pawr_stats {
+	uint32_t responses;
+	uint32_t mismatched;		/* Response from a node not in the slot */
+	uint32_t commands_acked;
+	uint16_t nodes;			/* Nodes holding a slot */
+	uint16_t unassigned;		/* Bound nodes left without a slot */
+};
+
+/**
+ * @brief Set up the train, started if enabled in the hub config
+ *
+ * @param cb Called for each node response
+ */
+int pawr_init(pawr_recv_cb_t cb);
+
+/**
+ * @brief Turn the mode on or off, the choice is kept in the hub config
+ */
+int pawr_set_enabled(bool enable);
+
+/**
+ * @brief Send a command to a node in its next subevent
+ *
+ * The command is repeated until the node acknowledges it.
+ *
+ * @return 0 on success, -ENOENT if the node has no slot
+ */
+int pawr_send_command(const bt_addr_le_t *addr, enum pawr_command command);
+
+void pawr_get_stats(struct pawr_stats *stats);
+
+#endif /* PAWR_H */
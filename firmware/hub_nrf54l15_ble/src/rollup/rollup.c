@@ -0,0 +1,360 @@
+/**
+ * @file rollup.c
+ * @brief Telemetry rollup implementation
+ *
+ * Each node has a fixed accumulator of count, min, max, sum and last for
+ * the current window. All windows close together: one delayed work item
+ * packs a summary per active node into as few IPC_NODE_SUMMARY frames as
+ * fit and starts the next window. Nodes that reported nothing are left
+ * out. Samples carrying an alarm fault are still accumulated but also go
+ * out at once as IPC_NODE_TELEMETRY.
+ *
+ * A node keeps its slot, and with it the last freshness counter, battery
+ * voltage and unit, across idle windows. Only when a new node finds the
+ * table full does the node heard least recently give up its slot, so a
+ * node missed for a window does not have its history folded in twice.
+ *
+ * Readings that fell out of the history before the node was heard again
+ * are marked missing, relative to the freshness counter. The node keeps
+ * its last ROLLUP_MISSING_SPAN readings for its Reading Batch
+ * characteristic, so those are what a backlog collection can still fold
+ * in, each once, into the window that is open when they arrive.
+ */
+
+#include "rollup.h"
+#include "ipc_handler.h"
+#include "storage.h"
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(rollup, LOG_LEVEL_INF);
+
+#define ROLLUP_CONFIG_KEY	"rollup_window"
+#define SUMMARIES_PER_FRAME	(IPC_MAX_PAYLOAD / sizeof(struct ipc_node_summary))
+
+struct rollup_acc {
+	bool used;
+	bool has_counter;
+	bt_addr_le_t addr;
+	uint32_t heard;		/* Window the node was last heard in */
+	uint16_t count;
+	uint16_t counter;
+	uint16_t missing_base;	/* Counter of bit 0 of missing */
+	uint64_t missing;	/* Readings neither advertised nor collected */
+	float min;
+	float max;
+	float sum;
+	float last;
+	char unit[IPC_NODE_UNIT_LEN];
+	uint16_t battery_mv;
+	uint8_t faults;
+	uint8_t battery_pct;
+	int8_t rssi;
+};
+
+static struct rollup_acc accs[ROLLUP_MAX_NODES];
+static uint32_t window_seq;
+static uint16_t window_s = ROLLUP_WINDOW_S_DEFAULT;
+static uint16_t next_window_s = ROLLUP_WINDOW_S_DEFAULT;
+static struct ipc_node_summary frame[SUMMARIES_PER_FRAME];
+static struct rollup_stats stats;
+static struct k_mutex rollup_mutex;
+static struct k_work_delayable window_work;
+
+/* Node ids on the wire are most significant byte first */
+static void addr_to_node_id(const bt_addr_le_t *addr, uint8_t *node_id)
+{
+	for (int i = 0; i < IPC_NODE_ADDR_LEN; i++) {
+		node_id[i] = addr->a.val[IPC_NODE_ADDR_LEN - 1 - i];
+	}
+}
+
+/*
+ * The node's slot. A new node takes a free slot, or else the one of the
+ * idle node heard least recently; nodes with readings in the current
+ * window are never evicted.
+ */
+static struct rollup_acc *find_used(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < ROLLUP_MAX_NODES; i++) {
+		if (accs[i].used && bt_addr_le_eq(&accs[i].addr, addr)) {
+			return &accs[i];
+		}
+	}
+	return NULL;
+}
+
+static struct rollup_acc *find_acc(const bt_addr_le_t *addr)
+{
+	struct rollup_acc *free_acc = find_used(addr);
+
+	if (free_acc) {
+		return free_acc;
+	}
+
+	for (int i = 0; i < ROLLUP_MAX_NODES; i++) {
+		struct rollup_acc *acc = &accs[i];
+
+		if (!acc->used) {
+			free_acc = acc;
+			break;
+		}
+		if (acc->count == 0 && (!free_acc || acc->heard < free_acc->heard)) {
+			free_acc = acc;
+		}
+	}
+
+	if (free_acc) {
+		memset(free_acc, 0, sizeof(*free_acc));
+		free_acc->used = true;
+		bt_addr_le_copy(&free_acc->addr, addr);
+	}
+	return free_acc;
+}
+
+static void send_passthrough(const bt_addr_le_t *addr, const struct rollup_sample *sample)
+{
+	struct ipc_node_telemetry rec = {
+		.value = sample->value,
+		.battery_mv = sample->battery_mv,
+		.battery_pct = sample->battery_pct,
+		.faults = sample->faults,
+		.rssi = sample->rssi,
+	};
+
+	memcpy(rec.unit, sample->unit, sizeof(rec.unit));
+	addr_to_node_id(addr, rec.node_id);
+	ipc_send(IPC_NODE_TELEMETRY, (const uint8_t *)&rec, sizeof(rec));
+	stats.passthrough++;
+	stats.messages++;
+}
+
+static void send_frame(size_t count)
+{
+	ipc_send(IPC_NODE_SUMMARY, (const uint8_t *)frame, count * sizeof(frame[0]));
+	stats.messages++;
+}
+
+static void window_work_handler(struct k_work *work)
+{
+	size_t count = 0;
+
+	k_mutex_lock(&rollup_mutex, K_FOREVER);
+
+	for (int i = 0; i < ROLLUP_MAX_NODES; i++) {
+		struct rollup_acc *acc = &accs[i];
+		struct ipc_node_summary *sum = &frame[count];
+
+		if (!acc->used || acc->count == 0) {
+			continue;
+		}
+
+		addr_to_node_id(&acc->addr, sum->node_id);
+		sum->window_s = window_s;
+		sum->count = acc->count;
+		sum->min = acc->min;
+		sum->max = acc->max;
+		sum->mean = acc->sum / acc->count;
+		sum->last = acc->last;
+		memcpy(sum->unit, acc->unit, sizeof(sum->unit));
+		sum->battery_mv = acc->battery_mv;
+		sum->faults = acc->faults;
+		sum->battery_pct = acc->battery_pct;
+		sum->rssi = acc->rssi;
+
+		/* Start the next window, the freshness counter carries over */
+		acc->count = 0;
+		acc->faults = 0;
+		stats.summaries++;
+
+		if (++count == SUMMARIES_PER_FRAME) {
+			send_frame(count);
+			count = 0;
+		}
+	}
+
+	if (count > 0) {
+		send_frame(count);
+	}
+
+	window_seq++;
+	window_s = next_window_s;
+	k_work_reschedule(&window_work, K_SECONDS(window_s));
+
+	k_mutex_unlock(&rollup_mutex);
+}
+
+int rollup_init(void)
+{
+	uint16_t stored;
+
+	k_mutex_init(&rollup_mutex);
+	k_work_init_delayable(&window_work, window_work_handler);
+
+	if (storage_load_config(ROLLUP_CONFIG_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+	    stored >= ROLLUP_WINDOW_S_MIN && stored <= ROLLUP_WINDOW_S_MAX) {
+		window_s = stored;
+		next_window_s = stored;
+	}
+
+	k_work_schedule(&window_work, K_SECONDS(window_s));
+
+	LOG_INF("Rollup initialized (%u s windows)", window_s);
+	return 0;
+}
+
+/* Mark counters first..last missing, keeping the newest that fit */
+static void mark_missing(struct rollup_acc *acc, uint16_t first, uint16_t last)
+{
+	uint16_t span = last - first + 1;
+	uint16_t shift;
+
+	if (span >= ROLLUP_MISSING_SPAN) {
+		first = last - ROLLUP_MISSING_SPAN + 1;
+		acc->missing = 0;
+	}
+	if (!acc->missing) {
+		acc->missing_base = first;
+	}
+
+	shift = last - acc->missing_base;
+	if (shift >= ROLLUP_MISSING_SPAN) {
+		shift -= ROLLUP_MISSING_SPAN - 1;
+		acc->missing >>= shift;
+		acc->missing_base += shift;
+	}
+
+	for (uint16_t c = first; c != (uint16_t)(last + 1); c++) {
+		acc->missing |= BIT64(c - acc->missing_base);
+	}
+}
+
+static void acc_fold(struct rollup_acc *acc, float value)
+{
+	if (acc->count == 0) {
+		acc->min = value;
+		acc->max = value;
+		acc->sum = 0.0f;
+	}
+	acc->count = MIN(acc->count + 1, UINT16_MAX);
+	acc->min = MIN(acc->min, value);
+	acc->max = MAX(acc->max, value);
+	acc->sum += value;
+	acc->last = value;
+	stats.samples++;
+}
+
+int rollup_add_sample(const bt_addr_le_t *addr, const struct rollup_sample *sample)
+{
+	struct rollup_acc *acc;
+	struct rollup_sample full;
+	uint16_t fresh = sample->history_len + 1;
+	int missed = 0;
+
+	k_mutex_lock(&rollup_mutex, K_FOREVER);
+
+	acc = find_acc(addr);
+	if (!acc) {
+		/* More nodes than accumulators, forward rather than lose it */
+		send_passthrough(addr, sample);
+		k_mutex_unlock(&rollup_mutex);
+		return -ENOMEM;
+	}
+	acc->heard = window_seq;
+
+	/* PAwR responses carry neither, keep what the node advertised last */
+	if (sample->battery_mv) {
+		acc->battery_mv = sample->battery_mv;
+	}
+	if (sample->unit[0]) {
+		memcpy(acc->unit, sample->unit, sizeof(acc->unit));
+	}
+
+	/*
+	 * Readings between the last counter seen and this one are in the
+	 * history, those before the history are missing. A counter that went
+	 * backwards means the node restarted, then all of the history is new
+	 * and nothing the node had before can be collected.
+	 */
+	if (acc->has_counter) {
+		uint16_t gap = sample->counter - acc->counter;
+
+		if (gap == 0) {
+			stats.duplicates++;
+			k_mutex_unlock(&rollup_mutex);
+			return 0;
+		}
+		if (gap >= 0x8000) {
+			acc->missing = 0;
+		} else if (gap > fresh) {
+			missed = gap - fresh;
+			mark_missing(acc, acc->counter + 1, sample->counter - fresh);
+			stats.missed += missed;
+		}
+		fresh = MIN(fresh, gap);
+	}
+	acc->counter = sample->counter;
+	acc->has_counter = true;
+
+	for (int i = fresh - 2; i >= 0; i--) {
+		acc_fold(acc, sample->history[i]);
+	}
+	acc_fold(acc, sample->value);
+	acc->faults |= sample->faults;
+	acc->battery_pct = sample->battery_pct;
+	acc->rssi = sample->rssi;
+
+	if (sample->faults & ROLLUP_ALARM_FAULTS) {
+		full = *sample;
+		full.battery_mv = acc->battery_mv;
+		memcpy(full.unit, acc->unit, sizeof(full.unit));
+		send_passthrough(addr, &full);
+	}
+
+	k_mutex_unlock(&rollup_mutex);
+	return missed;
+}
+
+int rollup_add_backlog(const bt_addr_le_t *addr, uint16_t counter, float value)
+{
+	struct rollup_acc *acc;
+	uint16_t bit;
+	int left = 0;
+
+	k_mutex_lock(&rollup_mutex, K_FOREVER);
+
+	acc = find_used(addr);
+	if (acc) {
+		bit = counter - acc->missing_base;
+		if (bit < ROLLUP_MISSING_SPAN && (acc->missing & BIT64(bit))) {
+			acc->missing &= ~BIT64(bit);
+			acc_fold(acc, value);
+			stats.collected++;
+		}
+		left = __builtin_popcountll(acc->missing);
+	}
+
+	k_mutex_unlock(&rollup_mutex);
+	return left;
+}
+
+int rollup_set_window(uint16_t seconds)
+{
+	if (seconds < ROLLUP_WINDOW_S_MIN || seconds > ROLLUP_WINDOW_S_MAX) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&rollup_mutex, K_FOREVER);
+	next_window_s = seconds;
+	k_mutex_unlock(&rollup_mutex);
+
+	return storage_save_config(ROLLUP_CONFIG_KEY, &seconds, sizeof(seconds));
+}
+
+void rollup_get_stats(struct rollup_stats *out)
+{
+	k_mutex_lock(&rollup_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&rollup_mutex);
+}
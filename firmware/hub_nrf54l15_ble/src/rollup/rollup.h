@@ -0,0 +1,86 @@
+/**
+ * @file rollup.h
+ * @brief Per-node telemetry rollup for Hub BLE Central
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <stdint.h>
+#include "node_manager.h"
+
+#define ROLLUP_MAX_NODES MAX_NODES
+
+#define ROLLUP_WINDOW_S_DEFAULT 60
+#define ROLLUP_WINDOW_S_MIN 10
+#define ROLLUP_WINDOW_S_MAX 3600
+
+/* Readings a node keeps for collection, GATT_RING_SIZE on the node */
+#define ROLLUP_MISSING_SPAN 64
+
+/* Sensor high/low, disconnected and ADC saturation put a node in alarm */
+#define ROLLUP_ALARM_FAULTS 0x0F
+
+/* One reading as advertised by a node */
+struct rollup_sample {
+	float value;
+	uint8_t faults;
+	uint8_t battery_pct;
+	uint16_t battery_mv;	/* 0 if the advertisement has none */
+	char unit[IPC_NODE_UNIT_LEN];	/* Empty if the advertisement has none */
+	int8_t rssi;
+	uint16_t counter;	/* Freshness counter, repeats are ignored */
+	const float *history;	/* Readings before value, newest first */
+	uint8_t history_len;
+};
+
+struct rollup_stats {
+	uint32_t samples;
+	uint32_t duplicates;
+	uint32_t missed;	/* Readings older than the history of the sample */
+	uint32_t collected;	/* Missed readings recovered from a backlog */
+	uint32_t summaries;
+	uint32_t passthrough;	/* Samples sent at full rate while in alarm */
+	uint32_t messages;	/* IPC frames sent */
+};
+
+/**
+ * @brief Start windowing, the window length is read from the hub config
+ */
+int rollup_init(void);
+
+/**
+ * @brief Fold a sample into its node's window
+ *
+ * Readings in the sample's history that the counter shows were not seen
+ * yet are folded in first, oldest first. A sample from a node in alarm
+ * is also forwarded right away as IPC_NODE_TELEMETRY. A sample without
+ * battery voltage or unit gets the last ones the node advertised.
+ *
+ * @return Readings the counter shows were missed beyond the history, which
+ *         only a backlog collection can recover, or -ENOMEM if there is
+ *         no accumulator for the node (the sample is forwarded)
+ */
+int rollup_add_sample(const bt_addr_le_t *addr, const struct rollup_sample *sample);
+
+/**
+ * @brief Fold a reading collected from the node's backlog
+ *
+ * Only a reading marked missing by rollup_add_sample is folded, into the
+ * current window; any other was counted already and is ignored.
+ *
+ * @return Readings of the node still missing
+ */
+int rollup_add_backlog(const bt_addr_le_t *addr, uint16_t counter, float value);
+
+/**
+ * @brief Change the window length, takes effect with the next window
+ *
+ * @return 0 on success, -EINVAL if outside ROLLUP_WINDOW_S_MIN..MAX
+ */
+int rollup_set_window(uint16_t window_s);
+
+void rollup_get_stats(struct rollup_stats *stats);
+
+#endif /* ROLLUP_H */
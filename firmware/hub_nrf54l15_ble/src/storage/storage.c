@@ -1,42 +1,372 @@
 /**
  * @file storage.c
  * @brief Storage manager implementation
+ *
+ * The binding table and the config entries are held in RAM and read from
+ * NVS once at boot. A save changes RAM and arms a delayed flush; the flush
+ * writes the binding table as one compact entry and each changed config
+ * value as its own entry. Commissioning a batch of nodes therefore costs
+ * one binding write instead of one per node.
  */
 
 #include "storage.h"
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/fs/nvs.h>
+#include <zephyr/storage/flash_map.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(storage, LOG_LEVEL_INF);
 
+#define NVS_PARTITION		storage_partition
+#define NVS_SECTOR_SIZE		4096
+#define NVS_ATE_SIZE		8	/* Allocation table entry per write */
+
+/* NVS ids */
+#define NVS_ID_BINDINGS		1
+#define NVS_ID_CONFIG_BASE	0x10
+#define NVS_ID_JOB_BASE		0x100
+
+#define BINDINGS_VERSION	1
+
+/* NVS_ID_BINDINGS entry, only count addresses are written */
+struct binding_record {
+	uint8_t version;
+	uint8_t count;
+	bt_addr_le_t addrs[STORAGE_MAX_BINDINGS];
+} __packed;
+
+/* Config entry in RAM, stored as the key followed by the value */
+struct config_entry {
+	bool used;
+	bool dirty;
+	uint16_t len;
+	char key[STORAGE_CONFIG_KEY_LEN];
+	uint8_t data[STORAGE_CONFIG_MAX_LEN];
+};
+
 static struct nvs_fs fs;
+static bool nvs_ready;
+
+static struct binding_record bindings;
+static bool bindings_dirty;
+static struct config_entry config[STORAGE_MAX_CONFIG];
+static uint8_t config_buf[STORAGE_CONFIG_KEY_LEN + STORAGE_CONFIG_MAX_LEN];
+
+static struct storage_stats stats;
+static struct k_mutex storage_mutex;
+static struct k_work_delayable flush_work;
+
+static uint16_t job_id(uint8_t slot, enum storage_job_part part)
+{
+	return NVS_ID_JOB_BASE + slot * 2 + part;
+}
+
+static void flash_write(uint16_t id, const void *data, size_t len)
+{
+	ssize_t ret = nvs_write(&fs, id, data, len);
+
+	if (ret < 0) {
+		LOG_WRN("NVS write of id %u failed: %d", id, (int)ret);
+	} else if (ret > 0) {
+		stats.flash_writes++;
+		stats.flash_bytes += ret + NVS_ATE_SIZE;
+	}
+}
+
+/* Called with storage_mutex held */
+static void flush_locked(void)
+{
+	if (!nvs_ready) {
+		return;
+	}
+
+	if (bindings_dirty) {
+		flash_write(NVS_ID_BINDINGS, &bindings,
+			    offsetof(struct binding_record, addrs) +
+			    bindings.count * sizeof(bt_addr_le_t));
+		bindings_dirty = false;
+		stats.flushes++;
+	}
+
+	for (int i = 0; i < STORAGE_MAX_CONFIG; i++) {
+		if (!config[i].dirty) {
+			continue;
+		}
+		memcpy(config_buf, config[i].key, STORAGE_CONFIG_KEY_LEN);
+		memcpy(config_buf + STORAGE_CONFIG_KEY_LEN, config[i].data, config[i].len);
+		flash_write(NVS_ID_CONFIG_BASE + i, config_buf,
+			    STORAGE_CONFIG_KEY_LEN + config[i].len);
+		config[i].dirty = false;
+		stats.flushes++;
+	}
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+	flush_locked();
+	k_mutex_unlock(&storage_mutex);
+}
+
+/* The first change arms the flush, later ones ride along */
+static void schedule_flush(void)
+{
+	stats.saves++;
+	k_work_schedule(&flush_work, K_MSEC(STORAGE_FLUSH_MS));
+}
+
+static void load_bindings(void)
+{
+	ssize_t len = nvs_read(&fs, NVS_ID_BINDINGS, &bindings, sizeof(bindings));
+
+	if (len < (ssize_t)offsetof(struct binding_record, addrs) ||
+	    bindings.version != BINDINGS_VERSION || bindings.count > STORAGE_MAX_BINDINGS ||
+	    len != (ssize_t)(offsetof(struct binding_record, addrs) +
+			     bindings.count * sizeof(bt_addr_le_t))) {
+		memset(&bindings, 0, sizeof(bindings));
+	}
+	bindings.version = BINDINGS_VERSION;
+}
+
+static void load_config(void)
+{
+	for (int i = 0; i < STORAGE_MAX_CONFIG; i++) {
+		ssize_t len = nvs_read(&fs, NVS_ID_CONFIG_BASE + i, config_buf,
+				       sizeof(config_buf));
+
+		if (len < STORAGE_CONFIG_KEY_LEN || len > (ssize_t)sizeof(config_buf)) {
+			continue;
+		}
+		memcpy(config[i].key, config_buf, STORAGE_CONFIG_KEY_LEN);
+		config[i].key[STORAGE_CONFIG_KEY_LEN - 1] = '\0';
+		config[i].len = len - STORAGE_CONFIG_KEY_LEN;
+		memcpy(config[i].data, config_buf + STORAGE_CONFIG_KEY_LEN, config[i].len);
+		config[i].used = true;
+	}
+}
 
 int storage_init(void)
 {
-	/* NVS initialization */
-	LOG_INF("Storage initialized");
+	uint32_t start;
+	int err;
+
+	k_mutex_init(&storage_mutex);
+	k_work_init_delayable(&flush_work, flush_work_handler);
+	bindings.version = BINDINGS_VERSION;
+
+	fs.flash_device = FIXED_PARTITION_DEVICE(NVS_PARTITION);
+	fs.offset = FIXED_PARTITION_OFFSET(NVS_PARTITION);
+	fs.sector_size = NVS_SECTOR_SIZE;
+	fs.sector_count = FIXED_PARTITION_SIZE(NVS_PARTITION) / NVS_SECTOR_SIZE;
+
+	if (!device_is_ready(fs.flash_device)) {
+		LOG_ERR("Flash device not ready");
+		return -ENODEV;
+	}
+
+	err = nvs_mount(&fs);
+	if (err) {
+		LOG_ERR("NVS mount failed: %d", err);
+		return err;
+	}
+	nvs_ready = true;
+
+	start = k_cycle_get_32();
+	load_bindings();
+	load_config();
+	stats.load_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+	LOG_INF("Storage initialized: %u bindings loaded in %u us", bindings.count,
+		stats.load_us);
 	return 0;
 }
 
+static int find_binding(const bt_addr_le_t *addr)
+{
+	for (int i = 0; i < bindings.count; i++) {
+		if (bt_addr_le_eq(&bindings.addrs[i], addr)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
 int storage_save_node_binding(const bt_addr_le_t *addr)
 {
-	LOG_INF("Saving node binding");
-	return 0;
+	int err = 0;
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+
+	if (find_binding(addr) < 0) {
+		if (bindings.count < STORAGE_MAX_BINDINGS) {
+			bt_addr_le_copy(&bindings.addrs[bindings.count++], addr);
+			bindings_dirty = true;
+			schedule_flush();
+		} else {
+			err = -ENOMEM;
+		}
+	}
+
+	k_mutex_unlock(&storage_mutex);
+	return err;
 }
 
-int storage_load_node_bindings(void)
+int storage_delete_node_binding(const bt_addr_le_t *addr)
 {
-	LOG_INF("Loading node bindings");
-	return 0;
+	int index;
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+
+	index = find_binding(addr);
+	if (index >= 0) {
+		/* Keep the table dense, order does not matter */
+		bindings.addrs[index] = bindings.addrs[--bindings.count];
+		bindings_dirty = true;
+		schedule_flush();
+	}
+
+	k_mutex_unlock(&storage_mutex);
+	return index >= 0 ? 0 : -ENOENT;
+}
+
+int storage_load_node_bindings(bt_addr_le_t *addrs, int max)
+{
+	int count;
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+	count = MIN(bindings.count, max);
+	memcpy(addrs, bindings.addrs, count * sizeof(bt_addr_le_t));
+	k_mutex_unlock(&storage_mutex);
+
+	return count;
+}
+
+static struct config_entry *find_config(const char *key, bool create)
+{
+	struct config_entry *free_entry = NULL;
+
+	for (int i = 0; i < STORAGE_MAX_CONFIG; i++) {
+		if (!config[i].used) {
+			free_entry = free_entry ? free_entry : &config[i];
+		} else if (strncmp(config[i].key, key, STORAGE_CONFIG_KEY_LEN) == 0) {
+			return &config[i];
+		}
+	}
+
+	if (!create || !free_entry) {
+		return NULL;
+	}
+	memset(free_entry, 0, sizeof(*free_entry));
+	strncpy(free_entry->key, key, STORAGE_CONFIG_KEY_LEN - 1);
+	free_entry->used = true;
+	return free_entry;
 }
 
 int storage_save_config(const char *key, const void *data, uint16_t len)
 {
-	return 0;
+	struct config_entry *entry;
+	int err = 0;
+
+	if (strlen(key) >= STORAGE_CONFIG_KEY_LEN || len > STORAGE_CONFIG_MAX_LEN) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+
+	entry = find_config(key, true);
+	if (!entry) {
+		err = -ENOMEM;
+	} else if (entry->len != len || memcmp(entry->data, data, len) != 0) {
+		memcpy(entry->data, data, len);
+		entry->len = len;
+		entry->dirty = true;
+		schedule_flush();
+	}
+
+	k_mutex_unlock(&storage_mutex);
+	return err;
 }
 
 int storage_load_config(const char *key, void *data, uint16_t max_len)
 {
-	return 0;
+	struct config_entry *entry;
+	int len = -ENOENT;
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+
+	entry = find_config(key, false);
+	if (entry) {
+		len = entry->len;
+		memcpy(data, entry->data, MIN(entry->len, max_len));
+	}
+
+	k_mutex_unlock(&storage_mutex);
+	return len;
+}
+
+int storage_flush(void)
+{
+	k_work_cancel_delayable(&flush_work);
+
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+	flush_locked();
+	k_mutex_unlock(&storage_mutex);
+
+	return nvs_ready ? 0 : -ENODEV;
+}
+
+void storage_get_stats(struct storage_stats *out)
+{
+	k_mutex_lock(&storage_mutex, K_FOREVER);
+	*out = stats;
+	k_mutex_unlock(&storage_mutex);
+}
+
+int storage_save_job(uint8_t slot, enum storage_job_part part, const void *data,
+		     uint16_t len)
+{
+	ssize_t ret;
+
+	if (!nvs_ready) {
+		return -ENODEV;
+	}
+	if (slot >= STORAGE_JOB_SLOTS) {
+		return -EINVAL;
+	}
+
+	/* nvs_write returns 0 when the stored data is already identical */
+	ret = nvs_write(&fs, job_id(slot, part), data, len);
+	if (ret < 0) {
+		LOG_WRN("Job journal write failed: %d", (int)ret);
+		return ret;
+	}
+	return ret > 0 ? ret + NVS_ATE_SIZE : 0;
+}
+
+ssize_t storage_load_job(uint8_t slot, enum storage_job_part part, void *data,
+			 uint16_t max_len)
+{
+	if (!nvs_ready) {
+		return -ENODEV;
+	}
+	if (slot >= STORAGE_JOB_SLOTS) {
+		return -EINVAL;
+	}
+	return nvs_read(&fs, job_id(slot, part), data, max_len);
+}
+
+int storage_delete_job(uint8_t slot)
+{
+	if (!nvs_ready) {
+		return -ENODEV;
+	}
+	if (slot >= STORAGE_JOB_SLOTS) {
+		return -EINVAL;
+	}
+
+	/* At most one empty allocation table entry per id */
+	nvs_delete(&fs, job_id(slot, STORAGE_JOB_PROGRESS));
+	nvs_delete(&fs, job_id(slot, STORAGE_JOB_REQUEST));
+	return 2 * NVS_ATE_SIZE;
 }
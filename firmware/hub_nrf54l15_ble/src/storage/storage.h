@@ -7,12 +7,88 @@
 #define STORAGE_H
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <zephyr/bluetooth/bluetooth.h>
 
+#define STORAGE_MAX_BINDINGS	32	/* MAX_NODES in node_manager.h */
+#define STORAGE_MAX_CONFIG	16
+#define STORAGE_CONFIG_KEY_LEN	16
+#define STORAGE_CONFIG_MAX_LEN	64
+
+/* Binding and config changes reach flash this long after the first one */
+#define STORAGE_FLUSH_MS	5000
+
+/* Job journal entries, one pair per job batch slot */
+#define STORAGE_JOB_SLOTS 8
+
+enum storage_job_part {
+	STORAGE_JOB_REQUEST,	/* Written once when the job arrives */
+	STORAGE_JOB_PROGRESS	/* Rewritten as nodes finish */
+};
+
+/* Flash cost of bindings and config, the job journal counts its own */
+struct storage_stats {
+	uint32_t saves;		/* Binding and config changes */
+	uint32_t flushes;	/* Coalesced writes of those changes */
+	uint32_t flash_writes;
+	uint32_t flash_bytes;	/* Including NVS allocation table entries */
+	uint32_t load_us;	/* Reading bindings and config at boot */
+};
+
+/**
+ * @brief Mount NVS and read all bindings and config into RAM
+ */
 int storage_init(void);
+
+/*
+ * Bindings and config live in RAM. Saving only updates RAM and arms a
+ * flush, so a burst of changes costs one write per NVS entry.
+ */
 int storage_save_node_binding(const bt_addr_le_t *addr);
-int storage_load_node_bindings(void);
+int storage_delete_node_binding(const bt_addr_le_t *addr);
+
+/**
+ * @brief Copy out the bound node addresses
+ *
+ * @return number of addresses copied
+ */
+int storage_load_node_bindings(bt_addr_le_t *addrs, int max);
+
 int storage_save_config(const char *key, const void *data, uint16_t len);
+
+/**
+ * @return length of the value, -ENOENT if the key is unknown
+ */
 int storage_load_config(const char *key, void *data, uint16_t max_len);
 
+/** @brief Write pending binding and config changes now, e.g. before a reboot */
+int storage_flush(void);
+
+void storage_get_stats(struct storage_stats *stats);
+
+/**
+ * @brief Journal one part of a queued job
+ *
+ * NVS appends, so rewriting a part only costs its new length. Unchanged
+ * data is not written again.
+ *
+ * @return flash bytes used, including NVS bookkeeping, or a negative error
+ */
+int storage_save_job(uint8_t slot, enum storage_job_part part, const void *data,
+		     uint16_t len);
+
+/**
+ * @return length of the stored part, which may exceed max_len,
+ *         -ENOENT if there is none
+ */
+ssize_t storage_load_job(uint8_t slot, enum storage_job_part part, void *data,
+			 uint16_t max_len);
+
+/**
+ * @brief Drop both parts of a finished job
+ *
+ * @return flash bytes used (at most), or a negative error
+ */
+int storage_delete_job(uint8_t slot);
+
 #endif /* STORAGE_H */
@@ -0,0 +1,72 @@
+/**
+ * @file ble_mock.c
+ * @brief Radio side of the job executor, for the journal tests
+ */
+
+#include "ble_mock.h"
+#include "connection_manager.h"
+#include "gatt_client.h"
+#include "node_manager.h"
+#include "pawr.h"
+#include <string.h>
+
+struct mock_result mock_results[MOCK_RESULTS_MAX];
+int mock_result_count;
+
+void mock_reset(void)
+{
+	memset(mock_results, 0, sizeof(mock_results));
+	mock_result_count = 0;
+}
+
+int connection_manager_open(const bt_addr_le_t *addr, const struct conn_session_cb *cb,
+			    void *user_data)
+{
+	return -ENOTCONN;
+}
+
+int connection_manager_disconnect(struct bt_conn *conn)
+{
+	return 0;
+}
+
+int gatt_client_write(struct bt_conn *conn, const struct bt_uuid *uuid, const void *data,
+		      uint16_t length, gatt_write_cb_t cb)
+{
+	return -ENOTCONN;
+}
+
+int pawr_send_command(const bt_addr_le_t *addr, enum pawr_command command)
+{
+	return 0;
+}
+
+int node_manager_add_node(const bt_addr_le_t *addr, int8_t rssi, const uint8_t *adv_data,
+			  uint8_t len)
+{
+	return 0;
+}
+
+int node_manager_bind_node(const bt_addr_le_t *addr)
+{
+	return 0;
+}
+
+int node_manager_unbind_node(const bt_addr_le_t *addr)
+{
+	return 0;
+}
+
+int ipc_send_response(uint32_t correlation_id, enum ipc_message_type type,
+		      const uint8_t *payload, uint16_t len)
+{
+	struct mock_result *r;
+
+	if (type != IPC_JOB_RESULT || mock_result_count == MOCK_RESULTS_MAX) {
+		return 0;
+	}
+	r = &mock_results[mock_result_count++];
+	memcpy(&r->res, payload, MIN(len, sizeof(r->res)));
+	r->correlation_id = correlation_id;
+	return 0;
+}
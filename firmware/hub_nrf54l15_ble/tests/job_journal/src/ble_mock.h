@@ -0,0 +1,26 @@
+/**
+ * @file ble_mock.h
+ * @brief Radio side of the job executor, for the journal tests
+ *
+ * Nothing is connected: config pushes fail to open a session, the other
+ * calls succeed. Job results sent to the cellular processor are recorded.
+ */
+
+#ifndef BLE_MOCK_H
+#define BLE_MOCK_H
+
+#include "ipc_handler.h"
+
+#define MOCK_RESULTS_MAX 8
+
+struct mock_result {
+	struct ipc_job_result res;
+	uint32_t correlation_id;
+};
+
+extern struct mock_result mock_results[MOCK_RESULTS_MAX];
+extern int mock_result_count;
+
+void mock_reset(void);
+
+#endif /* BLE_MOCK_H */
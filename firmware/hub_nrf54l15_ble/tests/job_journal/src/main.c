@@ -0,0 +1,153 @@
+/**
+ * @file main.c
+ * @brief Job journal tests
+ *
+ * Fills every batch slot with a 20-node job, lowest priority first, runs a
+ * few nodes and lets their progress reach the journal. Storage and the
+ * executor are then initialized again, as after a watchdog reset. The
+ * restored jobs must run in priority order, config pushes first, and the
+ * nodes that had finished must not run again. Reports the flash bytes
+ * written per job against its size, and the restore time.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include "job_executor.h"
+#include "storage.h"
+#include "ble_mock.h"
+
+#define NODES		20
+#define BODY_LEN	40
+#define RUN_BEFORE	5	/* Nodes finished before the reset */
+
+/* Progress flush period of job_executor.c */
+#define JOURNAL_FLUSH	K_MSEC(10000)
+
+/* Request header and one NVS allocation table entry per write */
+#define JOURNAL_HDR_LEN	12
+#define NVS_ATE_SIZE	8
+
+/* Queued lowest priority first, so arrival and priority order differ */
+static const enum job_type queued[MAX_JOB_BATCHES] = {
+	JOB_PULL_DIAGNOSTICS, JOB_UPDATE_FIRMWARE, JOB_REBOOT_NODE, JOB_PUSH_CONFIG,
+};
+
+static struct ipc_message msg;
+
+static int queue_batch(uint32_t job_id, enum job_type type)
+{
+	struct ipc_job_batch_request hdr = {
+		.job_id = job_id,
+		.type = type,
+		.node_count = NODES,
+	};
+	uint8_t *p = msg.payload;
+
+	memcpy(p, &hdr, sizeof(hdr));
+	p += sizeof(hdr);
+	for (int i = 0; i < NODES; i++) {
+		uint8_t node_id[IPC_NODE_ADDR_LEN] = { 0xc0, 0, 0, 0, job_id, i };
+
+		memcpy(p, node_id, sizeof(node_id));
+		p += sizeof(node_id);
+	}
+	memset(p, type, BODY_LEN);
+	p += BODY_LEN;
+
+	msg.type = IPC_JOB_BATCH_REQUEST;
+	msg.correlation_id = 0x100 + job_id;
+	msg.length = p - msg.payload;
+	return job_executor_queue_ipc(&msg);
+}
+
+static void *setup(void)
+{
+	zassert_ok(storage_init());
+	zassert_ok(job_executor_init());
+	return NULL;
+}
+
+ZTEST(job_journal, test_restore)
+{
+	/*
+	 * Nodes run after the reset when each result goes out: the config push
+	 * had 4 nodes done, diagnostics 1, the others none
+	 */
+	static const int done_after[MAX_JOB_BATCHES] = { 16, 36, 56, 75 };
+	struct job_journal_stats stats;
+	int results_at[MOCK_RESULTS_MAX] = { 0 };
+	int processed = 0;
+	uint32_t per_job;
+
+	for (int i = 0; i < MAX_JOB_BATCHES; i++) {
+		zassert_ok(queue_batch(i + 1, queued[i]));
+	}
+	zassert_equal(queue_batch(MAX_JOB_BATCHES + 1, JOB_PUSH_CONFIG), -ENOMEM);
+	zassert_equal(job_executor_get_pending_count(), MAX_JOB_BATCHES * NODES);
+
+	/*
+	 * Diagnostics arrived first and took every node slot, so one of its
+	 * nodes runs. Each slot freed goes to the config push. Their progress
+	 * reaches the journal.
+	 */
+	for (int i = 0; i < RUN_BEFORE; i++) {
+		zassert_true(job_executor_process() > 0);
+	}
+	k_sleep(JOURNAL_FLUSH);
+	zassert_equal(mock_result_count, 0);
+
+	/* Reset */
+	mock_reset();
+	zassert_ok(storage_init());
+	zassert_ok(job_executor_init());
+
+	job_executor_get_journal_stats(&stats);
+	zassert_equal(stats.restored, MAX_JOB_BATCHES);
+	zassert_equal(job_executor_get_pending_count(), MAX_JOB_BATCHES * NODES - RUN_BEFORE);
+
+	while (job_executor_process() > 0) {
+		processed++;
+		if (mock_result_count > 0 && !results_at[mock_result_count - 1]) {
+			results_at[mock_result_count - 1] = processed;
+		}
+	}
+	zassert_equal(processed, MAX_JOB_BATCHES * NODES - RUN_BEFORE);
+	zassert_equal(mock_result_count, MAX_JOB_BATCHES);
+
+	/* Highest priority first, each job done before the next one starts */
+	for (int i = 0; i < MAX_JOB_BATCHES; i++) {
+		struct mock_result *r = &mock_results[i];
+		uint32_t job_id = MAX_JOB_BATCHES - i;
+
+		zassert_equal(r->res.job_id, job_id, "Result %d is job %u", i, r->res.job_id);
+		zassert_equal(r->correlation_id, 0x100 + job_id);
+		zassert_equal(r->res.succeeded + r->res.failed, NODES);
+		zassert_equal(results_at[i], done_after[i], "Job %u done after %d nodes",
+			      job_id, results_at[i]);
+	}
+
+	/* Nothing left to restore */
+	zassert_ok(job_executor_init());
+	zassert_equal(job_executor_get_pending_count(), 0);
+
+	/*
+	 * A job costs its request once, with a header and an entry, one
+	 * progress write at most here, and the two deletes
+	 */
+	job_executor_get_journal_stats(&stats);
+	zassert_equal(stats.jobs, MAX_JOB_BATCHES);
+	zassert_equal(stats.request_bytes, MAX_JOB_BATCHES *
+		      (NODES * IPC_NODE_ADDR_LEN + BODY_LEN));
+	per_job = stats.flash_bytes / stats.jobs;
+	zassert_true(per_job <= stats.request_bytes / stats.jobs + JOURNAL_HDR_LEN +
+		     5 * NVS_ATE_SIZE + 8 + DIV_ROUND_UP(NODES, 8),
+		     "%u flash bytes per job", per_job);
+
+	TC_PRINT("%u jobs of %u bytes: %u flash bytes per job (%u.%02ux), restored in %u us\n",
+		 stats.jobs, stats.request_bytes / stats.jobs, per_job,
+		 stats.flash_bytes / stats.request_bytes,
+		 stats.flash_bytes * 100 / stats.request_bytes % 100, stats.restore_us);
+}
+
+ZTEST_SUITE(job_journal, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,171 @@
+/**
+ * @file main.c
+ * @brief Storage tests
+ *
+ * Runs storage.c on NVS in native_sim's storage_partition (four 4 KB
+ * sectors). Commissions 50 nodes within one flush window, of which the
+ * table takes STORAGE_MAX_BINDINGS, and checks that the binding table
+ * reaches flash in one write that fits a sector, so no sector is erased
+ * for it. The same sequence with a flush after every save
+ * shows what the table would cost uncoalesced. Storage is then mounted
+ * again to time loading the bindings back, as at boot.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <string.h>
+#include "storage/storage.h"
+
+#define COMMISSIONED	50
+#define NVS_SECTOR_SIZE	4096
+#define NVS_ATE_SIZE	8
+
+/* Binding record header: version, count */
+#define BINDINGS_HDR_LEN	2
+
+/* Time between two nodes being commissioned */
+#define COMMISSION_GAP	K_MSEC(50)
+
+static bt_addr_le_t node_addr(int i)
+{
+	bt_addr_le_t addr = { .type = BT_ADDR_LE_RANDOM };
+
+	addr.a.val[0] = i;
+	addr.a.val[1] = i >> 8;
+	addr.a.val[5] = 0xc0;
+	return addr;
+}
+
+/* Bind COMMISSIONED nodes, the ones past STORAGE_MAX_BINDINGS are refused */
+static void commission(bool flush_each)
+{
+	for (int i = 0; i < COMMISSIONED; i++) {
+		bt_addr_le_t addr = node_addr(i);
+		int err = storage_save_node_binding(&addr);
+
+		zassert_equal(err, i < STORAGE_MAX_BINDINGS ? 0 : -ENOMEM, "Node %d: %d", i, err);
+		if (flush_each) {
+			zassert_ok(storage_flush());
+		} else {
+			k_sleep(COMMISSION_GAP);
+		}
+	}
+}
+
+static void *setup(void)
+{
+	zassert_ok(storage_init());
+	return NULL;
+}
+
+/* No bindings, in RAM and in flash */
+static void before(void *fixture)
+{
+	bt_addr_le_t addrs[STORAGE_MAX_BINDINGS];
+	int count = storage_load_node_bindings(addrs, ARRAY_SIZE(addrs));
+
+	for (int i = 0; i < count; i++) {
+		zassert_ok(storage_delete_node_binding(&addrs[i]));
+	}
+	zassert_ok(storage_flush());
+}
+
+ZTEST(storage, test_commission_coalesced)
+{
+	const uint32_t table_bytes = BINDINGS_HDR_LEN +
+				     STORAGE_MAX_BINDINGS * sizeof(bt_addr_le_t) + NVS_ATE_SIZE;
+	struct storage_stats before;
+	struct storage_stats after;
+
+	storage_get_stats(&before);
+	commission(false);
+
+	/* Still within the window opened by the first node */
+	storage_get_stats(&after);
+	zassert_equal(after.flash_writes, before.flash_writes);
+
+	k_sleep(K_MSEC(STORAGE_FLUSH_MS));
+	storage_get_stats(&after);
+	zassert_equal(after.saves - before.saves, STORAGE_MAX_BINDINGS);
+	zassert_equal(after.flushes - before.flushes, 1);
+	zassert_equal(after.flash_writes - before.flash_writes, 1);
+	zassert_equal(after.flash_bytes - before.flash_bytes, table_bytes);
+	zassert_true(table_bytes < NVS_SECTOR_SIZE, "The table must not fill a sector");
+
+	TC_PRINT("%d nodes commissioned, %u bound: 1 write of %u bytes\n", COMMISSIONED,
+		 STORAGE_MAX_BINDINGS, table_bytes);
+}
+
+ZTEST(storage, test_commission_uncoalesced)
+{
+	struct storage_stats before;
+	struct storage_stats after;
+	uint32_t bytes;
+
+	storage_get_stats(&before);
+	commission(true);
+	storage_get_stats(&after);
+
+	/* One write per node, each rewriting the whole table so far */
+	bytes = after.flash_bytes - before.flash_bytes;
+	zassert_equal(after.flash_writes - before.flash_writes, STORAGE_MAX_BINDINGS);
+	zassert_true(bytes > NVS_SECTOR_SIZE / 2);
+
+	TC_PRINT("Flushed per node: %u writes of %u bytes, %u.%02u sectors\n",
+		 after.flash_writes - before.flash_writes, bytes, bytes / NVS_SECTOR_SIZE,
+		 bytes % NVS_SECTOR_SIZE * 100 / NVS_SECTOR_SIZE);
+}
+
+ZTEST(storage, test_load_bindings)
+{
+	bt_addr_le_t addrs[STORAGE_MAX_BINDINGS];
+	struct storage_stats stats;
+	int count;
+
+	commission(true);
+
+	/* As at boot, the table is read back from NVS */
+	zassert_ok(storage_init());
+	count = storage_load_node_bindings(addrs, ARRAY_SIZE(addrs));
+	zassert_equal(count, STORAGE_MAX_BINDINGS);
+	for (int i = 0; i < count; i++) {
+		bt_addr_le_t addr = node_addr(i);
+
+		zassert_true(bt_addr_le_eq(&addrs[i], &addr), "Binding %d", i);
+	}
+
+	storage_get_stats(&stats);
+	TC_PRINT("%d bindings loaded in %u us\n", count, stats.load_us);
+}
+
+ZTEST(storage, test_config_coalesced)
+{
+	struct storage_stats before;
+	struct storage_stats after;
+	char key[STORAGE_CONFIG_KEY_LEN];
+	uint32_t value;
+
+	storage_get_stats(&before);
+	for (uint32_t round = 0; round < 3; round++) {
+		for (int i = 0; i < STORAGE_MAX_CONFIG; i++) {
+			snprintk(key, sizeof(key), "cfg%d", i);
+			value = round * 100 + i;
+			zassert_ok(storage_save_config(key, &value, sizeof(value)));
+		}
+	}
+
+	/* Saving the value already held is not a change */
+	zassert_ok(storage_save_config("cfg0", &(uint32_t){ 200 }, sizeof(value)));
+	zassert_equal(storage_save_config("one_too_many", &value, sizeof(value)), -ENOMEM);
+
+	k_sleep(K_MSEC(STORAGE_FLUSH_MS));
+	storage_get_stats(&after);
+	zassert_equal(after.saves - before.saves, 3 * STORAGE_MAX_CONFIG);
+	zassert_equal(after.flash_writes - before.flash_writes, STORAGE_MAX_CONFIG);
+
+	zassert_equal(storage_load_config("cfg7", &value, sizeof(value)), sizeof(value));
+	zassert_equal(value, 207);
+	zassert_equal(storage_load_config("missing", &value, sizeof(value)), -ENOENT);
+}
+
+ZTEST_SUITE(storage, NULL, setup, before, NULL, NULL);
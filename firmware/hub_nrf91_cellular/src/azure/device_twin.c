@@ -1,14 +1,800 @@
-/* Device Twin stub implementation */
+/*
+ * Device Twin Implementation
+ *
+ * Reported properties go out as JSON Merge Patches carrying only what
+ * changed since IoT Hub last acknowledged a patch. Each node keeps three
+ * copies of its properties:
+ *
+ *   current  latest state from the BLE processor
+ *   sent     what the patch in flight carries
+ *   acked    what the cloud twin holds, updated on a 2xx response
+ *
+ * A node is dirty while current differs from acked by more than the
+ * field's reporting threshold. reported.nodes is keyed by nodeId, so a
+ * patch touches only the nodes and fields it names. A node the BLE
+ * processor's table no longer holds is sent as null, which removes it
+ * from the twin, and its slot is freed once the patch is acknowledged.
+ *
+ * Desired properties are diffed the same way before they reach the BLE
+ * processor: a job already seen is ignored, and push_node_config is only
+ * forwarded when its payload differs from the last one sent to that node.
+ * A configuration is translated to the node's binary Config encoding here,
+ * once per job, so neither the BLE processor nor the nodes parse JSON.
+ */
 
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/sys/crc.h>
+#include <cJSON.h>
+#include <cJSON_os.h>
 #include "device_twin.h"
+#include "iot_hub_client.h"
+#include "node_config_codec.h"
+#include "ipc/ipc_bridge.h"
+#include "ipc/node_table.h"
 
 LOG_MODULE_REGISTER(device_twin, LOG_LEVEL_INF);
 
-void device_twin_init(void) {
+#define RESPONSE_TIMEOUT_MS 30000
+#define SEEN_JOBS           32
+#define JOB_TIMEOUT_S       300  /* When the job has no timeoutSeconds */
+
+/* Property groups, a group is always sent whole */
+#define FIELD_SEEN    BIT(0)  /* lastSeen + lastReading */
+#define FIELD_BATTERY BIT(1)
+#define FIELD_FAULTS  BIT(2)
+#define FIELD_RSSI    BIT(3)
+#define FIELD_ALL     (FIELD_SEEN | FIELD_BATTERY | FIELD_FAULTS | FIELD_RSSI)
+#define FIELD_GONE    BIT(4)  /* The node itself, sent as null */
+
+struct node_props {
+    uint32_t last_seen;
+    float value;
+    char unit[NODE_UNIT_LEN];
+    uint16_t battery_mv;
+    uint8_t battery_pct;
+    uint8_t faults;
+    int8_t rssi;
+};
+
+struct twin_node {
+    uint8_t node_id[NODE_ADDR_LEN];
+    bool used;
+    bool reported;     /* acked holds real values */
+    bool dirty;
+    bool gone;         /* Dropped from the BLE node table */
+    uint8_t sent_mask; /* Fields in the patch in flight */
+    struct node_props current;
+    struct node_props sent;
+    struct node_props acked;
+    uint32_t config_crc;  /* Last configuration forwarded to the node */
+};
+
+struct json_writer {
+    char *buf;    /* NULL only counts */
+    size_t size;
+    size_t len;
+    bool overflow;
+};
+
+static const char *const fault_names[] = {
+    "sensor_high", "sensor_low", "sensor_disconnected", "adc_saturation",
+    "low_battery", "watchdog_reset",
+};
+
+static struct twin_node nodes[DEVICE_TWIN_MAX_NODES];
+static char patch_buf[DEVICE_TWIN_PATCH_SIZE];
+static uint32_t seen_jobs[SEEN_JOBS];
+static uint8_t seen_jobs_next;
+static uint8_t job_frame[IPC_MAX_PAYLOAD];  /* Too large for the MQTT RX stack */
+static uint8_t config_body[NODE_CONFIG_CODEC_MAX_LEN];
+static int desired_version;
+static bool desired_retry;   /* Something failed to forward, fetch desired again */
+static uint16_t rollup_window_sent;
+static uint8_t pawr_sent;    /* IPC_HUB_PAWR_*, 0 before the first */
+
+static uint32_t next_rid = 1;
+static uint32_t patch_rid;   /* 0 when no patch is in flight */
+static uint32_t get_rid;
+static int64_t patch_sent_at;
+
+static struct device_twin_stats stats;
+static struct k_mutex twin_mutex;
+
+static void json_printf(struct json_writer *w, const char *fmt, ...)
+{
+    va_list ap;
+    int ret;
+
+    va_start(ap, fmt);
+    ret = vsnprintf(w->buf ? w->buf + w->len : NULL, w->buf ? w->size - w->len : 0,
+                    fmt, ap);
+    va_end(ap);
+
+    if (ret < 0 || (w->buf && w->len + ret >= w->size)) {
+        w->overflow = true;
+        return;
+    }
+    w->len += ret;
+}
+
+static void format_time(uint32_t epoch, char *out, size_t size)
+{
+    time_t t = epoch;
+    struct tm tm;
+
+    gmtime_r(&t, &tm);
+    snprintf(out, size, "%04d-%02d-%02dT%02d:%02d:%02dZ", tm.tm_year + 1900,
+             tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+static uint8_t changed_fields(const struct twin_node *node)
+{
+    const struct node_props *cur = &node->current;
+    const struct node_props *ack = &node->acked;
+    uint8_t mask = 0;
+
+    if (node->gone) {
+        return FIELD_GONE;
+    }
+    if (!node->reported) {
+        return FIELD_ALL;
+    }
+    if (cur->last_seen - ack->last_seen >= DEVICE_TWIN_LAST_SEEN_S ||
+        strncmp(cur->unit, ack->unit, NODE_UNIT_LEN) != 0) {
+        mask |= FIELD_SEEN;
+    }
+    if (abs(cur->battery_mv - ack->battery_mv) >= DEVICE_TWIN_BATTERY_MV ||
+        cur->battery_pct != ack->battery_pct) {
+        mask |= FIELD_BATTERY;
+    }
+    if (cur->faults != ack->faults) {
+        mask |= FIELD_FAULTS;
+    }
+    if (abs(cur->rssi - ack->rssi) >= DEVICE_TWIN_RSSI_DB) {
+        mask |= FIELD_RSSI;
+    }
+    return mask;
+}
+
+static void apply_fields(struct node_props *dst, const struct node_props *src, uint8_t mask)
+{
+    if (mask & FIELD_SEEN) {
+        dst->last_seen = src->last_seen;
+        dst->value = src->value;
+        memcpy(dst->unit, src->unit, sizeof(dst->unit));
+    }
+    if (mask & FIELD_BATTERY) {
+        dst->battery_mv = src->battery_mv;
+        dst->battery_pct = src->battery_pct;
+    }
+    if (mask & FIELD_FAULTS) {
+        dst->faults = src->faults;
+    }
+    if (mask & FIELD_RSSI) {
+        dst->rssi = src->rssi;
+    }
+}
+
+/* "AA:BB:CC:DD:EE:FF":{...} with the requested fields */
+static void write_node(struct json_writer *w, const uint8_t *id,
+                       const struct node_props *p, uint8_t mask)
+{
+    char ts[24];
+    char unit[NODE_UNIT_LEN + 1];
+    const char *sep = "";
+
+    json_printf(w, "\"%02X:%02X:%02X:%02X:%02X:%02X\":",
+                id[0], id[1], id[2], id[3], id[4], id[5]);
+    if (mask & FIELD_GONE) {
+        json_printf(w, "null");
+        return;
+    }
+    json_printf(w, "{");
+
+    if (mask & FIELD_SEEN) {
+        /* Units are short ASCII tags, drop anything that needs escaping */
+        size_t n = 0;
+
+        for (size_t i = 0; i < NODE_UNIT_LEN && p->unit[i]; i++) {
+            if (p->unit[i] >= 0x20 && p->unit[i] != '"' && p->unit[i] != '\\') {
+                unit[n++] = p->unit[i];
+            }
+        }
+        unit[n] = '\0';
+
+        format_time(p->last_seen, ts, sizeof(ts));
+        json_printf(w, "\"lastSeen\":\"%s\",\"lastReading\":{\"value\":%.7g,"
+                    "\"unit\":\"%s\",\"timestamp\":\"%s\"}",
+                    ts, (double)p->value, unit, ts);
+        sep = ",";
+    }
+    if (mask & FIELD_BATTERY) {
+        json_printf(w, "%s\"batteryMv\":%u,\"batteryPercent\":%u",
+                    sep, p->battery_mv, p->battery_pct);
+        sep = ",";
+    }
+    if (mask & FIELD_FAULTS) {
+        const char *item_sep = "";
+
+        json_printf(w, "%s\"faults\":[", sep);
+        for (size_t bit = 0; bit < ARRAY_SIZE(fault_names); bit++) {
+            if (p->faults & BIT(bit)) {
+                json_printf(w, "%s\"%s\"", item_sep, fault_names[bit]);
+                item_sep = ",";
+            }
+        }
+        json_printf(w, "]");
+        sep = ",";
+    }
+    if (mask & FIELD_RSSI) {
+        json_printf(w, "%s\"rssi\":%d", sep, p->rssi);
+    }
+
+    json_printf(w, "}");
+}
+
+/* Size of the full reported document, the baseline for stats */
+static size_t full_document_size(void)
+{
+    struct json_writer w = { 0 };
+    const char *sep = "";
+
+    json_printf(&w, "{\"schemaVersion\":\"1.0.0\",\"nodes\":{");
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        if (nodes[i].used && !nodes[i].gone) {
+            json_printf(&w, "%s", sep);
+            write_node(&w, nodes[i].node_id, &nodes[i].current, FIELD_ALL);
+            sep = ",";
+        }
+    }
+    json_printf(&w, "}}");
+    return w.len;
+}
+
+/* Fill patch_buf with dirty nodes, as many as fit */
+static size_t build_patch(void)
+{
+    struct json_writer w = { .buf = patch_buf, .size = sizeof(patch_buf) };
+    size_t closing = strlen("}}");
+    int count = 0;
+
+    json_printf(&w, "{\"nodes\":{");
+
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        struct twin_node *node = &nodes[i];
+        size_t mark = w.len;
+        uint8_t mask;
+
+        if (!node->used || !node->dirty) {
+            continue;
+        }
+
+        mask = changed_fields(node);
+        if (!mask) {
+            node->dirty = false;
+            continue;
+        }
+
+        w.size = sizeof(patch_buf) - closing;
+        json_printf(&w, "%s", count ? "," : "");
+        write_node(&w, node->node_id, &node->current, mask);
+        if (w.overflow) {
+            /* Out of room, the rest go in the next sync */
+            w.len = mark;
+            break;
+        }
+
+        node->sent = node->current;
+        node->sent_mask = mask;
+        count++;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    w.size = sizeof(patch_buf);
+    w.overflow = false;
+    json_printf(&w, "}}");
+    return w.len;
+}
+
+static void patch_done(bool accepted)
+{
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        struct twin_node *node = &nodes[i];
+
+        if (!node->sent_mask) {
+            continue;
+        }
+        if (accepted && (node->sent_mask & FIELD_GONE)) {
+            if (node->gone) {
+                node->used = false;
+                continue;
+            }
+            /* Heard again meanwhile, the twin no longer has any of it */
+            node->reported = false;
+        } else if (accepted) {
+            apply_fields(&node->acked, &node->sent, node->sent_mask);
+            node->reported = true;
+        }
+        node->sent_mask = 0;
+        node->dirty = changed_fields(node) != 0;
+    }
+    patch_rid = 0;
+}
+
+static struct twin_node *find_node(const uint8_t *node_id, bool create)
+{
+    struct twin_node *free_slot = NULL;
+
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        if (!nodes[i].used) {
+            free_slot = free_slot ? free_slot : &nodes[i];
+        } else if (memcmp(nodes[i].node_id, node_id, NODE_ADDR_LEN) == 0) {
+            return &nodes[i];
+        }
+    }
+
+    if (!create || !free_slot) {
+        return NULL;
+    }
+
+    memset(free_slot, 0, sizeof(*free_slot));
+    memcpy(free_slot->node_id, node_id, NODE_ADDR_LEN);
+    free_slot->used = true;
+    return free_slot;
+}
+
+static bool parse_node_id(const char *str, uint8_t *node_id)
+{
+    return str && sscanf(str, "%2hhx:%2hhx:%2hhx:%2hhx:%2hhx:%2hhx",
+                         &node_id[0], &node_id[1], &node_id[2],
+                         &node_id[3], &node_id[4], &node_id[5]) == NODE_ADDR_LEN;
+}
+
+static int job_type_from_string(const char *type)
+{
+    if (!type) {
+        return -EINVAL;
+    } else if (strcmp(type, "push_node_config") == 0) {
+        return IPC_JOB_PUSH_CONFIG;
+    } else if (strcmp(type, "pull_node_diagnostics") == 0) {
+        return IPC_JOB_PULL_DIAGNOSTICS;
+    } else if (strcmp(type, "sample_node") == 0) {
+        return IPC_JOB_SAMPLE_NODE;
+    } else if (strcmp(type, "bind_node") == 0) {
+        return IPC_JOB_BIND_NODE;
+    } else if (strcmp(type, "unbind_node") == 0) {
+        return IPC_JOB_UNBIND_NODE;
+    }
+    return -ENOTSUP; /* Hub-level jobs are not executed by the BLE side */
+}
+
+/* Let the next push of this configuration through to the nodes given it */
+static void forget_config(uint32_t config_crc)
+{
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        if (nodes[i].used && nodes[i].config_crc == config_crc) {
+            nodes[i].config_crc = 0;
+        }
+    }
+}
+
+/* Job result from the BLE processor, user_data is the CRC of a config push */
+static void job_done(uint32_t correlation_id, int result,
+                     const uint8_t *payload, uint16_t len, void *user_data)
+{
+    struct ipc_job_result res = { .result = result };
+
+    if (result == 0 && len >= sizeof(res)) {
+        memcpy(&res, payload, sizeof(res));
+    }
+    if (res.result == 0) {
+        return;
+    }
+
+    LOG_WRN("Job %08x failed on %u of %u nodes: %d", res.job_id, res.failed,
+            res.succeeded + res.failed, res.result);
+
+    /* Which nodes missed it is not reported, so re-allow the push for all */
+    if (user_data) {
+        k_mutex_lock(&twin_mutex, K_FOREVER);
+        forget_config(POINTER_TO_UINT(user_data));
+        k_mutex_unlock(&twin_mutex);
+    }
+}
+
+static bool job_seen(uint32_t job_hash)
+{
+    for (int i = 0; i < SEEN_JOBS; i++) {
+        if (seen_jobs[i] == job_hash) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void job_mark_seen(uint32_t job_hash)
+{
+    seen_jobs[seen_jobs_next] = job_hash;
+    seen_jobs_next = (seen_jobs_next + 1) % SEEN_JOBS;
+}
+
+/*
+ * Add one target to the batch in job_frame. A node that already has this
+ * configuration is left out. Targets are looked up, not added: a node
+ * enters the reported document only once it has reported itself.
+ */
+static bool batch_add_target(const char *target, size_t *count, bool push_config,
+                             uint32_t body_crc)
+{
+    uint8_t node_id[NODE_ADDR_LEN];
+    struct twin_node *node;
+
+    if (!parse_node_id(target, node_id)) {
+        return false;
+    }
+
+    node = find_node(node_id, false);
+    if (push_config && node) {
+        if (node->config_crc == body_crc) {
+            stats.jobs_skipped++;
+            return false;
+        }
+        node->config_crc = body_crc;
+    }
+
+    memcpy(job_frame + sizeof(struct ipc_job_batch_request) + *count * NODE_ADDR_LEN,
+           node_id, NODE_ADDR_LEN);
+    (*count)++;
+    return true;
+}
+
+/* Move the body behind the target list and hand the batch to the BLE side */
+static int batch_send(struct ipc_job_batch_request *hdr, size_t count, const uint8_t *body,
+                      size_t body_len, uint32_t timeout_s, void *user_data)
+{
+    size_t ids_end = sizeof(*hdr) + count * NODE_ADDR_LEN;
+
+    hdr->node_count = count;
+    memcpy(job_frame, hdr, sizeof(*hdr));
+    memcpy(job_frame + ids_end, body, body_len);
+
+    return ipc_bridge_request(IPC_JOB_BATCH_REQUEST, job_frame, ids_end + body_len,
+                              timeout_s, job_done, user_data);
+}
+
+/*
+ * Forward a desired job to the BLE processor. All targets share one copy
+ * of the body; the targets of one job go out in as few frames as fit.
+ */
+static void handle_job(const cJSON *job)
+{
+    const char *job_id = cJSON_GetStringValue(cJSON_GetObjectItem(job, "jobId"));
+    const cJSON *payload = cJSON_GetObjectItem(job, "payload");
+    const cJSON *timeout = cJSON_GetObjectItem(job, "timeoutSeconds");
+    const cJSON *targets = cJSON_GetObjectItem(job, "targetNodeIds");
+    const cJSON *target;
+    struct ipc_job_batch_request hdr;
+    const uint8_t *body = NULL;
+    char *json = NULL;
+    size_t body_len = 0;
+    size_t max_targets;
+    size_t count = 0;
+    uint32_t body_crc;
+    uint32_t timeout_s;
+    bool push_config;
+    void *user_data;
+    int err = 0;
+    int type;
+
+    type = job_type_from_string(cJSON_GetStringValue(cJSON_GetObjectItem(job, "type")));
+    if (!job_id || type < 0) {
+        return;
+    }
+
+    hdr.job_id = crc32_ieee((const uint8_t *)job_id, strlen(job_id));
+    hdr.type = type;
+    if (job_seen(hdr.job_id)) {
+        stats.jobs_skipped++;
+        return;
+    }
+
+    push_config = type == IPC_JOB_PUSH_CONFIG;
+    if (push_config) {
+        err = node_config_codec_encode(payload, config_body, sizeof(config_body));
+        if (err < 0) {
+            /* Retrying cannot help, drop the job for good */
+            LOG_ERR("Job %s configuration not encodable: %d", job_id, err);
+            job_mark_seen(hdr.job_id);
+            return;
+        }
+        body = config_body;
+        body_len = err;
+        err = 0;
+    } else if (payload) {
+        json = cJSON_PrintUnformatted(payload);
+        body = (const uint8_t *)json;
+        body_len = json ? strlen(json) : 0;
+    }
+    if (sizeof(hdr) + NODE_ADDR_LEN + body_len > sizeof(job_frame)) {
+        LOG_ERR("Job %s payload too large (%zu bytes)", job_id, body_len);
+        job_mark_seen(hdr.job_id);
+        goto out;
+    }
+
+    max_targets = (sizeof(job_frame) - sizeof(hdr) - body_len) / NODE_ADDR_LEN;
+    body_crc = crc32_ieee(body, body_len);
+    user_data = push_config ? UINT_TO_POINTER(body_crc) : NULL;
+    timeout_s = cJSON_IsNumber(timeout) && timeout->valueint > 0 ? timeout->valueint
+                                                                  : JOB_TIMEOUT_S;
+
+    /* targetNodeIds fans one job out to many nodes, targetNodeId names one */
+    if (cJSON_IsArray(targets)) {
+        cJSON_ArrayForEach(target, targets) {
+            batch_add_target(cJSON_GetStringValue(target), &count, push_config, body_crc);
+            if (count == max_targets) {
+                err = batch_send(&hdr, count, body, body_len, timeout_s, user_data);
+                if (err) {
+                    break;
+                }
+                stats.jobs_forwarded++;
+                count = 0;
+            }
+        }
+    } else {
+        batch_add_target(cJSON_GetStringValue(cJSON_GetObjectItem(job, "targetNodeId")),
+                         &count, push_config, body_crc);
+    }
+
+    if (!err && count > 0) {
+        err = batch_send(&hdr, count, body, body_len, timeout_s, user_data);
+        if (!err) {
+            stats.jobs_forwarded++;
+        }
+    }
+    if (err) {
+        /* Not marked seen, so the next sync fetches desired and retries it */
+        LOG_ERR("Job %s not forwarded: %d", job_id, err);
+        desired_retry = true;
+        if (push_config) {
+            forget_config(body_crc);
+        }
+    } else {
+        job_mark_seen(hdr.job_id);
+    }
+
+out:
+    cJSON_free(json);
+}
+
+/* Hub settings for the BLE processor, forwarded when they change */
+static void handle_policies(const cJSON *policies)
+{
+    const cJSON *window = cJSON_GetObjectItem(policies, "rollupWindowSeconds");
+    const cJSON *pawr = cJSON_GetObjectItem(policies, "pawrEnabled");
+    struct ipc_hub_config cfg = { 0 };
+    int err;
+
+    if (cJSON_IsNumber(window) && window->valueint > 0 && window->valueint <= UINT16_MAX &&
+        window->valueint != rollup_window_sent) {
+        cfg.rollup_window_s = window->valueint;
+    }
+    if (cJSON_IsBool(pawr)) {
+        cfg.pawr = cJSON_IsTrue(pawr) ? IPC_HUB_PAWR_ON : IPC_HUB_PAWR_OFF;
+        cfg.pawr = cfg.pawr != pawr_sent ? cfg.pawr : 0;
+    }
+    if (!cfg.rollup_window_s && !cfg.pawr) {
+        return;
+    }
+
+    err = ipc_bridge_send(IPC_TWIN_UPDATE, &cfg, sizeof(cfg));
+    if (err) {
+        LOG_ERR("Hub config not forwarded: %d", err);
+        desired_retry = true;
+        return;
+    }
+    rollup_window_sent = cfg.rollup_window_s ? cfg.rollup_window_s : rollup_window_sent;
+    pawr_sent = cfg.pawr ? cfg.pawr : pawr_sent;
+}
+
+static void handle_desired(const cJSON *desired)
+{
+    const cJSON *version = cJSON_GetObjectItem(desired, "$version");
+    const cJSON *job;
+
+    /* Replayed or out-of-date patch */
+    if (cJSON_IsNumber(version)) {
+        if (version->valueint <= desired_version) {
+            return;
+        }
+        desired_version = version->valueint;
+    }
+
+    handle_policies(cJSON_GetObjectItem(desired, "policies"));
+
+    cJSON_ArrayForEach(job, cJSON_GetObjectItem(desired, "jobs")) {
+        handle_job(job);
+    }
+}
+
+static void handle_twin_json(const char *data, size_t len, const char *member)
+{
+    cJSON *root = cJSON_ParseWithLength(data, len);
+
+    if (!root) {
+        LOG_ERR("Invalid twin JSON");
+        return;
+    }
+
+    handle_desired(member ? cJSON_GetObjectItem(root, member) : root);
+    cJSON_Delete(root);
+}
+
+/* Mark nodes the BLE processor has dropped, the next patch removes them */
+static void drop_gone_nodes(void)
+{
+    struct ipc_node_entry entry;
+
+    for (int i = 0; i < DEVICE_TWIN_MAX_NODES; i++) {
+        struct twin_node *node = &nodes[i];
+
+        if (!node->used || node->gone ||
+            node_table_get(node->node_id, &entry) != -ENOENT) {
+            continue;
+        }
+        if (!node->reported) {
+            /* Never made it to the twin */
+            node->used = false;
+            continue;
+        }
+        node->gone = true;
+        node->dirty = true;
+    }
+}
+
+static void iot_hub_event_handler(const struct iot_hub_evt *evt)
+{
+    k_mutex_lock(&twin_mutex, K_FOREVER);
+
+    switch (evt->type) {
+    case IOT_HUB_EVT_CONNECTED:
+        /* Pick up desired changes made while offline */
+        get_rid = next_rid++;
+        iot_hub_twin_get(get_rid);
+        break;
+
+    case IOT_HUB_EVT_DISCONNECTED:
+        if (patch_rid) {
+            patch_done(false);
+        }
+        break;
+
+    case IOT_HUB_EVT_TWIN_RESPONSE:
+        if (evt->request_id == patch_rid) {
+            bool accepted = evt->result >= 200 && evt->result < 300;
+
+            if (!accepted) {
+                LOG_WRN("Reported patch rejected: %d", evt->result);
+                stats.rejected++;
+            }
+            patch_done(accepted);
+        } else if (evt->request_id == get_rid && evt->result == 200) {
+            handle_twin_json(evt->data, evt->data_len, "desired");
+        }
+        break;
+
+    case IOT_HUB_EVT_TWIN_DESIRED:
+        handle_twin_json(evt->data, evt->data_len, NULL);
+        break;
+
+    default:
+        break;
+    }
+
+    k_mutex_unlock(&twin_mutex);
+}
+
+int device_twin_init(void)
+{
+    k_mutex_init(&twin_mutex);
+    cJSON_Init();
+
     LOG_INF("Device Twin initialized");
+    return iot_hub_add_event_handler(iot_hub_event_handler);
+}
+
+void device_twin_update_node(const struct node_telemetry *rec)
+{
+    struct twin_node *node;
+
+    k_mutex_lock(&twin_mutex, K_FOREVER);
+
+    node = find_node(rec->node_id, true);
+    if (!node) {
+        k_mutex_unlock(&twin_mutex);
+        LOG_WRN("Twin shadow full");
+        return;
+    }
+
+    node->gone = false;
+    node->current = (struct node_props){
+        .last_seen = rec->timestamp,
+        .value = rec->value,
+        .battery_mv = rec->battery_mv,
+        .battery_pct = rec->battery_pct,
+        .faults = rec->faults,
+        .rssi = rec->rssi,
+    };
+    memcpy(node->current.unit, rec->unit, NODE_UNIT_LEN);
+    node->dirty = changed_fields(node) != 0;
+
+    k_mutex_unlock(&twin_mutex);
+}
+
+void device_twin_sync(void)
+{
+    size_t len;
+    uint32_t rid;
+
+    k_mutex_lock(&twin_mutex, K_FOREVER);
+
+    if (!iot_hub_is_connected()) {
+        goto out;
+    }
+
+    if (desired_retry) {
+        /* Same $version again, jobs already forwarded are skipped as seen */
+        desired_retry = false;
+        desired_version = 0;
+        get_rid = next_rid++;
+        iot_hub_twin_get(get_rid);
+    }
+
+    if (patch_rid) {
+        if (k_uptime_get() - patch_sent_at < RESPONSE_TIMEOUT_MS) {
+            goto out;
+        }
+        LOG_WRN("Reported patch %u timed out", patch_rid);
+        patch_done(false);
+    }
+
+    drop_gone_nodes();
+
+    stats.syncs++;
+    stats.full_bytes += full_document_size();
+
+    len = build_patch();
+    if (len == 0) {
+        goto out;
+    }
+
+    rid = next_rid++;
+    if (iot_hub_twin_report(patch_buf, len, rid) < 0) {
+        patch_done(false);
+        goto out;
+    }
+
+    patch_rid = rid;
+    patch_sent_at = k_uptime_get();
+    stats.patches++;
+    stats.patch_bytes += len;
+    LOG_INF("Reported patch %u: %zu bytes", rid, len);
+
+out:
+    k_mutex_unlock(&twin_mutex);
 }
 
-void device_twin_sync(void) {
-    LOG_INF("Syncing Device Twin");
+void device_twin_get_stats(struct device_twin_stats *out)
+{
+    k_mutex_lock(&twin_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&twin_mutex);
 }
@@ -1,9 +1,43 @@
-/* Device Twin stub */
+/*
+ * Device Twin
+ * Incremental reported properties and desired-property handling
+ */
 
 #ifndef DEVICE_TWIN_H
 #define DEVICE_TWIN_H
 
-void device_twin_init(void);
+#include <stdint.h>
+#include "telemetry_codec.h"
+
+#define DEVICE_TWIN_MAX_NODES   100   /* Twin contract limit per hub */
+#define DEVICE_TWIN_PATCH_SIZE  2048  /* Largest reported patch per sync */
+
+/* Reporting thresholds, smaller changes wait for the next real one */
+#define DEVICE_TWIN_LAST_SEEN_S    900  /* lastSeen / lastReading refresh */
+#define DEVICE_TWIN_BATTERY_MV     50
+#define DEVICE_TWIN_RSSI_DB        6
+
+struct device_twin_stats {
+    uint32_t syncs;
+    uint32_t patches;
+    uint32_t patch_bytes;    /* Reported bytes actually sent */
+    uint32_t full_bytes;     /* What full-document syncs would have sent */
+    uint32_t rejected;
+    uint32_t jobs_forwarded;
+    uint32_t jobs_skipped;   /* Already seen or no change for the node */
+};
+
+int device_twin_init(void);
+
+/**
+ * Send a reported-properties patch with the nodes that changed since the
+ * last acknowledged patch. Runs as an uplink scheduler task.
+ */
 void device_twin_sync(void);
 
-#endif
+/* Feed the shadow with the latest state of a node */
+void device_twin_update_node(const struct node_telemetry *rec);
+
+void device_twin_get_stats(struct device_twin_stats *stats);
+
+#endif /* DEVICE_TWIN_H */
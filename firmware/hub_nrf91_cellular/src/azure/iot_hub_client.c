@@ -1,24 +1,528 @@
-/* Azure IoT Hub Client stub implementation */
+/*
+ * Azure IoT Hub Client Implementation
+ */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/net/socket.h>
+#include <date_time.h>
 #include "iot_hub_client.h"
+#include "provisioning.h"
 
 LOG_MODULE_REGISTER(iot_hub, LOG_LEVEL_INF);
 
-int iot_hub_connect(void) {
+#define IOT_HUB_PORT        8883
+#define IOT_HUB_API_VERSION "api-version=2020-09-30"
+
+#define CONNACK_TIMEOUT_MS  10000
+#define MQTT_BUF_SIZE       256
+
+/* Traffic within this window already counts as a keepalive */
+#define HEARTBEAT_IDLE_MS   60000
+
+#define MQTT_RX_STACK_SIZE  4096  /* Twin handlers parse JSON on this thread */
+#define MQTT_RX_PRIORITY    K_PRIO_PREEMPT(5)
+
+/* Identity comes from the DPS assignment, see provisioning.c */
+#define USER_NAME_FMT        "%s/%s/?" IOT_HUB_API_VERSION
+#define TELEMETRY_TOPIC_CBOR "devices/%s/messages/events/$.ct=application%%2Fcbor"
+#define TELEMETRY_TOPIC_JSON \
+    "devices/%s/messages/events/$.ct=application%%2Fjson&$.ce=utf-8"
+#define TELEMETRY_TOPIC_LEN  (PROVISIONING_DEVICE_ID_LEN + 64)
+#define USER_NAME_LEN \
+    (PROVISIONING_HOSTNAME_LEN + PROVISIONING_DEVICE_ID_LEN + sizeof(IOT_HUB_API_VERSION) + 2)
+
+/* CONNACK codes meaning the hub does not accept this device identity */
+#define CONNACK_IDENTIFIER_REJECTED 2
+#define CONNACK_BAD_CREDENTIALS     4
+#define CONNACK_NOT_AUTHORIZED      5
+
+#define TWIN_RES_PREFIX      "$iothub/twin/res/"
+#define TWIN_DESIRED_PREFIX  "$iothub/twin/PATCH/properties/desired/"
+#define TWIN_GET_TOPIC       "$iothub/twin/GET/?$rid=%u"
+#define TWIN_REPORTED_TOPIC  "$iothub/twin/PATCH/properties/reported/?$rid=%u"
+#define TWIN_TOPIC_LEN       64
+
+static struct mqtt_client client;
+static struct sockaddr_storage broker;
+static uint8_t mqtt_rx_buf[MQTT_BUF_SIZE];
+static uint8_t mqtt_tx_buf[MQTT_BUF_SIZE];
+static char rx_payload[IOT_HUB_RX_PAYLOAD_SIZE + 1];
+static sec_tag_t sec_tags[] = { CONFIG_AZURE_IOT_HUB_SEC_TAG };
+
+static const struct provisioning_assignment *identity;
+static char user_name_buf[USER_NAME_LEN];
+static struct mqtt_utf8 user_name;
+static char topic_cbor[TELEMETRY_TOPIC_LEN];
+static char topic_json[TELEMETRY_TOPIC_LEN];
+
+/* Resolved once per hub, a failed connect resolves again */
+static char broker_host[PROVISIONING_HOSTNAME_LEN];
+static bool broker_cached;
+
+static bool connected;
+static int connack_result;
+static bool first_puback_seen;
+static uint16_t next_message_id = 1;  /* Under publish_mutex */
+static iot_hub_evt_handler_t evt_handlers[IOT_HUB_MAX_EVT_HANDLERS];
+
+/* Given once per connection to start the RX thread on the new socket */
+static K_SEM_DEFINE(rx_start, 0, 1);
+
+/*
+ * Publishes come from the main thread, the system work queue and the MQTT
+ * RX thread. The id is allocated and sent under one lock, so no two
+ * messages share an id and PUBACKs match the right batch.
+ */
+static K_MUTEX_DEFINE(publish_mutex);
+
+/* Message id 0 is reserved by MQTT */
+static uint16_t alloc_message_id(void)
+{
+    uint16_t id = next_message_id;
+
+    if (++next_message_id == 0) {
+        next_message_id = 1;
+    }
+    return id;
+}
+
+static void notify(const struct iot_hub_evt *evt)
+{
+    for (int i = 0; i < IOT_HUB_MAX_EVT_HANDLERS; i++) {
+        if (evt_handlers[i]) {
+            evt_handlers[i](evt);
+        }
+    }
+}
+
+uint32_t iot_hub_epoch_seconds(void)
+{
+    int64_t now_ms;
+
+    if (date_time_now(&now_ms) != 0) {
+        return 0; /* Network time not known yet */
+    }
+    return (uint32_t)(now_ms / MSEC_PER_SEC);
+}
+
+static bool topic_starts_with(const struct mqtt_utf8 *topic, const char *prefix)
+{
+    size_t len = strlen(prefix);
+
+    return topic->size >= len && memcmp(topic->utf8, prefix, len) == 0;
+}
+
+/* Parse "$iothub/twin/res/{status}/?$rid={rid}..." */
+static void parse_twin_response(const struct mqtt_utf8 *topic, struct iot_hub_evt *evt)
+{
+    char buf[TWIN_TOPIC_LEN];
+    size_t len = MIN(topic->size, sizeof(buf) - 1);
+    const char *rid;
+
+    memcpy(buf, topic->utf8, len);
+    buf[len] = '\0';
+
+    evt->result = strtol(buf + strlen(TWIN_RES_PREFIX), NULL, 10);
+    rid = strstr(buf, "$rid=");
+    evt->request_id = rid ? strtoul(rid + strlen("$rid="), NULL, 10) : 0;
+}
+
+/* Read the payload, twin topics are forwarded to the event handlers */
+static void handle_publish(const struct mqtt_publish_param *pub)
+{
+    const struct mqtt_utf8 *topic = &pub->message.topic.topic;
+    size_t total = pub->message.payload.len;
+    size_t received = 0;
+    struct iot_hub_evt hub_evt = { 0 };
+
+    /* An oversized payload is drained into the last chunk and dropped */
+    while (received < total) {
+        size_t offset = MIN(received, IOT_HUB_RX_PAYLOAD_SIZE - MQTT_BUF_SIZE);
+        int ret = mqtt_read_publish_payload_blocking(&client, rx_payload + offset,
+                                                     MIN(total - received, MQTT_BUF_SIZE));
+        if (ret <= 0) {
+            break;
+        }
+        received += ret;
+    }
+
+    if (pub->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+        struct mqtt_puback_param ack = { .message_id = pub->message_id };
+
+        mqtt_publish_qos1_ack(&client, &ack);
+    }
+
+    if (received != total || total > IOT_HUB_RX_PAYLOAD_SIZE) {
+        LOG_ERR("Dropped %zu byte cloud-to-device message", total);
+        return;
+    }
+    rx_payload[total] = '\0';
+
+    if (topic_starts_with(topic, TWIN_RES_PREFIX)) {
+        hub_evt.type = IOT_HUB_EVT_TWIN_RESPONSE;
+        parse_twin_response(topic, &hub_evt);
+    } else if (topic_starts_with(topic, TWIN_DESIRED_PREFIX)) {
+        hub_evt.type = IOT_HUB_EVT_TWIN_DESIRED;
+    } else {
+        return; /* Cloud-to-device messages are not handled yet */
+    }
+
+    hub_evt.data = rx_payload;
+    hub_evt.data_len = total;
+    notify(&hub_evt);
+}
+
+static int subscribe_twin(void)
+{
+    struct mqtt_topic topics[] = {
+        {
+            .topic = { .utf8 = (const uint8_t *)TWIN_RES_PREFIX "#",
+                       .size = sizeof(TWIN_RES_PREFIX "#") - 1 },
+            .qos = MQTT_QOS_0_AT_MOST_ONCE,
+        },
+        {
+            .topic = { .utf8 = (const uint8_t *)TWIN_DESIRED_PREFIX "#",
+                       .size = sizeof(TWIN_DESIRED_PREFIX "#") - 1 },
+            .qos = MQTT_QOS_0_AT_MOST_ONCE,
+        },
+    };
+    struct mqtt_subscription_list list = {
+        .list = topics,
+        .list_count = ARRAY_SIZE(topics),
+    };
+    int err;
+
+    k_mutex_lock(&publish_mutex, K_FOREVER);
+    list.message_id = alloc_message_id();
+    err = mqtt_subscribe(&client, &list);
+    k_mutex_unlock(&publish_mutex);
+
+    return err;
+}
+
+static void mqtt_evt_handler(struct mqtt_client *const c, const struct mqtt_evt *evt)
+{
+    struct iot_hub_evt hub_evt = { 0 };
+
+    switch (evt->type) {
+    case MQTT_EVT_CONNACK:
+        if (evt->result != 0) {
+            LOG_ERR("IoT Hub rejected connection: %d", evt->result);
+            connack_result = evt->result;
+            return;
+        }
+        connected = true;
+        /* A resumed session still holds the twin subscriptions */
+        if (!evt->param.connack.session_present_flag && subscribe_twin() != 0) {
+            LOG_WRN("Twin subscription failed");
+        }
+        hub_evt.type = IOT_HUB_EVT_CONNECTED;
+        notify(&hub_evt);
+        break;
+
+    case MQTT_EVT_DISCONNECT:
+        LOG_WRN("IoT Hub disconnected: %d", evt->result);
+        connected = false;
+        hub_evt.type = IOT_HUB_EVT_DISCONNECTED;
+        hub_evt.result = evt->result;
+        notify(&hub_evt);
+        break;
+
+    case MQTT_EVT_PUBACK:
+        if (!first_puback_seen) {
+            first_puback_seen = true;
+            LOG_INF("First publish acknowledged %lld ms after boot",
+                    (long long)k_uptime_get());
+        }
+        hub_evt.type = IOT_HUB_EVT_PUBACK;
+        hub_evt.message_id = evt->param.puback.message_id;
+        hub_evt.result = evt->result;
+        notify(&hub_evt);
+        break;
+
+    case MQTT_EVT_PUBLISH:
+        handle_publish(&evt->param.publish);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static int broker_resolve(const char *hostname)
+{
+    struct zsock_addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct zsock_addrinfo *result;
+    struct sockaddr_in *broker4 = (struct sockaddr_in *)&broker;
+    int err;
+
+    if (broker_cached && strcmp(broker_host, hostname) == 0) {
+        return 0;
+    }
+
+    err = zsock_getaddrinfo(hostname, NULL, &hints, &result);
+    if (err) {
+        LOG_ERR("Failed to resolve %s: %d", hostname, err);
+        return -EHOSTUNREACH;
+    }
+
+    broker4->sin_family = AF_INET;
+    broker4->sin_port = htons(IOT_HUB_PORT);
+    broker4->sin_addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr;
+
+    zsock_freeaddrinfo(result);
+
+    strncpy(broker_host, hostname, sizeof(broker_host) - 1);
+    broker_cached = true;
+    return 0;
+}
+
+/* Build the credentials and topics that carry the device identity */
+static void identity_setup(void)
+{
+    identity = provisioning_get_assignment();
+
+    snprintf(user_name_buf, sizeof(user_name_buf), USER_NAME_FMT,
+             identity->hostname, identity->device_id);
+    user_name.utf8 = (const uint8_t *)user_name_buf;
+    user_name.size = strlen(user_name_buf);
+
+    snprintf(topic_cbor, sizeof(topic_cbor), TELEMETRY_TOPIC_CBOR, identity->device_id);
+    snprintf(topic_json, sizeof(topic_json), TELEMETRY_TOPIC_JSON, identity->device_id);
+}
+
+static void client_setup(void)
+{
+    struct mqtt_sec_config *tls = &client.transport.tls.config;
+
+    mqtt_client_init(&client);
+
+    client.broker = &broker;
+    client.evt_cb = mqtt_evt_handler;
+    client.client_id.utf8 = (const uint8_t *)identity->device_id;
+    client.client_id.size = strlen(identity->device_id);
+    client.user_name = &user_name;
+    client.password = NULL; /* X.509 authentication */
+    client.protocol_version = MQTT_VERSION_3_1_1;
+    client.clean_session = 0; /* Keep subscriptions across reconnects */
+    client.rx_buf = mqtt_rx_buf;
+    client.rx_buf_size = sizeof(mqtt_rx_buf);
+    client.tx_buf = mqtt_tx_buf;
+    client.tx_buf_size = sizeof(mqtt_tx_buf);
+
+    client.transport.type = MQTT_TRANSPORT_SECURE;
+    tls->peer_verify = TLS_PEER_VERIFY_REQUIRED;
+    tls->cipher_list = NULL;
+    tls->sec_tag_list = sec_tags;
+    tls->sec_tag_count = ARRAY_SIZE(sec_tags);
+    tls->hostname = identity->hostname;
+    /* Reconnects resume the TLS session instead of a full handshake */
+    tls->session_cache = TLS_SESSION_CACHE_ENABLED;
+}
+
+/*
+ * Blocks on the socket until data arrives or the keepalive is due, so
+ * nothing wakes up while the link is idle. Runs until the connection
+ * drops; the disconnect event itself comes from mqtt_input() or
+ * mqtt_abort().
+ */
+static void mqtt_rx_thread(void *p1, void *p2, void *p3)
+{
+    struct zsock_pollfd fds;
+
+    while (1) {
+        k_sem_take(&rx_start, K_FOREVER);
+
+        fds.fd = client.transport.tls.sock;
+        fds.events = ZSOCK_POLLIN;
+
+        while (connected) {
+            int timeout = mqtt_keepalive_time_left(&client);
+            int ret = zsock_poll(&fds, 1, timeout);
+
+            if (ret < 0) {
+                LOG_ERR("MQTT poll failed: %d", errno);
+                mqtt_abort(&client);
+                break;
+            }
+            if (ret > 0 && (fds.revents & ZSOCK_POLLIN)) {
+                mqtt_input(&client);
+            }
+            if (ret > 0 && (fds.revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP |
+                                           ZSOCK_POLLNVAL))) {
+                LOG_ERR("MQTT socket error");
+                mqtt_abort(&client);
+                break;
+            }
+
+            mqtt_live(&client);
+        }
+    }
+}
+
+K_THREAD_DEFINE(mqtt_rx_tid, MQTT_RX_STACK_SIZE, mqtt_rx_thread, NULL, NULL, NULL,
+                MQTT_RX_PRIORITY, 0, 0);
+
+int iot_hub_connect(void)
+{
+    struct zsock_pollfd fds;
+    int64_t start = k_uptime_get();
+    int64_t deadline;
+    int err;
+
+    if (!provisioning_is_provisioned()) {
+        return -ENOENT;
+    }
+
     LOG_INF("Connecting to Azure IoT Hub");
-    return 0; /* Stub - success */
+
+    identity_setup();
+
+    err = broker_resolve(identity->hostname);
+    if (err) {
+        return err;
+    }
+
+    client_setup();
+
+    err = mqtt_connect(&client);
+    if (err) {
+        LOG_ERR("MQTT connect failed: %d", err);
+        broker_cached = false;
+        return err;
+    }
+
+    fds.fd = client.transport.tls.sock;
+    fds.events = ZSOCK_POLLIN;
+    deadline = start + CONNACK_TIMEOUT_MS;
+    connack_result = 0;
+
+    while (!connected && !connack_result && k_uptime_get() < deadline) {
+        if (zsock_poll(&fds, 1, deadline - k_uptime_get()) > 0) {
+            mqtt_input(&client);
+        }
+    }
+
+    if (!connected) {
+        mqtt_abort(&client);
+        broker_cached = false;
+
+        switch (connack_result) {
+        case 0:
+            LOG_ERR("No CONNACK from IoT Hub");
+            return -ETIMEDOUT;
+        case CONNACK_IDENTIFIER_REJECTED:
+        case CONNACK_BAD_CREDENTIALS:
+        case CONNACK_NOT_AUTHORIZED:
+            return -EACCES;
+        default:
+            return -ECONNREFUSED;
+        }
+    }
+
+    LOG_INF("IoT Hub connected in %lld ms", (long long)(k_uptime_get() - start));
+
+    k_sem_give(&rx_start);
+    return 0;
 }
 
-void iot_hub_disconnect(void) {
+void iot_hub_disconnect(void)
+{
     LOG_INF("Disconnecting from Azure IoT Hub");
+    if (connected) {
+        mqtt_disconnect(&client);
+    }
 }
 
-void iot_hub_process(void) {
-    /* Process MQTT messages */
+void iot_hub_heartbeat(void)
+{
+    int time_left;
+
+    if (!connected) {
+        return;
+    }
+
+    time_left = mqtt_keepalive_time_left(&client);
+    if (time_left >= 0 &&
+        time_left < CONFIG_MQTT_KEEPALIVE * MSEC_PER_SEC - HEARTBEAT_IDLE_MS) {
+        mqtt_ping(&client);
+    }
 }
 
-int iot_hub_publish_telemetry(const char *data) {
-    LOG_INF("Publishing telemetry: %s", data);
-    return 0;
+bool iot_hub_is_connected(void)
+{
+    return connected;
+}
+
+int iot_hub_add_event_handler(iot_hub_evt_handler_t handler)
+{
+    for (int i = 0; i < IOT_HUB_MAX_EVT_HANDLERS; i++) {
+        if (!evt_handlers[i]) {
+            evt_handlers[i] = handler;
+            return 0;
+        }
+    }
+    return -ENOMEM;
+}
+
+static int publish(const char *topic, const uint8_t *payload, size_t len)
+{
+    struct mqtt_publish_param param = { 0 };
+    int err;
+
+    if (!connected) {
+        return -ENOTCONN;
+    }
+
+    param.message.topic.qos = MQTT_QOS_1_AT_LEAST_ONCE;
+    param.message.topic.topic.utf8 = (const uint8_t *)topic;
+    param.message.topic.topic.size = strlen(topic);
+    param.message.payload.data = (uint8_t *)payload;
+    param.message.payload.len = len;
+
+    k_mutex_lock(&publish_mutex, K_FOREVER);
+    param.message_id = alloc_message_id();
+    err = mqtt_publish(&client, &param);
+    k_mutex_unlock(&publish_mutex);
+    if (err) {
+        LOG_ERR("Publish failed: %d", err);
+        return err;
+    }
+
+    LOG_DBG("Published %zu bytes (id %u)", len, param.message_id);
+    return param.message_id;
+}
+
+int iot_hub_publish_telemetry(const char *data)
+{
+    return publish(topic_json, (const uint8_t *)data, strlen(data));
+}
+
+int iot_hub_twin_get(uint32_t request_id)
+{
+    char topic[TWIN_TOPIC_LEN];
+
+    snprintf(topic, sizeof(topic), TWIN_GET_TOPIC, request_id);
+    return publish(topic, NULL, 0);
+}
+
+int iot_hub_twin_report(const char *patch, size_t len, uint32_t request_id)
+{
+    char topic[TWIN_TOPIC_LEN];
+
+    snprintf(topic, sizeof(topic), TWIN_REPORTED_TOPIC, request_id);
+    return publish(topic, (const uint8_t *)patch, len);
+}
+
+int iot_hub_publish_cbor(const uint8_t *payload, size_t len)
+{
+    return publish(topic_cbor, payload, len);
 }
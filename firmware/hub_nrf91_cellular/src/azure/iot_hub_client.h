@@ -1,13 +1,84 @@
 /*
- * Azure IoT Hub Client stub
+ * Azure IoT Hub Client
+ * MQTT connection to IoT Hub and device-to-cloud publishing
  */
 
 #ifndef IOT_HUB_CLIENT_H
 #define IOT_HUB_CLIENT_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IOT_HUB_MAX_EVT_HANDLERS 4
+
+/* Largest cloud-to-device payload, the twin document limit */
+#define IOT_HUB_RX_PAYLOAD_SIZE 8192
+
+enum iot_hub_evt_type {
+    IOT_HUB_EVT_CONNECTED,
+    IOT_HUB_EVT_DISCONNECTED,
+    IOT_HUB_EVT_PUBACK,
+    IOT_HUB_EVT_TWIN_RESPONSE,  /* Reply to a twin GET or reported PATCH */
+    IOT_HUB_EVT_TWIN_DESIRED,   /* Desired properties patch from the cloud */
+};
+
+struct iot_hub_evt {
+    enum iot_hub_evt_type type;
+    uint16_t message_id;  /* IOT_HUB_EVT_PUBACK */
+    int result;           /* HTTP-style status for IOT_HUB_EVT_TWIN_RESPONSE */
+    uint32_t request_id;  /* IOT_HUB_EVT_TWIN_RESPONSE */
+    const char *data;     /* Twin payloads, valid for the handler call only */
+    size_t data_len;
+};
+
+typedef void (*iot_hub_evt_handler_t)(const struct iot_hub_evt *evt);
+
+/**
+ * Connect to the hub assigned by DPS and wait for CONNACK. Incoming
+ * traffic is then handled on a dedicated thread, IOT_HUB_EVT_DISCONNECTED
+ * reports a dropped link. The MQTT session and TLS session are resumed
+ * when the hub still holds them.
+ *
+ * @return 0 on success, -EACCES if the hub refused the device identity,
+ *         other negative error codes for transient failures
+ */
 int iot_hub_connect(void);
 void iot_hub_disconnect(void);
-void iot_hub_process(void);
+bool iot_hub_is_connected(void);
+int iot_hub_add_event_handler(iot_hub_evt_handler_t handler);
+
+/**
+ * Send an MQTT PINGREQ unless other traffic went out recently. Lets the
+ * keepalive ride a planned uplink burst instead of waking the modem on
+ * its own timer.
+ */
+void iot_hub_heartbeat(void);
+
+/* Unix time from the network clock, 0 until the modem has synchronized */
+uint32_t iot_hub_epoch_seconds(void);
+
 int iot_hub_publish_telemetry(const char *data);
 
+/**
+ * Request the full twin document, answered by IOT_HUB_EVT_TWIN_RESPONSE
+ * carrying the same request id.
+ */
+int iot_hub_twin_get(uint32_t request_id);
+
+/**
+ * Publish a JSON Merge Patch of reported properties. IoT Hub answers with
+ * IOT_HUB_EVT_TWIN_RESPONSE, status 204 once the patch is applied.
+ */
+int iot_hub_twin_report(const char *patch, size_t len, uint32_t request_id);
+
+/**
+ * Publish len bytes of CBOR telemetry at QoS 1 (content type
+ * application/cbor). The payload is sent before this returns, so the
+ * caller may reuse its buffer.
+ *
+ * @return MQTT message id (> 0) on success, negative error code on failure
+ */
+int iot_hub_publish_cbor(const uint8_t *payload, size_t len);
+
 #endif /* IOT_HUB_CLIENT_H */
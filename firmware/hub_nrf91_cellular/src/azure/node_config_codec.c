@@ -0,0 +1,336 @@
+/*
+ * Node Config Codec Implementation
+ *
+ * A push_node_config job is translated here once, when it arrives from the
+ * twin. Every target shares the binary body, and the BLE processor and the
+ * nodes never see JSON. The schema's enum strings become their index, and
+ * calibration points are folded into what the node evaluates: a linear
+ * calibration becomes offset and slope, a table becomes millivolt
+ * breakpoints.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include "node_config_codec.h"
+
+#define RECORD_HDR_LEN 2  /* Tag, length */
+#define POINT_LEN      6  /* uint16 mV, float32 value */
+
+struct writer {
+    uint8_t *p;
+    uint8_t *end;
+    bool full;
+};
+
+/* Schema enums, in node order */
+static const char *const aggregation_names[] = {
+    "mean", "median", "min", "max", "trimmed_mean",
+};
+
+static const char *const warmup_mode_names[] = {
+    "fixed", "settle",
+};
+
+static const char *const calibration_names[] = {
+    "linear", "polynomial", "table",
+};
+
+static const char *const policy_names[] = {
+    "each_sample", "heartbeat", "on_change",
+};
+
+static void put(struct writer *w, uint8_t tag, const void *value, uint8_t len)
+{
+    if (w->full || w->end - w->p < RECORD_HDR_LEN + len) {
+        w->full = true;
+        return;
+    }
+    w->p[0] = tag;
+    w->p[1] = len;
+    memcpy(w->p + RECORD_HDR_LEN, value, len);
+    w->p += RECORD_HDR_LEN + len;
+}
+
+static void put_u8(struct writer *w, uint8_t tag, uint8_t value)
+{
+    put(w, tag, &value, 1);
+}
+
+static void put_u16(struct writer *w, uint8_t tag, uint16_t value)
+{
+    uint8_t le[2];
+
+    sys_put_le16(value, le);
+    put(w, tag, le, sizeof(le));
+}
+
+static void put_u32(struct writer *w, uint8_t tag, uint32_t value)
+{
+    uint8_t le[4];
+
+    sys_put_le32(value, le);
+    put(w, tag, le, sizeof(le));
+}
+
+static void set_f32(uint8_t *p, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    sys_put_le32(bits, p);
+}
+
+static void put_f32(struct writer *w, uint8_t tag, float value)
+{
+    uint8_t le[4];
+
+    set_f32(le, value);
+    put(w, tag, le, sizeof(le));
+}
+
+static int enum_index(const cJSON *item, const char *const *names, size_t count)
+{
+    const char *str = cJSON_GetStringValue(item);
+
+    for (size_t i = 0; str && i < count; i++) {
+        if (strcmp(str, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -EINVAL;
+}
+
+/* Integer members are clamped to the field, the node checks the range */
+static void put_number(struct writer *w, const cJSON *obj, const char *name, uint8_t tag,
+                       uint8_t len)
+{
+    const cJSON *item = cJSON_GetObjectItem(obj, name);
+    double value;
+
+    if (!cJSON_IsNumber(item)) {
+        return;
+    }
+    value = item->valuedouble;
+
+    switch (len) {
+    case 1:
+        put_u8(w, tag, CLAMP(value, 0, UINT8_MAX));
+        break;
+    case 2:
+        put_u16(w, tag, CLAMP(value, 0, UINT16_MAX));
+        break;
+    default:
+        put_u32(w, tag, CLAMP(value, 0, UINT32_MAX));
+        break;
+    }
+}
+
+static void put_float(struct writer *w, const cJSON *obj, const char *name, uint8_t tag)
+{
+    const cJSON *item = cJSON_GetObjectItem(obj, name);
+
+    if (cJSON_IsNumber(item)) {
+        put_f32(w, tag, item->valuedouble);
+    }
+}
+
+static int put_enum(struct writer *w, const cJSON *obj, const char *name, uint8_t tag,
+                    const char *const *names, size_t count)
+{
+    const cJSON *item = cJSON_GetObjectItem(obj, name);
+    int index;
+
+    if (!item) {
+        return 0;
+    }
+    index = enum_index(item, names, count);
+    if (index < 0) {
+        return index;
+    }
+    put_u8(w, tag, index);
+    return 0;
+}
+
+static int encode_sampling(struct writer *w, const cJSON *sampling)
+{
+    int err;
+
+    put_number(w, sampling, "intervalSeconds", NODE_CONFIG_TAG_INTERVAL, 4);
+    put_number(w, sampling, "warmupMs", NODE_CONFIG_TAG_WARMUP, 2);
+    put_number(w, sampling, "burstCount", NODE_CONFIG_TAG_BURST_COUNT, 1);
+    put_number(w, sampling, "minIntervalSeconds", NODE_CONFIG_TAG_MIN_INTERVAL, 4);
+    put_number(w, sampling, "maxIntervalSeconds", NODE_CONFIG_TAG_MAX_INTERVAL, 4);
+    err = put_enum(w, sampling, "warmupMode", NODE_CONFIG_TAG_WARMUP_MODE,
+                   warmup_mode_names, ARRAY_SIZE(warmup_mode_names));
+    if (err) {
+        return err;
+    }
+    return put_enum(w, sampling, "aggregation", NODE_CONFIG_TAG_AGGREGATION,
+                    aggregation_names, ARRAY_SIZE(aggregation_names));
+}
+
+static bool get_point(const cJSON *point, double *voltage, double *value)
+{
+    const cJSON *v = cJSON_GetObjectItem(point, "voltage");
+    const cJSON *y = cJSON_GetObjectItem(point, "value");
+
+    if (!cJSON_IsNumber(v) || !cJSON_IsNumber(y)) {
+        return false;
+    }
+    *voltage = v->valuedouble;
+    *value = y->valuedouble;
+    return true;
+}
+
+/* A line through the first two points, slope per volt */
+static int encode_linear(struct writer *w, const cJSON *points)
+{
+    double x0, y0, x1, y1;
+    double slope;
+
+    if (cJSON_GetArraySize(points) < 2 ||
+        !get_point(cJSON_GetArrayItem(points, 0), &x0, &y0) ||
+        !get_point(cJSON_GetArrayItem(points, 1), &x1, &y1) || x0 == x1) {
+        return -EINVAL;
+    }
+
+    slope = (y1 - y0) / (x1 - x0);
+    put_f32(w, NODE_CONFIG_TAG_CAL_OFFSET, y0 - slope * x0);
+    put_f32(w, NODE_CONFIG_TAG_CAL_SLOPE, slope);
+    put_f32(w, NODE_CONFIG_TAG_CAL_POLY_A, 0.0f);
+    put_f32(w, NODE_CONFIG_TAG_CAL_POLY_B, 0.0f);
+    return 0;
+}
+
+static int encode_polynomial(struct writer *w, const cJSON *coefficients)
+{
+    uint8_t value[NODE_CONFIG_POLY_MAX * sizeof(float)];
+    int count = cJSON_GetArraySize(coefficients);
+    const cJSON *item;
+    int i = 0;
+
+    if (count < 1 || count > NODE_CONFIG_POLY_MAX) {
+        return -EINVAL;
+    }
+
+    cJSON_ArrayForEach(item, coefficients) {
+        if (!cJSON_IsNumber(item)) {
+            return -EINVAL;
+        }
+        set_f32(&value[i++ * sizeof(float)], item->valuedouble);
+    }
+
+    put(w, NODE_CONFIG_TAG_CAL_POLY, value, count * sizeof(float));
+    return 0;
+}
+
+static int encode_table(struct writer *w, const cJSON *points)
+{
+    uint8_t value[NODE_CONFIG_POINTS_MAX * POINT_LEN];
+    int count = cJSON_GetArraySize(points);
+    const cJSON *point;
+    double voltage, y;
+    int i = 0;
+
+    if (count < 2 || count > NODE_CONFIG_POINTS_MAX) {
+        return -EINVAL;
+    }
+
+    cJSON_ArrayForEach(point, points) {
+        if (!get_point(point, &voltage, &y) || voltage < 0.0) {
+            return -EINVAL;
+        }
+        sys_put_le16(MIN(lround(voltage * 1000.0), UINT16_MAX), &value[i * POINT_LEN]);
+        set_f32(&value[i * POINT_LEN + 2], y);
+        i++;
+    }
+
+    put(w, NODE_CONFIG_TAG_CAL_POINTS, value, count * POINT_LEN);
+    return 0;
+}
+
+static int encode_calibration(struct writer *w, const cJSON *calibration)
+{
+    const cJSON *points = cJSON_GetObjectItem(calibration, "points");
+    int type;
+
+    type = enum_index(cJSON_GetObjectItem(calibration, "type"), calibration_names,
+                      ARRAY_SIZE(calibration_names));
+    if (type < 0) {
+        return type;
+    }
+    put_u8(w, NODE_CONFIG_TAG_CAL_TYPE, type);
+
+    switch (type) {
+    case 0:
+        return encode_linear(w, points);
+    case 1:
+        return encode_polynomial(w, cJSON_GetObjectItem(calibration, "polynomial"));
+    default:
+        return encode_table(w, points);
+    }
+}
+
+static int encode_advertisement(struct writer *w, const cJSON *advertisement)
+{
+    put_number(w, advertisement, "heartbeatSeconds", NODE_CONFIG_TAG_HEARTBEAT, 2);
+    put_float(w, advertisement, "deadband", NODE_CONFIG_TAG_DEADBAND);
+    return put_enum(w, advertisement, "policy", NODE_CONFIG_TAG_POLICY,
+                    policy_names, ARRAY_SIZE(policy_names));
+}
+
+/* The schema's faults thresholds are the node's alarms */
+static void encode_faults(struct writer *w, const cJSON *faults)
+{
+    bool enabled = !cJSON_IsFalse(cJSON_GetObjectItem(faults, "enabled"));
+
+    if (cJSON_IsNumber(cJSON_GetObjectItem(faults, "highThreshold"))) {
+        put_float(w, faults, "highThreshold", NODE_CONFIG_TAG_ALARM_HIGH);
+        put_u8(w, NODE_CONFIG_TAG_ALARM_HIGH_EN, enabled);
+    }
+    if (cJSON_IsNumber(cJSON_GetObjectItem(faults, "lowThreshold"))) {
+        put_float(w, faults, "lowThreshold", NODE_CONFIG_TAG_ALARM_LOW);
+        put_u8(w, NODE_CONFIG_TAG_ALARM_LOW_EN, enabled);
+    }
+}
+
+int node_config_codec_encode(const cJSON *config, uint8_t *buf, size_t size)
+{
+    struct writer w = { .p = buf + 1, .end = buf + size };
+    const cJSON *section;
+    int err = 0;
+
+    if (size < 1 || !cJSON_IsObject(config)) {
+        return size < 1 ? -ENOMEM : -EINVAL;
+    }
+    buf[0] = NODE_CONFIG_CODEC_VERSION;
+
+    section = cJSON_GetObjectItem(config, "sampling");
+    if (cJSON_IsObject(section)) {
+        err = encode_sampling(&w, section);
+    }
+    section = cJSON_GetObjectItem(config, "calibration");
+    if (!err && cJSON_IsObject(section)) {
+        err = encode_calibration(&w, section);
+    }
+    section = cJSON_GetObjectItem(config, "advertisement");
+    if (!err && cJSON_IsObject(section)) {
+        err = encode_advertisement(&w, section);
+    }
+    section = cJSON_GetObjectItem(config, "faults");
+    if (cJSON_IsObject(section)) {
+        encode_faults(&w, section);
+    }
+
+    if (err) {
+        return err;
+    }
+    if (w.full) {
+        return -ENOMEM;
+    }
+    return w.p - buf;
+}
@@ -0,0 +1,63 @@
+/*
+ * Node Config Codec
+ * JSON node configuration to the binary form of the node's Config
+ * characteristic
+ */
+
+#ifndef NODE_CONFIG_CODEC_H
+#define NODE_CONFIG_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <cJSON.h>
+
+/*
+ * Mirrors node_nrf54l15/src/config/config_codec.h: a version byte, then
+ * tag, length, value records, little-endian
+ */
+#define NODE_CONFIG_CODEC_VERSION 1
+
+enum node_config_tag {
+    NODE_CONFIG_TAG_INTERVAL = 0x01,
+    NODE_CONFIG_TAG_WARMUP = 0x02,
+    NODE_CONFIG_TAG_BURST_COUNT = 0x03,
+    NODE_CONFIG_TAG_AGGREGATION = 0x04,
+    NODE_CONFIG_TAG_MIN_INTERVAL = 0x05,
+    NODE_CONFIG_TAG_MAX_INTERVAL = 0x06,
+    NODE_CONFIG_TAG_WARMUP_MODE = 0x07,
+
+    NODE_CONFIG_TAG_CAL_TYPE = 0x10,
+    NODE_CONFIG_TAG_CAL_OFFSET = 0x11,
+    NODE_CONFIG_TAG_CAL_SLOPE = 0x12,
+    NODE_CONFIG_TAG_CAL_POLY_A = 0x13,
+    NODE_CONFIG_TAG_CAL_POLY_B = 0x14,
+    NODE_CONFIG_TAG_CAL_POLY = 0x15,
+    NODE_CONFIG_TAG_CAL_POINTS = 0x16,
+
+    NODE_CONFIG_TAG_POLICY = 0x20,
+    NODE_CONFIG_TAG_HEARTBEAT = 0x21,
+    NODE_CONFIG_TAG_DEADBAND = 0x22,
+
+    NODE_CONFIG_TAG_ALARM_HIGH = 0x30,
+    NODE_CONFIG_TAG_ALARM_LOW = 0x31,
+    NODE_CONFIG_TAG_ALARM_HIGH_EN = 0x32,
+    NODE_CONFIG_TAG_ALARM_LOW_EN = 0x33,
+};
+
+#define NODE_CONFIG_POLY_MAX   6
+#define NODE_CONFIG_POINTS_MAX 16
+
+/* Largest encoding, one ATT write at the 247-byte MTU */
+#define NODE_CONFIG_CODEC_MAX_LEN 214
+
+/**
+ * Encode a node-config.schema.json object. Only the fields present are
+ * encoded, the node keeps the others. binding and metadata are not part
+ * of the Config characteristic and are ignored.
+ *
+ * @return Encoded length, -EINVAL for an unknown enum string or a
+ *         malformed calibration, -ENOMEM if buf is too small
+ */
+int node_config_codec_encode(const cJSON *config, uint8_t *buf, size_t size);
+
+#endif /* NODE_CONFIG_CODEC_H */
@@ -1,16 +1,214 @@
-/* Provisioning stub implementation */
+/*
+ * Device Provisioning Implementation
+ *
+ * DPS is only needed to learn which IoT Hub the device belongs to. The
+ * answer rarely changes, so it is kept in NVS and a reboot goes straight
+ * to the hub. DPS runs again only if nothing is cached or the hub
+ * refuses the cached identity.
+ */
 
+#include <string.h>
+#include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/fs/nvs.h>
+#include <zephyr/storage/flash_map.h>
+#include <net/azure_iot_hub_dps.h>
 #include "provisioning.h"
+#include "../hub_events.h"
 
 LOG_MODULE_REGISTER(provisioning, LOG_LEVEL_INF);
 
-bool provisioning_is_provisioned(void) {
-    /* Check NVS for credentials */
-    return true; /* Stub - assume provisioned */
+#define NVS_PARTITION       nvs_storage
+#define NVS_SECTOR_SIZE     4096
+#define NVS_ID_ASSIGNMENT   1
+
+#define ASSIGNMENT_VERSION  1
+
+struct cached_assignment {
+    uint32_t version;
+    struct provisioning_assignment assignment;
+};
+
+static struct nvs_fs fs;
+static bool nvs_ready;
+static struct cached_assignment cache;
+static bool cache_valid;
+
+static bool dps_ready;
+static bool dps_stale;  /* The library may still hold a refused assignment */
+static enum azure_iot_hub_dps_reg_status dps_status;
+
+static void dps_handler(enum azure_iot_hub_dps_reg_status status)
+{
+    dps_status = status;
+
+    if (status == AZURE_IOT_HUB_DPS_REG_STATUS_ASSIGNED ||
+        status == AZURE_IOT_HUB_DPS_REG_STATUS_FAILED) {
+        k_event_post(&hub_events, HUB_EVT_DPS_DONE);
+    }
+}
+
+static int cache_load(void)
+{
+    ssize_t len = nvs_read(&fs, NVS_ID_ASSIGNMENT, &cache, sizeof(cache));
+
+    if (len != sizeof(cache) || cache.version != ASSIGNMENT_VERSION ||
+        cache.assignment.hostname[0] == '\0' || cache.assignment.device_id[0] == '\0') {
+        return -ENOENT;
+    }
+
+    /* Guard against a truncated write */
+    cache.assignment.hostname[PROVISIONING_HOSTNAME_LEN - 1] = '\0';
+    cache.assignment.device_id[PROVISIONING_DEVICE_ID_LEN - 1] = '\0';
+    return 0;
+}
+
+static void cache_store(void)
+{
+    ssize_t len;
+
+    if (!nvs_ready) {
+        return;
+    }
+
+    cache.version = ASSIGNMENT_VERSION;
+    len = nvs_write(&fs, NVS_ID_ASSIGNMENT, &cache, sizeof(cache));
+    if (len < 0) {
+        LOG_WRN("Failed to cache DPS assignment: %d", (int)len);
+    }
+}
+
+/* Copy the assignment out of the DPS library */
+static int dps_read_assignment(void)
+{
+    struct azure_iot_hub_buf hostname = {
+        .ptr = cache.assignment.hostname,
+        .size = sizeof(cache.assignment.hostname),
+    };
+    struct azure_iot_hub_buf device_id = {
+        .ptr = cache.assignment.device_id,
+        .size = sizeof(cache.assignment.device_id),
+    };
+    int err;
+
+    err = azure_iot_hub_dps_hostname_get(&hostname);
+    if (!err) {
+        err = azure_iot_hub_dps_device_id_get(&device_id);
+    }
+    return err;
 }
 
-int provisioning_register(void) {
+int provisioning_init(void)
+{
+    int err;
+
+    fs.flash_device = FIXED_PARTITION_DEVICE(NVS_PARTITION);
+    fs.offset = FIXED_PARTITION_OFFSET(NVS_PARTITION);
+    fs.sector_size = NVS_SECTOR_SIZE;
+    fs.sector_count = FIXED_PARTITION_SIZE(NVS_PARTITION) / NVS_SECTOR_SIZE;
+
+    if (!device_is_ready(fs.flash_device)) {
+        LOG_ERR("NVS flash device not ready");
+        return -ENODEV;
+    }
+
+    err = nvs_mount(&fs);
+    if (err) {
+        LOG_ERR("NVS mount failed: %d", err);
+        return err;
+    }
+    nvs_ready = true;
+
+    cache_valid = cache_load() == 0;
+    if (cache_valid) {
+        LOG_INF("Cached assignment: %s on %s", cache.assignment.device_id,
+                cache.assignment.hostname);
+    }
+
+    return 0;
+}
+
+bool provisioning_is_provisioned(void)
+{
+    return cache_valid;
+}
+
+int provisioning_register_start(void)
+{
+    struct azure_iot_hub_dps_config config = {
+        .handler = dps_handler,
+    };
+    int err;
+
     LOG_INF("DPS registration");
+
+    if (!dps_ready) {
+        err = azure_iot_hub_dps_init(&config);
+        if (err) {
+            LOG_ERR("DPS init failed: %d", err);
+            return err;
+        }
+        dps_ready = true;
+    }
+
+    /* Make the library ask DPS again instead of returning its own copy */
+    if (dps_stale) {
+        azure_iot_hub_dps_reset();
+        dps_stale = false;
+    }
+
+    k_event_clear(&hub_events, HUB_EVT_DPS_DONE);
+
+    err = azure_iot_hub_dps_start();
+    if (err == -EALREADY) {
+        /* The library still holds an assignment from an earlier run */
+        dps_status = AZURE_IOT_HUB_DPS_REG_STATUS_ASSIGNED;
+        k_event_post(&hub_events, HUB_EVT_DPS_DONE);
+    } else if (err) {
+        LOG_ERR("DPS start failed: %d", err);
+        return err;
+    }
+
     return 0;
 }
+
+int provisioning_register_finish(void)
+{
+    int err;
+
+    k_event_clear(&hub_events, HUB_EVT_DPS_DONE);
+
+    if (dps_status != AZURE_IOT_HUB_DPS_REG_STATUS_ASSIGNED) {
+        LOG_ERR("DPS registration failed");
+        return -EIO;
+    }
+
+    err = dps_read_assignment();
+    if (err) {
+        LOG_ERR("Failed to read DPS assignment: %d", err);
+        return err;
+    }
+
+    cache_store();
+    cache_valid = true;
+
+    LOG_INF("Assigned to %s as %s", cache.assignment.hostname,
+            cache.assignment.device_id);
+    return 0;
+}
+
+const struct provisioning_assignment *provisioning_get_assignment(void)
+{
+    return &cache.assignment;
+}
+
+void provisioning_invalidate(void)
+{
+    LOG_WRN("Dropping cached DPS assignment");
+
+    cache_valid = false;
+    if (nvs_ready) {
+        nvs_delete(&fs, NVS_ID_ASSIGNMENT);
+    }
+    dps_stale = true;
+}
@@ -1,11 +1,46 @@
-/* Provisioning stub */
+/*
+ * Device Provisioning
+ * DPS registration, with the assigned IoT Hub cached in NVS
+ */
 
 #ifndef PROVISIONING_H
 #define PROVISIONING_H
 
 #include <stdbool.h>
 
+#define PROVISIONING_HOSTNAME_LEN   128
+#define PROVISIONING_DEVICE_ID_LEN  128
+
+struct provisioning_assignment {
+    char hostname[PROVISIONING_HOSTNAME_LEN];
+    char device_id[PROVISIONING_DEVICE_ID_LEN];
+};
+
+/* Mount the NVS partition and load a cached assignment, if any */
+int provisioning_init(void);
+
+/* True when an assignment is cached and DPS can be skipped */
 bool provisioning_is_provisioned(void);
-int provisioning_register(void);
 
-#endif
+/**
+ * Start DPS registration. DPS answering, either way, is signalled with
+ * HUB_EVT_DPS_DONE so the caller can keep feeding the watchdog meanwhile.
+ *
+ * @return 0 if registration is under way
+ */
+int provisioning_register_start(void);
+
+/**
+ * Cache the hub DPS assigned, once HUB_EVT_DPS_DONE is posted.
+ *
+ * @return 0 on success, -EIO if the registration failed
+ */
+int provisioning_register_finish(void);
+
+/* Assigned IoT Hub, only valid while provisioning_is_provisioned() */
+const struct provisioning_assignment *provisioning_get_assignment(void);
+
+/* Drop the cache after IoT Hub refused it, the next connect runs DPS */
+void provisioning_invalidate(void);
+
+#endif /* PROVISIONING_H */
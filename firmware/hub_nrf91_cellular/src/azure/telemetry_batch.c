@@ -0,0 +1,409 @@
+/*
+ * Telemetry Batching Implementation
+ *
+ * Readings sit in a ring until they are acknowledged by IoT Hub:
+ *
+ *   tail ........ unsent ........ head
+ *   |  in flight  |    pending    |
+ *
+ * Pending readings are packed into one CBOR message per publish, up to
+ * TELEMETRY_BATCH_TARGET_BYTES. A message leaves the ring only when its
+ * PUBACK arrives, so a dropped connection re-sends everything in flight.
+ *
+ * Publishing is left to the uplink scheduler so the modem is not woken
+ * for every full message. Outside a scheduled flush, full messages go
+ * out only if the radio is already on or the ring is nearly full.
+ *
+ * When the ring fills up during an outage the oldest readings spill to
+ * the flash log (storage/telemetry_store.c). The backlog is drained in
+ * messages as large as the TX buffer once RAM holds nothing newer, as
+ * long as the radio is on anyway.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "telemetry_batch.h"
+#include "iot_hub_client.h"
+#include "network/lte_connection.h"
+#include "storage/telemetry_store.h"
+
+LOG_MODULE_REGISTER(telemetry_batch, LOG_LEVEL_INF);
+
+BUILD_ASSERT(IS_POWER_OF_TWO(TELEMETRY_BATCH_CAPACITY),
+             "Ring indices rely on unsigned wrap-around");
+
+/* MQTT payload buffer, messages are encoded in place */
+#define TX_BUF_SIZE         1024
+
+BUILD_ASSERT(TELEMETRY_BATCH_TARGET_BYTES <= TX_BUF_SIZE);
+
+#define RING_ENTRY(seq) (&ring[(seq) % TELEMETRY_BATCH_CAPACITY])
+
+/* Backlog messages fill the whole TX buffer */
+#define DRAIN_TARGET_BYTES  TX_BUF_SIZE
+#define DRAIN_MAX_RECORDS   48
+
+struct inflight_msg {
+    uint16_t message_id;
+    uint16_t count;
+    bool acked;
+    bool stored;                      /* Read from the flash log */
+    struct telemetry_store_span span; /* Flash records to consume on PUBACK */
+};
+
+struct drain_ctx {
+    size_t budget;
+    size_t used;
+    uint16_t count;
+};
+
+static struct node_telemetry ring[TELEMETRY_BATCH_CAPACITY];
+static uint32_t tail;    /* Oldest reading not yet acknowledged */
+static uint32_t unsent;  /* Oldest reading not yet published */
+static uint32_t head;    /* Next free slot */
+static size_t unsent_bytes;
+static bool flush_requested;
+
+static struct inflight_msg window[TELEMETRY_BATCH_WINDOW];
+static uint8_t window_start;
+static uint8_t window_len;
+
+static struct node_telemetry drain_buf[DRAIN_MAX_RECORDS];
+static uint8_t tx_buf[TX_BUF_SIZE];  /* Under batch_mutex, like the rest */
+static bool store_ready;
+
+static struct telemetry_batch_stats stats;
+static struct k_mutex batch_mutex;
+static struct k_work flush_work;
+
+/* Room left for records once the largest possible envelope is accounted for */
+static size_t record_budget(size_t target)
+{
+    return target - telemetry_codec_envelope_size(UINT32_MAX, TELEMETRY_BATCH_CAPACITY);
+}
+
+static const struct node_telemetry *ring_record(uint16_t i)
+{
+    return RING_ENTRY(unsent + i);
+}
+
+static const struct node_telemetry *drain_record(uint16_t i)
+{
+    return &drain_buf[i];
+}
+
+/* Encode count records into the TX buffer and publish them as one message */
+static int encode_and_publish(uint16_t count,
+                              const struct node_telemetry *(*record)(uint16_t i),
+                              const struct telemetry_store_span *span)
+{
+    struct telemetry_encoder enc;
+    size_t len;
+    int msg_id;
+    int err;
+
+    err = telemetry_codec_begin(&enc, tx_buf, sizeof(tx_buf),
+                                TELEMETRY_MSG_NODE_TELEMETRY, iot_hub_epoch_seconds(),
+                                count);
+    for (uint16_t i = 0; !err && i < count; i++) {
+        err = telemetry_codec_add_telemetry(&enc, record(i));
+    }
+    if (!err) {
+        err = telemetry_codec_end(&enc, &len);
+    }
+    if (err) {
+        LOG_ERR("Batch encode failed: %d", err);
+        return err;
+    }
+
+    msg_id = iot_hub_publish_cbor(tx_buf, len);
+    if (msg_id < 0) {
+        return msg_id;
+    }
+
+    window[(window_start + window_len) % TELEMETRY_BATCH_WINDOW] = (struct inflight_msg){
+        .message_id = msg_id,
+        .count = count,
+        .acked = false,
+        .stored = span != NULL,
+        .span = span ? *span : (struct telemetry_store_span){ 0 },
+    };
+    window_len++;
+
+    stats.messages++;
+    stats.bytes += len;
+
+    LOG_DBG("Batch %d: %u readings, %zu bytes%s", msg_id, count, len,
+            span ? " from flash" : "");
+    return 0;
+}
+
+/* Pack as many pending readings as fit the target size into one message */
+static int publish_batch(void)
+{
+    size_t budget = record_budget(TELEMETRY_BATCH_TARGET_BYTES);
+    size_t used = 0;
+    uint16_t count = 0;
+    int err;
+
+    while (unsent + count != head) {
+        size_t size = telemetry_codec_telemetry_size(RING_ENTRY(unsent + count));
+
+        if (count > 0 && used + size > budget) {
+            break;
+        }
+        used += size;
+        count++;
+    }
+
+    err = encode_and_publish(count, ring_record, NULL);
+    if (err) {
+        return err;
+    }
+
+    unsent += count;
+    unsent_bytes -= used;
+    return 0;
+}
+
+static bool drain_take(const struct node_telemetry *rec, void *ctx)
+{
+    struct drain_ctx *drain = ctx;
+    size_t size = telemetry_codec_telemetry_size(rec);
+
+    if (drain->count == DRAIN_MAX_RECORDS ||
+        (drain->count > 0 && drain->used + size > drain->budget)) {
+        return false;
+    }
+
+    drain_buf[drain->count++] = *rec;
+    drain->used += size;
+    return true;
+}
+
+static bool stored_in_flight(void)
+{
+    for (uint8_t i = 0; i < window_len; i++) {
+        if (window[(window_start + i) % TELEMETRY_BATCH_WINDOW].stored) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Publish one message worth of the flash backlog */
+static int publish_stored(void)
+{
+    struct drain_ctx drain = { .budget = record_budget(DRAIN_TARGET_BYTES) };
+    struct telemetry_store_span span;
+
+    if (!store_ready || telemetry_store_is_empty()) {
+        return -ENOENT;
+    }
+
+    /* Nothing outstanding, start over so newly stored records are seen */
+    if (!stored_in_flight()) {
+        telemetry_store_rewind();
+    }
+
+    if (telemetry_store_read(drain_take, &drain, &span) == 0) {
+        return -ENOENT;
+    }
+
+    return encode_and_publish(drain.count, drain_record, &span);
+}
+
+/* Move the oldest readings to flash to make room, nothing may be in flight */
+static int spill_locked(void)
+{
+    uint32_t count = MIN(TELEMETRY_BATCH_SPILL, head - tail);
+    uint32_t first = tail % TELEMETRY_BATCH_CAPACITY;
+    uint32_t chunk = MIN(count, TELEMETRY_BATCH_CAPACITY - first);
+    int err;
+
+    if (!store_ready || unsent != tail) {
+        return -EBUSY;
+    }
+
+    err = telemetry_store_append(&ring[first], chunk);
+    if (!err && count > chunk) {
+        err = telemetry_store_append(&ring[0], count - chunk);
+    }
+    if (err) {
+        return err;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        unsent_bytes -= telemetry_codec_telemetry_size(RING_ENTRY(tail + i));
+    }
+    tail += count;
+    unsent = tail;
+    stats.spilled += count;
+
+    LOG_INF("Spilled %u readings to flash", count);
+    return 0;
+}
+
+/* A full message is worth sending without waiting for the scheduler */
+static bool full_message_ready(void)
+{
+    if (unsent_bytes < record_budget(TELEMETRY_BATCH_TARGET_BYTES)) {
+        return false;
+    }
+    return lte_connection_is_radio_active() ||
+           head - tail >= TELEMETRY_BATCH_HIGH_WATER;
+}
+
+/* Caller holds batch_mutex */
+static void flush_locked(void)
+{
+    while (window_len < TELEMETRY_BATCH_WINDOW && iot_hub_is_connected()) {
+        if (unsent != head) {
+            if (!flush_requested && !full_message_ready()) {
+                break;
+            }
+            if (publish_batch() != 0) {
+                break;
+            }
+        } else if (flush_requested || lte_connection_is_radio_active()) {
+            /* Fresh readings are out, the backlog rides the same wake-up */
+            if (publish_stored() != 0) {
+                break;
+            }
+        } else {
+            break;
+        }
+    }
+
+    if (unsent == head) {
+        flush_requested = false;
+    }
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&batch_mutex, K_FOREVER);
+    flush_locked();
+    k_mutex_unlock(&batch_mutex);
+}
+
+static void handle_puback(uint16_t message_id)
+{
+    for (uint8_t i = 0; i < window_len; i++) {
+        struct inflight_msg *msg = &window[(window_start + i) % TELEMETRY_BATCH_WINDOW];
+
+        if (msg->message_id == message_id) {
+            msg->acked = true;
+            break;
+        }
+    }
+
+    /* Release acknowledged messages in publish order */
+    while (window_len > 0 && window[window_start].acked) {
+        struct inflight_msg *msg = &window[window_start];
+
+        if (msg->stored) {
+            telemetry_store_consume(&msg->span);
+        } else {
+            tail += msg->count;
+        }
+        window_start = (window_start + 1) % TELEMETRY_BATCH_WINDOW;
+        window_len--;
+    }
+}
+
+/* Everything in flight goes back to pending, it is re-sent on reconnect */
+static void rewind_inflight(void)
+{
+    unsent = tail;
+    unsent_bytes = 0;
+    for (uint32_t seq = unsent; seq != head; seq++) {
+        unsent_bytes += telemetry_codec_telemetry_size(RING_ENTRY(seq));
+    }
+    window_start = 0;
+    window_len = 0;
+
+    if (store_ready) {
+        telemetry_store_rewind();
+    }
+}
+
+static void iot_hub_event_handler(const struct iot_hub_evt *evt)
+{
+    k_mutex_lock(&batch_mutex, K_FOREVER);
+
+    switch (evt->type) {
+    case IOT_HUB_EVT_PUBACK:
+        handle_puback(evt->message_id);
+        k_work_submit(&flush_work);
+        break;
+    case IOT_HUB_EVT_DISCONNECTED:
+        rewind_inflight();
+        break;
+    case IOT_HUB_EVT_CONNECTED:
+        k_work_submit(&flush_work);
+        break;
+    default:
+        break;
+    }
+
+    k_mutex_unlock(&batch_mutex);
+}
+
+int telemetry_batch_init(void)
+{
+    k_mutex_init(&batch_mutex);
+    k_work_init(&flush_work, flush_work_handler);
+
+    store_ready = telemetry_store_init() == 0;
+    if (!store_ready) {
+        LOG_WRN("Flash log unavailable, readings are dropped when RAM is full");
+    }
+
+    LOG_INF("Telemetry batching: target %d bytes, capacity %d, window %d",
+            TELEMETRY_BATCH_TARGET_BYTES, TELEMETRY_BATCH_CAPACITY,
+            TELEMETRY_BATCH_WINDOW);
+
+    return iot_hub_add_event_handler(iot_hub_event_handler);
+}
+
+int telemetry_batch_add(const struct node_telemetry *rec)
+{
+    k_mutex_lock(&batch_mutex, K_FOREVER);
+
+    if (head - tail == TELEMETRY_BATCH_CAPACITY && spill_locked() != 0) {
+        stats.dropped++;
+        k_mutex_unlock(&batch_mutex);
+        LOG_WRN("Telemetry buffer full, reading dropped");
+        return -ENOMEM;
+    }
+
+    *RING_ENTRY(head) = *rec;
+    head++;
+    unsent_bytes += telemetry_codec_telemetry_size(rec);
+    stats.readings++;
+
+    if (rec->faults & TELEMETRY_BATCH_PRIORITY_FAULTS) {
+        flush_requested = true;
+    }
+
+    flush_locked();
+
+    k_mutex_unlock(&batch_mutex);
+    return 0;
+}
+
+void telemetry_batch_flush(void)
+{
+    k_mutex_lock(&batch_mutex, K_FOREVER);
+    flush_requested = true;
+    flush_locked();
+    k_mutex_unlock(&batch_mutex);
+}
+
+void telemetry_batch_get_stats(struct telemetry_batch_stats *out)
+{
+    k_mutex_lock(&batch_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&batch_mutex);
+}
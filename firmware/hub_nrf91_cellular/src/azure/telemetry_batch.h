@@ -0,0 +1,55 @@
+/*
+ * Telemetry Batching
+ * Accumulates node readings and packs them into size-targeted MQTT messages
+ */
+
+#ifndef TELEMETRY_BATCH_H
+#define TELEMETRY_BATCH_H
+
+#include <stdint.h>
+#include "telemetry_codec.h"
+
+#define TELEMETRY_BATCH_CAPACITY     256  /* Readings buffered in RAM */
+#define TELEMETRY_BATCH_TARGET_BYTES 768  /* Pack each message up to this size */
+#define TELEMETRY_BATCH_MAX_AGE_S    300  /* Upper bound on reading age, see main.c */
+#define TELEMETRY_BATCH_WINDOW       4    /* QoS 1 publishes awaiting PUBACK */
+
+/* Buffer fill that forces a publish even while the modem sleeps */
+#define TELEMETRY_BATCH_HIGH_WATER   (TELEMETRY_BATCH_CAPACITY * 3 / 4)
+
+/* Readings moved to the flash log at once when RAM is full */
+#define TELEMETRY_BATCH_SPILL        64
+
+/* Fault flags that bypass batching (sensor high/low alarms) */
+#define TELEMETRY_BATCH_PRIORITY_FAULTS 0x03
+
+struct telemetry_batch_stats {
+    uint32_t readings;
+    uint32_t messages;
+    uint32_t bytes;
+    uint32_t spilled;  /* Moved to the flash log */
+    uint32_t dropped;
+};
+
+int telemetry_batch_init(void);
+
+/**
+ * Queue one reading. Full messages are published right away only while
+ * the modem is already awake or the buffer is above the high-water mark.
+ * A reading carrying a priority fault is published immediately together
+ * with everything pending.
+ *
+ * @return 0 on success, -ENOMEM if the buffer is full and the oldest
+ *         readings could not be moved to flash
+ */
+int telemetry_batch_add(const struct node_telemetry *rec);
+
+/**
+ * Publish everything pending regardless of size, as far as the in-flight
+ * window allows. Runs as an uplink scheduler task.
+ */
+void telemetry_batch_flush(void);
+
+void telemetry_batch_get_stats(struct telemetry_batch_stats *stats);
+
+#endif /* TELEMETRY_BATCH_H */
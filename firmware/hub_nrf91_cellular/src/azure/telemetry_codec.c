@@ -0,0 +1,219 @@
+/*
+ * Telemetry Codec Implementation
+ *
+ * Envelope:  { 0: version, 1: kind, 2: timestamp, 3: [ record, ... ] }
+ * Records are positional CBOR arrays so no field names go over the air:
+ *   telemetry:  [ node_id(bstr 6), timestamp, value(f32), unit, quality,
+ *                 battery_mv, battery_pct, faults, rssi ]
+ *               or, for a window summary where value is the mean,
+ *               [ ..., rssi, count, min(f32), max(f32) ]
+ *   discovered: [ node_id(bstr 6), rssi, battery_pct, last_reading(f32),
+ *                 fault_flags, counter ]
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <zephyr/sys/util.h>
+#include <zcbor_encode.h>
+#include "telemetry_codec.h"
+
+#define ENVELOPE_KEY_VERSION   0
+#define ENVELOPE_KEY_KIND      1
+#define ENVELOPE_KEY_TIMESTAMP 2
+#define ENVELOPE_KEY_RECORDS   3
+#define ENVELOPE_ENTRIES       4
+
+#define TELEMETRY_FIELDS  9
+#define SUMMARY_FIELDS    12
+#define DISCOVERED_FIELDS 6
+
+#ifdef CONFIG_ZCBOR_CANONICAL
+#define CONTAINER_SIZE(n) cbor_head_size(n)
+#else
+#define CONTAINER_SIZE(n) 2 /* Indefinite-length start and break bytes */
+#endif
+
+/* Size of a CBOR head (major type + argument) for an unsigned value */
+static size_t cbor_head_size(uint32_t value)
+{
+    if (value < 24) {
+        return 1;
+    } else if (value <= UINT8_MAX) {
+        return 2;
+    } else if (value <= UINT16_MAX) {
+        return 3;
+    }
+    return 5;
+}
+
+static size_t cbor_int_size(int32_t value)
+{
+    return cbor_head_size(value < 0 ? (uint32_t)(-1 - value) : (uint32_t)value);
+}
+
+size_t telemetry_codec_envelope_size(uint32_t timestamp, size_t count)
+{
+    return CONTAINER_SIZE(ENVELOPE_ENTRIES) +
+           cbor_head_size(ENVELOPE_KEY_VERSION) + cbor_head_size(TELEMETRY_CODEC_VERSION) +
+           cbor_head_size(ENVELOPE_KEY_KIND) + cbor_head_size(TELEMETRY_MSG_NODE_DISCOVERED) +
+           cbor_head_size(ENVELOPE_KEY_TIMESTAMP) + cbor_head_size(timestamp) +
+           cbor_head_size(ENVELOPE_KEY_RECORDS) + CONTAINER_SIZE(count);
+}
+
+static size_t telemetry_fields(const struct node_telemetry *rec)
+{
+    return rec->count ? SUMMARY_FIELDS : TELEMETRY_FIELDS;
+}
+
+size_t telemetry_codec_telemetry_size(const struct node_telemetry *rec)
+{
+    size_t unit_len = strnlen(rec->unit, NODE_UNIT_LEN);
+    size_t summary = 0;
+
+    if (rec->count) {
+        summary = cbor_head_size(rec->count) + 2 * (1 + sizeof(float));
+    }
+
+    return CONTAINER_SIZE(telemetry_fields(rec)) +
+           1 + NODE_ADDR_LEN +
+           cbor_head_size(rec->timestamp) +
+           1 + sizeof(float) +
+           cbor_head_size(unit_len) + unit_len +
+           cbor_head_size(rec->quality) +
+           cbor_head_size(rec->battery_mv) +
+           cbor_head_size(rec->battery_pct) +
+           cbor_head_size(rec->faults) +
+           cbor_int_size(rec->rssi) +
+           summary;
+}
+
+int telemetry_codec_begin(struct telemetry_encoder *enc, uint8_t *buf, size_t size,
+                          enum telemetry_msg_kind kind, uint32_t timestamp,
+                          size_t max_records)
+{
+    zcbor_state_t *state = enc->state;
+
+    zcbor_new_encode_state(enc->state, ARRAY_SIZE(enc->state), buf, size, 1);
+    enc->buf = buf;
+    enc->max_records = max_records;
+    enc->count = 0;
+
+    if (!zcbor_map_start_encode(state, ENVELOPE_ENTRIES) ||
+        !zcbor_uint32_put(state, ENVELOPE_KEY_VERSION) ||
+        !zcbor_uint32_put(state, TELEMETRY_CODEC_VERSION) ||
+        !zcbor_uint32_put(state, ENVELOPE_KEY_KIND) ||
+        !zcbor_uint32_put(state, kind) ||
+        !zcbor_uint32_put(state, ENVELOPE_KEY_TIMESTAMP) ||
+        !zcbor_uint32_put(state, timestamp) ||
+        !zcbor_uint32_put(state, ENVELOPE_KEY_RECORDS) ||
+        !zcbor_list_start_encode(state, max_records)) {
+        return -ENOMEM;
+    }
+
+    return 0;
+}
+
+int telemetry_codec_add_telemetry(struct telemetry_encoder *enc,
+                                  const struct node_telemetry *rec)
+{
+    zcbor_state_t *state = enc->state;
+    size_t fields = telemetry_fields(rec);
+
+    if (enc->count >= enc->max_records) {
+        return -ENOMEM;
+    }
+
+    if (!zcbor_list_start_encode(state, fields) ||
+        !zcbor_bstr_encode_ptr(state, (const char *)rec->node_id, NODE_ADDR_LEN) ||
+        !zcbor_uint32_put(state, rec->timestamp) ||
+        !zcbor_float32_put(state, rec->value) ||
+        !zcbor_tstr_encode_ptr(state, rec->unit, strnlen(rec->unit, NODE_UNIT_LEN)) ||
+        !zcbor_uint32_put(state, rec->quality) ||
+        !zcbor_uint32_put(state, rec->battery_mv) ||
+        !zcbor_uint32_put(state, rec->battery_pct) ||
+        !zcbor_uint32_put(state, rec->faults) ||
+        !zcbor_int32_put(state, rec->rssi)) {
+        return -ENOMEM;
+    }
+    if (rec->count &&
+        (!zcbor_uint32_put(state, rec->count) ||
+         !zcbor_float32_put(state, rec->min) ||
+         !zcbor_float32_put(state, rec->max))) {
+        return -ENOMEM;
+    }
+    if (!zcbor_list_end_encode(state, fields)) {
+        return -ENOMEM;
+    }
+
+    enc->count++;
+    return 0;
+}
+
+int telemetry_codec_add_discovered(struct telemetry_encoder *enc,
+                                   const struct node_discovered *rec)
+{
+    zcbor_state_t *state = enc->state;
+
+    if (enc->count >= enc->max_records) {
+        return -ENOMEM;
+    }
+
+    if (!zcbor_list_start_encode(state, DISCOVERED_FIELDS) ||
+        !zcbor_bstr_encode_ptr(state, (const char *)rec->node_id, NODE_ADDR_LEN) ||
+        !zcbor_int32_put(state, rec->rssi) ||
+        !zcbor_uint32_put(state, rec->battery_pct) ||
+        !zcbor_float32_put(state, rec->last_reading) ||
+        !zcbor_uint32_put(state, rec->fault_flags) ||
+        !zcbor_uint32_put(state, rec->counter) ||
+        !zcbor_list_end_encode(state, DISCOVERED_FIELDS)) {
+        return -ENOMEM;
+    }
+
+    enc->count++;
+    return 0;
+}
+
+int telemetry_codec_end(struct telemetry_encoder *enc, size_t *encoded_len)
+{
+    zcbor_state_t *state = enc->state;
+
+    if (!zcbor_list_end_encode(state, enc->max_records) ||
+        !zcbor_map_end_encode(state, ENVELOPE_ENTRIES)) {
+        return -ENOMEM;
+    }
+
+    *encoded_len = state->payload - enc->buf;
+    return 0;
+}
+
+int telemetry_codec_encode_telemetry(uint8_t *buf, size_t size, uint32_t timestamp,
+                                     const struct node_telemetry *records, size_t count,
+                                     size_t *encoded_len)
+{
+    struct telemetry_encoder enc;
+    int err;
+
+    err = telemetry_codec_begin(&enc, buf, size, TELEMETRY_MSG_NODE_TELEMETRY,
+                                timestamp, count);
+    for (size_t i = 0; !err && i < count; i++) {
+        err = telemetry_codec_add_telemetry(&enc, &records[i]);
+    }
+
+    return err ? err : telemetry_codec_end(&enc, encoded_len);
+}
+
+int telemetry_codec_encode_discovered(uint8_t *buf, size_t size, uint32_t timestamp,
+                                      const struct node_discovered *records, size_t count,
+                                      size_t *encoded_len)
+{
+    struct telemetry_encoder enc;
+    int err;
+
+    err = telemetry_codec_begin(&enc, buf, size, TELEMETRY_MSG_NODE_DISCOVERED,
+                                timestamp, count);
+    for (size_t i = 0; !err && i < count; i++) {
+        err = telemetry_codec_add_discovered(&enc, &records[i]);
+    }
+
+    return err ? err : telemetry_codec_end(&enc, encoded_len);
+}
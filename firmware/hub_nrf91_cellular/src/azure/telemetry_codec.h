@@ -0,0 +1,109 @@
+/*
+ * Telemetry Codec
+ * Compact CBOR encoding of node telemetry and discovery records
+ */
+
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <zcbor_common.h>
+
+#define NODE_ADDR_LEN 6
+#define NODE_UNIT_LEN 8
+
+/* Envelope schema version, bumped on any change to the record layout */
+#define TELEMETRY_CODEC_VERSION 2
+
+/* Envelope message kinds (CBOR key 1) */
+enum telemetry_msg_kind {
+    TELEMETRY_MSG_NODE_TELEMETRY = 1,
+    TELEMETRY_MSG_NODE_DISCOVERED = 2,
+};
+
+/* Binary form of NodeTelemetryPayload (common/protocol/ipc-protocol.ts) */
+struct node_telemetry {
+    uint8_t node_id[NODE_ADDR_LEN];  /* BLE MAC address */
+    uint32_t timestamp;              /* Unix epoch seconds */
+    float value;                     /* Engineering units */
+    char unit[NODE_UNIT_LEN];        /* NUL-terminated */
+    uint8_t quality;                 /* QUALITY_FLAGS bitfield */
+    uint16_t battery_mv;
+    uint8_t battery_pct;
+    uint8_t faults;                  /* FAULT_FLAGS bitfield */
+    int8_t rssi;
+    uint16_t count;                  /* Readings in a window summary, 0 for one reading */
+    float min;                       /* Window range, only if count is set */
+    float max;
+};
+
+/* Binary form of NodeDiscoveredPayload (common/protocol/ipc-protocol.ts) */
+struct node_discovered {
+    uint8_t node_id[NODE_ADDR_LEN];
+    int8_t rssi;
+    uint8_t battery_pct;
+    float last_reading;
+    uint8_t fault_flags;
+    uint16_t counter;
+};
+
+/* Envelope map -> records list -> record list */
+#define TELEMETRY_CODEC_NESTING 3
+
+/* Streaming encoder, records are appended one at a time */
+struct telemetry_encoder {
+    zcbor_state_t state[TELEMETRY_CODEC_NESTING + 2];
+    uint8_t *buf;
+    size_t max_records;
+    size_t count;
+};
+
+/**
+ * Start an envelope of the given kind holding at most max_records records.
+ *
+ * @return 0 on success, -ENOMEM if buf is too small for the envelope
+ */
+int telemetry_codec_begin(struct telemetry_encoder *enc, uint8_t *buf, size_t size,
+                          enum telemetry_msg_kind kind, uint32_t timestamp,
+                          size_t max_records);
+
+int telemetry_codec_add_telemetry(struct telemetry_encoder *enc,
+                                  const struct node_telemetry *rec);
+int telemetry_codec_add_discovered(struct telemetry_encoder *enc,
+                                   const struct node_discovered *rec);
+
+/**
+ * Close the envelope and return its final encoded length.
+ */
+int telemetry_codec_end(struct telemetry_encoder *enc, size_t *encoded_len);
+
+/**
+ * Exact encoded size of the envelope around count records, and of a single
+ * telemetry record. Used to pack messages up to a target size.
+ */
+size_t telemetry_codec_envelope_size(uint32_t timestamp, size_t count);
+size_t telemetry_codec_telemetry_size(const struct node_telemetry *rec);
+
+/**
+ * Encode a batch of telemetry records into buf.
+ *
+ * Records are written straight into the caller's buffer (normally the MQTT
+ * TX buffer) with no intermediate representation.
+ *
+ * @return 0 on success, -ENOMEM if the batch does not fit
+ */
+int telemetry_codec_encode_telemetry(uint8_t *buf, size_t size, uint32_t timestamp,
+                                     const struct node_telemetry *records, size_t count,
+                                     size_t *encoded_len);
+
+/**
+ * Encode a batch of node discovery records into buf.
+ *
+ * @return 0 on success, -ENOMEM if the batch does not fit
+ */
+int telemetry_codec_encode_discovered(uint8_t *buf, size_t size, uint32_t timestamp,
+                                      const struct node_discovered *records, size_t count,
+                                      size_t *encoded_len);
+
+#endif /* TELEMETRY_CODEC_H */
@@ -0,0 +1,20 @@
+/*
+ * Hub Events
+ * Wake-up sources for the main state machine, posted from driver callbacks
+ */
+
+#ifndef HUB_EVENTS_H
+#define HUB_EVENTS_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#define HUB_EVT_LTE_UP     BIT(0)  /* Registered to the network, level */
+#define HUB_EVT_CLOUD_DOWN BIT(1)  /* IoT Hub MQTT connection dropped */
+#define HUB_EVT_IPC_RX     BIT(2)  /* Bytes waiting from the BLE processor */
+#define HUB_EVT_DPS_DONE   BIT(3)  /* DPS registration assigned or failed */
+
+/* Defined in main.c */
+extern struct k_event hub_events;
+
+#endif /* HUB_EVENTS_H */
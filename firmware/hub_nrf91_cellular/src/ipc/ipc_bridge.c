@@ -1,14 +1,285 @@
-/* IPC Bridge stub implementation */
+/*
+ * IPC Bridge Implementation
+ *
+ * UART reception runs on the async API. The driver callback only copies
+ * received bytes into a ring buffer and raises HUB_EVT_IPC_RX; the main
+ * thread reassembles frames from the ring in ipc_bridge_process().
+ *
+ * Frames carry no sync marker. After a bad header or CRC one byte is
+ * dropped and decoding resumes, which resynchronizes on the next frame.
+ *
+ * Requests that expect an answer get a correlation id from
+ * ipc_requests.c; responses are routed back by that id alone.
+ */
 
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/ring_buffer.h>
 #include <zephyr/logging/log.h>
 #include "ipc_bridge.h"
+#include "node_table.h"
+#include "hub_events.h"
+#include "azure/device_twin.h"
+#include "azure/iot_hub_client.h"
+#include "azure/telemetry_batch.h"
 
 LOG_MODULE_REGISTER(ipc_bridge, LOG_LEVEL_INF);
 
-void ipc_bridge_init(void) {
+#define IPC_UART_NODE     DT_NODELABEL(uart1)
+#define RX_CHUNK_SIZE     64
+#define RX_RING_SIZE      1024
+#define RX_IDLE_US        1000  /* Hand over a partial chunk after 1 ms of silence */
+#define TX_TIMEOUT_MS     1000
+#define FRAME_SIZE        (sizeof(struct ipc_header) + IPC_MAX_PAYLOAD)
+
+static const struct device *uart = DEVICE_DT_GET(IPC_UART_NODE);
+static uint8_t rx_chunks[2][RX_CHUNK_SIZE];
+static uint8_t next_chunk;
+static uint8_t rx_frame[FRAME_SIZE];
+static size_t rx_frame_len;
+static uint8_t tx_frame[FRAME_SIZE];
+
+static K_SEM_DEFINE(tx_idle, 1, 1);
+
+RING_BUF_DECLARE(rx_ring, RX_RING_SIZE);
+
+static void uart_callback(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+    switch (evt->type) {
+    case UART_RX_RDY:
+        if (ring_buf_put(&rx_ring, evt->data.rx.buf + evt->data.rx.offset,
+                         evt->data.rx.len) < evt->data.rx.len) {
+            LOG_WRN("IPC RX overrun");
+        }
+        k_event_post(&hub_events, HUB_EVT_IPC_RX);
+        break;
+
+    case UART_RX_BUF_REQUEST:
+        uart_rx_buf_rsp(dev, rx_chunks[next_chunk], RX_CHUNK_SIZE);
+        next_chunk ^= 1;
+        break;
+
+    case UART_RX_DISABLED:
+        /* Restart after a line error, reception must never stay off */
+        next_chunk = 1;
+        uart_rx_enable(dev, rx_chunks[0], RX_CHUNK_SIZE, RX_IDLE_US);
+        break;
+
+    case UART_TX_DONE:
+    case UART_TX_ABORTED:
+        k_sem_give(&tx_idle);
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void handle_node_telemetry(const uint8_t *payload, uint16_t len)
+{
+    struct ipc_node_telemetry wire;
+    struct node_telemetry rec = { 0 };
+
+    for (uint16_t off = 0; off + sizeof(wire) <= len; off += sizeof(wire)) {
+        memcpy(&wire, payload + off, sizeof(wire));
+
+        memcpy(rec.node_id, wire.node_id, sizeof(rec.node_id));
+        memcpy(rec.unit, wire.unit, sizeof(rec.unit));
+        rec.timestamp = wire.timestamp ? wire.timestamp : iot_hub_epoch_seconds();
+        rec.value = wire.value;
+        rec.quality = wire.quality;
+        rec.battery_mv = wire.battery_mv;
+        rec.battery_pct = wire.battery_pct;
+        rec.faults = wire.faults;
+        rec.rssi = wire.rssi;
+
+        telemetry_batch_add(&rec);
+        device_twin_update_node(&rec);
+    }
+}
+
+/*
+ * A window summary goes upstream as one record holding the mean as its
+ * value, plus count, min and max; the twin gets the last value as the
+ * node's latest reading.
+ */
+static void handle_node_summary(const uint8_t *payload, uint16_t len)
+{
+    struct ipc_node_summary wire;
+    struct node_telemetry rec = { 0 };
+
+    for (uint16_t off = 0; off + sizeof(wire) <= len; off += sizeof(wire)) {
+        memcpy(&wire, payload + off, sizeof(wire));
+
+        memcpy(rec.node_id, wire.node_id, sizeof(rec.node_id));
+        memcpy(rec.unit, wire.unit, sizeof(rec.unit));
+        rec.timestamp = iot_hub_epoch_seconds();
+        rec.battery_mv = wire.battery_mv;
+        rec.battery_pct = wire.battery_pct;
+        rec.faults = wire.faults;
+        rec.rssi = wire.rssi;
+
+        LOG_DBG("Summary of %u samples over %u s", wire.count, wire.window_s);
+
+        rec.value = wire.mean;
+        rec.count = wire.count;
+        rec.min = wire.min;
+        rec.max = wire.max;
+        telemetry_batch_add(&rec);
+
+        rec.value = wire.last;
+        rec.count = 0;
+        device_twin_update_node(&rec);
+    }
+}
+
+static void dispatch(const struct ipc_header *hdr, const uint8_t *payload)
+{
+    switch (hdr->type) {
+    case IPC_NODE_TELEMETRY:
+        handle_node_telemetry(payload, hdr->length);
+        break;
+    case IPC_NODE_SUMMARY:
+        handle_node_summary(payload, hdr->length);
+        break;
+    case IPC_NODE_TABLE_VERSION:
+        node_table_handle_version(payload, hdr->length);
+        break;
+    case IPC_JOB_RESULT:
+    case IPC_NODE_SYNC_RESPONSE:
+        if (ipc_request_complete(hdr->correlation_id, payload, hdr->length) != 0) {
+            LOG_WRN("Unmatched IPC response %u", hdr->correlation_id);
+        }
+        break;
+    default:
+        LOG_DBG("Unhandled IPC message type %u", hdr->type);
+        break;
+    }
+}
+
+static void drop_bytes(size_t count)
+{
+    memmove(rx_frame, rx_frame + count, rx_frame_len - count);
+    rx_frame_len -= count;
+}
+
+int ipc_bridge_init(void)
+{
+    int err;
+
+    if (!device_is_ready(uart)) {
+        LOG_ERR("IPC UART not ready");
+        return -ENODEV;
+    }
+
+    err = uart_callback_set(uart, uart_callback, NULL);
+    if (err) {
+        LOG_ERR("Failed to set UART callback: %d", err);
+        return err;
+    }
+
+    next_chunk = 1;
+    err = uart_rx_enable(uart, rx_chunks[0], RX_CHUNK_SIZE, RX_IDLE_US);
+    if (err && err != -EBUSY) {
+        LOG_ERR("Failed to enable UART RX: %d", err);
+        return err;
+    }
+
+    ipc_requests_init();
+    node_table_init();
+
     LOG_INF("IPC Bridge initialized");
+    return 0;
+}
+
+void ipc_bridge_process(void)
+{
+    struct ipc_header hdr;
+
+    do {
+        rx_frame_len += ring_buf_get(&rx_ring, rx_frame + rx_frame_len,
+                                     sizeof(rx_frame) - rx_frame_len);
+
+        while (rx_frame_len >= sizeof(hdr)) {
+            memcpy(&hdr, rx_frame, sizeof(hdr));
+
+            if (hdr.version != IPC_PROTOCOL_VERSION || hdr.length > IPC_MAX_PAYLOAD) {
+                drop_bytes(1);
+                continue;
+            }
+            if (rx_frame_len < sizeof(hdr) + hdr.length) {
+                break;
+            }
+            if (crc32_ieee(rx_frame + sizeof(hdr), hdr.length) != hdr.crc32) {
+                LOG_WRN("IPC frame CRC mismatch");
+                drop_bytes(1);
+                continue;
+            }
+
+            dispatch(&hdr, rx_frame + sizeof(hdr));
+            drop_bytes(sizeof(hdr) + hdr.length);
+        }
+    } while (!ring_buf_is_empty(&rx_ring));
+}
+
+static int send_frame(enum ipc_message_type type, uint32_t correlation_id,
+                      const void *payload, uint16_t len)
+{
+    struct ipc_header hdr = {
+        .length = len,
+        .type = type,
+        .version = IPC_PROTOCOL_VERSION,
+        .correlation_id = correlation_id,
+        .crc32 = crc32_ieee(payload, len),
+    };
+    int err;
+
+    if (len > IPC_MAX_PAYLOAD) {
+        return -EMSGSIZE;
+    }
+
+    /* The frame buffer belongs to the driver until TX completes */
+    if (k_sem_take(&tx_idle, K_MSEC(TX_TIMEOUT_MS)) != 0) {
+        return -EBUSY;
+    }
+
+    memcpy(tx_frame, &hdr, sizeof(hdr));
+    memcpy(tx_frame + sizeof(hdr), payload, len);
+
+    err = uart_tx(uart, tx_frame, sizeof(hdr) + len, SYS_FOREVER_US);
+    if (err) {
+        k_sem_give(&tx_idle);
+        LOG_ERR("IPC send failed: %d", err);
+    }
+    return err;
+}
+
+int ipc_bridge_send(enum ipc_message_type type, const void *payload, uint16_t len)
+{
+    return send_frame(type, IPC_CORRELATION_NONE, payload, len);
 }
 
-void ipc_bridge_process(void) {
-    /* Process UART messages from BLE processor */
+int ipc_bridge_request(enum ipc_message_type type, const void *payload, uint16_t len,
+                       uint32_t timeout_s, ipc_request_cb_t cb, void *user_data)
+{
+    uint32_t id;
+    int err;
+
+    if (len > IPC_MAX_PAYLOAD) {
+        return -EMSGSIZE;
+    }
+
+    id = ipc_request_open(timeout_s, cb, user_data);
+    if (id == IPC_CORRELATION_NONE) {
+        return -ENOMEM;
+    }
+
+    err = send_frame(type, id, payload, len);
+    if (err) {
+        ipc_request_cancel(id);
+    }
+    return err;
 }
@@ -1,9 +1,182 @@
-/* IPC Bridge stub */
+/*
+ * IPC Bridge
+ * Framed UART link to the nRF54L15 BLE processor
+ */
 
 #ifndef IPC_BRIDGE_H
 #define IPC_BRIDGE_H
 
-void ipc_bridge_init(void);
+#include <stdint.h>
+#include <zephyr/toolchain.h>
+#include <zephyr/sys/util.h>
+#include "azure/telemetry_codec.h"
+#include "ipc_requests.h"
+
+#define IPC_PROTOCOL_VERSION 3
+#define IPC_MAX_PAYLOAD      2048
+
+/* Mirrors hub_nrf54l15_ble/src/ipc/ipc_handler.h */
+enum ipc_message_type {
+    IPC_NODE_DISCOVERED,
+    IPC_NODE_TELEMETRY,
+    IPC_JOB_REQUEST,
+    IPC_JOB_RESULT,
+    IPC_TWIN_UPDATE,
+    IPC_JOB_BATCH_REQUEST,
+    IPC_NODE_SUMMARY,
+    IPC_NODE_TABLE_VERSION,
+    IPC_NODE_SYNC_REQUEST,
+    IPC_NODE_SYNC_RESPONSE
+};
+
+/*
+ * Frame header, followed by length payload bytes, crc32 covers the payload.
+ * A response echoes the correlation id of its request.
+ */
+struct ipc_header {
+    uint16_t length;
+    uint8_t type;
+    uint8_t version;
+    uint32_t correlation_id;
+    uint32_t crc32;
+} __packed;
+
+/*
+ * IPC_NODE_TELEMETRY payload is one or more of these. A timestamp of 0
+ * is stamped on receipt.
+ */
+struct ipc_node_telemetry {
+    uint8_t node_id[NODE_ADDR_LEN];
+    uint32_t timestamp;
+    float value;
+    char unit[NODE_UNIT_LEN];
+    uint8_t quality;
+    uint16_t battery_mv;
+    uint8_t battery_pct;
+    uint8_t faults;
+    int8_t rssi;
+} __packed;
+
+/* IPC_NODE_SUMMARY payload is one or more of these, one per node and window */
+struct ipc_node_summary {
+    uint8_t node_id[NODE_ADDR_LEN];
+    uint16_t window_s;  /* Ended when the frame was sent */
+    uint16_t count;
+    float min;
+    float max;
+    float mean;
+    float last;
+    char unit[NODE_UNIT_LEN];
+    uint16_t battery_mv;  /* 0 if not known */
+    uint8_t faults;     /* Every fault seen in the window */
+    uint8_t battery_pct;
+    int8_t rssi;
+} __packed;
+
+/* IPC_TWIN_UPDATE payload, hub settings from the twin; 0 leaves one as is */
+struct ipc_hub_config {
+    uint16_t rollup_window_s;
+    uint8_t pawr;         /* IPC_HUB_PAWR_* */
+} __packed;
+
+#define IPC_HUB_PAWR_OFF    1
+#define IPC_HUB_PAWR_ON     2
+
+/*
+ * IPC_NODE_TABLE_VERSION payload, sent when the BLE node table changed.
+ * The epoch is drawn at BLE boot; versions only compare within one epoch.
+ */
+struct ipc_node_table_version {
+    uint32_t epoch;
+    uint32_t version;
+} __packed;
+
+/* IPC_NODE_SYNC_REQUEST payload, an unknown epoch gets a full table */
+struct ipc_node_sync_request {
+    uint32_t epoch;
+    uint32_t since_version;
+} __packed;
+
+/* IPC_NODE_SYNC_RESPONSE payload header, followed by count node entries */
+struct ipc_node_sync_response {
+    uint32_t epoch;
+    uint32_t version;
+    uint8_t full;  /* Entries replace the whole table */
+    uint16_t count;
+} __packed;
+
+#define IPC_NODE_PRESENT   BIT(0)  /* Cleared for a removed node */
+#define IPC_NODE_BOUND     BIT(1)
+#define IPC_NODE_CONNECTED BIT(2)
+
+struct ipc_node_entry {
+    uint8_t node_id[NODE_ADDR_LEN];
+    uint8_t flags;
+    uint8_t state;
+    uint8_t battery_pct;
+    uint8_t faults;
+    int8_t rssi;
+    float last_reading;
+} __packed;
+
+/* Mirrors enum job_type in hub_nrf54l15_ble/src/job_executor/job_executor.h */
+enum ipc_job_type {
+    IPC_JOB_PUSH_CONFIG,
+    IPC_JOB_PULL_DIAGNOSTICS,
+    IPC_JOB_UPDATE_FIRMWARE,
+    IPC_JOB_REBOOT_NODE,
+    IPC_JOB_SAMPLE_NODE,
+    IPC_JOB_BIND_NODE,
+    IPC_JOB_UNBIND_NODE
+};
+
+/* IPC_JOB_REQUEST payload header, followed by the job body */
+struct ipc_job_request {
+    uint32_t job_id;
+    uint8_t type;
+    uint8_t node_id[NODE_ADDR_LEN];
+} __packed;
+
+/*
+ * IPC_JOB_BATCH_REQUEST payload header, followed by node_count node ids
+ * and then the job body shared by all of them
+ */
+struct ipc_job_batch_request {
+    uint32_t job_id;
+    uint8_t type;
+    uint16_t node_count;
+} __packed;
+
+/* IPC_JOB_RESULT payload, answers a whole request */
+struct ipc_job_result {
+    uint32_t job_id;
+    int32_t result;  /* 0, or the first failure: negative errno or positive ATT code */
+    uint16_t succeeded;
+    uint16_t failed;
+} __packed;
+
+/* Start UART reception, HUB_EVT_IPC_RX is posted when bytes arrive */
+int ipc_bridge_init(void);
+
+/* Decode and dispatch every complete frame received so far */
 void ipc_bridge_process(void);
 
-#endif
+/**
+ * Frame and send one message to the BLE processor.
+ *
+ * @return 0 on success, -EMSGSIZE if the payload is too long
+ */
+int ipc_bridge_send(enum ipc_message_type type, const void *payload, uint16_t len);
+
+/**
+ * Send a message that expects a response. cb runs exactly once, with the
+ * response or with -ETIMEDOUT after timeout_s seconds.
+ *
+ * @return 0 on success, -ENOMEM if too many requests are outstanding,
+ *         other negative error codes if the message could not be sent
+ *         (cb is not called then)
+ */
+int ipc_bridge_request(enum ipc_message_type type, const void *payload, uint16_t len,
+                       uint32_t timeout_s, ipc_request_cb_t cb, void *user_data);
+
+#endif /* IPC_BRIDGE_H */
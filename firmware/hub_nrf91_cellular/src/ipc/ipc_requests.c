@@ -0,0 +1,249 @@
+/*
+ * IPC Requests Implementation
+ *
+ * Every outstanding request owns one slot of a fixed table. Its id on
+ * the wire is the slot index in the low bits and the slot's generation
+ * above it, so a response is matched with one array access and a late
+ * reply to a recycled slot fails the generation check.
+ *
+ * Free slots form a singly linked list. Pending slots hang off a hashed
+ * timer wheel of one-second buckets; each bucket is a doubly linked list
+ * so completing a request unlinks it in O(1). A bucket holds every
+ * request expiring on a tick congruent to it, the ones due on a later
+ * lap are skipped when the bucket is visited. The wheel only ticks while
+ * requests are pending.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "ipc_requests.h"
+
+LOG_MODULE_REGISTER(ipc_requests, LOG_LEVEL_INF);
+
+BUILD_ASSERT(IS_POWER_OF_TWO(IPC_REQUESTS_MAX), "Slot index is masked from the id");
+
+#define WHEEL_BUCKETS  64
+#define TICK_MS        1000
+#define NIL            UINT16_MAX
+
+#define SLOT_BITS      LOG2(IPC_REQUESTS_MAX)
+#define SLOT_MASK      (IPC_REQUESTS_MAX - 1)
+#define GEN_MAX        (UINT32_MAX >> SLOT_BITS)
+
+struct request_slot {
+    ipc_request_cb_t cb;
+    void *user_data;
+    uint32_t expiry;       /* Wheel tick */
+    uint32_t generation;   /* 0 unless the request is live */
+    uint16_t next;
+    uint16_t prev;
+};
+
+static struct request_slot slots[IPC_REQUESTS_MAX];
+static uint16_t wheel[WHEEL_BUCKETS];
+static uint16_t free_head;
+static uint32_t now_tick;
+static uint32_t last_generation[IPC_REQUESTS_MAX];  /* Survives slot release */
+
+static struct ipc_request_stats stats;
+static struct k_mutex requests_mutex;
+static struct k_work_delayable tick_work;
+
+static uint32_t make_id(uint16_t idx)
+{
+    return (last_generation[idx] << SLOT_BITS) | idx;
+}
+
+static void bucket_insert(uint16_t idx)
+{
+    uint16_t *head = &wheel[slots[idx].expiry % WHEEL_BUCKETS];
+
+    slots[idx].prev = NIL;
+    slots[idx].next = *head;
+    if (*head != NIL) {
+        slots[*head].prev = idx;
+    }
+    *head = idx;
+}
+
+static void bucket_remove(uint16_t idx)
+{
+    struct request_slot *s = &slots[idx];
+
+    if (s->prev != NIL) {
+        slots[s->prev].next = s->next;
+    } else {
+        wheel[s->expiry % WHEEL_BUCKETS] = s->next;
+    }
+    if (s->next != NIL) {
+        slots[s->next].prev = s->prev;
+    }
+}
+
+static void slot_free(uint16_t idx)
+{
+    slots[idx].generation = 0;
+    slots[idx].next = free_head;
+    free_head = idx;
+    stats.in_flight--;
+}
+
+/* Slot of a live request, or NIL */
+static uint16_t lookup(uint32_t correlation_id)
+{
+    uint16_t idx = correlation_id & SLOT_MASK;
+    uint32_t generation = correlation_id >> SLOT_BITS;
+
+    if (generation == 0 || slots[idx].generation != generation) {
+        return NIL;
+    }
+    return idx;
+}
+
+static void tick_work_handler(struct k_work *work)
+{
+    uint16_t expired = NIL;
+    uint16_t idx;
+
+    k_mutex_lock(&requests_mutex, K_FOREVER);
+
+    now_tick++;
+    idx = wheel[now_tick % WHEEL_BUCKETS];
+    while (idx != NIL) {
+        uint16_t next = slots[idx].next;
+
+        if (slots[idx].expiry == now_tick) {
+            bucket_remove(idx);
+            /* Park on a private list, the callbacks run unlocked */
+            slots[idx].generation = 0;
+            slots[idx].next = expired;
+            expired = idx;
+            stats.timed_out++;
+        }
+        idx = next;
+    }
+
+    k_mutex_unlock(&requests_mutex);
+
+    for (idx = expired; idx != NIL; idx = slots[idx].next) {
+        LOG_WRN("IPC request %u timed out", make_id(idx));
+        slots[idx].cb(make_id(idx), -ETIMEDOUT, NULL, 0, slots[idx].user_data);
+    }
+
+    k_mutex_lock(&requests_mutex, K_FOREVER);
+
+    while (expired != NIL) {
+        idx = expired;
+        expired = slots[idx].next;
+        slot_free(idx);
+    }
+
+    if (stats.in_flight > 0) {
+        k_work_reschedule(&tick_work, K_MSEC(TICK_MS));
+    }
+
+    k_mutex_unlock(&requests_mutex);
+}
+
+void ipc_requests_init(void)
+{
+    k_mutex_init(&requests_mutex);
+    k_work_init_delayable(&tick_work, tick_work_handler);
+
+    for (uint16_t i = 0; i < IPC_REQUESTS_MAX; i++) {
+        slots[i].generation = 0;
+        slots[i].next = i + 1 < IPC_REQUESTS_MAX ? i + 1 : NIL;
+    }
+    for (int i = 0; i < WHEEL_BUCKETS; i++) {
+        wheel[i] = NIL;
+    }
+    free_head = 0;
+}
+
+uint32_t ipc_request_open(uint32_t timeout_s, ipc_request_cb_t cb, void *user_data)
+{
+    struct request_slot *s;
+    uint16_t idx;
+    uint32_t id;
+
+    k_mutex_lock(&requests_mutex, K_FOREVER);
+
+    idx = free_head;
+    if (idx == NIL) {
+        stats.rejected++;
+        k_mutex_unlock(&requests_mutex);
+        LOG_WRN("IPC request table full");
+        return IPC_CORRELATION_NONE;
+    }
+    free_head = slots[idx].next;
+
+    s = &slots[idx];
+    s->cb = cb;
+    s->user_data = user_data;
+    /* Expire after at least timeout_s full seconds */
+    s->expiry = now_tick + CLAMP(timeout_s, 1, IPC_REQUEST_MAX_TIMEOUT_S) + 1;
+
+    /* Never reuse a generation right away, a late reply must not match */
+    last_generation[idx] = last_generation[idx] % GEN_MAX + 1;
+    s->generation = last_generation[idx];
+    bucket_insert(idx);
+    id = make_id(idx);
+
+    stats.opened++;
+    stats.in_flight++;
+    stats.peak = MAX(stats.peak, stats.in_flight);
+
+    if (stats.in_flight == 1) {
+        k_work_reschedule(&tick_work, K_MSEC(TICK_MS));
+    }
+
+    k_mutex_unlock(&requests_mutex);
+    return id;
+}
+
+/* Release a live request, handing it the response if there is one */
+static int finish(uint32_t correlation_id, bool respond, const uint8_t *payload, uint16_t len)
+{
+    ipc_request_cb_t cb;
+    void *user_data;
+    uint16_t idx;
+
+    k_mutex_lock(&requests_mutex, K_FOREVER);
+
+    idx = lookup(correlation_id);
+    if (idx == NIL) {
+        stats.unmatched += respond;
+        k_mutex_unlock(&requests_mutex);
+        return -ENOENT;
+    }
+
+    cb = slots[idx].cb;
+    user_data = slots[idx].user_data;
+    bucket_remove(idx);
+    slot_free(idx);
+    stats.completed += respond;
+
+    k_mutex_unlock(&requests_mutex);
+
+    if (respond) {
+        cb(correlation_id, 0, payload, len, user_data);
+    }
+    return 0;
+}
+
+int ipc_request_complete(uint32_t correlation_id, const uint8_t *payload, uint16_t len)
+{
+    return finish(correlation_id, true, payload, len);
+}
+
+int ipc_request_cancel(uint32_t correlation_id)
+{
+    return finish(correlation_id, false, NULL, 0);
+}
+
+void ipc_requests_get_stats(struct ipc_request_stats *out)
+{
+    k_mutex_lock(&requests_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&requests_mutex);
+}
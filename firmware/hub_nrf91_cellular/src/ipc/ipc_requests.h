@@ -0,0 +1,56 @@
+/*
+ * IPC Requests
+ * Correlation of requests to the BLE processor with their responses
+ */
+
+#ifndef IPC_REQUESTS_H
+#define IPC_REQUESTS_H
+
+#include <stdint.h>
+
+#define IPC_REQUESTS_MAX           256   /* Outstanding requests, a power of two */
+#define IPC_REQUEST_MAX_TIMEOUT_S  3600
+
+/* Correlation id 0 marks an unsolicited message */
+#define IPC_CORRELATION_NONE       0
+
+/**
+ * Called once per request: result is 0 with the response payload, or
+ * -ETIMEDOUT with no payload. Runs without any IPC lock held.
+ */
+typedef void (*ipc_request_cb_t)(uint32_t correlation_id, int result,
+                                 const uint8_t *payload, uint16_t len, void *user_data);
+
+struct ipc_request_stats {
+    uint32_t opened;
+    uint32_t completed;
+    uint32_t timed_out;
+    uint32_t unmatched;  /* Responses for unknown or expired requests */
+    uint32_t rejected;   /* Table full */
+    uint16_t in_flight;
+    uint16_t peak;
+};
+
+void ipc_requests_init(void);
+
+/**
+ * Reserve a correlation id for a request that expires after timeout_s
+ * seconds (clamped to IPC_REQUEST_MAX_TIMEOUT_S).
+ *
+ * @return correlation id (> 0), or 0 if the table is full
+ */
+uint32_t ipc_request_open(uint32_t timeout_s, ipc_request_cb_t cb, void *user_data);
+
+/**
+ * Hand a response to its request and release the id.
+ *
+ * @return 0 on success, -ENOENT if the id is unknown or already expired
+ */
+int ipc_request_complete(uint32_t correlation_id, const uint8_t *payload, uint16_t len);
+
+/* Release an id without a response, the callback is not called */
+int ipc_request_cancel(uint32_t correlation_id);
+
+void ipc_requests_get_stats(struct ipc_request_stats *stats);
+
+#endif /* IPC_REQUESTS_H */
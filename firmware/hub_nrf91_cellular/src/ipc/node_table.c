@@ -0,0 +1,211 @@
+/*
+ * Node Table Implementation
+ *
+ * The BLE processor announces each new table version with a small
+ * IPC_NODE_TABLE_VERSION notice. The mirror then asks for the changes
+ * since the version it holds and applies them; traffic follows the rate
+ * of change rather than the number of nodes. A full table comes back
+ * only when the BLE side cannot answer with a delta, e.g. after it
+ * rebooted. One sync is in flight at a time. IPC frames arrive in
+ * order, so a response is at least as new as every notice received
+ * before it; a failed sync is retried after NODE_TABLE_RETRY_S.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "node_table.h"
+
+LOG_MODULE_REGISTER(node_table, LOG_LEVEL_INF);
+
+struct mirror_node {
+    bool used;
+    struct ipc_node_entry entry;
+};
+
+static struct mirror_node mirror[NODE_TABLE_MAX_NODES];
+static uint32_t epoch;       /* 0 until the first sync */
+static uint32_t version;
+static uint32_t announced_epoch;
+static uint32_t announced_version;
+static bool sync_pending;
+
+static struct node_table_stats stats;
+static struct k_mutex table_mutex;
+static struct k_work_delayable retry_work;
+
+static struct mirror_node *find_node(const uint8_t *node_id, bool create)
+{
+    struct mirror_node *free_slot = NULL;
+
+    for (int i = 0; i < NODE_TABLE_MAX_NODES; i++) {
+        if (!mirror[i].used) {
+            free_slot = free_slot ? free_slot : &mirror[i];
+        } else if (memcmp(mirror[i].entry.node_id, node_id, NODE_ADDR_LEN) == 0) {
+            return &mirror[i];
+        }
+    }
+
+    if (!create || !free_slot) {
+        return NULL;
+    }
+    free_slot->used = true;
+    stats.nodes++;
+    return free_slot;
+}
+
+static void apply_entry(const struct ipc_node_entry *entry)
+{
+    struct mirror_node *node;
+
+    if (!(entry->flags & IPC_NODE_PRESENT)) {
+        node = find_node(entry->node_id, false);
+        if (node) {
+            node->used = false;
+            stats.nodes--;
+        }
+        return;
+    }
+
+    node = find_node(entry->node_id, true);
+    if (!node) {
+        LOG_WRN("Node table full");
+        return;
+    }
+    node->entry = *entry;
+}
+
+static bool behind(void)
+{
+    return epoch != announced_epoch || version < announced_version;
+}
+
+static void sync_done(uint32_t correlation_id, int result,
+                      const uint8_t *payload, uint16_t len, void *user_data)
+{
+    struct ipc_node_sync_response hdr;
+    struct ipc_node_entry entry;
+
+    k_mutex_lock(&table_mutex, K_FOREVER);
+
+    sync_pending = false;
+
+    if (result == 0 && len >= sizeof(hdr)) {
+        memcpy(&hdr, payload, sizeof(hdr));
+    }
+    if (result != 0 || len < sizeof(hdr) || len < sizeof(hdr) + hdr.count * sizeof(entry)) {
+        LOG_WRN("Node table sync failed: %d", result);
+        k_work_schedule(&retry_work, K_SECONDS(NODE_TABLE_RETRY_S));
+        k_mutex_unlock(&table_mutex);
+        return;
+    }
+
+    if (hdr.full) {
+        memset(mirror, 0, sizeof(mirror));
+        stats.nodes = 0;
+        stats.full_syncs++;
+    }
+
+    for (uint16_t i = 0; i < hdr.count; i++) {
+        memcpy(&entry, payload + sizeof(hdr) + i * sizeof(entry), sizeof(entry));
+        apply_entry(&entry);
+    }
+
+    epoch = hdr.epoch;
+    version = hdr.version;
+    announced_epoch = epoch;
+    announced_version = MAX(announced_version, version);
+    stats.syncs++;
+    stats.entries += hdr.count;
+    stats.bytes += len;
+
+    LOG_DBG("Node table at %u (%s, %u entries)", version, hdr.full ? "full" : "delta",
+            hdr.count);
+
+    k_mutex_unlock(&table_mutex);
+}
+
+/* Called with table_mutex held */
+static void request_sync(void)
+{
+    struct ipc_node_sync_request req = {
+        .epoch = epoch,
+        .since_version = version,
+    };
+    int err;
+
+    err = ipc_bridge_request(IPC_NODE_SYNC_REQUEST, &req, sizeof(req),
+                             NODE_TABLE_TIMEOUT_S, sync_done, NULL);
+    if (err) {
+        LOG_WRN("Node table sync not sent: %d", err);
+        k_work_schedule(&retry_work, K_SECONDS(NODE_TABLE_RETRY_S));
+        return;
+    }
+    sync_pending = true;
+}
+
+static void retry_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&table_mutex, K_FOREVER);
+    if (!sync_pending) {
+        request_sync();
+    }
+    k_mutex_unlock(&table_mutex);
+}
+
+void node_table_init(void)
+{
+    k_mutex_init(&table_mutex);
+    k_work_init_delayable(&retry_work, retry_work_handler);
+
+    k_mutex_lock(&table_mutex, K_FOREVER);
+    request_sync();
+    k_mutex_unlock(&table_mutex);
+}
+
+void node_table_handle_version(const uint8_t *payload, uint16_t len)
+{
+    struct ipc_node_table_version msg;
+
+    if (len < sizeof(msg)) {
+        return;
+    }
+    memcpy(&msg, payload, sizeof(msg));
+
+    k_mutex_lock(&table_mutex, K_FOREVER);
+
+    announced_epoch = msg.epoch;
+    announced_version = msg.version;
+    if (!sync_pending && behind()) {
+        request_sync();
+    }
+
+    k_mutex_unlock(&table_mutex);
+}
+
+int node_table_get(const uint8_t *node_id, struct ipc_node_entry *entry)
+{
+    struct mirror_node *node;
+
+    k_mutex_lock(&table_mutex, K_FOREVER);
+
+    if (epoch == 0) {
+        k_mutex_unlock(&table_mutex);
+        return -EAGAIN;
+    }
+
+    node = find_node(node_id, false);
+    if (node) {
+        *entry = node->entry;
+    }
+
+    k_mutex_unlock(&table_mutex);
+    return node ? 0 : -ENOENT;
+}
+
+void node_table_get_stats(struct node_table_stats *out)
+{
+    k_mutex_lock(&table_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&table_mutex);
+}
@@ -0,0 +1,42 @@
+/*
+ * Node Table
+ * Mirror of the BLE processor's node table, kept in sync by deltas
+ */
+
+#ifndef NODE_TABLE_H
+#define NODE_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "ipc_bridge.h"
+
+#define NODE_TABLE_MAX_NODES  100  /* Twin contract limit per hub */
+#define NODE_TABLE_TIMEOUT_S  5
+#define NODE_TABLE_RETRY_S    30
+
+struct node_table_stats {
+    uint32_t syncs;
+    uint32_t full_syncs;
+    uint32_t entries;  /* Node entries received */
+    uint32_t bytes;    /* Sync response bytes received */
+    uint16_t nodes;
+};
+
+/* Ask for the whole table, the BLE processor may have been up for a while */
+void node_table_init(void);
+
+/* IPC_NODE_TABLE_VERSION from the BLE processor */
+void node_table_handle_version(const uint8_t *payload, uint16_t len);
+
+/**
+ * Copy the mirrored entry of one node. The twin uses it to drop nodes
+ * the BLE processor no longer knows.
+ *
+ * @return 0 on success, -ENOENT if the node is not in the table,
+ *         -EAGAIN before the first sync
+ */
+int node_table_get(const uint8_t *node_id, struct ipc_node_entry *entry);
+
+void node_table_get_stats(struct node_table_stats *stats);
+
+#endif /* NODE_TABLE_H */
@@ -7,13 +7,31 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/watchdog.h>
 #include "network/lte_connection.h"
+#include "network/uplink_scheduler.h"
 #include "azure/iot_hub_client.h"
+#include "azure/telemetry_batch.h"
 #include "azure/device_twin.h"
 #include "azure/provisioning.h"
 #include "ipc/ipc_bridge.h"
+#include "hub_events.h"
 
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
+/* Uplink cadence: period and how far each run may move to share a wake-up */
+#define TELEMETRY_SLACK_S   60
+#define TWIN_SYNC_PERIOD_S  300
+#define TWIN_SYNC_SLACK_S   120
+#define HEARTBEAT_PERIOD_S  840
+#define HEARTBEAT_SLACK_S   240
+
+BUILD_ASSERT(HEARTBEAT_PERIOD_S + HEARTBEAT_SLACK_S < CONFIG_MQTT_KEEPALIVE,
+             "Heartbeat must land before the MQTT keepalive expires");
+
+#define WDT_TIMEOUT_MS          30000
+#define WDT_FEED_INTERVAL_MS    10000
+#define LTE_CONNECT_TIMEOUT_MS  60000
+#define DPS_TIMEOUT_MS          60000
+
 /* Hub states */
 enum hub_state {
     HUB_INIT,
@@ -25,9 +43,10 @@ enum hub_state {
 };
 
 static enum hub_state current_state = HUB_INIT;
-static struct k_work_delayable twin_sync_work;
 static const struct device *wdt;
 
+K_EVENT_DEFINE(hub_events);
+
 /* Watchdog callback */
 static void wdt_callback(const struct device *dev, int channel_id)
 {
@@ -45,7 +64,7 @@ static int init_watchdog(void)
 
     struct wdt_timeout_cfg wdt_config = {
         .window.min = 0,
-        .window.max = 30000, /* 30 seconds */
+        .window.max = WDT_TIMEOUT_MS,
         .callback = wdt_callback,
     };
 
@@ -67,18 +86,54 @@ static void feed_watchdog(void)
     }
 }
 
-/* Twin sync worker */
-static void twin_sync_worker(struct k_work *work)
+/*
+ * Block until one of the events in mask is posted or timeout_ms passes,
+ * feeding the watchdog while asleep. A mask of 0 simply sleeps.
+ */
+static uint32_t wait_events(uint32_t mask, int32_t timeout_ms)
+{
+    int64_t deadline = k_uptime_get() + timeout_ms;
+    int64_t remaining = timeout_ms;
+    uint32_t events;
+
+    do {
+        feed_watchdog();
+        events = k_event_wait(&hub_events, mask, false,
+                              K_MSEC(MIN(remaining, WDT_FEED_INTERVAL_MS)));
+        remaining = deadline - k_uptime_get();
+    } while (!events && remaining > 0);
+
+    return events;
+}
+
+/* Posted from the MQTT RX thread when the connection drops */
+static void iot_hub_event_handler(const struct iot_hub_evt *evt)
 {
-    if (current_state == OPERATIONAL) {
-        device_twin_sync();
-        k_work_schedule(&twin_sync_work, K_MINUTES(5));
+    if (evt->type == IOT_HUB_EVT_DISCONNECTED) {
+        k_event_post(&hub_events, HUB_EVT_CLOUD_DOWN);
     }
 }
 
+/* Register periodic uplink work with the scheduler */
+static void init_uplink_tasks(void)
+{
+    uplink_scheduler_init();
+
+    /* Oldest buffered reading is never older than TELEMETRY_BATCH_MAX_AGE_S */
+    uplink_scheduler_add_task("telemetry",
+                              TELEMETRY_BATCH_MAX_AGE_S - TELEMETRY_SLACK_S,
+                              TELEMETRY_SLACK_S, telemetry_batch_flush);
+    uplink_scheduler_add_task("twin", TWIN_SYNC_PERIOD_S, TWIN_SYNC_SLACK_S,
+                              device_twin_sync);
+    uplink_scheduler_add_task("heartbeat", HEARTBEAT_PERIOD_S, HEARTBEAT_SLACK_S,
+                              iot_hub_heartbeat);
+}
+
 /* State machine */
 static void run_state_machine(void)
 {
+    int err;
+
     switch (current_state) {
     case HUB_INIT:
         LOG_INF("Initializing hub");
@@ -91,52 +146,81 @@ static void run_state_machine(void)
 
     case LTE_CONNECTING:
         LOG_INF("Connecting to LTE network");
-        if (lte_connection_connect() == 0) {
-            if (provisioning_is_provisioned()) {
-                current_state = IOT_HUB_CONNECTING;
-            } else {
-                current_state = DPS_PROVISIONING;
-            }
+        if (lte_connection_connect() != 0) {
+            wait_events(0, LTE_CONNECT_TIMEOUT_MS);
+            break;
+        }
+        if (!wait_events(HUB_EVT_LTE_UP, LTE_CONNECT_TIMEOUT_MS)) {
+            LOG_ERR("LTE connection timeout");
+            break;
+        }
+        LOG_INF("LTE connected successfully");
+        if (provisioning_is_provisioned()) {
+            current_state = IOT_HUB_CONNECTING;
+        } else {
+            current_state = DPS_PROVISIONING;
         }
         break;
 
     case DPS_PROVISIONING:
         LOG_INF("Provisioning via DPS");
-        if (provisioning_register() == 0) {
+        err = provisioning_register_start();
+        if (err == 0 && !wait_events(HUB_EVT_DPS_DONE, DPS_TIMEOUT_MS)) {
+            LOG_ERR("DPS registration timed out");
+            err = -ETIMEDOUT;
+        }
+        if (err == 0) {
+            err = provisioning_register_finish();
+        }
+        if (err == 0) {
             current_state = IOT_HUB_CONNECTING;
         } else {
-            k_sleep(K_SECONDS(30));
+            wait_events(0, 30000);
         }
         break;
 
     case IOT_HUB_CONNECTING:
+        if (!lte_connection_is_connected()) {
+            current_state = LTE_CONNECTING;
+            break;
+        }
         LOG_INF("Connecting to IoT Hub");
-        if (iot_hub_connect() == 0) {
-            device_twin_init();
-            ipc_bridge_init();
-            k_work_schedule(&twin_sync_work, K_MINUTES(5));
+        err = iot_hub_connect();
+        if (err == 0) {
+            /* Drop any disconnect left over from failed attempts */
+            k_event_clear(&hub_events, HUB_EVT_CLOUD_DOWN);
+            uplink_scheduler_start();
             current_state = OPERATIONAL;
+        } else if (err == -EACCES) {
+            /* Device moved to another hub, ask DPS again */
+            provisioning_invalidate();
+            current_state = DPS_PROVISIONING;
         } else {
-            k_sleep(K_SECONDS(10));
+            wait_events(0, 10000);
         }
         break;
 
-    case OPERATIONAL:
-        /* Process IPC messages */
-        ipc_bridge_process();
-        
-        /* Process IoT Hub messages */
-        iot_hub_process();
-        
-        /* Feed watchdog */
-        feed_watchdog();
-        
-        k_sleep(K_MSEC(100));
+    case OPERATIONAL: {
+        /* Sleep until there is work, waking only to feed the watchdog */
+        uint32_t events = wait_events(HUB_EVT_IPC_RX | HUB_EVT_CLOUD_DOWN,
+                                      WDT_FEED_INTERVAL_MS);
+
+        k_event_clear(&hub_events, events);
+
+        if (events & HUB_EVT_IPC_RX) {
+            ipc_bridge_process();
+        }
+        if (events & HUB_EVT_CLOUD_DOWN) {
+            LOG_WRN("IoT Hub connection lost, reconnecting");
+            uplink_scheduler_stop();
+            current_state = IOT_HUB_CONNECTING;
+        }
         break;
+    }
 
     case ERROR:
         LOG_ERR("Error state, retrying from init");
-        k_sleep(K_SECONDS(60));
+        wait_events(0, 60000);
         current_state = HUB_INIT;
         break;
     }
@@ -151,8 +235,21 @@ int main(void)
         LOG_ERR("Failed to initialize watchdog");
     }
 
-    /* Initialize twin sync work */
-    k_work_init_delayable(&twin_sync_work, twin_sync_worker);
+    /* Cached DPS assignment, lets a reboot skip provisioning */
+    if (provisioning_init() != 0) {
+        LOG_ERR("Failed to initialize provisioning storage");
+    }
+
+    /* Initialize uplink batching and scheduling */
+    telemetry_batch_init();
+    device_twin_init();
+    init_uplink_tasks();
+    iot_hub_add_event_handler(iot_hub_event_handler);
+
+    /* Buffer BLE processor traffic from boot, even before the cloud is up */
+    if (ipc_bridge_init() != 0) {
+        LOG_ERR("Failed to initialize IPC bridge");
+    }
 
     /* Run state machine */
     while (1) {
@@ -7,10 +7,48 @@
 #include <modem/lte_lc.h>
 #include <modem/modem_info.h>
 #include "lte_connection.h"
+#include "hub_events.h"
 
 LOG_MODULE_REGISTER(lte_connection, LOG_LEVEL_INF);
 
+/* Predicted wake-ups are aimed this far inside the window, not at its edge */
+#define WAKE_GUARD_MS 100
+
 static bool connected = false;
+static bool rrc_connected = false;
+static int64_t rrc_connected_at;
+static int64_t rrc_idle_at;  /* Last RRC release, the PSM and eDRX timers start here */
+static struct lte_radio_stats radio_stats;
+static lte_connection_rrc_cb_t rrc_cb;
+
+static struct lte_power_params power_params = {
+    .psm_tau_s = -1,
+    .psm_active_time_s = -1,
+    .edrx_ms = -1,
+    .edrx_ptw_ms = -1,
+};
+
+static void rrc_update(bool now_connected)
+{
+    int64_t now = k_uptime_get();
+
+    if (now_connected == rrc_connected) {
+        return;
+    }
+
+    if (now_connected) {
+        radio_stats.rrc_connections++;
+        rrc_connected_at = now;
+    } else {
+        radio_stats.rrc_connected_ms += now - rrc_connected_at;
+        rrc_idle_at = now;
+    }
+    rrc_connected = now_connected;
+
+    if (rrc_cb) {
+        rrc_cb(now_connected);
+    }
+}
 
 static void lte_handler(const struct lte_lc_evt *const evt)
 {
@@ -20,13 +58,27 @@ static void lte_handler(const struct lte_lc_evt *const evt)
             evt->nw_reg_status == LTE_LC_NW_REG_REGISTERED_ROAMING) {
             LOG_INF("LTE network registered");
             connected = true;
-        } else {
+            k_event_post(&hub_events, HUB_EVT_LTE_UP);
+        } else if (connected) {
+            LOG_WRN("LTE network registration lost");
             connected = false;
+            k_event_clear(&hub_events, HUB_EVT_LTE_UP);
         }
         break;
     case LTE_LC_EVT_PSM_UPDATE:
         LOG_INF("PSM parameter update: TAU=%d, Active time=%d",
                 evt->psm_cfg.tau, evt->psm_cfg.active_time);
+        power_params.psm_tau_s = evt->psm_cfg.tau;
+        power_params.psm_active_time_s = evt->psm_cfg.active_time;
+        break;
+    case LTE_LC_EVT_EDRX_UPDATE:
+        LOG_INF("eDRX parameter update: eDRX=%.2f s, PTW=%.2f s",
+                (double)evt->edrx_cfg.edrx, (double)evt->edrx_cfg.ptw);
+        power_params.edrx_ms = (int32_t)(evt->edrx_cfg.edrx * MSEC_PER_SEC);
+        power_params.edrx_ptw_ms = (int32_t)(evt->edrx_cfg.ptw * MSEC_PER_SEC);
+        break;
+    case LTE_LC_EVT_RRC_UPDATE:
+        rrc_update(evt->rrc_mode == LTE_LC_RRC_MODE_CONNECTED);
         break;
     default:
         break;
@@ -55,6 +107,12 @@ int lte_connection_init(void)
         LOG_WRN("Failed to request PSM: %d", err);
     }
 
+    /* Request eDRX so cloud-to-device traffic does not need a PSM wake */
+    err = lte_lc_edrx_req(true);
+    if (err) {
+        LOG_WRN("Failed to request eDRX: %d", err);
+    }
+
     return 0;
 }
 
@@ -64,32 +122,81 @@ int lte_connection_connect(void)
 
     LOG_INF("Connecting to LTE network");
 
+    /* Registration is reported through HUB_EVT_LTE_UP */
     err = lte_lc_connect_async(lte_handler);
     if (err) {
         LOG_ERR("Failed to start LTE connection: %d", err);
         return err;
     }
 
-    /* Wait for connection (with timeout) */
-    for (int i = 0; i < 60; i++) {
-        if (connected) {
-            LOG_INF("LTE connected successfully");
-            return 0;
-        }
-        k_sleep(K_SECONDS(1));
-    }
-
-    LOG_ERR("LTE connection timeout");
-    return -ETIMEDOUT;
+    return 0;
 }
 
 void lte_connection_disconnect(void)
 {
     lte_lc_offline();
     connected = false;
+    k_event_clear(&hub_events, HUB_EVT_LTE_UP);
+    rrc_update(false);
 }
 
 bool lte_connection_is_connected(void)
 {
     return connected;
 }
+
+bool lte_connection_is_radio_active(void)
+{
+    return rrc_connected;
+}
+
+void lte_connection_get_power_params(struct lte_power_params *params)
+{
+    *params = power_params;
+}
+
+int64_t lte_connection_wake_in(int64_t from, int64_t to)
+{
+    int64_t wake = -1;
+    int64_t edrx_end = INT64_MAX;
+    int64_t t;
+
+    if (rrc_connected) {
+        t = MAX(from, k_uptime_get());
+        return t <= to ? t : -1;
+    }
+
+    /* The periodic TAU connects on its own */
+    if (power_params.psm_tau_s > 0) {
+        t = rrc_idle_at + (int64_t)power_params.psm_tau_s * MSEC_PER_SEC + WAKE_GUARD_MS;
+        if (t >= from && t <= to) {
+            wake = t;
+        }
+        /* With PSM, paging windows only run during the active time */
+        edrx_end = rrc_idle_at + (int64_t)MAX(power_params.psm_active_time_s, 0) * MSEC_PER_SEC;
+    }
+
+    /* The receiver is already on at the start of each eDRX window */
+    if (power_params.edrx_ms > 0) {
+        t = MIN(to - WAKE_GUARD_MS, edrx_end) - rrc_idle_at;
+        t = rrc_idle_at + t / power_params.edrx_ms * power_params.edrx_ms;
+        if (t > rrc_idle_at && t + WAKE_GUARD_MS >= from) {
+            wake = MAX(wake, t + WAKE_GUARD_MS);
+        }
+    }
+
+    return wake;
+}
+
+void lte_connection_get_radio_stats(struct lte_radio_stats *stats)
+{
+    *stats = radio_stats;
+    if (rrc_connected) {
+        stats->rrc_connected_ms += k_uptime_get() - rrc_connected_at;
+    }
+}
+
+void lte_connection_set_rrc_handler(lte_connection_rrc_cb_t cb)
+{
+    rrc_cb = cb;
+}
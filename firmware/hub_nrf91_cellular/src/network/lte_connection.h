@@ -5,9 +5,49 @@
 #ifndef LTE_CONNECTION_H
 #define LTE_CONNECTION_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Power saving parameters granted by the network, -1 when not granted */
+struct lte_power_params {
+    int32_t psm_tau_s;
+    int32_t psm_active_time_s;
+    int32_t edrx_ms;
+    int32_t edrx_ptw_ms;
+};
+
+/* Radio activity counters, RRC connected time approximates radio-on time */
+struct lte_radio_stats {
+    uint32_t rrc_connections;
+    uint64_t rrc_connected_ms;
+};
+
+typedef void (*lte_connection_rrc_cb_t)(bool rrc_connected);
+
 int lte_connection_init(void);
+
+/* Start network attach, completion is signalled with HUB_EVT_LTE_UP */
 int lte_connection_connect(void);
 void lte_connection_disconnect(void);
 bool lte_connection_is_connected(void);
 
+/**
+ * True while the modem holds an RRC connection. Uplink sent now costs no
+ * extra radio wake-up.
+ */
+bool lte_connection_is_radio_active(void);
+void lte_connection_get_power_params(struct lte_power_params *params);
+
+/**
+ * Latest uptime in [from, to] at which the modem is awake without being
+ * woken for uplink: an RRC connection already open, the periodic TAU, or
+ * the start of an eDRX paging window. Predicted from the granted timers
+ * and the last RRC release.
+ *
+ * @return Uptime in ms, or -1 if the modem sleeps throughout
+ */
+int64_t lte_connection_wake_in(int64_t from, int64_t to);
+void lte_connection_get_radio_stats(struct lte_radio_stats *stats);
+void lte_connection_set_rrc_handler(lte_connection_rrc_cb_t cb);
+
 #endif /* LTE_CONNECTION_H */
@@ -0,0 +1,201 @@
+/*
+ * Uplink Scheduler Implementation
+ *
+ * Every modem wake-up costs an RRC connection setup plus the inactivity
+ * tail before the modem drops back to PSM or eDRX sleep, so uplink is
+ * grouped into as few connections as possible:
+ *
+ *   - Each task may run anywhere in [due - slack, due + slack].
+ *   - The burst for the earliest deadline goes at the last moment in that
+ *     task's window when the modem is awake anyway, as predicted from the
+ *     granted TAU and eDRX cycle. Failing that it goes at due + slack,
+ *     the last moment before the task would be late. Every task whose
+ *     window has opened runs in the same burst.
+ *   - Whenever the modem enters RRC connected for any other reason
+ *     (periodic TAU, paging during an eDRX window, an expedited alarm
+ *     publish), tasks whose window is open ride along on that connection.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include "uplink_scheduler.h"
+#include "lte_connection.h"
+
+LOG_MODULE_REGISTER(uplink_scheduler, LOG_LEVEL_INF);
+
+struct uplink_task {
+    const char *name;
+    uplink_task_fn_t fn;
+    int64_t period_ms;
+    int64_t slack_ms;
+    int64_t due;
+};
+
+static struct uplink_task tasks[UPLINK_SCHEDULER_MAX_TASKS];
+static uint8_t task_count;
+static bool running;
+
+static struct uplink_scheduler_stats stats;
+static struct k_mutex sched_mutex;
+static struct k_work_delayable burst_work;
+static struct k_work piggyback_work;
+
+static void schedule_next(void)
+{
+    struct uplink_task *first = NULL;
+    int64_t deadline;
+    int64_t wake;
+
+    for (uint8_t i = 0; i < task_count; i++) {
+        if (!first || tasks[i].due + tasks[i].slack_ms < first->due + first->slack_ms) {
+            first = &tasks[i];
+        }
+    }
+    if (!first) {
+        return;
+    }
+
+    deadline = first->due + first->slack_ms;
+    wake = lte_connection_wake_in(MAX(first->due - first->slack_ms, k_uptime_get()), deadline);
+
+    k_work_reschedule(&burst_work, K_TIMEOUT_ABS_MS(wake < 0 ? deadline : wake));
+}
+
+/* Run every task whose window has opened, caller holds sched_mutex */
+static uint8_t run_open_tasks(void)
+{
+    int64_t now = k_uptime_get();
+    uint8_t ran = 0;
+
+    for (uint8_t i = 0; i < task_count; i++) {
+        struct uplink_task *task = &tasks[i];
+
+        if (now < task->due - task->slack_ms) {
+            continue;
+        }
+
+        LOG_DBG("Running %s (%lld ms from due)", task->name,
+                (long long)(now - task->due));
+        task->fn();
+        task->due = now + task->period_ms;
+        ran++;
+    }
+
+    return ran;
+}
+
+static void burst_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+
+    if (running) {
+        if (lte_connection_is_radio_active()) {
+            stats.piggybacked += run_open_tasks();
+        } else if (run_open_tasks() > 0) {
+            stats.bursts++;
+        }
+        schedule_next();
+    }
+
+    k_mutex_unlock(&sched_mutex);
+}
+
+static void piggyback_work_handler(struct k_work *work)
+{
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+
+    if (running) {
+        if (lte_connection_is_radio_active()) {
+            stats.piggybacked += run_open_tasks();
+        }
+        /* A release restarts the TAU and eDRX timers the wake-ups follow */
+        schedule_next();
+    }
+
+    k_mutex_unlock(&sched_mutex);
+}
+
+/* Called from the LTE link controller, defer the actual work */
+static void rrc_handler(bool rrc_connected)
+{
+    k_work_submit(&piggyback_work);
+}
+
+int uplink_scheduler_init(void)
+{
+    k_mutex_init(&sched_mutex);
+    k_work_init_delayable(&burst_work, burst_work_handler);
+    k_work_init(&piggyback_work, piggyback_work_handler);
+
+    lte_connection_set_rrc_handler(rrc_handler);
+
+    return 0;
+}
+
+int uplink_scheduler_add_task(const char *name, uint32_t period_s, uint32_t slack_s,
+                              uplink_task_fn_t fn)
+{
+    if (task_count >= UPLINK_SCHEDULER_MAX_TASKS) {
+        return -ENOMEM;
+    }
+
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+
+    tasks[task_count++] = (struct uplink_task){
+        .name = name,
+        .fn = fn,
+        .period_ms = (int64_t)period_s * MSEC_PER_SEC,
+        /* A window wider than half a period would reopen right after a run */
+        .slack_ms = (int64_t)MIN(slack_s, period_s / 2) * MSEC_PER_SEC,
+        .due = k_uptime_get() + (int64_t)period_s * MSEC_PER_SEC,
+    };
+
+    if (running) {
+        schedule_next();
+    }
+
+    k_mutex_unlock(&sched_mutex);
+    return 0;
+}
+
+void uplink_scheduler_start(void)
+{
+    struct lte_power_params params;
+    int64_t now = k_uptime_get();
+
+    lte_connection_get_power_params(&params);
+    LOG_INF("Uplink scheduler: %u tasks, PSM TAU %d s, active %d s, eDRX %d ms",
+            task_count, params.psm_tau_s, params.psm_active_time_s, params.edrx_ms);
+
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+
+    for (uint8_t i = 0; i < task_count; i++) {
+        tasks[i].due = now + tasks[i].period_ms;
+    }
+    running = true;
+    schedule_next();
+
+    k_mutex_unlock(&sched_mutex);
+}
+
+void uplink_scheduler_stop(void)
+{
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+    running = false;
+    k_work_cancel_delayable(&burst_work);
+    k_mutex_unlock(&sched_mutex);
+}
+
+void uplink_scheduler_get_stats(struct uplink_scheduler_stats *out)
+{
+    struct lte_radio_stats radio;
+
+    lte_connection_get_radio_stats(&radio);
+
+    k_mutex_lock(&sched_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&sched_mutex);
+
+    out->rrc_connections = radio.rrc_connections;
+    out->radio_on_ms = radio.rrc_connected_ms;
+}
@@ -0,0 +1,40 @@
+/*
+ * Uplink Scheduler
+ * Coalesces periodic uplink work into bursts aligned with modem wake-ups
+ */
+
+#ifndef UPLINK_SCHEDULER_H
+#define UPLINK_SCHEDULER_H
+
+#include <stdint.h>
+
+#define UPLINK_SCHEDULER_MAX_TASKS 4
+
+typedef void (*uplink_task_fn_t)(void);
+
+struct uplink_scheduler_stats {
+    uint32_t bursts;          /* Wake-ups initiated by the scheduler */
+    uint32_t piggybacked;     /* Task runs on an RRC connection opened by others */
+    uint32_t rrc_connections; /* All modem wake-ups, from any source */
+    uint64_t radio_on_ms;     /* Total time in RRC connected mode */
+};
+
+int uplink_scheduler_init(void);
+
+/**
+ * Register periodic uplink work. The task runs every period_s seconds,
+ * give or take slack_s, so consecutive runs are never more than
+ * period_s + slack_s apart.
+ *
+ * @return 0 on success, -ENOMEM if the task table is full
+ */
+int uplink_scheduler_add_task(const char *name, uint32_t period_s, uint32_t slack_s,
+                              uplink_task_fn_t fn);
+
+/* Start scheduling once the cloud connection is up */
+void uplink_scheduler_start(void);
+void uplink_scheduler_stop(void);
+
+void uplink_scheduler_get_stats(struct uplink_scheduler_stats *stats);
+
+#endif /* UPLINK_SCHEDULER_H */
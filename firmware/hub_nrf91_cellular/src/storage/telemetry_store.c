@@ -0,0 +1,429 @@
+/*
+ * Telemetry Store Implementation
+ *
+ * The partition is a ring of erase sectors, each a header followed by
+ * fixed-size record slots:
+ *
+ *   | header | slot | slot | ... |    header = magic, seq, erase count, crc
+ *                                     slot   = record, crc, state
+ *
+ * Sectors are filled in physical order and recycled oldest first, which
+ * spreads erases evenly over the partition. A record's position is
+ * seq * SLOTS_PER_SECTOR + slot, so positions only ever grow.
+ *
+ * No head or tail pointer is stored. At boot the sector with the highest
+ * seq is the head, and the last non-blank slot in it marks the write
+ * position. A slot torn by a power cut fails its CRC and is skipped.
+ * Uploaded records are marked by clearing their state word, which is
+ * left erased on append, so consuming costs one word write per record.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include "telemetry_store.h"
+
+LOG_MODULE_REGISTER(telemetry_store, LOG_LEVEL_INF);
+
+#define STORE_PARTITION     telemetry_storage
+#define SECTOR_MAGIC        0x544c4f32  /* "TLO2", changes with the record layout */
+#define SLOT_STATE_LIVE     0xffffffff
+#define SLOT_STATE_CONSUMED 0x00000000
+#define ERASED_WORD         0xffffffff
+
+struct sector_header {
+    uint32_t magic;
+    uint32_t seq;          /* Starts at 1, bumped every time a sector is opened */
+    uint32_t erase_count;
+    uint32_t crc;
+};
+
+struct store_slot {
+    struct node_telemetry rec;
+    uint32_t crc;
+    uint32_t state;
+};
+
+#define SLOTS_PER_SECTOR \
+    ((TELEMETRY_STORE_SECTOR_SIZE - sizeof(struct sector_header)) / sizeof(struct store_slot))
+
+/* The state word stays erased on append */
+#define SLOT_WRITE_SIZE offsetof(struct store_slot, state)
+
+BUILD_ASSERT(sizeof(struct store_slot) % sizeof(uint32_t) == 0,
+             "Slots must keep flash word alignment");
+
+struct sector_info {
+    uint32_t seq;          /* 0 when the sector has no valid header */
+    uint32_t erase_count;
+    uint16_t live;         /* Records not yet consumed */
+    uint16_t used;         /* Slots written, including torn ones */
+};
+
+static const struct flash_area *fa;
+static struct sector_info sectors[TELEMETRY_STORE_MAX_SECTORS];
+static uint32_t sector_count;
+static uint32_t head_sector;
+static uint32_t head_seq;
+static uint32_t cursor;  /* Next position to hand out, in drain order */
+
+static struct telemetry_store_stats stats;
+static struct k_mutex store_mutex;
+
+static bool newest_first(void)
+{
+    return TELEMETRY_STORE_DRAIN_POLICY == TELEMETRY_STORE_NEWEST_FIRST;
+}
+
+static off_t sector_offset(uint32_t idx)
+{
+    return (off_t)idx * TELEMETRY_STORE_SECTOR_SIZE;
+}
+
+static off_t slot_offset(uint32_t idx, uint32_t slot)
+{
+    return sector_offset(idx) + sizeof(struct sector_header) +
+           slot * sizeof(struct store_slot);
+}
+
+/* One past the newest record */
+static uint32_t head_pos(void)
+{
+    return head_seq * SLOTS_PER_SECTOR + sectors[head_sector].used;
+}
+
+static uint32_t oldest_seq(void)
+{
+    return head_seq >= sector_count ? head_seq - sector_count + 1 : 1;
+}
+
+/* Physical sector holding seq, fails once the sector has been recycled */
+static int sector_of(uint32_t seq, uint32_t *idx)
+{
+    if (seq > head_seq || head_seq - seq >= sector_count) {
+        return -ENOENT;
+    }
+
+    *idx = (head_sector + sector_count - (head_seq - seq)) % sector_count;
+    return sectors[*idx].seq == seq ? 0 : -ENOENT;
+}
+
+static uint32_t header_crc(const struct sector_header *hdr)
+{
+    return crc32_ieee((const uint8_t *)hdr, offsetof(struct sector_header, crc));
+}
+
+static uint32_t record_crc(const struct node_telemetry *rec)
+{
+    return crc32_ieee((const uint8_t *)rec, sizeof(*rec));
+}
+
+/* True if the slot holds an intact record that has not been consumed */
+static bool slot_read_live(uint32_t idx, uint32_t slot, struct store_slot *s)
+{
+    if (flash_area_read(fa, slot_offset(idx, slot), s, sizeof(*s)) != 0) {
+        return false;
+    }
+    return s->state == SLOT_STATE_LIVE && s->crc == record_crc(&s->rec);
+}
+
+static bool slot_is_blank(const struct store_slot *s)
+{
+    const uint32_t *word = (const uint32_t *)s;
+
+    for (size_t i = 0; i < sizeof(*s) / sizeof(uint32_t); i++) {
+        if (word[i] != ERASED_WORD) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void scan_sector(uint32_t idx)
+{
+    struct sector_info *info = &sectors[idx];
+    struct sector_header hdr;
+    struct store_slot s;
+
+    *info = (struct sector_info){ 0 };
+
+    if (flash_area_read(fa, sector_offset(idx), &hdr, sizeof(hdr)) != 0 ||
+        hdr.magic != SECTOR_MAGIC || hdr.crc != header_crc(&hdr)) {
+        return;
+    }
+
+    info->seq = hdr.seq;
+    info->erase_count = hdr.erase_count;
+
+    for (uint32_t slot = 0; slot < SLOTS_PER_SECTOR; slot++) {
+        if (slot_read_live(idx, slot, &s)) {
+            info->live++;
+        } else if (slot_is_blank(&s)) {
+            continue;
+        } else if (s.state == SLOT_STATE_LIVE) {
+            stats.corrupt++;
+        }
+        info->used = slot + 1;
+    }
+}
+
+/* Recycle the sector after the head, dropping whatever it still holds */
+static int open_next_sector(void)
+{
+    uint32_t next = (head_sector + 1) % sector_count;
+    struct sector_info *info = &sectors[next];
+    struct sector_header hdr = {
+        .magic = SECTOR_MAGIC,
+        .seq = head_seq + 1,
+        .erase_count = info->erase_count + 1,
+    };
+    int err;
+
+    if (info->live > 0) {
+        LOG_WRN("Log full, %u unsent readings overwritten", info->live);
+        stats.dropped += info->live;
+        stats.live -= info->live;
+    }
+
+    err = flash_area_erase(fa, sector_offset(next), TELEMETRY_STORE_SECTOR_SIZE);
+    *info = (struct sector_info){ .erase_count = hdr.erase_count };
+    if (err) {
+        LOG_ERR("Sector %u erase failed: %d", next, err);
+        return err;
+    }
+
+    hdr.crc = header_crc(&hdr);
+    err = flash_area_write(fa, sector_offset(next), &hdr, sizeof(hdr));
+    if (err) {
+        LOG_ERR("Sector %u header write failed: %d", next, err);
+        return err;
+    }
+
+    info->seq = hdr.seq;
+    head_sector = next;
+    head_seq = hdr.seq;
+    stats.max_erase_count = MAX(stats.max_erase_count, hdr.erase_count);
+    return 0;
+}
+
+/* Advance pos to the next live record in drain order, inclusive */
+static bool walk(uint32_t *pos, struct store_slot *s)
+{
+    uint32_t idx;
+
+    if (newest_first()) {
+        while (*pos >= oldest_seq() * SLOTS_PER_SECTOR) {
+            uint32_t seq = *pos / SLOTS_PER_SECTOR;
+
+            if (sector_of(seq, &idx) != 0 || sectors[idx].live == 0) {
+                *pos = seq * SLOTS_PER_SECTOR - 1;
+                continue;
+            }
+            if (slot_read_live(idx, *pos % SLOTS_PER_SECTOR, s)) {
+                return true;
+            }
+            (*pos)--;
+        }
+    } else {
+        *pos = MAX(*pos, oldest_seq() * SLOTS_PER_SECTOR);
+        while (*pos < head_pos()) {
+            uint32_t seq = *pos / SLOTS_PER_SECTOR;
+
+            if (sector_of(seq, &idx) != 0 || sectors[idx].live == 0) {
+                *pos = (seq + 1) * SLOTS_PER_SECTOR;
+                continue;
+            }
+            if (slot_read_live(idx, *pos % SLOTS_PER_SECTOR, s)) {
+                return true;
+            }
+            (*pos)++;
+        }
+    }
+
+    return false;
+}
+
+static void rewind_locked(void)
+{
+    cursor = newest_first() ? head_pos() - 1 : oldest_seq() * SLOTS_PER_SECTOR;
+}
+
+int telemetry_store_init(void)
+{
+    uint32_t idx;
+    int err;
+
+    k_mutex_init(&store_mutex);
+
+    err = flash_area_open(FIXED_PARTITION_ID(STORE_PARTITION), &fa);
+    if (err) {
+        LOG_ERR("Failed to open telemetry partition: %d", err);
+        return err;
+    }
+
+    sector_count = MIN(fa->fa_size / TELEMETRY_STORE_SECTOR_SIZE,
+                       TELEMETRY_STORE_MAX_SECTORS);
+    if (sector_count < 2) {
+        LOG_ERR("Telemetry partition too small");
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&store_mutex, K_FOREVER);
+
+    stats = (struct telemetry_store_stats){ 0 };
+    head_seq = 0;
+    for (uint32_t i = 0; i < sector_count; i++) {
+        scan_sector(i);
+        if (sectors[i].seq > head_seq) {
+            head_seq = sectors[i].seq;
+            head_sector = i;
+        }
+        stats.max_erase_count = MAX(stats.max_erase_count, sectors[i].erase_count);
+    }
+
+    if (head_seq == 0) {
+        LOG_INF("Formatting telemetry log");
+        head_sector = sector_count - 1;
+        err = open_next_sector();
+    }
+
+    /* Records in sectors that fell out of the ring can never be reached */
+    for (uint32_t i = 0; i < sector_count; i++) {
+        if (sectors[i].seq != 0 &&
+            (sector_of(sectors[i].seq, &idx) != 0 || idx != i)) {
+            sectors[i].live = 0;
+        }
+        stats.live += sectors[i].live;
+    }
+
+    rewind_locked();
+
+    k_mutex_unlock(&store_mutex);
+
+    LOG_INF("Telemetry log: %u sectors, %u slots each, %u readings pending, %u torn",
+            sector_count, (uint32_t)SLOTS_PER_SECTOR, stats.live, stats.corrupt);
+    return err;
+}
+
+int telemetry_store_append(const struct node_telemetry *recs, size_t count)
+{
+    struct store_slot s;
+    int err = 0;
+
+    k_mutex_lock(&store_mutex, K_FOREVER);
+
+    for (size_t i = 0; i < count; i++) {
+        struct sector_info *head = &sectors[head_sector];
+
+        if (head->used >= SLOTS_PER_SECTOR) {
+            err = open_next_sector();
+            if (err) {
+                break;
+            }
+            head = &sectors[head_sector];
+        }
+
+        memcpy(&s.rec, &recs[i], sizeof(s.rec));
+        s.crc = record_crc(&s.rec);
+
+        /* A failed write may leave a partial slot, never reuse it */
+        err = flash_area_write(fa, slot_offset(head_sector, head->used), &s,
+                               SLOT_WRITE_SIZE);
+        head->used++;
+        if (err) {
+            LOG_ERR("Record write failed: %d", err);
+            break;
+        }
+
+        head->live++;
+        stats.live++;
+        stats.appended++;
+    }
+
+    k_mutex_unlock(&store_mutex);
+    return err;
+}
+
+size_t telemetry_store_read(telemetry_store_take_cb_t take, void *ctx,
+                            struct telemetry_store_span *span)
+{
+    struct store_slot s;
+    uint32_t pos;
+    size_t taken = 0;
+
+    k_mutex_lock(&store_mutex, K_FOREVER);
+
+    pos = cursor;
+    while (walk(&pos, &s) && take(&s.rec, ctx)) {
+        if (taken == 0) {
+            span->first = pos;
+            span->last = pos;
+        }
+        span->first = MIN(span->first, pos);
+        span->last = MAX(span->last, pos);
+        taken++;
+
+        if (newest_first()) {
+            pos--;
+        } else {
+            pos++;
+        }
+    }
+    cursor = pos;
+
+    k_mutex_unlock(&store_mutex);
+    return taken;
+}
+
+void telemetry_store_consume(const struct telemetry_store_span *span)
+{
+    const uint32_t consumed = SLOT_STATE_CONSUMED;
+    struct store_slot s;
+    uint32_t idx;
+
+    k_mutex_lock(&store_mutex, K_FOREVER);
+
+    for (uint32_t pos = span->first; pos <= span->last; pos++) {
+        uint32_t seq = pos / SLOTS_PER_SECTOR;
+        uint32_t slot = pos % SLOTS_PER_SECTOR;
+
+        /* Sector recycled while the upload was in flight */
+        if (sector_of(seq, &idx) != 0) {
+            continue;
+        }
+        if (!slot_read_live(idx, slot, &s)) {
+            continue;
+        }
+        if (flash_area_write(fa, slot_offset(idx, slot) + offsetof(struct store_slot, state),
+                             &consumed, sizeof(consumed)) != 0) {
+            continue;
+        }
+
+        sectors[idx].live--;
+        stats.live--;
+        stats.consumed++;
+    }
+
+    k_mutex_unlock(&store_mutex);
+}
+
+void telemetry_store_rewind(void)
+{
+    k_mutex_lock(&store_mutex, K_FOREVER);
+    rewind_locked();
+    k_mutex_unlock(&store_mutex);
+}
+
+bool telemetry_store_is_empty(void)
+{
+    return stats.live == 0;
+}
+
+void telemetry_store_get_stats(struct telemetry_store_stats *out)
+{
+    k_mutex_lock(&store_mutex, K_FOREVER);
+    *out = stats;
+    k_mutex_unlock(&store_mutex);
+}
@@ -0,0 +1,77 @@
+/*
+ * Telemetry Store
+ * Flash-backed store-and-forward log for readings that do not fit in RAM
+ */
+
+#ifndef TELEMETRY_STORE_H
+#define TELEMETRY_STORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "azure/telemetry_codec.h"
+
+#define TELEMETRY_STORE_SECTOR_SIZE 4096
+#define TELEMETRY_STORE_MAX_SECTORS 64
+
+enum telemetry_store_policy {
+    TELEMETRY_STORE_OLDEST_FIRST,
+    TELEMETRY_STORE_NEWEST_FIRST,
+};
+
+/* Order in which the backlog is uploaded after an outage, tests build both */
+#ifndef TELEMETRY_STORE_DRAIN_POLICY
+#define TELEMETRY_STORE_DRAIN_POLICY TELEMETRY_STORE_NEWEST_FIRST
+#endif
+
+/* Range of log positions handed out by one read, consumed on PUBACK */
+struct telemetry_store_span {
+    uint32_t first;
+    uint32_t last;
+};
+
+struct telemetry_store_stats {
+    uint32_t live;        /* Records waiting to be uploaded */
+    uint32_t appended;
+    uint32_t consumed;
+    uint32_t dropped;     /* Overwritten before upload */
+    uint32_t corrupt;     /* Failed CRC, torn by a power cut */
+    uint32_t max_erase_count;
+};
+
+/* Called for each record in drain order, return false to stop before it */
+typedef bool (*telemetry_store_take_cb_t)(const struct node_telemetry *rec, void *ctx);
+
+/**
+ * Mount the partition and rebuild head and tail by scanning sector
+ * headers, so the log survives a power cut at any point.
+ */
+int telemetry_store_init(void);
+
+/**
+ * Append records. When the log is full the oldest sector is recycled and
+ * its unsent records are counted as dropped.
+ */
+int telemetry_store_append(const struct node_telemetry *recs, size_t count);
+
+/**
+ * Hand out records not yet handed out, in drain policy order, until take
+ * returns false. Records stay in flash until telemetry_store_consume().
+ * Newest first, records appended since the last rewind are handed out
+ * after the next one.
+ *
+ * @return number of records taken, span describes them
+ */
+size_t telemetry_store_read(telemetry_store_take_cb_t take, void *ctx,
+                            struct telemetry_store_span *span);
+
+/* Mark every record in span as uploaded */
+void telemetry_store_consume(const struct telemetry_store_span *span);
+
+/* Forget outstanding reads, unconsumed records are handed out again */
+void telemetry_store_rewind(void);
+
+bool telemetry_store_is_empty(void);
+void telemetry_store_get_stats(struct telemetry_store_stats *stats);
+
+#endif /* TELEMETRY_STORE_H */
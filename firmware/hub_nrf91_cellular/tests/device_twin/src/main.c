@@ -0,0 +1,140 @@
+/*
+ * Device Twin Tests
+ *
+ * Feeds the twin shadow a day of readings from a 32-node site sampling
+ * every 60 s and syncs on the 300 s cadence main.c registers, against a
+ * mocked IoT Hub twin. Compares the reported bytes per sync with what a
+ * full-document sync of the same state would have sent.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <stdio.h>
+#include <string.h>
+#include "azure/device_twin.h"
+#include "twin_mock.h"
+
+#define NODES           32
+#define SAMPLE_PERIOD_S 60
+#define SYNC_PERIOD_S   300  /* TWIN_SYNC_PERIOD_S of main.c */
+#define HOUR_S          3600
+#define DAY_S           (24 * HOUR_S)
+#define EPOCH_BASE      1760000000
+
+/* Node 12 reports a disconnected sensor for an hour, node 5 fades by 10 dB */
+#define FAULT_NODE      12
+#define FADE_NODE       5
+
+static void node_id(uint8_t *id, int node)
+{
+    const uint8_t base[NODE_ADDR_LEN] = { 0xC0, 0x4E, 0x30, 0x11, 0x22, node };
+
+    memcpy(id, base, NODE_ADDR_LEN);
+}
+
+/*
+ * Readings drift the way a quiet site does: RSSI jitters by +-2 dB, the
+ * battery loses a millivolt every 20 minutes
+ */
+static void make_reading(struct node_telemetry *rec, int node, int second)
+{
+    static const char *const units[] = { "PSI", "degC", "bar", "mA" };
+    int sample = second / SAMPLE_PERIOD_S;
+
+    memset(rec, 0, sizeof(*rec));
+    node_id(rec->node_id, node);
+    rec->timestamp = EPOCH_BASE + second;
+    rec->value = 101.325f + node * 0.25f + (sample % 17) * 0.01f;
+    strcpy(rec->unit, units[node % ARRAY_SIZE(units)]);
+    rec->quality = 0x07;
+    rec->battery_mv = 2950 - node * 5 - second / 1200;
+    rec->battery_pct = (rec->battery_mv - 2000) / 10;
+    rec->rssi = -60 - node % 20 + (node * 7 + sample * 13) % 5 - 2;
+
+    if (node == FAULT_NODE && second >= 6 * HOUR_S && second < 7 * HOUR_S) {
+        rec->faults = BIT(2); /* sensor_disconnected */
+    }
+    if (node == FADE_NODE && second >= 10 * HOUR_S && second < 12 * HOUR_S) {
+        rec->rssi -= 10;
+    }
+}
+
+static void *setup(void)
+{
+    zassert_ok(device_twin_init());
+    return NULL;
+}
+
+ZTEST(device_twin, test_day_against_full_document)
+{
+    struct device_twin_stats twin;
+    struct mock_twin_stats hub;
+    struct node_telemetry rec;
+    uint32_t first_hour_patch = 0;
+    uint32_t first_hour_full = 0;
+    uint32_t max_patch = 0;
+    uint8_t gone[NODE_ADDR_LEN];
+    char gone_key[32];
+
+    for (int second = 0; second < DAY_S; second += SAMPLE_PERIOD_S) {
+        for (int node = 0; node < NODES; node++) {
+            make_reading(&rec, node, second);
+            device_twin_update_node(&rec);
+        }
+
+        k_sleep(K_SECONDS(SAMPLE_PERIOD_S));
+        if ((second + SAMPLE_PERIOD_S) % SYNC_PERIOD_S == 0) {
+            uint32_t before;
+
+            device_twin_get_stats(&twin);
+            before = twin.patch_bytes;
+
+            device_twin_sync();
+
+            device_twin_get_stats(&twin);
+            max_patch = MAX(max_patch, twin.patch_bytes - before);
+            if (second + SAMPLE_PERIOD_S == HOUR_S) {
+                first_hour_patch = twin.patch_bytes;
+                first_hour_full = twin.full_bytes;
+            }
+        }
+    }
+    /* Last response */
+    k_sleep(K_SECONDS(5));
+
+    device_twin_get_stats(&twin);
+    mock_twin_get_stats(&hub);
+
+    zassert_equal(twin.syncs, DAY_S / SYNC_PERIOD_S);
+    zassert_equal(twin.rejected, 0);
+    zassert_equal(hub.reports, twin.patches);
+    zassert_equal(hub.report_bytes, twin.patch_bytes);
+    zassert_equal(hub.acked, hub.reports, "Every patch acknowledged");
+    zassert_true(max_patch <= DEVICE_TWIN_PATCH_SIZE);
+
+    /*
+     * The first patches carry whole nodes, later ones mostly the lastSeen
+     * refresh each node is due every 15 minutes. Resending whole nodes
+     * would fill every patch to DEVICE_TWIN_PATCH_SIZE instead.
+     */
+    zassert_true(twin.patch_bytes * 4 < twin.full_bytes);
+    zassert_true(first_hour_patch * 2 < first_hour_full);
+
+    TC_PRINT("%u nodes, %u syncs/day:\n", NODES, twin.syncs);
+    TC_PRINT("  full document: %u B/day, %u B/sync\n",
+             twin.full_bytes, twin.full_bytes / twin.syncs);
+    TC_PRINT("  merge patches: %u B/day, %u B/sync (%u patches, largest %u B)\n",
+             twin.patch_bytes, twin.patch_bytes / twin.syncs, twin.patches, max_patch);
+    TC_PRINT("  first hour:    %u B full, %u B patched\n",
+             first_hour_full, first_hour_patch);
+
+    /* A node the BLE processor dropped goes out as null */
+    node_id(gone, NODES - 1);
+    mock_node_table_remove(gone);
+    device_twin_sync();
+    snprintf(gone_key, sizeof(gone_key), "\"%02X:%02X:%02X:%02X:%02X:%02X\":null",
+             gone[0], gone[1], gone[2], gone[3], gone[4], gone[5]);
+    zassert_not_null(strstr(mock_twin_last_patch(), gone_key));
+}
+
+ZTEST_SUITE(device_twin, NULL, setup, NULL, NULL, NULL);
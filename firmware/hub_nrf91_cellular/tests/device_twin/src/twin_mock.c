@@ -0,0 +1,104 @@
+/*
+ * Mocked IoT Hub twin and BLE node table
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include "azure/iot_hub_client.h"
+#include "azure/device_twin.h"
+#include "ipc/ipc_bridge.h"
+#include "ipc/node_table.h"
+#include "twin_mock.h"
+
+#define MAX_REMOVED 4
+
+static iot_hub_evt_handler_t handler;
+static struct mock_twin_stats stats;
+static char last_patch[DEVICE_TWIN_PATCH_SIZE + 1];
+static uint32_t pending_rid;
+static uint8_t removed[MAX_REMOVED][NODE_ADDR_LEN];
+static int removed_count;
+
+/* IoT Hub answers a reported patch with 204 No Content */
+static void response_work_handler(struct k_work *work)
+{
+    struct iot_hub_evt evt = {
+        .type = IOT_HUB_EVT_TWIN_RESPONSE,
+        .request_id = pending_rid,
+        .result = 204,
+    };
+
+    stats.acked++;
+    handler(&evt);
+}
+
+static K_WORK_DELAYABLE_DEFINE(response_work, response_work_handler);
+
+int iot_hub_twin_report(const char *patch, size_t len, uint32_t request_id)
+{
+    __ASSERT_NO_MSG(len <= DEVICE_TWIN_PATCH_SIZE);
+    memcpy(last_patch, patch, len);
+    last_patch[len] = '\0';
+
+    stats.reports++;
+    stats.report_bytes += len;
+    pending_rid = request_id;
+    k_work_reschedule(&response_work, K_MSEC(MOCK_RTT_MS));
+    return 0;
+}
+
+/* Nothing desired, the test covers the reported side only */
+int iot_hub_twin_get(uint32_t request_id)
+{
+    return 0;
+}
+
+int iot_hub_add_event_handler(iot_hub_evt_handler_t evt_handler)
+{
+    handler = evt_handler;
+    return 0;
+}
+
+bool iot_hub_is_connected(void)
+{
+    return true;
+}
+
+int ipc_bridge_send(enum ipc_message_type type, const void *payload, uint16_t len)
+{
+    return -ENOTSUP;
+}
+
+int ipc_bridge_request(enum ipc_message_type type, const void *payload, uint16_t len,
+                       uint32_t timeout_s, ipc_request_cb_t cb, void *user_data)
+{
+    return -ENOTSUP;
+}
+
+int node_table_get(const uint8_t *node_id, struct ipc_node_entry *entry)
+{
+    for (int i = 0; i < removed_count; i++) {
+        if (memcmp(removed[i], node_id, NODE_ADDR_LEN) == 0) {
+            return -ENOENT;
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->node_id, node_id, NODE_ADDR_LEN);
+    return 0;
+}
+
+void mock_node_table_remove(const uint8_t *node_id)
+{
+    __ASSERT_NO_MSG(removed_count < MAX_REMOVED);
+    memcpy(removed[removed_count++], node_id, NODE_ADDR_LEN);
+}
+
+void mock_twin_get_stats(struct mock_twin_stats *out)
+{
+    *out = stats;
+}
+
+const char *mock_twin_last_patch(void)
+{
+    return last_patch;
+}
@@ -0,0 +1,28 @@
+/*
+ * Mocked IoT Hub twin and BLE node table
+ * Records every reported patch and acknowledges it a round trip later
+ */
+
+#ifndef TWIN_MOCK_H
+#define TWIN_MOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOCK_RTT_MS 200
+
+struct mock_twin_stats {
+    uint32_t reports;
+    uint32_t report_bytes;
+    uint32_t acked;
+};
+
+void mock_twin_get_stats(struct mock_twin_stats *stats);
+
+/* Last reported patch, NUL-terminated */
+const char *mock_twin_last_patch(void);
+
+/* The BLE processor drops the node from its table */
+void mock_node_table_remove(const uint8_t *node_id);
+
+#endif /* TWIN_MOCK_H */
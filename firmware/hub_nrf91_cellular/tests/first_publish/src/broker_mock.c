@@ -0,0 +1,383 @@
+/*
+ * Local IoT Hub stand-in
+ *
+ * A blocking connect costs the TCP handshake plus one round trip for a
+ * resumed TLS session or two for a full handshake. Packets the hub sends
+ * back are queued with the time they arrive, and zsock_poll() sleeps until
+ * then. Only what iot_hub_client.c and provisioning.c call is provided.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/net/mqtt.h>
+#include <zephyr/net/socket.h>
+#include <net/azure_iot_hub_dps.h>
+#include <date_time.h>
+#include "broker_mock.h"
+
+#define MAX_HOSTS    4
+#define MAX_PACKETS  8
+#define HOSTNAME_LEN 64
+#define MOCK_SOCKET  1
+
+struct hub {
+    char hostname[HOSTNAME_LEN];
+    bool tls_session;   /* Held in the modem's TLS session cache */
+    bool mqtt_session;  /* Held by the hub for the device */
+    bool refused;
+};
+
+struct packet {
+    enum mqtt_evt_type type;
+    int result;
+    uint16_t message_id;
+    bool session_present;
+    int64_t arrives;
+};
+
+static struct hub hubs[MAX_HOSTS];
+static struct hub *current;
+static struct packet packets[MAX_PACKETS];
+static int packet_count;
+static struct mock_broker_stats stats;
+
+/* Given whenever a packet is queued, so a poller looks again */
+static K_SEM_DEFINE(traffic, 0, MAX_PACKETS);
+
+static char dps_hostname[HOSTNAME_LEN];
+static char dps_device_id[HOSTNAME_LEN];
+static azure_iot_hub_dps_handler_t dps_handler;
+static bool dps_assigned;
+
+static struct hub *hub_get(const char *hostname)
+{
+    struct hub *free_hub = NULL;
+
+    for (int i = 0; i < MAX_HOSTS; i++) {
+        if (hubs[i].hostname[0] == '\0') {
+            free_hub = free_hub ? free_hub : &hubs[i];
+        } else if (strcmp(hubs[i].hostname, hostname) == 0) {
+            return &hubs[i];
+        }
+    }
+    __ASSERT_NO_MSG(free_hub);
+    strncpy(free_hub->hostname, hostname, HOSTNAME_LEN - 1);
+    return free_hub;
+}
+
+static void round_trips(uint32_t count)
+{
+    stats.round_trips += count;
+    k_sleep(K_MSEC(count * MOCK_RTT_MS));
+}
+
+/* A packet from the hub, an answer arrives a round trip after the request */
+static void queue_packet(const struct packet *pkt, bool answer)
+{
+    __ASSERT_NO_MSG(packet_count < MAX_PACKETS);
+    packets[packet_count] = *pkt;
+    packets[packet_count].arrives = k_uptime_get() + (answer ? MOCK_RTT_MS : 0);
+    packet_count++;
+    k_sem_give(&traffic);
+}
+
+/* Oldest packet, they all travel the same link */
+static struct packet *next_packet(void)
+{
+    struct packet *next = NULL;
+
+    for (int i = 0; i < packet_count; i++) {
+        if (!next || packets[i].arrives < next->arrives) {
+            next = &packets[i];
+        }
+    }
+    return next;
+}
+
+static void drop_packet(struct packet *pkt)
+{
+    *pkt = packets[--packet_count];
+}
+
+void mock_dps_assign(const char *hostname, const char *device_id)
+{
+    strncpy(dps_hostname, hostname, sizeof(dps_hostname) - 1);
+    strncpy(dps_device_id, device_id, sizeof(dps_device_id) - 1);
+}
+
+void mock_broker_keep_session(const char *hostname)
+{
+    hub_get(hostname)->mqtt_session = true;
+}
+
+void mock_broker_refuse(const char *hostname)
+{
+    hub_get(hostname)->refused = true;
+}
+
+void mock_broker_drop(void)
+{
+    struct packet pkt = { .type = MQTT_EVT_DISCONNECT, .result = -ECONNRESET };
+
+    packet_count = 0;
+    queue_packet(&pkt, false);
+}
+
+void mock_modem_reset(void)
+{
+    for (int i = 0; i < MAX_HOSTS; i++) {
+        hubs[i].tls_session = false;
+    }
+}
+
+void mock_broker_get_stats(struct mock_broker_stats *out)
+{
+    *out = stats;
+}
+
+void mock_broker_reset_stats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+/* Sockets */
+
+int zsock_getaddrinfo(const char *host, const char *service,
+                      const struct zsock_addrinfo *hints, struct zsock_addrinfo **res)
+{
+    static struct sockaddr_in addr = { .sin_family = AF_INET };
+    static struct zsock_addrinfo info = { .ai_family = AF_INET };
+
+    info.ai_addr = (struct sockaddr *)&addr;
+    *res = &info;
+
+    stats.dns++;
+    round_trips(1);
+    return 0;
+}
+
+void zsock_freeaddrinfo(struct zsock_addrinfo *ai)
+{
+}
+
+int zsock_poll(struct zsock_pollfd *fds, int nfds, int timeout)
+{
+    int64_t deadline = timeout < 0 ? -1 : k_uptime_get() + timeout;
+
+    fds->revents = 0;
+
+    while (1) {
+        struct packet *pkt = next_packet();
+        int64_t wake = pkt ? pkt->arrives : -1;
+
+        if (pkt && pkt->arrives <= k_uptime_get()) {
+            fds->revents = ZSOCK_POLLIN;
+            return 1;
+        }
+        if (deadline >= 0 && k_uptime_get() >= deadline) {
+            return 0;
+        }
+        if (deadline >= 0 && (wake < 0 || deadline < wake)) {
+            wake = deadline;
+        }
+        k_sem_take(&traffic, wake < 0 ? K_FOREVER : K_TIMEOUT_ABS_MS(wake));
+    }
+}
+
+/* MQTT */
+
+void mqtt_client_init(struct mqtt_client *client)
+{
+    memset(client, 0, sizeof(*client));
+}
+
+int mqtt_connect(struct mqtt_client *client)
+{
+    const struct mqtt_sec_config *tls = &client->transport.tls.config;
+    struct packet connack = { .type = MQTT_EVT_CONNACK };
+
+    current = hub_get(tls->hostname);
+    packet_count = 0;
+
+    /* TCP, then TLS */
+    round_trips(1);
+    if (tls->session_cache == TLS_SESSION_CACHE_ENABLED && current->tls_session) {
+        stats.tls_resumed++;
+        round_trips(1);
+    } else {
+        stats.tls_full++;
+        round_trips(2);
+        current->tls_session = tls->session_cache == TLS_SESSION_CACHE_ENABLED;
+    }
+    client->transport.tls.sock = MOCK_SOCKET;
+
+    if (current->refused) {
+        connack.result = 5; /* Not authorized */
+        stats.refused++;
+    } else {
+        connack.session_present = current->mqtt_session && !client->clean_session;
+        current->mqtt_session = !client->clean_session;
+    }
+    stats.round_trips++;
+    queue_packet(&connack, true);
+    return 0;
+}
+
+int mqtt_input(struct mqtt_client *client)
+{
+    struct packet *pkt = next_packet();
+    struct mqtt_evt evt = { 0 };
+
+    if (!pkt || pkt->arrives > k_uptime_get()) {
+        return 0;
+    }
+
+    evt.type = pkt->type;
+    evt.result = pkt->result;
+    switch (pkt->type) {
+    case MQTT_EVT_CONNACK:
+        evt.param.connack.session_present_flag = pkt->session_present;
+        evt.param.connack.return_code = pkt->result;
+        break;
+    case MQTT_EVT_PUBACK:
+        evt.param.puback.message_id = pkt->message_id;
+        break;
+    case MQTT_EVT_SUBACK:
+        evt.param.suback.message_id = pkt->message_id;
+        break;
+    default:
+        break;
+    }
+    drop_packet(pkt);
+
+    client->evt_cb(client, &evt);
+    return 0;
+}
+
+int mqtt_subscribe(struct mqtt_client *client, const struct mqtt_subscription_list *list)
+{
+    struct packet suback = { .type = MQTT_EVT_SUBACK, .message_id = list->message_id };
+
+    /* Pipelined, nothing waits for the SUBACK */
+    stats.subscribes++;
+    queue_packet(&suback, true);
+    return 0;
+}
+
+int mqtt_publish(struct mqtt_client *client, const struct mqtt_publish_param *param)
+{
+    struct packet puback = { .type = MQTT_EVT_PUBACK, .message_id = param->message_id };
+
+    if (param->message.topic.qos == MQTT_QOS_1_AT_LEAST_ONCE) {
+        stats.round_trips++;
+        queue_packet(&puback, true);
+    }
+    return 0;
+}
+
+int mqtt_disconnect(struct mqtt_client *client)
+{
+    struct packet pkt = { .type = MQTT_EVT_DISCONNECT };
+
+    packet_count = 0;
+    queue_packet(&pkt, false);
+    return 0;
+}
+
+int mqtt_abort(struct mqtt_client *client)
+{
+    struct mqtt_evt evt = { .type = MQTT_EVT_DISCONNECT, .result = -ECONNABORTED };
+
+    packet_count = 0;
+    client->evt_cb(client, &evt);
+    return 0;
+}
+
+int mqtt_live(struct mqtt_client *client)
+{
+    return 0;
+}
+
+int mqtt_keepalive_time_left(const struct mqtt_client *client)
+{
+    return CONFIG_MQTT_KEEPALIVE * MSEC_PER_SEC;
+}
+
+int mqtt_ping(struct mqtt_client *client)
+{
+    return 0;
+}
+
+int mqtt_publish_qos1_ack(struct mqtt_client *client, const struct mqtt_puback_param *param)
+{
+    return 0;
+}
+
+int mqtt_read_publish_payload_blocking(struct mqtt_client *client, void *buffer, size_t length)
+{
+    return -EIO;
+}
+
+/* DPS, answered after its round trips and retry-after */
+
+static void dps_work_handler(struct k_work *work)
+{
+    dps_assigned = true;
+    dps_handler(AZURE_IOT_HUB_DPS_REG_STATUS_ASSIGNED);
+}
+
+static K_WORK_DELAYABLE_DEFINE(dps_work, dps_work_handler);
+
+int azure_iot_hub_dps_init(struct azure_iot_hub_dps_config *cfg)
+{
+    dps_handler = cfg->handler;
+    return 0;
+}
+
+int azure_iot_hub_dps_start(void)
+{
+    if (dps_assigned) {
+        return -EALREADY;
+    }
+
+    stats.dps++;
+    stats.round_trips += MOCK_DPS_ROUND_TRIPS;
+    k_work_reschedule(&dps_work,
+                      K_MSEC(MOCK_DPS_ROUND_TRIPS * MOCK_RTT_MS + MOCK_DPS_RETRY_MS));
+    return 0;
+}
+
+int azure_iot_hub_dps_reset(void)
+{
+    dps_assigned = false;
+    return 0;
+}
+
+static int copy_out(struct azure_iot_hub_buf *buf, const char *value)
+{
+    if (!dps_assigned) {
+        return -ENOENT;
+    }
+    if (strlen(value) >= buf->size) {
+        return -ENOMEM;
+    }
+    strcpy(buf->ptr, value);
+    buf->size = strlen(value);
+    return 0;
+}
+
+int azure_iot_hub_dps_hostname_get(struct azure_iot_hub_buf *buf)
+{
+    return copy_out(buf, dps_hostname);
+}
+
+int azure_iot_hub_dps_device_id_get(struct azure_iot_hub_buf *buf)
+{
+    return copy_out(buf, dps_device_id);
+}
+
+/* No network time on a simulated link */
+int date_time_now(int64_t *unix_time_ms)
+{
+    return -ENODATA;
+}
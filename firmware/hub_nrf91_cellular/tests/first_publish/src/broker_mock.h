@@ -0,0 +1,53 @@
+/*
+ * Local IoT Hub stand-in
+ * Replaces the MQTT library, socket calls and the DPS library under
+ * iot_hub_client.c and provisioning.c. Each exchange with the network
+ * costs simulated round trips, so time-to-first-publish follows from what
+ * the client has cached.
+ */
+
+#ifndef BROKER_MOCK_H
+#define BROKER_MOCK_H
+
+#include <stdint.h>
+
+/* A typical LTE-M round trip */
+#define MOCK_RTT_MS           200
+
+/*
+ * DPS over MQTT: DNS, TCP, full TLS handshake, CONNECT, SUBSCRIBE and the
+ * registration request, then the status poll after DPS's retry-after
+ */
+#define MOCK_DPS_ROUND_TRIPS  8
+#define MOCK_DPS_RETRY_MS     3000
+
+/* What the client did, DPS counted only as registrations and round trips */
+struct mock_broker_stats {
+    uint32_t round_trips;  /* Waited on in turn */
+    uint32_t dps;          /* Registrations run */
+    uint32_t dns;          /* Hub lookups */
+    uint32_t tls_full;
+    uint32_t tls_resumed;
+    uint32_t refused;      /* CONNACK refusing the identity */
+    uint32_t subscribes;
+};
+
+/* Identity DPS assigns from now on */
+void mock_dps_assign(const char *hostname, const char *device_id);
+
+/* The hub still holds an MQTT session from an earlier connection */
+void mock_broker_keep_session(const char *hostname);
+
+/* The hub refuses the device from now on, as after a move to another hub */
+void mock_broker_refuse(const char *hostname);
+
+/* The hub drops the connection */
+void mock_broker_drop(void);
+
+/* Modem reset, the TLS session cache is lost */
+void mock_modem_reset(void);
+
+void mock_broker_get_stats(struct mock_broker_stats *stats);
+void mock_broker_reset_stats(void);
+
+#endif /* BROKER_MOCK_H */
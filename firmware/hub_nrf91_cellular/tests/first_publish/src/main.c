@@ -0,0 +1,176 @@
+/*
+ * Time-to-First-Publish Tests
+ *
+ * Runs iot_hub_client.c and provisioning.c against a local IoT Hub
+ * stand-in (broker_mock.c) that charges a simulated LTE-M round trip for
+ * every exchange, and measures the time to the first PUBACK:
+ *
+ * - after a reboot, with the DPS assignment cached in NVS and the modem's
+ *   TLS session cache lost,
+ * - after the link drops, resuming the TLS and MQTT sessions,
+ * - after the hub refuses the device, which then takes the first-boot path
+ *   through DPS to a hub it has never connected to.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include "hub_events.h"
+#include "azure/iot_hub_client.h"
+#include "azure/provisioning.h"
+#include "broker_mock.h"
+
+#define HUB_A     "hub-a.azure-devices.net"
+#define HUB_B     "hub-b.azure-devices.net"
+#define DEVICE_ID "hub-0001"
+
+/* The DPS wait of main.c */
+#define DPS_TIMEOUT    K_SECONDS(60)
+#define PUBACK_TIMEOUT K_SECONDS(10)
+
+/* Each sleep may end up to a tick late */
+#define SLACK_MS(round_trips) ((round_trips) * 20)
+
+K_EVENT_DEFINE(hub_events);
+
+static K_SEM_DEFINE(puback, 0, 1);
+static const uint8_t reading[32];
+
+struct publish_result {
+    int64_t ms;          /* From boot, link loss or refusal to the PUBACK */
+    int64_t refused_ms;  /* Connect attempt the hub refused, 0 if none */
+    struct mock_broker_stats stats;
+};
+
+static void evt_handler(const struct iot_hub_evt *evt)
+{
+    if (evt->type == IOT_HUB_EVT_PUBACK) {
+        k_sem_give(&puback);
+    }
+}
+
+/* DPS the way main.c runs it */
+static void provision(void)
+{
+    zassert_ok(provisioning_register_start());
+    zassert_true(k_event_wait(&hub_events, HUB_EVT_DPS_DONE, false, DPS_TIMEOUT) != 0);
+    zassert_ok(provisioning_register_finish());
+}
+
+/*
+ * Connect as main.c does, going back to DPS if the hub refuses the
+ * identity, then publish one reading and wait for its PUBACK. Time and
+ * counts start again at a refusal.
+ */
+static void first_publish(struct publish_result *res)
+{
+    int64_t start = k_uptime_get();
+    int err;
+
+    memset(res, 0, sizeof(*res));
+    mock_broker_reset_stats();
+
+    if (!provisioning_is_provisioned()) {
+        provision();
+    }
+    err = iot_hub_connect();
+    if (err == -EACCES) {
+        res->refused_ms = k_uptime_get() - start;
+        start = k_uptime_get();
+        mock_broker_reset_stats();
+
+        provisioning_invalidate();
+        provision();
+        err = iot_hub_connect();
+    }
+    zassert_ok(err);
+
+    zassert_true(iot_hub_publish_cbor(reading, sizeof(reading)) > 0);
+    zassert_ok(k_sem_take(&puback, PUBACK_TIMEOUT));
+
+    res->ms = k_uptime_get() - start;
+    mock_broker_get_stats(&res->stats);
+}
+
+static void drop_link(void)
+{
+    mock_broker_drop();
+    while (iot_hub_is_connected()) {
+        k_sleep(K_MSEC(1));
+    }
+}
+
+static void *setup(void)
+{
+    zassert_ok(provisioning_init());
+    zassert_ok(iot_hub_add_event_handler(evt_handler));
+    return NULL;
+}
+
+ZTEST(first_publish, test_time_to_first_publish)
+{
+    struct publish_result reboot, reconnect, moved;
+    uint32_t rt;
+
+    /* An earlier boot provisioned the device and left a session on the hub */
+    zassert_false(provisioning_is_provisioned());
+    mock_dps_assign(HUB_A, DEVICE_ID);
+    provision();
+    mock_broker_keep_session(HUB_A);
+
+    /* Reboot: the assignment comes from NVS, the TLS session is gone */
+    mock_modem_reset();
+    zassert_ok(provisioning_init());
+    zassert_true(provisioning_is_provisioned());
+    first_publish(&reboot);
+
+    /* DNS, TCP, full TLS handshake, CONNECT, PUBLISH */
+    rt = reboot.stats.round_trips;
+    zassert_equal(reboot.stats.dps, 0);
+    zassert_equal(reboot.stats.dns, 1);
+    zassert_equal(reboot.stats.tls_full, 1);
+    zassert_equal(reboot.stats.subscribes, 0, "Session resumed, nothing to subscribe");
+    zassert_equal(rt, 6);
+    zassert_between_inclusive(reboot.ms, rt * MOCK_RTT_MS, rt * MOCK_RTT_MS + SLACK_MS(rt));
+
+    /* Link loss: cached address, resumed TLS and MQTT sessions */
+    drop_link();
+    first_publish(&reconnect);
+
+    /* TCP, resumed TLS, CONNECT, PUBLISH */
+    rt = reconnect.stats.round_trips;
+    zassert_equal(reconnect.stats.dns, 0);
+    zassert_equal(reconnect.stats.tls_resumed, 1);
+    zassert_equal(reconnect.stats.subscribes, 0);
+    zassert_equal(rt, 4);
+    zassert_between_inclusive(reconnect.ms, rt * MOCK_RTT_MS,
+                              rt * MOCK_RTT_MS + SLACK_MS(rt));
+
+    /* Moved to hub B: refused by hub A, then the first-boot path */
+    mock_broker_refuse(HUB_A);
+    mock_dps_assign(HUB_B, DEVICE_ID);
+    drop_link();
+    first_publish(&moved);
+
+    /* DPS, DNS, TCP, full TLS handshake, CONNECT and SUBSCRIBE, PUBLISH */
+    rt = moved.stats.round_trips;
+    zassert_true(moved.refused_ms > 0, "Hub A refused the device");
+    zassert_equal(moved.stats.dps, 1);
+    zassert_equal(moved.stats.dns, 1);
+    zassert_equal(moved.stats.tls_full, 1);
+    zassert_equal(moved.stats.subscribes, 1);
+    zassert_equal(rt, MOCK_DPS_ROUND_TRIPS + 6);
+    zassert_between_inclusive(moved.ms, rt * MOCK_RTT_MS + MOCK_DPS_RETRY_MS,
+                              rt * MOCK_RTT_MS + MOCK_DPS_RETRY_MS + SLACK_MS(rt));
+    zassert_equal(strcmp(provisioning_get_assignment()->hostname, HUB_B), 0);
+
+    TC_PRINT("Time to first PUBACK at %u ms round trip:\n", MOCK_RTT_MS);
+    TC_PRINT("  first boot (DPS): %lld ms, %u round trips\n",
+             (long long)moved.ms, moved.stats.round_trips);
+    TC_PRINT("  reboot (cached):  %lld ms, %u round trips\n",
+             (long long)reboot.ms, reboot.stats.round_trips);
+    TC_PRINT("  reconnect:        %lld ms, %u round trips\n",
+             (long long)reconnect.ms, reconnect.stats.round_trips);
+    TC_PRINT("  refused attempt:  %lld ms\n", (long long)moved.refused_ms);
+}
+
+ZTEST_SUITE(first_publish, NULL, setup, NULL, NULL, NULL);
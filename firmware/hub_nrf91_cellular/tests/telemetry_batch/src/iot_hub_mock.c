@@ -0,0 +1,96 @@
+/*
+ * Mocked IoT Hub client
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include "azure/iot_hub_client.h"
+#include "network/lte_connection.h"
+#include "iot_hub_mock.h"
+
+#define MAX_INFLIGHT 16
+#define MAX_MESSAGES 256
+#define EPOCH_BASE   1760000000
+
+struct pending_ack {
+    uint16_t message_id;
+    int64_t due;
+};
+
+static iot_hub_evt_handler_t handler;
+static struct pending_ack acks[MAX_INFLIGHT];
+static int ack_count;
+static uint16_t next_message_id = 1;
+static struct mock_hub_stats stats;
+static uint16_t lengths[MAX_MESSAGES];
+
+static void ack_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(ack_work, ack_work_handler);
+
+/* PUBACKs arrive in publish order */
+static void ack_work_handler(struct k_work *work)
+{
+    while (ack_count > 0 && acks[0].due <= k_uptime_get()) {
+        struct iot_hub_evt evt = {
+            .type = IOT_HUB_EVT_PUBACK,
+            .message_id = acks[0].message_id,
+        };
+
+        memmove(&acks[0], &acks[1], --ack_count * sizeof(acks[0]));
+        stats.acked++;
+        handler(&evt);
+    }
+    if (ack_count > 0) {
+        k_work_reschedule(&ack_work, K_TIMEOUT_ABS_MS(acks[0].due));
+    }
+}
+
+int iot_hub_publish_cbor(const uint8_t *payload, size_t len)
+{
+    uint16_t id = next_message_id++;
+
+    __ASSERT_NO_MSG(ack_count < MAX_INFLIGHT);
+    acks[ack_count++] = (struct pending_ack){ id, k_uptime_get() + MOCK_RTT_MS };
+    if (ack_count == 1) {
+        k_work_reschedule(&ack_work, K_MSEC(MOCK_RTT_MS));
+    }
+
+    if (stats.messages < MAX_MESSAGES) {
+        lengths[stats.messages] = len;
+    }
+    stats.messages++;
+    stats.payload_bytes += len;
+    return id;
+}
+
+int iot_hub_add_event_handler(iot_hub_evt_handler_t evt_handler)
+{
+    handler = evt_handler;
+    return 0;
+}
+
+bool iot_hub_is_connected(void)
+{
+    return true;
+}
+
+uint32_t iot_hub_epoch_seconds(void)
+{
+    return EPOCH_BASE + k_uptime_get() / MSEC_PER_SEC;
+}
+
+/* The modem sleeps between scheduled uplinks */
+bool lte_connection_is_radio_active(void)
+{
+    return false;
+}
+
+void mock_hub_get_stats(struct mock_hub_stats *out)
+{
+    *out = stats;
+}
+
+size_t mock_hub_message_len(uint32_t i)
+{
+    return i < MIN(stats.messages, MAX_MESSAGES) ? lengths[i] : 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * Mocked IoT Hub client
+ * Records every CBOR publish and acknowledges it a round trip later
+ */
+
+#ifndef IOT_HUB_MOCK_H
+#define IOT_HUB_MOCK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MOCK_RTT_MS 200
+
+struct mock_hub_stats {
+    uint32_t messages;
+    uint32_t payload_bytes;
+    uint32_t acked;
+};
+
+void mock_hub_get_stats(struct mock_hub_stats *stats);
+
+/* Payload length of the i-th publish, 0 past the first 256 */
+size_t mock_hub_message_len(uint32_t i);
+
+#endif /* IOT_HUB_MOCK_H */
@@ -0,0 +1,149 @@
+/*
+ * Telemetry Batching Tests
+ *
+ * Feeds the batcher an hour of readings from a 32-node site sampling every
+ * 60 s, flushed on the telemetry cadence main.c registers, against a mocked
+ * IoT Hub client. Compares messages and bytes per hour with the uplink the
+ * hub had before batching: one JSON publish per reading
+ * (NodeTelemetryPayload from common/protocol/ipc-protocol.ts).
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <stdio.h>
+#include <string.h>
+#include "azure/telemetry_batch.h"
+#include "iot_hub_mock.h"
+
+#define NODES             32
+#define SAMPLE_PERIOD_S   60
+#define HOUR_S            3600
+#define READINGS_PER_HOUR (NODES * HOUR_S / SAMPLE_PERIOD_S)
+
+/* The telemetry task of main.c, without its slack */
+#define FLUSH_PERIOD_S    (TELEMETRY_BATCH_MAX_AGE_S - 60)
+
+/* Topics of iot_hub_client.c for device "hub-0001" */
+#define TOPIC_CBOR "devices/hub-0001/messages/events/$.ct=application%2Fcbor"
+#define TOPIC_JSON "devices/hub-0001/messages/events/$.ct=application%2Fjson&$.ce=utf-8"
+
+/* Around each QoS 1 publish: a TLS record and a TCP/IP header each way */
+#define TLS_RECORD_BYTES 29
+#define TCP_IP_BYTES     40
+#define PUBACK_BYTES     4
+
+struct uplink {
+    uint32_t messages;
+    uint32_t payload_bytes;
+    uint32_t air_bytes;
+};
+
+/* PUBLISH with its fixed header, topic and message id, plus the PUBACK */
+static size_t air_bytes(size_t payload, size_t topic_len)
+{
+    size_t remaining = 2 + topic_len + 2 + payload;
+    size_t header = 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3);
+
+    return header + remaining + PUBACK_BYTES + 2 * (TLS_RECORD_BYTES + TCP_IP_BYTES);
+}
+
+/* The JSON form of the record, as the old uplink rendered it */
+static int json_record(char *buf, size_t size, const struct node_telemetry *rec)
+{
+    const uint8_t *a = rec->node_id;
+
+    return snprintf(buf, size,
+                    "{\"nodeId\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                    "\"reading\":{\"timestamp\":%u,\"value\":%.7g,\"unit\":\"%s\",\"quality\":%u},"
+                    "\"battery\":{\"millivolts\":%u,\"percent\":%u},"
+                    "\"faults\":[%s],\"rssi\":%d}",
+                    a[0], a[1], a[2], a[3], a[4], a[5],
+                    rec->timestamp, (double)rec->value, rec->unit, rec->quality,
+                    rec->battery_mv, rec->battery_pct,
+                    rec->faults & 0x01 ? "\"sensor_open\"" : "", rec->rssi);
+}
+
+static void make_reading(struct node_telemetry *rec, int node, int second)
+{
+    static const char *const units[] = { "PSI", "degC", "bar", "mA" };
+    const uint8_t node_id[NODE_ADDR_LEN] = { 0xC0, 0x4E, 0x30, 0x11, 0x22, node };
+
+    memset(rec, 0, sizeof(*rec));
+    memcpy(rec->node_id, node_id, sizeof(node_id));
+    rec->timestamp = 1760000000 + second;
+    rec->value = 101.325f + node * 0.25f + (second / SAMPLE_PERIOD_S) * 0.01f;
+    strcpy(rec->unit, units[node % ARRAY_SIZE(units)]);
+    rec->quality = 0x07;
+    rec->battery_mv = 2950 - node * 5;
+    rec->battery_pct = 87 - node;
+    rec->rssi = -60 - node;
+}
+
+static void *setup(void)
+{
+    zassert_ok(telemetry_batch_init());
+    return NULL;
+}
+
+ZTEST(telemetry_batch, test_hour_against_unbatched)
+{
+    struct telemetry_batch_stats batch;
+    struct mock_hub_stats hub;
+    struct uplink batched = { 0 };
+    struct uplink unbatched = { 0 };
+    struct node_telemetry rec;
+    char json[256];
+
+    for (int second = 0; second < HOUR_S; second += SAMPLE_PERIOD_S) {
+        for (int node = 0; node < NODES; node++) {
+            int len;
+
+            make_reading(&rec, node, second);
+            zassert_ok(telemetry_batch_add(&rec));
+
+            len = json_record(json, sizeof(json), &rec);
+            unbatched.messages++;
+            unbatched.payload_bytes += len;
+            unbatched.air_bytes += air_bytes(len, strlen(TOPIC_JSON));
+        }
+
+        k_sleep(K_SECONDS(SAMPLE_PERIOD_S));
+        if ((second + SAMPLE_PERIOD_S) % FLUSH_PERIOD_S == 0) {
+            telemetry_batch_flush();
+        }
+    }
+    /* Last PUBACKs */
+    k_sleep(K_SECONDS(5));
+
+    telemetry_batch_get_stats(&batch);
+    mock_hub_get_stats(&hub);
+
+    zassert_equal(batch.readings, READINGS_PER_HOUR);
+    zassert_equal(batch.dropped, 0);
+    zassert_equal(batch.spilled, 0, "Nothing reaches flash while connected");
+    zassert_equal(hub.messages, batch.messages);
+    zassert_equal(hub.acked, hub.messages, "Every message acknowledged");
+
+    for (uint32_t i = 0; i < hub.messages; i++) {
+        size_t len = mock_hub_message_len(i);
+
+        zassert_true(len > 0 && len <= TELEMETRY_BATCH_TARGET_BYTES,
+                     "Message %u is %zu bytes", i, len);
+        batched.air_bytes += air_bytes(len, strlen(TOPIC_CBOR));
+    }
+    batched.messages = hub.messages;
+    batched.payload_bytes = hub.payload_bytes;
+
+    /* At least 20 readings a message, short only at the end of a flush */
+    zassert_true(batched.messages <= (HOUR_S / FLUSH_PERIOD_S) *
+                 DIV_ROUND_UP(READINGS_PER_HOUR / (HOUR_S / FLUSH_PERIOD_S), 20));
+    zassert_true(batched.air_bytes * 5 < unbatched.air_bytes);
+
+    TC_PRINT("%u readings/h from %u nodes:\n", READINGS_PER_HOUR, NODES);
+    TC_PRINT("  unbatched JSON: %u msg/h, %u payload B/h, ~%u B/h on air\n",
+             unbatched.messages, unbatched.payload_bytes, unbatched.air_bytes);
+    TC_PRINT("  batched CBOR:   %u msg/h, %u payload B/h, ~%u B/h on air\n",
+             batched.messages, batched.payload_bytes, batched.air_bytes);
+}
+
+ZTEST_SUITE(telemetry_batch, NULL, setup, NULL, NULL, NULL);
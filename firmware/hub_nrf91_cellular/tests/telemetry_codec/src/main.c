@@ -0,0 +1,181 @@
+/*
+ * Telemetry Codec Tests
+ *
+ * Checks the size prediction the batcher packs with and the window summary
+ * record, and compares the CBOR encoding of a representative batch with
+ * the JSON the hub sent before, NodeTelemetryPayload from
+ * common/protocol/ipc-protocol.ts.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <stdio.h>
+#include <string.h>
+#include "azure/telemetry_codec.h"
+
+#define BATCH_SIZE 20
+#define BENCH_RUNS 1000
+
+static struct node_telemetry batch[BATCH_SIZE];
+static uint8_t cbor_buf[1024];
+static char json_buf[4096];
+
+static void *setup(void)
+{
+    static const char *const units[] = { "PSI", "degC", "bar", "mA" };
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        struct node_telemetry *rec = &batch[i];
+        const uint8_t node_id[NODE_ADDR_LEN] = { 0xC0, 0x4E, 0x30, 0x11, 0x22, i };
+
+        memcpy(rec->node_id, node_id, sizeof(node_id));
+        rec->timestamp = 1760000000 + i * 60;
+        rec->value = 101.325f + i * 0.25f;
+        strcpy(rec->unit, units[i % ARRAY_SIZE(units)]);
+        rec->quality = 0x07;
+        rec->battery_mv = 2950 - i * 5;
+        rec->battery_pct = 87 - i;
+        rec->faults = i == 7 ? 0x01 : 0;
+        rec->rssi = -60 - i;
+    }
+    return NULL;
+}
+
+/* The JSON form of the record, as the old uplink rendered it */
+static int json_record(char *buf, size_t size, const struct node_telemetry *rec)
+{
+    const uint8_t *a = rec->node_id;
+
+    return snprintf(buf, size,
+                    "{\"nodeId\":\"%02X:%02X:%02X:%02X:%02X:%02X\","
+                    "\"reading\":{\"timestamp\":%u,\"value\":%.7g,\"unit\":\"%s\",\"quality\":%u},"
+                    "\"battery\":{\"millivolts\":%u,\"percent\":%u},"
+                    "\"faults\":[%s],\"rssi\":%d}",
+                    a[0], a[1], a[2], a[3], a[4], a[5],
+                    rec->timestamp, (double)rec->value, rec->unit, rec->quality,
+                    rec->battery_mv, rec->battery_pct,
+                    rec->faults & 0x01 ? "\"sensor_open\"" : "", rec->rssi);
+}
+
+static size_t json_batch(void)
+{
+    size_t len = 0;
+
+    json_buf[len++] = '[';
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        if (i) {
+            json_buf[len++] = ',';
+        }
+        len += json_record(&json_buf[len], sizeof(json_buf) - len, &batch[i]);
+    }
+    json_buf[len++] = ']';
+    return len;
+}
+
+ZTEST(telemetry_codec, test_size_prediction)
+{
+    size_t expected = telemetry_codec_envelope_size(batch[0].timestamp, BATCH_SIZE);
+    size_t len;
+
+    for (int i = 0; i < BATCH_SIZE; i++) {
+        expected += telemetry_codec_telemetry_size(&batch[i]);
+    }
+
+    zassert_ok(telemetry_codec_encode_telemetry(cbor_buf, sizeof(cbor_buf), batch[0].timestamp,
+                                                batch, BATCH_SIZE, &len));
+    zassert_equal(len, expected, "batcher packs by this prediction");
+}
+
+ZTEST(telemetry_codec, test_envelope_head)
+{
+    size_t len;
+
+    zassert_ok(telemetry_codec_encode_telemetry(cbor_buf, sizeof(cbor_buf), 1760000000,
+                                                batch, 1, &len));
+    /* Map of 4, version, kind, timestamp, records list of 1 */
+    zassert_equal(cbor_buf[0], 0xA4);
+    zassert_equal(cbor_buf[1], 0x00);
+    zassert_equal(cbor_buf[2], TELEMETRY_CODEC_VERSION);
+    zassert_equal(cbor_buf[4], TELEMETRY_MSG_NODE_TELEMETRY);
+    zassert_equal(cbor_buf[5], 0x02);
+    zassert_equal(cbor_buf[6], 0x1A, "32-bit timestamp");
+    zassert_equal(cbor_buf[11], 0x03);
+    zassert_equal(cbor_buf[12], 0x81);
+    /* Record: list of 9, 6-byte node id */
+    zassert_equal(cbor_buf[13], 0x89);
+    zassert_equal(cbor_buf[14], 0x46);
+    zassert_mem_equal(&cbor_buf[15], batch[0].node_id, NODE_ADDR_LEN);
+}
+
+ZTEST(telemetry_codec, test_summary_record)
+{
+    struct node_telemetry rec = batch[0];
+    size_t len;
+
+    rec.count = 12;
+    rec.min = 99.5f;
+    rec.max = 104.0f;
+
+    zassert_ok(telemetry_codec_encode_telemetry(cbor_buf, sizeof(cbor_buf), rec.timestamp,
+                                                &rec, 1, &len));
+    zassert_equal(len, telemetry_codec_envelope_size(rec.timestamp, 1) +
+                       telemetry_codec_telemetry_size(&rec));
+    /* List of 12, ending in count, min and max */
+    zassert_equal(cbor_buf[13], 0x8C);
+    zassert_equal(cbor_buf[len - 11], 12);
+    zassert_equal(cbor_buf[len - 10], 0xFA, "32-bit float min");
+    zassert_equal(cbor_buf[len - 5], 0xFA, "32-bit float max");
+}
+
+ZTEST(telemetry_codec, test_buffer_too_small)
+{
+    size_t len;
+    size_t size = telemetry_codec_envelope_size(batch[0].timestamp, 2) +
+                  telemetry_codec_telemetry_size(&batch[0]);
+
+    zassert_equal(telemetry_codec_encode_telemetry(cbor_buf, size, batch[0].timestamp,
+                                                   batch, 2, &len), -ENOMEM);
+}
+
+ZTEST(telemetry_codec, test_max_records)
+{
+    struct telemetry_encoder enc;
+
+    zassert_ok(telemetry_codec_begin(&enc, cbor_buf, sizeof(cbor_buf),
+                                     TELEMETRY_MSG_NODE_TELEMETRY, 0, 1));
+    zassert_ok(telemetry_codec_add_telemetry(&enc, &batch[0]));
+    zassert_equal(telemetry_codec_add_telemetry(&enc, &batch[1]), -ENOMEM);
+}
+
+/* Size and encode time against JSON, printed for the README */
+ZTEST(telemetry_codec, test_batch_against_json)
+{
+    size_t cbor_len = 0;
+    size_t json_len = 0;
+    uint32_t start;
+    uint64_t cbor_ns, json_ns;
+
+    start = k_cycle_get_32();
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        zassert_ok(telemetry_codec_encode_telemetry(cbor_buf, sizeof(cbor_buf),
+                                                    batch[0].timestamp, batch, BATCH_SIZE,
+                                                    &cbor_len));
+    }
+    cbor_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+
+    start = k_cycle_get_32();
+    for (int run = 0; run < BENCH_RUNS; run++) {
+        json_len = json_batch();
+    }
+    json_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+
+    TC_PRINT("%d records: CBOR %zu bytes, JSON %zu bytes (%zu%%)\n", BATCH_SIZE,
+             cbor_len, json_len, cbor_len * 100 / json_len);
+    TC_PRINT("Per record: CBOR %zu bytes %llu ns, JSON %zu bytes %llu ns\n",
+             cbor_len / BATCH_SIZE, (unsigned long long)(cbor_ns / (BENCH_RUNS * BATCH_SIZE)),
+             json_len / BATCH_SIZE, (unsigned long long)(json_ns / (BENCH_RUNS * BATCH_SIZE)));
+
+    zassert_true(cbor_len * 2 < json_len, "CBOR is less than half the JSON");
+}
+
+ZTEST_SUITE(telemetry_codec, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,317 @@
+/*
+ * Telemetry Store Tests
+ *
+ * Runs the flash log on the simulated flash of native_sim, eight sectors
+ * (boards/native_sim.overlay). Power cuts are reproduced by writing part
+ * of a slot or of a sector header straight to the partition, then mounting
+ * the log again. Also covers a full ring and its overwrite accounting, a
+ * consume whose span was recycled while the upload was in flight, and the
+ * drain order of the policy the suite was built with (testcase.yaml builds
+ * both). The benchmark times appends and a drain in telemetry_batch.c's
+ * batches.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <string.h>
+#include "storage/telemetry_store.h"
+
+/* On-flash layout of telemetry_store.c */
+#define SECTOR_MAGIC     0x544c4f32
+#define HEADER_LEN       16
+#define SLOT_LEN         (sizeof(struct node_telemetry) + 2 * sizeof(uint32_t))
+#define SLOTS_PER_SECTOR ((TELEMETRY_STORE_SECTOR_SIZE - HEADER_LEN) / SLOT_LEN)
+
+/* Records per append and per read, as telemetry_batch.c moves them */
+#define BATCH 20
+
+#define MAX_RECORDS (TELEMETRY_STORE_MAX_SECTORS * SLOTS_PER_SECTOR)
+
+static const struct flash_area *fa;
+static uint32_t sector_count;
+
+struct drain {
+    uint32_t *ts;
+    size_t count;
+    size_t max;
+};
+
+static uint32_t taken[MAX_RECORDS];
+
+static bool newest_first(void)
+{
+    return TELEMETRY_STORE_DRAIN_POLICY == TELEMETRY_STORE_NEWEST_FIRST;
+}
+
+static off_t slot_offset(uint32_t sector, uint32_t slot)
+{
+    return (off_t)sector * TELEMETRY_STORE_SECTOR_SIZE + HEADER_LEN + slot * SLOT_LEN;
+}
+
+/* Records first to first + count - 1, the timestamp is the sequence number */
+static void append_range(uint32_t first, uint32_t count)
+{
+    struct node_telemetry recs[BATCH];
+
+    while (count > 0) {
+        uint32_t n = MIN(count, BATCH);
+
+        for (uint32_t i = 0; i < n; i++) {
+            recs[i] = (struct node_telemetry){
+                .node_id = { 0xc0, 0, 0, 0, 0, (first + i) % 8 },
+                .timestamp = first + i,
+                .value = (first + i) * 0.5f,
+                .unit = "bar",
+                .quality = 0x07,
+                .battery_mv = 3000,
+            };
+        }
+        zassert_ok(telemetry_store_append(recs, n));
+        first += n;
+        count -= n;
+    }
+}
+
+static bool take(const struct node_telemetry *rec, void *ctx)
+{
+    struct drain *drain = ctx;
+
+    if (drain->count == drain->max) {
+        return false;
+    }
+    zassert_equal(rec->value, rec->timestamp * 0.5f);
+    drain->ts[drain->count++] = rec->timestamp;
+    return true;
+}
+
+/* Hand out every record not yet handed out */
+static size_t read_all(struct telemetry_store_span *span)
+{
+    struct drain drain = { .ts = taken, .max = ARRAY_SIZE(taken) };
+
+    telemetry_store_read(take, &drain, span);
+    return drain.count;
+}
+
+/* The records read are first to last, in drain policy order */
+static void check_order(size_t count, uint32_t first, uint32_t last)
+{
+    zassert_equal(count, last - first + 1);
+    for (size_t i = 0; i < count; i++) {
+        zassert_equal(taken[i], newest_first() ? last - i : first + i,
+                      "Record %zu out of order", i);
+    }
+}
+
+static void remount(void)
+{
+    zassert_ok(telemetry_store_init());
+}
+
+static void *setup(void)
+{
+    zassert_ok(flash_area_open(FIXED_PARTITION_ID(telemetry_storage), &fa));
+    sector_count = MIN(fa->fa_size / TELEMETRY_STORE_SECTOR_SIZE, TELEMETRY_STORE_MAX_SECTORS);
+    TC_PRINT("%u sectors of %u slots, %s first\n", sector_count, (uint32_t)SLOTS_PER_SECTOR,
+             newest_first() ? "newest" : "oldest");
+    return NULL;
+}
+
+/* A blank partition for every test */
+static void before(void *fixture)
+{
+    zassert_ok(flash_area_erase(fa, 0, fa->fa_size));
+    remount();
+}
+
+ZTEST(telemetry_store, test_drain_order)
+{
+    struct telemetry_store_span span;
+    struct telemetry_store_stats stats;
+
+    /* Reads start from a rewind, as telemetry_batch.c does with nothing in flight */
+    append_range(0, 50);
+    telemetry_store_rewind();
+    check_order(read_all(&span), 0, 49);
+    zassert_equal(span.first, SLOTS_PER_SECTOR);
+    zassert_equal(span.last, SLOTS_PER_SECTOR + 49);
+
+    /* Nothing more to hand out until the read is rewound */
+    zassert_equal(read_all(&span), 0);
+    telemetry_store_rewind();
+    check_order(read_all(&span), 0, 49);
+
+    telemetry_store_consume(&span);
+    zassert_true(telemetry_store_is_empty());
+
+    /* Consumed records stay consumed across a reboot */
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, 0);
+    zassert_equal(read_all(&span), 0);
+}
+
+ZTEST(telemetry_store, test_partial_drain)
+{
+    struct drain drain = { .ts = taken, .max = BATCH };
+    struct telemetry_store_span span;
+
+    append_range(0, 3 * BATCH);
+    telemetry_store_rewind();
+
+    zassert_equal(telemetry_store_read(take, &drain, &span), BATCH);
+    telemetry_store_consume(&span);
+    zassert_equal(taken[0], newest_first() ? 3 * BATCH - 1 : 0);
+
+    /* Newer readings arrive while the backlog drains */
+    append_range(3 * BATCH, BATCH);
+    remount();
+    if (newest_first()) {
+        /* The new batch, then the backlog below the one consumed */
+        zassert_equal(read_all(&span), 3 * BATCH);
+        for (uint32_t i = 0; i < 3 * BATCH; i++) {
+            zassert_equal(taken[i], i < BATCH ? 4 * BATCH - 1 - i : 3 * BATCH - 1 - i);
+        }
+    } else {
+        check_order(read_all(&span), BATCH, 4 * BATCH - 1);
+    }
+}
+
+ZTEST(telemetry_store, test_torn_slot)
+{
+    const uint8_t partial[8] = { 0 };
+    struct telemetry_store_span span;
+    struct telemetry_store_stats stats;
+
+    /* The first sector opened is physical sector 0 */
+    append_range(0, 5);
+    zassert_ok(flash_area_write(fa, slot_offset(0, 5), partial, sizeof(partial)));
+
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, 5);
+    zassert_equal(stats.corrupt, 1);
+
+    /* The torn slot is skipped, never written again */
+    append_range(5, 1);
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, 6);
+    zassert_equal(stats.corrupt, 1);
+    check_order(read_all(&span), 0, 5);
+}
+
+ZTEST(telemetry_store, test_torn_header)
+{
+    const uint32_t magic = SECTOR_MAGIC;
+    struct telemetry_store_span span;
+    struct telemetry_store_stats stats;
+
+    /* Sector 0 full, the cut comes while the header of sector 1 is written */
+    append_range(0, SLOTS_PER_SECTOR);
+    zassert_ok(flash_area_write(fa, TELEMETRY_STORE_SECTOR_SIZE, &magic, sizeof(magic)));
+
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, SLOTS_PER_SECTOR);
+    zassert_equal(stats.corrupt, 0);
+
+    /* Sector 1 is erased and opened again */
+    append_range(SLOTS_PER_SECTOR, 1);
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, SLOTS_PER_SECTOR + 1);
+    check_order(read_all(&span), 0, SLOTS_PER_SECTOR);
+}
+
+ZTEST(telemetry_store, test_full_ring)
+{
+    const uint32_t total = sector_count * SLOTS_PER_SECTOR + SLOTS_PER_SECTOR / 2;
+    struct telemetry_store_span span;
+    struct telemetry_store_stats stats;
+
+    append_range(0, total);
+
+    /* Opening the last half sector recycled the oldest, full one */
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.appended, total);
+    zassert_equal(stats.dropped, SLOTS_PER_SECTOR);
+    zassert_equal(stats.live, total - SLOTS_PER_SECTOR);
+    zassert_equal(stats.max_erase_count, 2);
+
+    remount();
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.live, total - SLOTS_PER_SECTOR);
+    check_order(read_all(&span), SLOTS_PER_SECTOR, total - 1);
+
+    telemetry_store_consume(&span);
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.consumed, total - SLOTS_PER_SECTOR);
+    zassert_true(telemetry_store_is_empty());
+}
+
+ZTEST(telemetry_store, test_consume_recycled)
+{
+    const uint32_t full = sector_count * SLOTS_PER_SECTOR;
+    struct telemetry_store_span span;
+    struct telemetry_store_stats stats;
+
+    /* Everything is in flight when one more record recycles the oldest sector */
+    append_range(0, full);
+    telemetry_store_rewind();
+    check_order(read_all(&span), 0, full - 1);
+    append_range(full, 1);
+
+    telemetry_store_consume(&span);
+    telemetry_store_get_stats(&stats);
+    zassert_equal(stats.dropped, SLOTS_PER_SECTOR);
+    zassert_equal(stats.consumed, full - SLOTS_PER_SECTOR);
+    zassert_equal(stats.live, 1);
+
+    telemetry_store_rewind();
+    check_order(read_all(&span), full, full);
+}
+
+ZTEST(telemetry_store, test_benchmark)
+{
+    const uint32_t count = (sector_count - 1) * SLOTS_PER_SECTOR;
+    struct drain drain = { .ts = taken, .max = BATCH };
+    struct telemetry_store_span span;
+    uint32_t start;
+    uint64_t append_ns;
+    uint64_t drain_ns;
+    uint64_t mount_ns;
+    size_t drained = 0;
+
+    start = k_cycle_get_32();
+    append_range(0, count);
+    append_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+
+    start = k_cycle_get_32();
+    remount();
+    mount_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+
+    start = k_cycle_get_32();
+    for (;;) {
+        drain.count = 0;
+        if (telemetry_store_read(take, &drain, &span) == 0) {
+            break;
+        }
+        telemetry_store_consume(&span);
+        drained += drain.count;
+    }
+    drain_ns = k_cyc_to_ns_floor64(k_cycle_get_32() - start);
+
+    zassert_equal(drained, count);
+    zassert_true(telemetry_store_is_empty());
+
+    TC_PRINT("%u records: append %llu ns, drain %llu ns per record, mount %llu us\n",
+             count, append_ns / count, drain_ns / count, mount_ns / 1000);
+    if (append_ns && drain_ns) {
+        TC_PRINT("append %llu records/s, drain %llu records/s\n",
+                 count * 1000000000ull / append_ns, count * 1000000000ull / drain_ns);
+    }
+}
+
+ZTEST_SUITE(telemetry_store, NULL, setup, before, NULL, NULL);
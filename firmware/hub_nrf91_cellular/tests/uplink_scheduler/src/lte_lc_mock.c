@@ -0,0 +1,197 @@
+/*
+ * Mocked LTE link controller
+ */
+
+#include <zephyr/kernel.h>
+#include <modem/lte_lc.h>
+#include "lte_lc_mock.h"
+
+enum modem_state {
+    MODEM_SLEEP,
+    MODEM_PAGING,     /* eDRX paging time window */
+    MODEM_CONNECTED,
+};
+
+static lte_lc_evt_handler_t handler;
+static struct mock_network net;
+static enum modem_state state;
+static int64_t state_since;
+static int64_t idle_at;
+static bool attached;
+static struct mock_modem_stats stats;
+
+static void release_work_handler(struct k_work *work);
+static void paging_work_handler(struct k_work *work);
+static void tau_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(release_work, release_work_handler);
+static K_WORK_DELAYABLE_DEFINE(paging_work, paging_work_handler);
+static K_WORK_DELAYABLE_DEFINE(tau_work, tau_work_handler);
+
+static void send_evt(const struct lte_lc_evt *evt)
+{
+    if (handler) {
+        handler(evt);
+    }
+}
+
+static void set_state(enum modem_state next)
+{
+    int64_t now = k_uptime_get();
+
+    if (state != MODEM_SLEEP) {
+        stats.radio_on_ms += now - state_since;
+    }
+    if (state == MODEM_SLEEP && next != MODEM_SLEEP) {
+        stats.wakeups++;
+    }
+    state = next;
+    state_since = now;
+}
+
+/* Plan the wake-ups of the idle period that starts now */
+static void enter_idle(void)
+{
+    idle_at = k_uptime_get();
+    set_state(MODEM_SLEEP);
+
+    if (net.edrx_ms) {
+        k_work_reschedule(&paging_work, K_MSEC(net.edrx_ms));
+    }
+    if (net.psm_tau_s) {
+        k_work_reschedule(&tau_work, K_SECONDS(net.psm_tau_s));
+    }
+}
+
+static void connect(void)
+{
+    struct lte_lc_evt evt = {
+        .type = LTE_LC_EVT_RRC_UPDATE,
+        .rrc_mode = LTE_LC_RRC_MODE_CONNECTED,
+    };
+
+    if (state != MODEM_CONNECTED) {
+        set_state(MODEM_CONNECTED);
+        k_work_cancel_delayable(&paging_work);
+        k_work_cancel_delayable(&tau_work);
+        send_evt(&evt);
+    }
+    k_work_reschedule(&release_work, K_MSEC(net.inactivity_ms));
+}
+
+static void release_work_handler(struct k_work *work)
+{
+    struct lte_lc_evt evt = {
+        .type = LTE_LC_EVT_RRC_UPDATE,
+        .rrc_mode = LTE_LC_RRC_MODE_IDLE,
+    };
+
+    enter_idle();
+    send_evt(&evt);
+}
+
+static void paging_work_handler(struct k_work *work)
+{
+    int64_t now = k_uptime_get();
+
+    if (state == MODEM_PAGING) {
+        set_state(MODEM_SLEEP);
+    } else if (state == MODEM_SLEEP) {
+        /* With PSM, paging only runs during the active time */
+        if (net.psm_tau_s && now - idle_at > (int64_t)net.psm_active_s * MSEC_PER_SEC) {
+            return;
+        }
+        set_state(MODEM_PAGING);
+        k_work_reschedule(&paging_work, K_MSEC(net.ptw_ms));
+        return;
+    }
+
+    /* Next window, one eDRX cycle after the last one started */
+    k_work_reschedule(&paging_work, K_MSEC(net.edrx_ms - net.ptw_ms));
+}
+
+static void tau_work_handler(struct k_work *work)
+{
+    connect();
+}
+
+void mock_modem_start(const struct mock_network *network)
+{
+    struct lte_lc_evt psm = { .type = LTE_LC_EVT_PSM_UPDATE };
+    struct lte_lc_evt edrx = { .type = LTE_LC_EVT_EDRX_UPDATE };
+
+    net = *network;
+    attached = true;
+    state = MODEM_CONNECTED;
+    state_since = k_uptime_get();
+
+    psm.psm_cfg.tau = net.psm_tau_s && net.report_grants ? (int)net.psm_tau_s : -1;
+    psm.psm_cfg.active_time = net.psm_tau_s && net.report_grants ? (int)net.psm_active_s : -1;
+    edrx.edrx_cfg.edrx = net.edrx_ms && net.report_grants ? net.edrx_ms / 1000.0f : -1.0f;
+    edrx.edrx_cfg.ptw = net.ptw_ms / 1000.0f;
+    send_evt(&psm);
+    send_evt(&edrx);
+
+    /* Attach ends with the modem releasing its connection */
+    connect();
+}
+
+void mock_modem_stop(void)
+{
+    attached = false;
+    k_work_cancel_delayable(&release_work);
+    k_work_cancel_delayable(&paging_work);
+    k_work_cancel_delayable(&tau_work);
+}
+
+void mock_modem_uplink(void)
+{
+    if (!attached) {
+        return;
+    }
+    if (state == MODEM_SLEEP) {
+        stats.uplink_wakeups++;
+    }
+    connect();
+}
+
+void mock_modem_get_stats(struct mock_modem_stats *out)
+{
+    *out = stats;
+    if (state != MODEM_SLEEP) {
+        out->radio_on_ms += k_uptime_get() - state_since;
+    }
+}
+
+/* lte_lc API used by lte_connection.c */
+
+int lte_lc_init(void)
+{
+    return 0;
+}
+
+int lte_lc_register_handler(lte_lc_evt_handler_t evt_handler)
+{
+    handler = evt_handler;
+    return 0;
+}
+
+int lte_lc_psm_req(bool enable)
+{
+    return 0;
+}
+
+int lte_lc_edrx_req(bool enable)
+{
+    return 0;
+}
+
+int lte_lc_connect_async(lte_lc_evt_handler_t evt_handler)
+{
+    return 0;
+}
+
+int lte_lc_offline(void)
+{
+    return 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Mocked LTE link controller
+ * A modem model that sleeps, wakes for TAU and eDRX paging windows, and
+ * holds an RRC connection for the inactivity timer after each uplink
+ */
+
+#ifndef LTE_LC_MOCK_H
+#define LTE_LC_MOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* What the network grants, 0 for none */
+struct mock_network {
+    uint32_t psm_tau_s;
+    uint32_t psm_active_s;
+    uint32_t edrx_ms;
+    uint32_t ptw_ms;
+    uint32_t inactivity_ms;  /* RRC release after the last uplink */
+    bool report_grants;      /* Send PSM/eDRX updates to the application */
+};
+
+struct mock_modem_stats {
+    uint32_t wakeups;        /* Leaving sleep for any reason */
+    uint32_t uplink_wakeups; /* Of those, woken by uplink */
+    uint64_t radio_on_ms;    /* Receiver on: RRC connected or paging window */
+};
+
+/* Attach to the network with the given grants, the modem starts idle */
+void mock_modem_start(const struct mock_network *network);
+void mock_modem_stop(void);
+
+/* Application uplink, connects the modem if needed */
+void mock_modem_uplink(void);
+
+void mock_modem_get_stats(struct mock_modem_stats *stats);
+
+#endif /* LTE_LC_MOCK_H */
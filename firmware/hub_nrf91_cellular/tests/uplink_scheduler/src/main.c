@@ -0,0 +1,209 @@
+/*
+ * Uplink Scheduler Tests
+ *
+ * Runs the scheduler and lte_connection.c against a mocked lte_lc modem for
+ * a simulated hour per network configuration, once with the grants hidden
+ * from the application (fixed deadlines) and once with them reported, and
+ * compares modem wake-ups and radio-on time.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include "hub_events.h"
+#include "network/lte_connection.h"
+#include "network/uplink_scheduler.h"
+#include "lte_lc_mock.h"
+
+/* The cadence main.c registers */
+#define TELEMETRY_PERIOD_S 240
+#define TELEMETRY_SLACK_S  60
+#define TWIN_PERIOD_S      300
+#define TWIN_SLACK_S       120
+#define HEARTBEAT_PERIOD_S 840
+#define HEARTBEAT_SLACK_S  240
+
+#define WARMUP   K_MINUTES(30)
+#define MEASURED K_HOURS(1)
+
+K_EVENT_DEFINE(hub_events);
+
+struct task_probe {
+    uint32_t period_s;
+    uint32_t slack_s;
+    int64_t last_run;
+    int64_t max_gap;
+    uint32_t runs;
+};
+
+static struct task_probe probes[3] = {
+    { TELEMETRY_PERIOD_S, TELEMETRY_SLACK_S },
+    { TWIN_PERIOD_S, TWIN_SLACK_S },
+    { HEARTBEAT_PERIOD_S, HEARTBEAT_SLACK_S },
+};
+
+struct hour_result {
+    struct mock_modem_stats modem;
+    uint32_t bursts;
+    uint32_t piggybacked;
+};
+
+static void probe_run(struct task_probe *probe)
+{
+    int64_t now = k_uptime_get();
+
+    if (probe->last_run) {
+        probe->max_gap = MAX(probe->max_gap, now - probe->last_run);
+    }
+    probe->last_run = now;
+    probe->runs++;
+    mock_modem_uplink();
+}
+
+static void telemetry_task(void)
+{
+    probe_run(&probes[0]);
+}
+
+static void twin_task(void)
+{
+    probe_run(&probes[1]);
+}
+
+static void heartbeat_task(void)
+{
+    probe_run(&probes[2]);
+}
+
+static void *setup(void)
+{
+    lte_connection_init();
+    uplink_scheduler_init();
+    uplink_scheduler_add_task("telemetry", TELEMETRY_PERIOD_S, TELEMETRY_SLACK_S,
+                              telemetry_task);
+    uplink_scheduler_add_task("twin", TWIN_PERIOD_S, TWIN_SLACK_S, twin_task);
+    uplink_scheduler_add_task("heartbeat", HEARTBEAT_PERIOD_S, HEARTBEAT_SLACK_S,
+                              heartbeat_task);
+    return NULL;
+}
+
+static void run_hour(const struct mock_network *net, struct hour_result *result)
+{
+    struct mock_modem_stats before, after;
+    struct uplink_scheduler_stats sched_before, sched_after;
+
+    for (size_t i = 0; i < ARRAY_SIZE(probes); i++) {
+        probes[i].last_run = 0;
+        probes[i].max_gap = 0;
+    }
+
+    mock_modem_start(net);
+    uplink_scheduler_start();
+    k_sleep(WARMUP);
+
+    mock_modem_get_stats(&before);
+    uplink_scheduler_get_stats(&sched_before);
+    k_sleep(MEASURED);
+    mock_modem_get_stats(&after);
+    uplink_scheduler_get_stats(&sched_after);
+
+    uplink_scheduler_stop();
+    mock_modem_stop();
+
+    result->modem.wakeups = after.wakeups - before.wakeups;
+    result->modem.uplink_wakeups = after.uplink_wakeups - before.uplink_wakeups;
+    result->modem.radio_on_ms = after.radio_on_ms - before.radio_on_ms;
+    result->bursts = sched_after.bursts - sched_before.bursts;
+    result->piggybacked = sched_after.piggybacked - sched_before.piggybacked;
+}
+
+static void check_deadlines(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(probes); i++) {
+        zassert_true(probes[i].max_gap <=
+                     (int64_t)(probes[i].period_s + probes[i].slack_s) * MSEC_PER_SEC,
+                     "task %zu late: %lld ms between runs", i, (long long)probes[i].max_gap);
+    }
+}
+
+static void compare(const char *name, struct mock_network net,
+                    struct hour_result *fixed, struct hour_result *aligned)
+{
+    net.report_grants = false;
+    run_hour(&net, fixed);
+    check_deadlines();
+
+    net.report_grants = true;
+    run_hour(&net, aligned);
+    check_deadlines();
+
+    TC_PRINT("%s per hour:\n", name);
+    TC_PRINT("  fixed:   %u wake-ups (%u for uplink), radio on %u s, %u bursts\n",
+             fixed->modem.wakeups, fixed->modem.uplink_wakeups,
+             (uint32_t)(fixed->modem.radio_on_ms / MSEC_PER_SEC), fixed->bursts);
+    TC_PRINT("  aligned: %u wake-ups (%u for uplink), radio on %u s, %u bursts, "
+             "%u piggybacked\n",
+             aligned->modem.wakeups, aligned->modem.uplink_wakeups,
+             (uint32_t)(aligned->modem.radio_on_ms / MSEC_PER_SEC), aligned->bursts,
+             aligned->piggybacked);
+}
+
+/* eDRX without PSM: uplink goes out in the paging windows the modem opens anyway */
+ZTEST(uplink_scheduler, test_edrx_82s)
+{
+    struct hour_result fixed, aligned;
+
+    compare("eDRX 81.92 s", (struct mock_network){
+        .edrx_ms = 81920, .ptw_ms = 2560, .inactivity_ms = 10000,
+    }, &fixed, &aligned);
+
+    zassert_equal(aligned.modem.uplink_wakeups, 0, "every burst rides a paging window");
+    zassert_true(aligned.modem.wakeups < fixed.modem.wakeups);
+    /* Bursts come earlier in their windows, so a few more of them */
+    zassert_true(aligned.modem.radio_on_ms * 100 <= fixed.modem.radio_on_ms * 105);
+}
+
+/* A cycle longer than the windows leaves nothing to align to */
+ZTEST(uplink_scheduler, test_edrx_164s)
+{
+    struct hour_result fixed, aligned;
+
+    compare("eDRX 163.84 s", (struct mock_network){
+        .edrx_ms = 163840, .ptw_ms = 2560, .inactivity_ms = 10000,
+    }, &fixed, &aligned);
+
+    zassert_true(aligned.modem.wakeups <= fixed.modem.wakeups);
+    zassert_true(aligned.modem.radio_on_ms <= fixed.modem.radio_on_ms);
+}
+
+/*
+ * PSM with a short active time: every window opens after the paging
+ * stops, so the deadlines are kept as they are
+ */
+ZTEST(uplink_scheduler, test_psm)
+{
+    struct hour_result fixed, aligned;
+
+    compare("PSM TAU 3600 s, active 60 s, eDRX 20.48 s", (struct mock_network){
+        .psm_tau_s = 3600, .psm_active_s = 60, .edrx_ms = 20480, .ptw_ms = 1280,
+        .inactivity_ms = 10000,
+    }, &fixed, &aligned);
+
+    zassert_true(aligned.modem.wakeups <= fixed.modem.wakeups);
+    zassert_true(aligned.modem.radio_on_ms <= fixed.modem.radio_on_ms);
+}
+
+/* A TAU that lands inside the windows takes the burst with it */
+ZTEST(uplink_scheduler, test_psm_short_tau)
+{
+    struct hour_result fixed, aligned;
+
+    compare("PSM TAU 240 s, active 0 s", (struct mock_network){
+        .psm_tau_s = 240, .inactivity_ms = 10000,
+    }, &fixed, &aligned);
+
+    zassert_true(aligned.modem.wakeups <= fixed.modem.wakeups);
+    zassert_true(aligned.piggybacked > 0);
+    zassert_equal(aligned.bursts, 0, "no wake-up of its own");
+}
+
+ZTEST_SUITE(uplink_scheduler, NULL, setup, NULL, NULL, NULL);
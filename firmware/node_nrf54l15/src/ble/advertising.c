@@ -1,32 +1,297 @@
 /*
- * BLE Advertising Implementation - Stub
+ * BLE Advertising Implementation
+ *
+ * One advertising set carries readings and takes connections. Outside
+ * commissioning it is a connectable extended advertisement with the
+ * version 2 payload: the hub collects readings while scanning and
+ * connects to the same set for configuration or DFU. Each advertisement
+ * carries the last ADV_HISTORY_LEN readings, so a hub that misses a few
+ * advertisements, or only scans part of the time, still gets every
+ * reading from the next one it hears. Each reading carries the seconds
+ * since the one before it, because with report-by-exception and an
+ * adaptive interval the readings are not evenly spaced. While a hub is
+ * connected the set runs non-connectable, so readings keep flowing.
+ *
+ * Commissioning uses legacy connectable advertising with the 17-byte
+ * version 1 payload and the device name, because phones and Web
+ * Bluetooth do not scan for extended advertising.
+ *
+ * A reading only replaces the data of the running set. The set is
+ * recreated from the system work queue when the mode or the connection
+ * state changes, which is rare. The version 1 payload is double-buffered:
+ * a reading is written to the idle buffer, which is then published, so
+ * the PAwR response, built from the Bluetooth thread, always copies a
+ * complete payload.
  */
 
 #include "advertising.h"
 #include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(advertising, LOG_LEVEL_INF);
 
-int advertising_start(struct node_config *config)
+struct adv_older {
+    float value;
+    uint8_t spacing_s[2];                /* Seconds since the reading before it */
+} __packed;
+
+struct adv_history {
+    uint8_t company_id[2];
+    uint8_t version;
+    uint8_t node_id[6];                  /* Most significant byte first */
+    uint8_t battery_pct;
+    float last_reading;
+    uint8_t faults;
+    uint8_t counter[2];                  /* Counter of last_reading */
+    uint8_t spacing_s[2];                /* Seconds since the reading before last_reading */
+    uint8_t count;                       /* Valid readings, last_reading included */
+    uint8_t battery_mv[2];
+    char unit[8];                        /* NUL-padded */
+    struct adv_older older[ADV_HISTORY_LEN - 1]; /* Newest first */
+} __packed;
+
+BUILD_ASSERT(offsetof(struct adv_history, spacing_s) == ADV_LEN,
+             "History must extend the version 1 layout");
+BUILD_ASSERT(SIZEOF_FIELD(struct adv_history, unit) == SIZEOF_FIELD(struct sensor_reading, unit),
+             "Unit is copied whole from the reading");
+
+/* Flags and manufacturer data AD structures around the payload */
+BUILD_ASSERT(3 + 2 + sizeof(struct adv_history) <= CONFIG_BT_CTLR_ADV_DATA_LEN_MAX,
+             "Version 2 payload must fit one advertising PDU");
+
+static struct adv_history payload;
+static uint16_t counter;
+static uint32_t last_ms;               /* Timestamp of last_reading */
+
+/* Version 1 payloads, published holds the one being advertised */
+static uint8_t legacy_payload[2][ADV_LEN];
+static uint8_t published;
+
+static const struct bt_data legacy_ad[2][2] = {
+    {
+        BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+        BT_DATA(BT_DATA_MANUFACTURER_DATA, legacy_payload[0], ADV_LEN),
+    },
+    {
+        BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+        BT_DATA(BT_DATA_MANUFACTURER_DATA, legacy_payload[1], ADV_LEN),
+    },
+};
+
+static const struct bt_data history_ad[] = {
+    BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+    BT_DATA(BT_DATA_MANUFACTURER_DATA, &payload, sizeof(payload)),
+};
+
+static enum adv_mode adv_mode = ADV_MODE_OPERATIONAL;
+static struct bt_le_ext_adv *adv;
+static bool adv_legacy;        /* The running set is legacy */
+static bool adv_enabled;       /* Between advertising_start() and _stop() */
+static bool central_connected;
+static struct k_work restart_work;
+
+static uint8_t battery_pct(uint16_t battery_mv)
 {
-    LOG_INF("BLE advertising started (stub)");
-    return bt_le_adv_start(BT_LE_ADV_CONN_NAME, NULL, 0, NULL, 0);
+    uint32_t mv = CLAMP(battery_mv, ADV_BATTERY_MV_EMPTY, ADV_BATTERY_MV_FULL);
+
+    return (mv - ADV_BATTERY_MV_EMPTY) * 100 / (ADV_BATTERY_MV_FULL - ADV_BATTERY_MV_EMPTY);
 }
 
-int advertising_stop(void)
+static uint32_t mode_interval_ms(enum adv_mode mode)
 {
-    return bt_le_adv_stop();
+    switch (mode) {
+    case ADV_MODE_COMMISSIONING:
+        return ADV_INTERVAL_COMMISSIONING_MS;
+    case ADV_MODE_FAULT:
+        return ADV_INTERVAL_FAULT_MS;
+    default:
+        return ADV_INTERVAL_OPERATIONAL_MS;
+    }
 }
 
-int advertising_update_reading(struct sensor_reading *reading)
+static int set_data(void)
+{
+    if (adv_legacy) {
+        return bt_le_ext_adv_set_data(adv, legacy_ad[published], ARRAY_SIZE(legacy_ad[0]),
+                                      NULL, 0);
+    }
+    return bt_le_ext_adv_set_data(adv, history_ad, ARRAY_SIZE(history_ad), NULL, 0);
+}
+
+static void adv_connected(struct bt_le_ext_adv *set, struct bt_le_ext_adv_connected_info *info)
+{
+    /* The set stopped, run it non-connectable while the hub is here */
+    central_connected = true;
+    k_work_submit(&restart_work);
+}
+
+static const struct bt_le_ext_adv_cb adv_cb = {
+    .connected = adv_connected,
+};
+
+static void conn_recycled(void)
+{
+    if (central_connected) {
+        central_connected = false;
+        k_work_submit(&restart_work);
+    }
+}
+
+BT_CONN_CB_DEFINE(adv_conn_callbacks) = {
+    .recycled = conn_recycled,
+};
+
+static int adv_restart(void)
 {
-    LOG_DBG("Advertising updated with reading: %.2f %s", reading->value, reading->unit);
+    /* Advertising interval units are 0.625 ms */
+    uint32_t interval = mode_interval_ms(adv_mode) * 8 / 5;
+    struct bt_le_adv_param param =
+        BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_USE_IDENTITY, interval, interval, NULL);
+    int ret;
+
+    if (adv) {
+        bt_le_ext_adv_stop(adv);
+        bt_le_ext_adv_delete(adv);
+        adv = NULL;
+    }
+    if (!adv_enabled) {
+        return 0;
+    }
+
+    adv_legacy = adv_mode == ADV_MODE_COMMISSIONING && !central_connected;
+    if (adv_legacy) {
+        param.options |= BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_USE_NAME;
+    } else {
+        param.options |= BT_LE_ADV_OPT_EXT_ADV;
+        if (!central_connected) {
+            param.options |= BT_LE_ADV_OPT_CONNECTABLE;
+        }
+    }
+
+    ret = bt_le_ext_adv_create(&param, &adv_cb, &adv);
+    if (ret) {
+        LOG_ERR("Advertising set create failed: %d", ret);
+        return ret;
+    }
+
+    ret = set_data();
+    if (!ret) {
+        ret = bt_le_ext_adv_start(adv, BT_LE_EXT_ADV_START_DEFAULT);
+    }
+    if (ret) {
+        LOG_ERR("Advertising start failed: %d", ret);
+        bt_le_ext_adv_delete(adv);
+        adv = NULL;
+        return ret;
+    }
+
+    LOG_INF("Advertising %s, %u ms", adv_legacy ? "legacy" :
+            central_connected ? "extended, non-connectable" : "extended",
+            mode_interval_ms(adv_mode));
     return 0;
 }
 
-int advertising_update_fault_state(void)
+static void restart_work_handler(struct k_work *work)
 {
-    LOG_WRN("Advertising updated with fault state");
+    adv_restart();
+}
+
+int advertising_start(void)
+{
+    bt_addr_le_t addrs[CONFIG_BT_ID_MAX];
+    size_t count = ARRAY_SIZE(addrs);
+
+    k_work_init(&restart_work, restart_work_handler);
+
+    bt_id_get(addrs, &count);
+    for (size_t i = 0; i < sizeof(payload.node_id); i++) {
+        payload.node_id[i] = addrs[0].a.val[sizeof(payload.node_id) - 1 - i];
+    }
+    sys_put_le16(ADV_COMPANY_ID, payload.company_id);
+    payload.version = ADV_VERSION_HISTORY;
+
+    /* Version 1 header until the first reading */
+    memcpy(legacy_payload[published], &payload, ADV_LEN);
+    legacy_payload[published][offsetof(struct adv_history, version)] = ADV_VERSION;
+
+    adv_enabled = true;
+    return adv_restart();
+}
+
+int advertising_stop(void)
+{
+    adv_enabled = false;
+    k_work_submit(&restart_work);
+    return 0;
+}
+
+int advertising_set_mode(enum adv_mode mode)
+{
+    bool restart = (mode == ADV_MODE_COMMISSIONING) != (adv_mode == ADV_MODE_COMMISSIONING) ||
+                   mode_interval_ms(mode) != mode_interval_ms(adv_mode);
+
+    adv_mode = mode;
+    if (adv_enabled && restart) {
+        k_work_submit(&restart_work);
+    }
     return 0;
 }
+
+/* Fill the idle version 1 buffer, make it the advertised one, then set the data */
+static int publish(void)
+{
+    uint8_t idle = !published;
+
+    memcpy(legacy_payload[idle], &payload, ADV_LEN);
+    legacy_payload[idle][offsetof(struct adv_history, version)] = ADV_VERSION;
+    compiler_barrier();
+    published = idle;
+
+    if (!adv) {
+        return -EAGAIN;
+    }
+    return set_data();
+}
+
+int advertising_update_reading(struct sensor_reading *reading)
+{
+    uint32_t spacing_s = 0;
+
+    if (payload.count > 0) {
+        memmove(&payload.older[1], &payload.older[0],
+                sizeof(payload.older) - sizeof(payload.older[0]));
+        payload.older[0].value = payload.last_reading;
+        memcpy(payload.older[0].spacing_s, payload.spacing_s, sizeof(payload.spacing_s));
+        spacing_s = DIV_ROUND_CLOSEST(reading->timestamp_ms - last_ms, MSEC_PER_SEC);
+    }
+    last_ms = reading->timestamp_ms;
+    payload.last_reading = reading->value;
+    payload.count = MIN(payload.count + 1, ADV_HISTORY_LEN);
+    payload.battery_pct = battery_pct(reading->battery_mv);
+    sys_put_le16(reading->battery_mv, payload.battery_mv);
+    strncpy(payload.unit, reading->unit, sizeof(payload.unit));
+    payload.faults = reading->faults;
+    reading->counter = ++counter;
+    sys_put_le16(counter, payload.counter);
+    sys_put_le16(MIN(spacing_s, UINT16_MAX), payload.spacing_s);
+
+    LOG_DBG("Advertising updated with reading: %.2f %s", (double)reading->value, reading->unit);
+    return publish();
+}
+
+int advertising_set_faults(uint8_t faults)
+{
+    payload.faults |= faults;
+
+    LOG_WRN("Advertising faults 0x%02x", payload.faults);
+    return publish();
+}
+
+void advertising_get_payload(uint8_t *buf)
+{
+    memcpy(buf, legacy_payload[published], ADV_LEN);
+}
+
@@ -1,5 +1,7 @@
 /*
- * BLE Advertising - Stub
+ * BLE Advertising
+ * One advertising set that carries recent readings to the hub and takes
+ * connections for config and DFU
  */
 
 #ifndef ADVERTISING_H
@@ -7,9 +9,62 @@
 
 #include "../sensor/sensor_control.h"
 
-int advertising_start(struct node_config *config);
+/* Manufacturer data, see NodeAdvertisement in common/protocol/ble-protocol.ts */
+#define ADV_COMPANY_ID        0x0059
+#define ADV_VERSION           1
+#define ADV_VERSION_HISTORY   2
+#define ADV_LEN               17    /* Version 1 payload */
+#define ADV_HISTORY_LEN       8     /* Readings per advertisement, newest included */
+
+/* Advertising interval per state, see ble-protocol.md */
+#define ADV_INTERVAL_COMMISSIONING_MS  100
+#define ADV_INTERVAL_OPERATIONAL_MS    1000
+#define ADV_INTERVAL_FAULT_MS          500
+
+enum adv_mode {
+    ADV_MODE_COMMISSIONING,
+    ADV_MODE_OPERATIONAL,
+    ADV_MODE_FAULT,
+};
+
+/* Fault flags of the payload, see ble-protocol.md */
+#define ADV_FAULT_SENSOR_HIGH         BIT(0)
+#define ADV_FAULT_SENSOR_LOW          BIT(1)
+#define ADV_FAULT_SENSOR_DISCONNECTED BIT(2)
+#define ADV_FAULT_ADC_SATURATION      BIT(3)
+#define ADV_FAULT_LOW_BATTERY         BIT(4)
+#define ADV_FAULT_WATCHDOG_RESET      BIT(5)
+#define ADV_FAULT_CONFIG_CORRUPT      BIT(6)
+
+/* Battery range mapped to 0-100 % */
+#define ADV_BATTERY_MV_EMPTY  2000
+#define ADV_BATTERY_MV_FULL   3000
+
+/*
+ * Start advertising. Connections are only needed for config and DFU,
+ * readings go out in the advertisements.
+ */
+int advertising_start(void);
+
 int advertising_stop(void);
+
+/*
+ * Select the advertising interval, and legacy advertising for
+ * commissioning. Advertising restarts only when either changes; before
+ * advertising_start() the mode is kept.
+ */
+int advertising_set_mode(enum adv_mode mode);
+
+/* Add a reading to the payload, updated in place, and set its counter */
 int advertising_update_reading(struct sensor_reading *reading);
-int advertising_update_fault_state(void);
+
+/*
+ * Add fault flags to the payload without a reading, updated in place. The
+ * counter is unchanged; the next reading sets the flags again.
+ */
+int advertising_set_faults(uint8_t faults);
+
+/* Copy the latest reading as a version 1 payload of ADV_LEN bytes */
+void advertising_get_payload(uint8_t *buf);
 
 #endif /* ADVERTISING_H */
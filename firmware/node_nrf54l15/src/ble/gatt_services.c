@@ -1,20 +1,550 @@
 /*
- * GATT Services Implementation - Stub
+ * GATT Services Implementation
+ *
+ * Every reading goes into a RAM ring. A hub that subscribes to the Reading
+ * Batch characteristic is sent the ring as packed notifications, as many
+ * readings each as its ATT MTU allows, so with data length extension a
+ * day's backlog goes out in a few PDUs instead of one per reading. The
+ * next batch is sent when the previous one is out, one per connection
+ * event. Subscribers of the Reading characteristic (Web Bluetooth) still
+ * get one reading per notification.
+ *
+ * A Config write is decoded and checked in the write callback, so the hub
+ * gets an error response for a bad value. It is applied to the running
+ * configuration from the system work queue, between samples.
+ *
+ * The Diagnostics characteristic reads back the sensor timing of the last
+ * reading, including the settle time learned in settle warm-up mode.
+ *
+ * Pairing is refused outside the commissioning window except from the hub
+ * that commissioned the node, see pairing_accept().
+ *
+ * Connection state is set from the Bluetooth callbacks and the ring is
+ * only touched from the system work queue.
  */
 
 #include "gatt_services.h"
+#include "../config/config_codec.h"
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
+#include <string.h>
 
 LOG_MODULE_REGISTER(gatt_services, LOG_LEVEL_INF);
 
-int gatt_services_init(struct node_config *config)
+/* ATT notification header: opcode and handle */
+#define ATT_NOTIFY_HDR_LEN  3
+
+/* Reading Batch header: count, unit length, counter of the first entry */
+#define BATCH_HDR_LEN       4
+
+/* Diagnostics value: five little-endian uint32 of struct sensor_timing */
+#define DIAG_LEN            20
+
+/* Retry delay when the stack is out of buffers */
+#define FLUSH_RETRY_MS      50
+
+/* Smallest ATT MTU */
+#define ATT_MTU_MIN         23
+
+BUILD_ASSERT(ATT_MTU_MIN - ATT_NOTIFY_HDR_LEN - BATCH_HDR_LEN -
+             (sizeof(((struct sensor_reading *)0)->unit) - 1) >= GATT_BATCH_ENTRY_LEN,
+             "One reading with the longest unit must fit the smallest MTU");
+
+#define BATCH_BUF_LEN       (BATCH_HDR_LEN + sizeof(((struct sensor_reading *)0)->unit) + \
+                             GATT_BATCH_MAX * GATT_BATCH_ENTRY_LEN)
+
+struct ring_entry {
+    uint32_t timestamp_ms;
+    float value;
+    uint16_t counter;
+    uint8_t quality;
+};
+
+static struct bt_uuid_128 sensor_service_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x00001000, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb));
+static struct bt_uuid_128 reading_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x00001001, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb));
+static struct bt_uuid_128 reading_batch_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x00001008, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb));
+static struct bt_uuid_128 config_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x00001002, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb));
+static struct bt_uuid_128 diagnostics_uuid = BT_UUID_INIT_128(
+    BT_UUID_128_ENCODE(0x00001005, 0x0000, 0x1000, 0x8000, 0x00805f9b34fb));
+
+static struct sensor_reading last_reading;
+
+static struct ring_entry ring[GATT_RING_SIZE];
+static uint16_t ring_tail;          /* Oldest entry */
+static uint16_t ring_count;
+static uint8_t inflight;            /* Entries in the batch being sent */
+static atomic_t batch_sent;
+
+static struct bt_conn *hub_conn;
+static bool reading_notify;
+static bool batch_notify;
+static uint8_t batch_cap = GATT_BATCH_MAX; /* Lowered while notifications fail */
+
+static uint8_t batch_buf[BATCH_BUF_LEN];
+static struct k_work_delayable flush_work;
+
+static struct node_config *node_config;
+static struct node_config pending_config;
+static uint8_t pending_sections;
+static atomic_t config_busy;
+static gatt_config_cb_t config_changed;
+static struct k_work config_work;
+static uint8_t config_buf[CONFIG_CODEC_MAX_LEN];
+static bt_addr_le_t config_peer;    /* Writer of pending_config */
+static bool config_peer_bonded;
+
+static bool commissioning;
+static bt_addr_le_t bound_hub;
+static bool hub_bound;
+
+static uint8_t reading_quality(const struct sensor_reading *reading)
+{
+    uint8_t quality = GATT_QUALITY_VALID | GATT_QUALITY_CALIBRATED;
+
+    if (reading->faults == 0) {
+        quality |= GATT_QUALITY_IN_RANGE;
+    }
+    return quality;
+}
+
+/* Reading characteristic value: timestamp, value, unit, quality */
+static uint16_t encode_reading(const struct sensor_reading *reading, uint8_t *buf)
 {
-    LOG_INF("GATT services initialized (stub)");
+    uint8_t unit_len = strlen(reading->unit);
+    uint8_t *p = buf;
+
+    sys_put_le32(reading->timestamp_ms, p);
+    p += 4;
+    memcpy(p, &reading->value, sizeof(float));
+    p += sizeof(float);
+    *p++ = unit_len;
+    memcpy(p, reading->unit, unit_len);
+    p += unit_len;
+    *p++ = reading_quality(reading);
+
+    return p - buf;
+}
+
+static ssize_t read_reading(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            void *buf, uint16_t len, uint16_t offset)
+{
+    uint8_t value[4 + sizeof(float) + 1 + sizeof(last_reading.unit) + 1];
+    uint16_t value_len = encode_reading(&last_reading, value);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, value_len);
+}
+
+static void reading_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    reading_notify = (value == BT_GATT_CCC_NOTIFY);
+}
+
+static void batch_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+    batch_notify = (value == BT_GATT_CCC_NOTIFY);
+    if (batch_notify) {
+        LOG_INF("Batch subscribed, %u readings queued", ring_count);
+        k_work_reschedule(&flush_work, K_NO_WAIT);
+    }
+}
+
+static ssize_t read_config(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                           void *buf, uint16_t len, uint16_t offset)
+{
+    int value_len = config_codec_encode(node_config, config_buf, sizeof(config_buf));
+
+    if (value_len < 0) {
+        return BT_GATT_ERR(GATT_ERR_APPLICATION);
+    }
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, config_buf, value_len);
+}
+
+static ssize_t read_diagnostics(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                                void *buf, uint16_t len, uint16_t offset)
+{
+    struct sensor_timing timing;
+    uint8_t value[DIAG_LEN];
+
+    sensor_get_timing(&timing);
+    sys_put_le32(timing.sensor_on_us, &value[0]);
+    sys_put_le32(timing.warmup_us, &value[4]);
+    sys_put_le32(timing.acquire_us, &value[8]);
+    sys_put_le32(timing.settle_us, &value[12]);
+    sys_put_le32(timing.settle_timeouts, &value[16]);
+
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+struct bond_match {
+    const bt_addr_le_t *addr;
+    bool found;
+};
+
+static void match_bond(const struct bt_bond_info *info, void *user_data)
+{
+    struct bond_match *match = user_data;
+
+    match->found |= bt_addr_le_eq(&info->addr, match->addr);
+}
+
+static bool peer_bonded(const bt_addr_le_t *peer)
+{
+    struct bond_match match = { .addr = peer };
+
+    bt_foreach_bond(BT_ID_DEFAULT, match_bond, &match);
+    return match.found;
+}
+
+/* The whole value in one write, long writes are not accepted */
+static ssize_t write_config(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+                            const void *buf, uint16_t len, uint16_t offset, uint8_t flags)
+{
+    struct config_codec_stats stats;
+    uint8_t sections;
+    int ret;
+
+    if (offset) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    if (!atomic_cas(&config_busy, 0, 1)) {
+        return BT_GATT_ERR(GATT_ERR_BUSY);
+    }
+
+    bt_addr_le_copy(&config_peer, bt_conn_get_dst(conn));
+    config_peer_bonded = peer_bonded(&config_peer);
+    pending_config = *node_config;
+    ret = config_codec_decode(buf, len, &pending_config, &sections);
+    config_codec_get_stats(&stats);
+    if (ret) {
+        atomic_clear(&config_busy);
+        LOG_WRN("Config write rejected: %d", ret);
+        return BT_GATT_ERR(ret == -ERANGE ? GATT_ERR_OUT_OF_RANGE : GATT_ERR_APPLICATION);
+    }
+
+    LOG_INF("Config written, %u bytes, sections 0x%02x, decoded in %u us",
+            len, sections, stats.decode_us);
+    pending_sections = sections;
+    k_work_submit(&config_work);
+    return len;
+}
+
+static bool pairing_open(void)
+{
+    return commissioning || k_uptime_get() < GATT_PAIRING_WINDOW_S * MSEC_PER_SEC;
+}
+
+/*
+ * A peer that configures the node while pairing is open is its hub, unless
+ * it bonded: hubs pair on every connection, the web app bonds
+ */
+static void bind_hub(const bt_addr_le_t *peer, bool bonded)
+{
+    int ret;
+
+    if (bonded || !pairing_open() || (hub_bound && bt_addr_le_eq(&bound_hub, peer))) {
+        return;
+    }
+
+    bt_addr_le_copy(&bound_hub, peer);
+    hub_bound = true;
+    ret = settings_save_one(GATT_HUB_SETTINGS_KEY, &bound_hub, sizeof(bound_hub));
+    if (ret) {
+        LOG_WRN("Hub address not stored: %d", ret);
+    }
+}
+
+static void config_work_handler(struct k_work *work)
+{
+    bind_hub(&config_peer, config_peer_bonded);
+    *node_config = pending_config;
+    if (config_changed) {
+        config_changed(pending_sections);
+    }
+    atomic_clear(&config_busy);
+}
+
+/*
+ * Subscribing and writing the configuration take an encrypted link. With no
+ * display or keys on either side pairing is Just Works, so encryption is the
+ * level both ends can reach; the stack answers 0x0f until the peer pairs.
+ * Encryption alone would let any phone pair and write, so pairing_accept()
+ * limits who may pair.
+ */
+BT_GATT_SERVICE_DEFINE(sensor_svc,
+    BT_GATT_PRIMARY_SERVICE(&sensor_service_uuid),
+    BT_GATT_CHARACTERISTIC(&reading_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_READ, read_reading, NULL, NULL),
+    BT_GATT_CCC(reading_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT),
+    BT_GATT_CHARACTERISTIC(&reading_batch_uuid.uuid, BT_GATT_CHRC_NOTIFY,
+                           BT_GATT_PERM_NONE, NULL, NULL, NULL),
+    BT_GATT_CCC(batch_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT),
+    BT_GATT_CHARACTERISTIC(&config_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
+                           BT_GATT_PERM_READ | BT_GATT_PERM_WRITE_ENCRYPT,
+                           read_config, write_config, NULL),
+    BT_GATT_CHARACTERISTIC(&diagnostics_uuid.uuid, BT_GATT_CHRC_READ,
+                           BT_GATT_PERM_READ, read_diagnostics, NULL, NULL),
+);
+
+/* Value attributes, after the service and each characteristic declaration */
+#define READING_ATTR        (&sensor_svc.attrs[2])
+#define READING_BATCH_ATTR  (&sensor_svc.attrs[5])
+
+static void ring_push(const struct sensor_reading *reading)
+{
+    struct ring_entry *entry;
+
+    if (ring_count == GATT_RING_SIZE) {
+        /* Drop the oldest, which may be part of the batch in flight */
+        ring_tail = (ring_tail + 1) % GATT_RING_SIZE;
+        ring_count--;
+        if (inflight) {
+            inflight--;
+        }
+    }
+
+    entry = &ring[(ring_tail + ring_count) % GATT_RING_SIZE];
+    entry->timestamp_ms = reading->timestamp_ms;
+    entry->value = reading->value;
+    entry->counter = reading->counter;
+    entry->quality = reading_quality(reading);
+    ring_count++;
+}
+
+static void ring_pop(uint16_t count)
+{
+    ring_tail = (ring_tail + count) % GATT_RING_SIZE;
+    ring_count -= count;
+}
+
+/* Readings that fit one notification at this ATT MTU, after the unit */
+static uint8_t batch_fit(uint16_t mtu, uint8_t unit_len)
+{
+    uint16_t payload = mtu - ATT_NOTIFY_HDR_LEN - BATCH_HDR_LEN - unit_len;
+
+    return CLAMP(payload / GATT_BATCH_ENTRY_LEN, 1, GATT_BATCH_MAX);
+}
+
+static void batch_sent_cb(struct bt_conn *conn, void *user_data)
+{
+    atomic_set(&batch_sent, 1);
+    k_work_reschedule(&flush_work, K_NO_WAIT);
+}
+
+/*
+ * Batch layout: count, unit length, counter of the first entry, unit, then
+ * entries oldest first. Entries carry consecutive counters, so the hub can
+ * tell which of them it missed in the advertisements.
+ */
+static uint16_t encode_batch(uint8_t count)
+{
+    uint8_t unit_len = strlen(last_reading.unit);
+    uint8_t *p = batch_buf;
+
+    *p++ = count;
+    *p++ = unit_len;
+    sys_put_le16(ring[ring_tail].counter, p);
+    p += 2;
+    memcpy(p, last_reading.unit, unit_len);
+    p += unit_len;
+
+    for (uint8_t i = 0; i < count; i++) {
+        const struct ring_entry *entry = &ring[(ring_tail + i) % GATT_RING_SIZE];
+
+        sys_put_le32(entry->timestamp_ms, p);
+        memcpy(p + 4, &entry->value, sizeof(float));
+        p[8] = entry->quality;
+        p += GATT_BATCH_ENTRY_LEN;
+    }
+
+    return p - batch_buf;
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+    struct bt_gatt_notify_params params = {
+        .attr = READING_BATCH_ATTR,
+        .func = batch_sent_cb,
+    };
+    uint8_t count;
+    int ret;
+
+    if (atomic_cas(&batch_sent, 1, 0)) {
+        ring_pop(inflight);
+        inflight = 0;
+    }
+
+    if (!hub_conn) {
+        /* A batch in flight at disconnect is sent again next time */
+        inflight = 0;
+        atomic_clear(&batch_sent);
+        return;
+    }
+
+    if (!batch_notify || inflight || ring_count == 0) {
+        return;
+    }
+
+    /* Sized now, from the MTU and the unit the batch is sent with */
+    count = batch_fit(bt_gatt_get_mtu(hub_conn), strlen(last_reading.unit));
+    count = MIN(MIN(count, batch_cap), ring_count);
+    params.data = batch_buf;
+    params.len = encode_batch(count);
+
+    ret = bt_gatt_notify_cb(hub_conn, &params);
+    if (ret == -ENOMEM) {
+        /* Out of buffers, or a PDU the stack will not take: go smaller */
+        batch_cap = MAX(count / 2, 1);
+        k_work_reschedule(&flush_work, K_MSEC(FLUSH_RETRY_MS));
+        return;
+    }
+    if (ret) {
+        LOG_WRN("Batch notify failed: %d", ret);
+        return;
+    }
+
+    batch_cap = GATT_BATCH_MAX;
+    inflight = count;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+    int ret;
+
+    if (err || hub_conn) {
+        return;
+    }
+
+    hub_conn = bt_conn_ref(conn);
+
+    /* Longest link layer packets, so a full batch is one PDU */
+    ret = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+    if (ret) {
+        LOG_DBG("Data length update failed: %d", ret);
+    }
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+    if (conn != hub_conn) {
+        return;
+    }
+
+    bt_conn_unref(hub_conn);
+    hub_conn = NULL;
+    reading_notify = false;
+    batch_notify = false;
+    batch_cap = GATT_BATCH_MAX;
+    k_work_reschedule(&flush_work, K_NO_WAIT);
+}
+
+BT_CONN_CB_DEFINE(gatt_conn_callbacks) = {
+    .connected = connected,
+    .disconnected = disconnected,
+};
+
+/*
+ * Threat model: Just Works has no MITM protection and the hub pairs again
+ * on every connection without keeping keys. Any peer in range may pair
+ * while the node is uncommissioned or within GATT_PAIRING_WINDOW_S of a
+ * power cycle, which takes physical access. Outside that only the hub that
+ * commissioned the node may pair; peers bonded in the window reconnect
+ * with their keys. This keeps out passing phones, not an attacker who
+ * spoofs the hub's address or listens in on a pairing. That takes passkey
+ * or OOB pairing, which this hardware has no means for.
+ */
+static enum bt_security_err pairing_accept(struct bt_conn *conn,
+                                           const struct bt_conn_pairing_feat *const feat)
+{
+    const bt_addr_le_t *peer = bt_conn_get_dst(conn);
+    char addr[BT_ADDR_LE_STR_LEN];
+
+    if (pairing_open() || (hub_bound && bt_addr_le_eq(&bound_hub, peer))) {
+        return BT_SECURITY_ERR_SUCCESS;
+    }
+
+    bt_addr_le_to_str(peer, addr, sizeof(addr));
+    LOG_WRN("Pairing from %s refused outside the commissioning window", addr);
+    return BT_SECURITY_ERR_PAIR_NOT_ALLOWED;
+}
+
+static struct bt_conn_auth_cb auth_callbacks = {
+    .pairing_accept = pairing_accept,
+};
+
+static int load_hub(const char *key, size_t len, settings_read_cb read_cb, void *cb_arg,
+                    void *param)
+{
+    if (len == sizeof(bound_hub) && read_cb(cb_arg, &bound_hub, len) == (ssize_t)len) {
+        hub_bound = true;
+    }
     return 0;
 }
 
+static void mtu_updated(struct bt_conn *conn, uint16_t tx, uint16_t rx)
+{
+    if (conn != hub_conn) {
+        return;
+    }
+
+    LOG_INF("ATT MTU %u, up to %u readings per batch", tx,
+            batch_fit(tx, strlen(last_reading.unit)));
+    k_work_reschedule(&flush_work, K_NO_WAIT);
+}
+
+static struct bt_gatt_cb gatt_callbacks = {
+    .att_mtu_updated = mtu_updated,
+};
+
+int gatt_services_init(struct node_config *config, gatt_config_cb_t config_cb)
+{
+    int ret;
+
+    ret = bt_conn_auth_cb_register(&auth_callbacks);
+    if (ret) {
+        LOG_ERR("Auth callbacks not registered: %d", ret);
+        return ret;
+    }
+    settings_load_subtree_direct(GATT_HUB_SETTINGS_KEY, load_hub, NULL);
+
+    node_config = config;
+    config_changed = config_cb;
+    k_work_init(&config_work, config_work_handler);
+    k_work_init_delayable(&flush_work, flush_work_handler);
+    bt_gatt_cb_register(&gatt_callbacks);
+
+    LOG_INF("GATT services initialized");
+    return 0;
+}
+
+void gatt_services_set_commissioning(bool value)
+{
+    commissioning = value;
+}
+
 int gatt_notify_reading(struct sensor_reading *reading)
 {
-    LOG_DBG("GATT notification sent: %.2f %s", reading->value, reading->unit);
+    uint8_t value[4 + sizeof(float) + 1 + sizeof(reading->unit) + 1];
+    int ret;
+
+    last_reading = *reading;
+    ring_push(reading);
+
+    if (hub_conn && reading_notify) {
+        ret = bt_gatt_notify(hub_conn, READING_ATTR, value, encode_reading(reading, value));
+        if (ret) {
+            LOG_DBG("Reading notify failed: %d", ret);
+        }
+    }
+
+    k_work_reschedule(&flush_work, K_NO_WAIT);
     return 0;
 }
@@ -1,5 +1,7 @@
 /*
- * GATT Services - Stub
+ * GATT Services
+ * Industrial Sensor Service with single and batched reading notifications
+ * and the Config characteristic
  */
 
 #ifndef GATT_SERVICES_H
@@ -7,7 +9,49 @@
 
 #include "../sensor/sensor_control.h"
 
-int gatt_services_init(struct node_config *config);
+/* Readings kept for the next hub connection, oldest dropped when full */
+#define GATT_RING_SIZE          64
+
+/* Reading Batch entry: timestamp, value, quality */
+#define GATT_BATCH_ENTRY_LEN    9
+
+/* Readings per batch at the largest ATT MTU (247), any unit fits */
+#define GATT_BATCH_MAX          26
+
+/* Quality flags, see docs/interfaces/ble-protocol.md */
+#define GATT_QUALITY_VALID      BIT(0)
+#define GATT_QUALITY_CALIBRATED BIT(1)
+#define GATT_QUALITY_IN_RANGE   BIT(2)
+
+/* Pairing is open to any peer for this long after boot, see gatt_services.c */
+#define GATT_PAIRING_WINDOW_S   300
+
+/* Settings key of the hub that commissioned the node */
+#define GATT_HUB_SETTINGS_KEY   "node/hub"
+
+/* ATT application errors, see docs/interfaces/ble-protocol.md */
+#define GATT_ERR_APPLICATION    0x80
+#define GATT_ERR_OUT_OF_RANGE   0x82
+#define GATT_ERR_BUSY           0x84
+
+/*
+ * Called from the system work queue once a Config write is in config,
+ * with a bit per enum node_config_section it changed
+ */
+typedef void (*gatt_config_cb_t)(uint8_t sections);
+
+int gatt_services_init(struct node_config *config, gatt_config_cb_t config_cb);
+
+/*
+ * Open pairing to any peer while the node is waiting to be commissioned,
+ * besides the window after boot
+ */
+void gatt_services_set_commissioning(bool commissioning);
+
+/*
+ * Notify a reading to subscribers of the Reading characteristic and queue
+ * it for the Reading Batch characteristic
+ */
 int gatt_notify_reading(struct sensor_reading *reading);
 
 #endif /* GATT_SERVICES_H */
@@ -0,0 +1,346 @@
+/*
+ * PAwR Sync Implementation
+ *
+ * The node syncs to the hub's periodic train and listens to one subevent
+ * only, picked from its address the same way the hub does. The subevent
+ * data lists node ids in slot order; the node answers in its slot with
+ * the version 1 advertisement payload and the last command it executed.
+ * Listening events are skipped down to one per sampling interval (at most
+ * PAWR_SYNC_MAX_LATENCY_S apart), so the radio is on for one subevent and
+ * one response slot per reading.
+ *
+ * HCI commands that wait for completion are not allowed in the Bluetooth
+ * callbacks, so creating, configuring and dropping the sync run from the
+ * system work queue.
+ */
+
+#include "pawr_sync.h"
+#include "advertising.h"
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/logging/log.h>
+#include <string.h>
+
+LOG_MODULE_REGISTER(pawr_sync, LOG_LEVEL_INF);
+
+/* Hub manufacturer data, see docs/interfaces/ble-protocol.md */
+#define PAWR_TYPE_BEACON    0x10
+#define PAWR_TYPE_SLOTS     0x11
+#define PAWR_SLOTS_HDR_LEN  4       /* Company, type, count */
+#define PAWR_ENTRY_LEN      7       /* Node id, command */
+#define PAWR_RESPONSE_LEN   (ADV_LEN + 1)
+
+struct slot_lookup {
+    int slot;
+    uint8_t command;
+};
+
+static const struct node_config *node_config;
+static pawr_sync_command_cb_t command_cb;
+
+static struct bt_le_per_adv_sync *sync;
+static struct bt_le_per_adv_sync_param sync_param;
+static bool searching;
+static bool found;
+static uint8_t num_subevents;
+static uint8_t node_id[6];
+static uint8_t subevent;
+static uint8_t last_command;
+static uint16_t unassigned;         /* Listening events without a slot */
+static uint32_t retry_s = PAWR_SYNC_RETRY_MIN_S;
+
+static struct k_work_delayable search_work;
+static struct k_work create_work;
+static struct k_work select_work;
+static struct k_work drop_work;
+
+NET_BUF_SIMPLE_DEFINE_STATIC(rsp_buf, 2 + PAWR_RESPONSE_LEN);
+
+static void search_stop(void)
+{
+    if (searching) {
+        bt_le_scan_stop();
+        searching = false;
+    }
+}
+
+static void search_later(void)
+{
+    k_work_reschedule(&search_work, K_SECONDS(retry_s));
+    retry_s = MIN(retry_s * 2, PAWR_SYNC_RETRY_MAX_S);
+}
+
+static void search_work_handler(struct k_work *work)
+{
+    int ret;
+
+    if (sync) {
+        return;
+    }
+
+    if (searching) {
+        /* Nothing found, try again later */
+        search_stop();
+        search_later();
+        return;
+    }
+
+    found = false;
+    ret = bt_le_scan_start(BT_LE_SCAN_PASSIVE, NULL);
+    if (ret) {
+        LOG_WRN("PAwR search scan failed: %d", ret);
+        search_later();
+        return;
+    }
+
+    searching = true;
+    k_work_reschedule(&search_work, K_SECONDS(PAWR_SYNC_SEARCH_S));
+}
+
+static void create_work_handler(struct k_work *work)
+{
+    int ret;
+
+    if (sync) {
+        return;
+    }
+
+    ret = bt_le_per_adv_sync_create(&sync_param, &sync);
+    if (ret) {
+        LOG_WRN("PAwR sync create failed: %d", ret);
+        sync = NULL;
+        found = false;
+        return;
+    }
+
+    LOG_INF("Hub train found, syncing with skip %u", sync_param.skip);
+}
+
+static void select_work_handler(struct k_work *work)
+{
+    struct bt_le_per_adv_sync_subevent_params params = {
+        .num_subevents = 1,
+        .subevents = &subevent,
+    };
+    bt_addr_le_t addrs[CONFIG_BT_ID_MAX];
+    size_t count = ARRAY_SIZE(addrs);
+    int ret;
+
+    if (!sync) {
+        return;
+    }
+
+    /* Same id and subevent as the hub computes from our address */
+    bt_id_get(addrs, &count);
+    for (size_t i = 0; i < sizeof(node_id); i++) {
+        node_id[i] = addrs[0].a.val[sizeof(node_id) - 1 - i];
+    }
+    subevent = addrs[0].a.val[0] % num_subevents;
+    unassigned = 0;
+
+    ret = bt_le_per_adv_sync_subevent(sync, &params);
+    if (ret) {
+        LOG_WRN("PAwR subevent select failed: %d", ret);
+        k_work_submit(&drop_work);
+        return;
+    }
+
+    LOG_INF("Synced to hub train, subevent %u", subevent);
+}
+
+/* Give up on a train that is of no use to us, and search again later */
+static void drop_work_handler(struct k_work *work)
+{
+    if (!sync) {
+        return;
+    }
+
+    bt_le_per_adv_sync_delete(sync);
+    sync = NULL;
+    search_later();
+}
+
+static bool is_hub_beacon(struct bt_data *data, void *user_data)
+{
+    bool *beacon = user_data;
+
+    if (data->type == BT_DATA_MANUFACTURER_DATA && data->data_len >= 3 &&
+        sys_get_le16(&data->data[0]) == ADV_COMPANY_ID &&
+        data->data[2] == PAWR_TYPE_BEACON) {
+        *beacon = true;
+        return false;
+    }
+    return true;
+}
+
+static void scan_recv(const struct bt_le_scan_recv_info *info, struct net_buf_simple *buf)
+{
+    uint32_t interval_ms;
+    uint32_t listen_ms;
+    uint32_t skip;
+    bool beacon = false;
+
+    if (!searching || found || info->interval == 0) {
+        return;
+    }
+
+    bt_data_parse(buf, is_hub_beacon, &beacon);
+    if (!beacon) {
+        return;
+    }
+
+    /* Listen once per reading, but often enough for commands */
+    interval_ms = info->interval * 5 / 4;
+    listen_ms = MIN(node_config->sampling.interval_seconds, PAWR_SYNC_MAX_LATENCY_S) * 1000;
+    skip = CLAMP(listen_ms / interval_ms, 1, BT_GAP_PER_ADV_MAX_SKIP + 1) - 1;
+
+    memset(&sync_param, 0, sizeof(sync_param));
+    bt_addr_le_copy(&sync_param.addr, info->addr);
+    sync_param.sid = info->sid;
+    sync_param.skip = skip;
+    sync_param.timeout = CLAMP((skip + 1) * interval_ms * PAWR_SYNC_TIMEOUT_EVENTS / 10,
+                               10, BT_GAP_PER_ADV_MAX_TIMEOUT);
+
+    found = true;
+    k_work_submit(&create_work);
+}
+
+static struct bt_le_scan_cb scan_callbacks = {
+    .recv = scan_recv,
+};
+
+static void synced(struct bt_le_per_adv_sync *s, struct bt_le_per_adv_sync_synced_info *info)
+{
+    if (s != sync) {
+        return;
+    }
+
+    search_stop();
+    k_work_cancel_delayable(&search_work);
+    retry_s = PAWR_SYNC_RETRY_MIN_S;
+
+    if (info->num_subevents == 0) {
+        LOG_WRN("Periodic train has no subevents");
+        k_work_submit(&drop_work);
+        return;
+    }
+
+    num_subevents = info->num_subevents;
+    k_work_submit(&select_work);
+}
+
+static void term(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_term_info *info)
+{
+    if (s != sync) {
+        return;
+    }
+
+    LOG_INF("Hub train lost: %u", info->reason);
+    sync = NULL;
+    k_work_reschedule(&search_work, K_SECONDS(1));
+}
+
+static bool find_slot(struct bt_data *data, void *user_data)
+{
+    struct slot_lookup *lookup = user_data;
+    const uint8_t *entry;
+    uint8_t count;
+
+    if (data->type != BT_DATA_MANUFACTURER_DATA || data->data_len < PAWR_SLOTS_HDR_LEN ||
+        sys_get_le16(&data->data[0]) != ADV_COMPANY_ID ||
+        data->data[2] != PAWR_TYPE_SLOTS) {
+        return true;
+    }
+
+    count = MIN(data->data[3], (data->data_len - PAWR_SLOTS_HDR_LEN) / PAWR_ENTRY_LEN);
+    entry = &data->data[PAWR_SLOTS_HDR_LEN];
+    for (int i = 0; i < count; i++, entry += PAWR_ENTRY_LEN) {
+        if (memcmp(entry, node_id, sizeof(node_id)) == 0) {
+            lookup->slot = i;
+            lookup->command = entry[sizeof(node_id)];
+            break;
+        }
+    }
+    return false;
+}
+
+static void recv(struct bt_le_per_adv_sync *s, const struct bt_le_per_adv_sync_recv_info *info,
+                 struct net_buf_simple *buf)
+{
+    struct slot_lookup lookup = { .slot = -1 };
+    struct bt_le_per_adv_response_params params;
+    int ret;
+
+    if (s != sync || !buf || info->subevent != subevent) {
+        return;
+    }
+
+    bt_data_parse(buf, find_slot, &lookup);
+    if (lookup.slot < 0) {
+        /* Not bound to this hub, listening to it only costs power */
+        if (++unassigned == PAWR_SYNC_UNASSIGNED_MAX) {
+            LOG_INF("No slot on this hub train");
+            k_work_submit(&drop_work);
+        }
+        return;
+    }
+    unassigned = 0;
+
+    /* A repeat of the last command is only acknowledged again */
+    if (lookup.command != PAWR_CMD_NONE && lookup.command != last_command) {
+        last_command = lookup.command;
+        if (command_cb) {
+            command_cb(lookup.command & 0x0f);
+        }
+    }
+
+    net_buf_simple_reset(&rsp_buf);
+    net_buf_simple_add_u8(&rsp_buf, 1 + PAWR_RESPONSE_LEN);
+    net_buf_simple_add_u8(&rsp_buf, BT_DATA_MANUFACTURER_DATA);
+    advertising_get_payload(net_buf_simple_add(&rsp_buf, ADV_LEN));
+    net_buf_simple_add_u8(&rsp_buf, last_command);
+
+    params.request_event = info->periodic_event_counter;
+    params.request_subevent = info->subevent;
+    params.response_subevent = info->subevent;
+    params.response_slot = lookup.slot;
+
+    ret = bt_le_per_adv_set_response_data(sync, &params, &rsp_buf);
+    if (ret) {
+        LOG_DBG("PAwR response failed: %d", ret);
+    }
+}
+
+static struct bt_le_per_adv_sync_cb sync_callbacks = {
+    .synced = synced,
+    .term = term,
+    .recv = recv,
+};
+
+int pawr_sync_init(const struct node_config *config, pawr_sync_command_cb_t cb)
+{
+    int ret;
+
+    node_config = config;
+    command_cb = cb;
+
+    k_work_init_delayable(&search_work, search_work_handler);
+    k_work_init(&create_work, create_work_handler);
+    k_work_init(&select_work, select_work_handler);
+    k_work_init(&drop_work, drop_work_handler);
+    bt_le_per_adv_sync_cb_register(&sync_callbacks);
+
+    ret = bt_le_scan_cb_register(&scan_callbacks);
+    if (ret) {
+        LOG_ERR("Scan callback register failed: %d", ret);
+        return ret;
+    }
+
+    k_work_schedule(&search_work, K_NO_WAIT);
+    return 0;
+}
+
+bool pawr_sync_is_synced(void)
+{
+    return sync != NULL;
+}
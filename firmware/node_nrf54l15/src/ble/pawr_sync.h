@@ -0,0 +1,39 @@
+/*
+ * PAwR Sync
+ * Collection by a hub's Periodic Advertising with Responses train
+ */
+
+#ifndef PAWR_SYNC_H
+#define PAWR_SYNC_H
+
+#include "../sensor/sensor_control.h"
+
+/* Commands from the hub, see enum pawr_command on the hub */
+#define PAWR_CMD_NONE    0
+#define PAWR_CMD_SAMPLE  1
+
+/* Longest time between two responses, bounds command latency */
+#define PAWR_SYNC_MAX_LATENCY_S  10
+
+/* Train search: scan this long, then back off between searches */
+#define PAWR_SYNC_SEARCH_S       5
+#define PAWR_SYNC_RETRY_MIN_S    60
+#define PAWR_SYNC_RETRY_MAX_S    (24 * 3600)
+
+/* Sync is lost after this many missed listening events */
+#define PAWR_SYNC_TIMEOUT_EVENTS 3
+
+/* A train with no slot for us is dropped after this many listening events */
+#define PAWR_SYNC_UNASSIGNED_MAX 30
+
+typedef void (*pawr_sync_command_cb_t)(uint8_t command);
+
+/*
+ * Look for a hub train and answer in the assigned slot with the latest
+ * reading. Without a train the node only searches now and then.
+ */
+int pawr_sync_init(const struct node_config *config, pawr_sync_command_cb_t cb);
+
+bool pawr_sync_is_synced(void);
+
+#endif /* PAWR_SYNC_H */
@@ -0,0 +1,336 @@
+/*
+ * Configuration Codec Implementation
+ *
+ * The hub translates a configuration from JSON once, and the node reads
+ * the records straight into struct node_config. This needs no heap, no
+ * string handling and no long write: a full configuration is 214 bytes
+ * against 244 for one write at the 247-byte MTU, and a typical push of a
+ * few fields is a few dozen bytes.
+ */
+
+#include "config_codec.h"
+#include "../sensor/adc.h"
+#include "../sensor/aggregate.h"
+#include "../sensor/reporting.h"
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+#include <string.h>
+
+BUILD_ASSERT(CONFIG_CODEC_MAX_LEN <= CONFIG_CODEC_WRITE_MAX, "Config must fit one ATT write");
+
+#define RECORD_HDR_LEN  2               /* Tag, length */
+
+struct writer {
+    uint8_t *p;
+    uint8_t *end;
+    bool full;
+};
+
+/* Compiled only to check a written calibration */
+static struct calibration scratch;
+
+static struct config_codec_stats stats;
+
+static float get_f32(const uint8_t *p)
+{
+    uint32_t bits = sys_get_le32(p);
+    float value;
+
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static void set_f32(uint8_t *p, float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    sys_put_le32(bits, p);
+}
+
+/* Scalar records must have exactly their type's length */
+static int decode_record(uint8_t tag, const uint8_t *v, uint8_t len, struct node_config *config)
+{
+    static const uint8_t scalar_len[] = {
+        [CONFIG_TAG_INTERVAL] = 4, [CONFIG_TAG_WARMUP] = 2,
+        [CONFIG_TAG_BURST_COUNT] = 1, [CONFIG_TAG_AGGREGATION] = 1,
+        [CONFIG_TAG_MIN_INTERVAL] = 4, [CONFIG_TAG_MAX_INTERVAL] = 4,
+        [CONFIG_TAG_WARMUP_MODE] = 1,
+        [CONFIG_TAG_CAL_TYPE] = 1, [CONFIG_TAG_CAL_OFFSET] = 4,
+        [CONFIG_TAG_CAL_SLOPE] = 4, [CONFIG_TAG_CAL_POLY_A] = 4,
+        [CONFIG_TAG_CAL_POLY_B] = 4,
+        [CONFIG_TAG_POLICY] = 1, [CONFIG_TAG_HEARTBEAT] = 2,
+        [CONFIG_TAG_DEADBAND] = 4,
+        [CONFIG_TAG_ALARM_HIGH] = 4, [CONFIG_TAG_ALARM_LOW] = 4,
+        [CONFIG_TAG_ALARM_HIGH_EN] = 1, [CONFIG_TAG_ALARM_LOW_EN] = 1,
+    };
+    struct calibration_config *cal = &config->calibration;
+
+    if (tag < ARRAY_SIZE(scalar_len) && scalar_len[tag] && len != scalar_len[tag]) {
+        return -EINVAL;
+    }
+
+    switch (tag) {
+    case CONFIG_TAG_INTERVAL:
+        config->sampling.interval_seconds = sys_get_le32(v);
+        break;
+    case CONFIG_TAG_WARMUP:
+        config->sampling.warmup_ms = sys_get_le16(v);
+        break;
+    case CONFIG_TAG_BURST_COUNT:
+        config->sampling.burst_count = v[0];
+        break;
+    case CONFIG_TAG_AGGREGATION:
+        config->sampling.aggregation = v[0];
+        break;
+    case CONFIG_TAG_MIN_INTERVAL:
+        config->sampling.min_interval_seconds = sys_get_le32(v);
+        break;
+    case CONFIG_TAG_MAX_INTERVAL:
+        config->sampling.max_interval_seconds = sys_get_le32(v);
+        break;
+    case CONFIG_TAG_WARMUP_MODE:
+        config->sampling.warmup_mode = v[0];
+        break;
+    case CONFIG_TAG_CAL_TYPE:
+        cal->type = v[0];
+        break;
+    case CONFIG_TAG_CAL_OFFSET:
+        cal->offset = get_f32(v);
+        break;
+    case CONFIG_TAG_CAL_SLOPE:
+        cal->slope = get_f32(v);
+        break;
+    case CONFIG_TAG_CAL_POLY_A:
+        cal->poly_a = get_f32(v);
+        break;
+    case CONFIG_TAG_CAL_POLY_B:
+        cal->poly_b = get_f32(v);
+        break;
+    case CONFIG_TAG_CAL_POLY:
+        if (len % sizeof(float) || len / sizeof(float) > CALIBRATION_POLY_MAX) {
+            return -EINVAL;
+        }
+        cal->poly_count = len / sizeof(float);
+        for (uint8_t i = 0; i < cal->poly_count; i++) {
+            cal->poly[i] = get_f32(&v[i * sizeof(float)]);
+        }
+        break;
+    case CONFIG_TAG_CAL_POINTS:
+        if (len % CONFIG_POINT_LEN || len / CONFIG_POINT_LEN > CALIBRATION_POINTS_MAX) {
+            return -EINVAL;
+        }
+        cal->point_count = len / CONFIG_POINT_LEN;
+        for (uint8_t i = 0; i < cal->point_count; i++, v += CONFIG_POINT_LEN) {
+            cal->points[i].voltage_mv = sys_get_le16(v);
+            cal->points[i].value = get_f32(v + 2);
+        }
+        break;
+    case CONFIG_TAG_POLICY:
+        config->advertisement.policy = v[0];
+        break;
+    case CONFIG_TAG_HEARTBEAT:
+        config->advertisement.heartbeat_seconds = sys_get_le16(v);
+        break;
+    case CONFIG_TAG_DEADBAND:
+        config->advertisement.deadband = get_f32(v);
+        break;
+    case CONFIG_TAG_ALARM_HIGH:
+        config->alarms.high_threshold = get_f32(v);
+        break;
+    case CONFIG_TAG_ALARM_LOW:
+        config->alarms.low_threshold = get_f32(v);
+        break;
+    case CONFIG_TAG_ALARM_HIGH_EN:
+        config->alarms.enable_high = v[0] != 0;
+        break;
+    case CONFIG_TAG_ALARM_LOW_EN:
+        config->alarms.enable_low = v[0] != 0;
+        break;
+    default:
+        return -ENOENT;
+    }
+
+    return 0;
+}
+
+/* Range checks of the sections written, as in the schema */
+static int validate(const struct node_config *config, uint8_t sections)
+{
+    if (sections & BIT(NODE_CONFIG_SAMPLING)) {
+        if (!IN_RANGE(config->sampling.interval_seconds, 1, CONFIG_INTERVAL_MAX_S) ||
+            config->sampling.min_interval_seconds > CONFIG_INTERVAL_MAX_S ||
+            config->sampling.max_interval_seconds > CONFIG_INTERVAL_MAX_S ||
+            config->sampling.warmup_ms > CONFIG_WARMUP_MAX_MS ||
+            !IN_RANGE(config->sampling.burst_count, 1, ADC_BURST_MAX) ||
+            config->sampling.aggregation > AGGREGATION_TRIMMED_MEAN ||
+            config->sampling.warmup_mode > WARMUP_SETTLE) {
+            return -ERANGE;
+        }
+    }
+
+    if (sections & BIT(NODE_CONFIG_CALIBRATION)) {
+        if (calibration_compile(&config->calibration, &scratch)) {
+            return -ERANGE;
+        }
+    }
+
+    if (sections & BIT(NODE_CONFIG_ADVERTISEMENT)) {
+        if (config->advertisement.policy > REPORT_ON_CHANGE ||
+            !IN_RANGE(config->advertisement.heartbeat_seconds, 1, CONFIG_HEARTBEAT_MAX_S) ||
+            !(config->advertisement.deadband >= 0.0f)) {
+            return -ERANGE;
+        }
+    }
+
+    return 0;
+}
+
+int config_codec_decode(const uint8_t *buf, uint16_t len, struct node_config *config,
+                        uint8_t *sections)
+{
+    const uint8_t *p = buf + 1;
+    const uint8_t *end = buf + len;
+    uint32_t start = k_cycle_get_32();
+    uint32_t elapsed;
+    int ret = 0;
+
+    *sections = 0;
+
+    if (len < 1 || buf[0] != CONFIG_CODEC_VERSION) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    while (p < end) {
+        uint8_t tag;
+        uint8_t rec_len;
+        int err;
+
+        if (end - p < RECORD_HDR_LEN || end - p - RECORD_HDR_LEN < p[1]) {
+            ret = -EINVAL;
+            goto out;
+        }
+        tag = p[0];
+        rec_len = p[1];
+
+        err = decode_record(tag, p + RECORD_HDR_LEN, rec_len, config);
+        if (err == 0) {
+            *sections |= BIT(CONFIG_TAG_SECTION(tag));
+        } else if (err != -ENOENT) {
+            ret = err;
+            goto out;
+        }
+        p += RECORD_HDR_LEN + rec_len;
+    }
+
+    ret = validate(config, *sections);
+
+out:
+    elapsed = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    stats.decodes++;
+    stats.decode_us = elapsed;
+    stats.decode_max_us = MAX(stats.decode_max_us, elapsed);
+    if (ret) {
+        stats.errors++;
+    }
+    return ret;
+}
+
+static void put(struct writer *w, uint8_t tag, const void *value, uint8_t len)
+{
+    if (w->full || w->end - w->p < RECORD_HDR_LEN + len) {
+        w->full = true;
+        return;
+    }
+    w->p[0] = tag;
+    w->p[1] = len;
+    memcpy(w->p + RECORD_HDR_LEN, value, len);
+    w->p += RECORD_HDR_LEN + len;
+}
+
+static void put_u8(struct writer *w, uint8_t tag, uint8_t value)
+{
+    put(w, tag, &value, 1);
+}
+
+static void put_u16(struct writer *w, uint8_t tag, uint16_t value)
+{
+    uint8_t le[2];
+
+    sys_put_le16(value, le);
+    put(w, tag, le, sizeof(le));
+}
+
+static void put_u32(struct writer *w, uint8_t tag, uint32_t value)
+{
+    uint8_t le[4];
+
+    sys_put_le32(value, le);
+    put(w, tag, le, sizeof(le));
+}
+
+static void put_f32(struct writer *w, uint8_t tag, float value)
+{
+    uint8_t le[4];
+
+    set_f32(le, value);
+    put(w, tag, le, sizeof(le));
+}
+
+int config_codec_encode(const struct node_config *config, uint8_t *buf, uint16_t len)
+{
+    const struct calibration_config *cal = &config->calibration;
+    uint8_t poly_count = MIN(cal->poly_count, CALIBRATION_POLY_MAX);
+    uint8_t point_count = MIN(cal->point_count, CALIBRATION_POINTS_MAX);
+    uint8_t table[CALIBRATION_POINTS_MAX * CONFIG_POINT_LEN];
+    uint8_t poly[CALIBRATION_POLY_MAX * sizeof(float)];
+    struct writer w = { .p = buf + 1, .end = buf + len };
+
+    if (len < 1) {
+        return -ENOMEM;
+    }
+    buf[0] = CONFIG_CODEC_VERSION;
+
+    put_u32(&w, CONFIG_TAG_INTERVAL, config->sampling.interval_seconds);
+    put_u16(&w, CONFIG_TAG_WARMUP, config->sampling.warmup_ms);
+    put_u8(&w, CONFIG_TAG_BURST_COUNT, config->sampling.burst_count);
+    put_u8(&w, CONFIG_TAG_AGGREGATION, config->sampling.aggregation);
+    put_u32(&w, CONFIG_TAG_MIN_INTERVAL, config->sampling.min_interval_seconds);
+    put_u32(&w, CONFIG_TAG_MAX_INTERVAL, config->sampling.max_interval_seconds);
+    put_u8(&w, CONFIG_TAG_WARMUP_MODE, config->sampling.warmup_mode);
+
+    put_u8(&w, CONFIG_TAG_CAL_TYPE, cal->type);
+    put_f32(&w, CONFIG_TAG_CAL_OFFSET, cal->offset);
+    put_f32(&w, CONFIG_TAG_CAL_SLOPE, cal->slope);
+    put_f32(&w, CONFIG_TAG_CAL_POLY_A, cal->poly_a);
+    put_f32(&w, CONFIG_TAG_CAL_POLY_B, cal->poly_b);
+    for (uint8_t i = 0; i < poly_count; i++) {
+        set_f32(&poly[i * sizeof(float)], cal->poly[i]);
+    }
+    put(&w, CONFIG_TAG_CAL_POLY, poly, poly_count * sizeof(float));
+    for (uint8_t i = 0; i < point_count; i++) {
+        sys_put_le16(cal->points[i].voltage_mv, &table[i * CONFIG_POINT_LEN]);
+        set_f32(&table[i * CONFIG_POINT_LEN + 2], cal->points[i].value);
+    }
+    put(&w, CONFIG_TAG_CAL_POINTS, table, point_count * CONFIG_POINT_LEN);
+
+    put_u8(&w, CONFIG_TAG_POLICY, config->advertisement.policy);
+    put_u16(&w, CONFIG_TAG_HEARTBEAT, config->advertisement.heartbeat_seconds);
+    put_f32(&w, CONFIG_TAG_DEADBAND, config->advertisement.deadband);
+
+    put_f32(&w, CONFIG_TAG_ALARM_HIGH, config->alarms.high_threshold);
+    put_f32(&w, CONFIG_TAG_ALARM_LOW, config->alarms.low_threshold);
+    put_u8(&w, CONFIG_TAG_ALARM_HIGH_EN, config->alarms.enable_high);
+    put_u8(&w, CONFIG_TAG_ALARM_LOW_EN, config->alarms.enable_low);
+
+    if (w.full) {
+        return -ENOMEM;
+    }
+    return w.p - buf;
+}
+
+void config_codec_get_stats(struct config_codec_stats *out)
+{
+    *out = stats;
+}
@@ -0,0 +1,92 @@
+/*
+ * Configuration Codec
+ * Binary form of the Config characteristic
+ */
+
+#ifndef CONFIG_CODEC_H
+#define CONFIG_CODEC_H
+
+#include "config_manager.h"
+
+/* First byte of the value, bumped on any incompatible tag change */
+#define CONFIG_CODEC_VERSION     1
+
+/*
+ * Tags of the records after the version byte: tag, length, value, with
+ * integers and floats little-endian. The high nibble of a tag is its
+ * enum node_config_section. Absent tags leave the field as it is, unknown
+ * tags are skipped.
+ */
+enum config_tag {
+    CONFIG_TAG_INTERVAL = 0x01,         /* uint32, seconds */
+    CONFIG_TAG_WARMUP = 0x02,           /* uint16, ms */
+    CONFIG_TAG_BURST_COUNT = 0x03,      /* uint8 */
+    CONFIG_TAG_AGGREGATION = 0x04,      /* uint8, enum aggregation */
+    CONFIG_TAG_MIN_INTERVAL = 0x05,     /* uint32, seconds */
+    CONFIG_TAG_MAX_INTERVAL = 0x06,     /* uint32, seconds */
+    CONFIG_TAG_WARMUP_MODE = 0x07,      /* uint8, enum warmup_mode */
+
+    CONFIG_TAG_CAL_TYPE = 0x10,         /* uint8, enum calibration_type */
+    CONFIG_TAG_CAL_OFFSET = 0x11,       /* float32 */
+    CONFIG_TAG_CAL_SLOPE = 0x12,        /* float32, per volt */
+    CONFIG_TAG_CAL_POLY_A = 0x13,       /* float32 */
+    CONFIG_TAG_CAL_POLY_B = 0x14,       /* float32 */
+    CONFIG_TAG_CAL_POLY = 0x15,         /* float32[], constant first */
+    CONFIG_TAG_CAL_POINTS = 0x16,       /* {uint16 mV, float32 value}[] */
+
+    CONFIG_TAG_POLICY = 0x20,           /* uint8, enum report_policy */
+    CONFIG_TAG_HEARTBEAT = 0x21,        /* uint16, seconds */
+    CONFIG_TAG_DEADBAND = 0x22,         /* float32 */
+
+    CONFIG_TAG_ALARM_HIGH = 0x30,       /* float32 */
+    CONFIG_TAG_ALARM_LOW = 0x31,        /* float32 */
+    CONFIG_TAG_ALARM_HIGH_EN = 0x32,    /* uint8, 0 or 1 */
+    CONFIG_TAG_ALARM_LOW_EN = 0x33,     /* uint8, 0 or 1 */
+};
+
+#define CONFIG_TAG_SECTION(tag)  ((tag) >> 4)
+
+/* Table point record entry */
+#define CONFIG_POINT_LEN         6
+
+/* Every field with a full polynomial and table */
+#define CONFIG_CODEC_MAX_LEN     214
+
+/* A full configuration fits one write at the 247-byte ATT MTU */
+#define CONFIG_CODEC_WRITE_MAX   244
+
+/* Limits checked on decode, as in the schema */
+#define CONFIG_INTERVAL_MAX_S    86400
+#define CONFIG_WARMUP_MAX_MS     10000
+#define CONFIG_HEARTBEAT_MAX_S   3600
+
+struct config_codec_stats {
+    uint32_t decodes;
+    uint32_t errors;
+    uint32_t decode_us;         /* Last decode, validation included */
+    uint32_t decode_max_us;
+};
+
+/*
+ * Apply an encoded configuration over config. Nothing is allocated and
+ * there is no recursion, so the stack use is the fixed frame of this call.
+ * A calibration is checked by compiling it. On error config may be partly
+ * written, so decode into a copy.
+ *
+ * @param sections Set to a bit per enum node_config_section written
+ * @return 0 on success, -EINVAL if the value is malformed, -ERANGE if a
+ *         field is out of range
+ */
+int config_codec_decode(const uint8_t *buf, uint16_t len, struct node_config *config,
+                        uint8_t *sections);
+
+/*
+ * Encode every field of config, for reading the characteristic
+ *
+ * @return Encoded length, or -ENOMEM if buf is too small
+ */
+int config_codec_encode(const struct node_config *config, uint8_t *buf, uint16_t len);
+
+void config_codec_get_stats(struct config_codec_stats *stats);
+
+#endif /* CONFIG_CODEC_H */
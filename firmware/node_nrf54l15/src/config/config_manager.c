@@ -1,46 +1,208 @@
 /*
- * Configuration Manager Implementation - Stub
+ * Configuration Manager Implementation
+ *
+ * Each section of struct node_config is one settings entry under
+ * NODE_CONFIG_SETTINGS_ROOT: a layout version byte, the section as laid
+ * out in RAM, and a CRC-32 over both. Boot loads the whole subtree in one
+ * pass straight into the config, with no parsing. A Config or Calibration
+ * write stores only its own section, and NVS skips the write if the value
+ * is unchanged. A section in any other layout is ignored and keeps its
+ * defaults.
  */
 
 #include "config_manager.h"
+#include <zephyr/settings/settings.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
 #include <zephyr/logging/log.h>
 #include <string.h>
 
 LOG_MODULE_REGISTER(config_manager, LOG_LEVEL_INF);
 
-void config_manager_set_defaults(struct node_config *config)
+#define RECORD_HDR_LEN   1          /* Layout version */
+#define RECORD_CRC_LEN   4
+#define RECORD_MAX_LEN   (RECORD_HDR_LEN + sizeof(struct calibration_config) + RECORD_CRC_LEN)
+#define SECTION_NAME_MAX 16
+
+#define SECTION(name, field) \
+    { name, offsetof(struct node_config, field), sizeof(((struct node_config *)0)->field) }
+
+struct section {
+    const char *name;
+    size_t offset;
+    size_t size;
+};
+
+static const struct section sections[NODE_CONFIG_SECTIONS] = {
+    [NODE_CONFIG_SAMPLING] = SECTION("sampling", sampling),
+    [NODE_CONFIG_CALIBRATION] = SECTION("calibration", calibration),
+    [NODE_CONFIG_ADVERTISEMENT] = SECTION("advertisement", advertisement),
+    [NODE_CONFIG_ALARMS] = SECTION("alarms", alarms),
+};
+
+BUILD_ASSERT(sizeof(struct calibration_config) >= sizeof(((struct node_config *)0)->sampling) &&
+             sizeof(struct calibration_config) >= sizeof(((struct node_config *)0)->advertisement) &&
+             sizeof(struct calibration_config) >= sizeof(((struct node_config *)0)->alarms),
+             "Calibration is the largest section");
+
+struct load_ctx {
+    struct node_config *config;
+    uint8_t loaded;             /* Bit per section */
+};
+
+static uint8_t record_buf[RECORD_MAX_LEN];
+static struct config_stats stats;
+
+static void fill_defaults(struct node_config *config)
 {
     memset(config, 0, sizeof(*config));
-    
+
     config->sampling.interval_seconds = 60;
     config->sampling.warmup_ms = 100;
     config->sampling.burst_count = 10;
     config->sampling.aggregation = 0; /* mean */
-    
+    config->sampling.warmup_mode = WARMUP_FIXED;
+
+    config->calibration.type = CALIBRATION_LINEAR;
     config->calibration.offset = 0.0f;
     config->calibration.slope = 20.0f; /* 0-5V to 0-100 PSI */
     config->calibration.poly_a = 0.0f;
     config->calibration.poly_b = 0.0f;
-    
+
+    config->advertisement.policy = 0; /* each_sample */
+    config->advertisement.heartbeat_seconds = 300;
+    config->advertisement.deadband = 0.0f;
+
     config->alarms.high_threshold = 100.0f;
     config->alarms.low_threshold = 0.0f;
     config->alarms.enable_high = true;
     config->alarms.enable_low = false;
-    
-    config->schema_version = 1;
-    
+
+    config->schema_version = NODE_CONFIG_VERSION;
+}
+
+void config_manager_set_defaults(struct node_config *config)
+{
+    fill_defaults(config);
     LOG_INF("Configuration set to defaults");
 }
 
+static int load_section(const char *key, size_t len, settings_read_cb read_cb,
+                        void *cb_arg, void *param)
+{
+    struct load_ctx *ctx = param;
+    const uint8_t *body = &record_buf[RECORD_HDR_LEN];
+    size_t body_len;
+    uint8_t version;
+    int section;
+
+    for (section = 0; section < NODE_CONFIG_SECTIONS; section++) {
+        if (strcmp(key, sections[section].name) == 0) {
+            break;
+        }
+    }
+    if (section == NODE_CONFIG_SECTIONS) {
+        return 0;
+    }
+
+    if (len < RECORD_HDR_LEN + RECORD_CRC_LEN || len > sizeof(record_buf) ||
+        read_cb(cb_arg, record_buf, len) != (ssize_t)len) {
+        LOG_WRN("Config section %s unreadable", key);
+        return 0;
+    }
+
+    body_len = len - RECORD_HDR_LEN - RECORD_CRC_LEN;
+    if (crc32_ieee(record_buf, len - RECORD_CRC_LEN) != sys_get_le32(&record_buf[len - RECORD_CRC_LEN])) {
+        LOG_WRN("Config section %s corrupt, using defaults", key);
+        stats.crc_errors++;
+        return 0;
+    }
+
+    version = record_buf[0];
+    if (version != NODE_CONFIG_VERSION || body_len != sections[section].size) {
+        LOG_WRN("Config section %s has unknown layout %u", key, version);
+        return 0;
+    }
+    memcpy((uint8_t *)ctx->config + sections[section].offset, body, body_len);
+
+    ctx->loaded |= BIT(section);
+    return 0;
+}
+
 int config_manager_load(struct node_config *config)
 {
-    LOG_INF("Loading configuration (stub - using defaults)");
-    config_manager_set_defaults(config);
+    struct load_ctx ctx = { .config = config };
+    uint32_t start = k_cycle_get_32();
+    int ret;
+
+    fill_defaults(config);
+
+    ret = settings_subsys_init();
+    if (ret) {
+        LOG_ERR("Settings init failed: %d", ret);
+        return ret;
+    }
+
+    ret = settings_load_subtree_direct(NODE_CONFIG_SETTINGS_ROOT, load_section, &ctx);
+    stats.load_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    stats.sections_loaded = __builtin_popcount(ctx.loaded);
+    if (ret) {
+        LOG_ERR("Config load failed: %d", ret);
+        return ret;
+    }
+
+    if (!ctx.loaded) {
+        LOG_INF("No stored configuration");
+        return -ENOENT;
+    }
+
+    LOG_INF("Configuration loaded in %u us, %u sections",
+            stats.load_us, stats.sections_loaded);
+    return 0;
+}
+
+int config_manager_save_section(const struct node_config *config,
+                                enum node_config_section section)
+{
+    char key[sizeof(NODE_CONFIG_SETTINGS_ROOT) + SECTION_NAME_MAX];
+    size_t size = sections[section].size;
+    size_t len = RECORD_HDR_LEN + size;
+    int ret;
+
+    record_buf[0] = NODE_CONFIG_VERSION;
+    memcpy(&record_buf[RECORD_HDR_LEN], (const uint8_t *)config + sections[section].offset, size);
+    sys_put_le32(crc32_ieee(record_buf, len), &record_buf[len]);
+    len += RECORD_CRC_LEN;
+
+    snprintk(key, sizeof(key), NODE_CONFIG_SETTINGS_ROOT "/%s", sections[section].name);
+    ret = settings_save_one(key, record_buf, len);
+    if (ret) {
+        LOG_ERR("Saving %s failed: %d", key, ret);
+        return ret;
+    }
+
+    LOG_DBG("Saved %s, %zu bytes", key, len);
     return 0;
 }
 
 int config_manager_save(struct node_config *config)
 {
-    LOG_INF("Saving configuration (stub)");
+    int ret;
+
+    config->schema_version = NODE_CONFIG_VERSION;
+
+    for (int section = 0; section < NODE_CONFIG_SECTIONS; section++) {
+        ret = config_manager_save_section(config, section);
+        if (ret) {
+            return ret;
+        }
+    }
+
+    LOG_INF("Configuration saved");
     return 0;
 }
+
+void config_manager_get_stats(struct config_stats *out)
+{
+    *out = stats;
+}
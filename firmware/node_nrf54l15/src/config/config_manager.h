@@ -1,5 +1,6 @@
 /*
- * Configuration Manager - Stub
+ * Configuration Manager
+ * Node configuration persisted through Zephyr settings
  */
 
 #ifndef CONFIG_MANAGER_H
@@ -7,8 +8,44 @@
 
 #include "../sensor/sensor_control.h"
 
+/* node_config.schema_version of this firmware */
+#define NODE_CONFIG_VERSION        3
+
+/* Settings subtree, one entry per section */
+#define NODE_CONFIG_SETTINGS_ROOT  "node/cfg"
+
+/* Sections stored and updated independently */
+enum node_config_section {
+    NODE_CONFIG_SAMPLING,
+    NODE_CONFIG_CALIBRATION,
+    NODE_CONFIG_ADVERTISEMENT,
+    NODE_CONFIG_ALARMS,
+    NODE_CONFIG_SECTIONS,
+};
+
+struct config_stats {
+    uint32_t load_us;           /* Last config_manager_load() */
+    uint8_t sections_loaded;
+    uint8_t crc_errors;
+};
+
+/*
+ * Load the stored sections over the defaults. A section in another layout
+ * keeps its defaults.
+ *
+ * @return 0 if any section was loaded, -ENOENT if none is stored
+ */
 int config_manager_load(struct node_config *config);
+
+/* Store every section */
 int config_manager_save(struct node_config *config);
+
+/* Store one section, after a Config or Calibration write */
+int config_manager_save_section(const struct node_config *config,
+                                enum node_config_section section);
+
 void config_manager_set_defaults(struct node_config *config);
 
+void config_manager_get_stats(struct config_stats *stats);
+
 #endif /* CONFIG_MANAGER_H */
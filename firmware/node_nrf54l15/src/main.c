@@ -21,9 +21,12 @@
 #include <zephyr/bluetooth/gatt.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/drivers/watchdog.h>
+#include <zephyr/settings/settings.h>
 
 #include "sensor/sensor_control.h"
+#include "sensor/reporting.h"
 #include "ble/advertising.h"
+#include "ble/pawr_sync.h"
 #include "ble/gatt_services.h"
 #include "config/config_manager.h"
 #include "power/power_manager.h"
@@ -32,7 +35,7 @@
 LOG_MODULE_REGISTER(main, LOG_LEVEL_INF);
 
 /* Application state */
-static enum {
+static enum app_state {
     STATE_FACTORY,
     STATE_UNCOMMISSIONED,
     STATE_COMMISSIONING,
@@ -51,6 +54,38 @@ static int wdt_channel_id;
 /* Application configuration */
 static struct node_config current_config;
 
+/* Boot to first sample, for the boot time budget */
+static uint32_t first_sample_ms;
+
+/**
+ * Change state and the advertising interval that goes with it
+ */
+static void set_app_state(enum app_state state)
+{
+    app_state = state;
+    gatt_services_set_commissioning(state == STATE_UNCOMMISSIONED ||
+                                    state == STATE_COMMISSIONING);
+
+    switch (state) {
+    case STATE_UNCOMMISSIONED:
+    case STATE_COMMISSIONING:
+        advertising_set_mode(ADV_MODE_COMMISSIONING);
+        break;
+    case STATE_FAULT:
+        /*
+         * Sampling stops. Repeated read failures go out as a disconnected
+         * sensor, the nearest fault flag, at the faster fault interval.
+         */
+        LOG_WRN("Node in fault state");
+        advertising_set_faults(ADV_FAULT_SENSOR_DISCONNECTED);
+        advertising_set_mode(ADV_MODE_FAULT);
+        break;
+    default:
+        advertising_set_mode(ADV_MODE_OPERATIONAL);
+        break;
+    }
+}
+
 /**
  * Sensor sampling work handler
  */
@@ -58,9 +93,15 @@ static void sample_work_handler(struct k_work *work)
 {
     int ret;
     struct sensor_reading reading;
+    uint32_t interval_s = current_config.sampling.interval_seconds;
 
     LOG_INF("Starting sensor sample cycle");
 
+    if (!first_sample_ms) {
+        first_sample_ms = k_uptime_get_32();
+        LOG_INF("First sample %u ms after boot", first_sample_ms);
+    }
+
     /* Feed watchdog */
     if (wdt_dev) {
         wdt_feed(wdt_dev, wdt_channel_id);
@@ -74,26 +115,65 @@ static void sample_work_handler(struct k_work *work)
         
         /* Enter fault state if too many consecutive failures */
         if (diagnostics_get_fault_count() > 5) {
-            app_state = STATE_FAULT;
+            set_app_state(STATE_FAULT);
         }
     } else {
         LOG_INF("Reading: %.2f %s (raw: %d)", 
                 reading.value, reading.unit, reading.raw_value);
         
-        /* Update advertisement data */
-        advertising_update_reading(&reading);
-        
-        /* Send notification if connected */
-        gatt_notify_reading(&reading);
+        if (reporting_should_send(&current_config, &reading)) {
+            /* Update advertisement data */
+            advertising_update_reading(&reading);
+
+            /* Send notification if connected */
+            gatt_notify_reading(&reading);
+        } else {
+            LOG_DBG("Within deadband, not reported");
+        }
         
         /* Clear fault counter on successful read */
         diagnostics_clear_fault_count();
+
+        interval_s = reporting_next_interval(&current_config, &reading);
     }
 
     /* Schedule next sample */
     if (app_state == STATE_OPERATIONAL) {
-        k_work_schedule(&sample_work, 
-                       K_SECONDS(current_config.sampling.interval_seconds));
+        k_work_schedule(&sample_work, K_SECONDS(interval_s));
+    }
+}
+
+/**
+ * Configuration written over the Config characteristic, already in
+ * current_config. Only the changed sections are stored.
+ */
+static void config_written(uint8_t sections)
+{
+    for (int section = 0; section < NODE_CONFIG_SECTIONS; section++) {
+        if (sections & BIT(section)) {
+            config_manager_save_section(&current_config, section);
+        }
+    }
+
+    if (sections & BIT(NODE_CONFIG_CALIBRATION)) {
+        sensor_configure(&current_config);
+    }
+
+    if (app_state == STATE_UNCOMMISSIONED || app_state == STATE_COMMISSIONING) {
+        LOG_INF("Configured, starting sensor sampling");
+        set_app_state(STATE_OPERATIONAL);
+        k_work_schedule(&sample_work, K_NO_WAIT);
+    }
+}
+
+/**
+ * Command from the hub's PAwR train
+ */
+static void pawr_command(uint8_t command)
+{
+    if (command == PAWR_CMD_SAMPLE && app_state == STATE_OPERATIONAL) {
+        LOG_INF("Sample requested by hub");
+        k_work_reschedule(&sample_work, K_NO_WAIT);
     }
 }
 
@@ -143,19 +223,12 @@ static void connected(struct bt_conn *conn, uint8_t err)
     }
 
     LOG_INF("Connected");
-    
-    /* Stop advertising while connected */
-    advertising_stop();
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
+    /* advertising.c makes the set connectable again */
     LOG_INF("Disconnected: %u", reason);
-    
-    /* Resume advertising after disconnect */
-    if (app_state == STATE_OPERATIONAL) {
-        advertising_start(&current_config);
-    }
 }
 
 BT_CONN_CB_DEFINE(conn_callbacks) = {
@@ -182,13 +255,17 @@ int main(void)
 
     /* Load configuration from non-volatile storage */
     ret = config_manager_load(&current_config);
-    if (ret < 0) {
+    if (ret == -ENOENT) {
+        LOG_INF("Not commissioned, using defaults");
+        config_manager_set_defaults(&current_config);
+        set_app_state(STATE_UNCOMMISSIONED);
+    } else if (ret < 0) {
         LOG_WRN("Failed to load config, using defaults: %d", ret);
         config_manager_set_defaults(&current_config);
-        app_state = STATE_UNCOMMISSIONED;
+        set_app_state(STATE_UNCOMMISSIONED);
     } else {
         LOG_INF("Configuration loaded successfully");
-        app_state = STATE_OPERATIONAL;
+        set_app_state(STATE_OPERATIONAL);
     }
 
     /* Initialize power management */
@@ -211,22 +288,34 @@ int main(void)
         LOG_ERR("Bluetooth init failed: %d", ret);
         return ret;
     }
+
+    /* Identity address and bonds, stored by the Bluetooth host */
+    ret = settings_load();
+    if (ret) {
+        LOG_WRN("Settings load failed: %d", ret);
+    }
     LOG_INF("Bluetooth initialized");
 
     /* Initialize GATT services */
-    ret = gatt_services_init(&current_config);
+    ret = gatt_services_init(&current_config, config_written);
     if (ret < 0) {
         LOG_ERR("GATT services init failed: %d", ret);
         return ret;
     }
 
     /* Start BLE advertising */
-    ret = advertising_start(&current_config);
+    ret = advertising_start();
     if (ret < 0) {
         LOG_ERR("Advertising start failed: %d", ret);
         return ret;
     }
 
+    /* Answer in a hub's PAwR train if there is one, advertising stays on */
+    ret = pawr_sync_init(&current_config, pawr_command);
+    if (ret < 0) {
+        LOG_WRN("PAwR sync init failed, advertising only: %d", ret);
+    }
+
     /* Initialize diagnostics */
     diagnostics_init();
 
@@ -250,13 +339,6 @@ int main(void)
 
         /* Sleep for 1 second */
         k_sleep(K_SECONDS(1));
-
-        /* Check for fault state */
-        if (app_state == STATE_FAULT) {
-            LOG_WRN("Node in fault state");
-            /* Update advertising to indicate fault */
-            advertising_update_fault_state();
-        }
     }
 
     return 0;
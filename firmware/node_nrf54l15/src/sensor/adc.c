@@ -1,28 +1,135 @@
 /*
- * ADC Implementation - Stub
+ * ADC Implementation
+ *
+ * Channels come from the zephyr,user io-channels in the board overlay:
+ * the sensor input first, the battery second. A burst is a single
+ * adc_sequence with extra samplings at a fixed interval. The SAADC's
+ * internal sample timer triggers each conversion and EasyDMA stores the
+ * results, so the reading thread sleeps through the burst instead of
+ * waking for every sample. That only holds for intervals the timer can
+ * produce, which the build checks. Settling probes use the same sequence at a
+ * lower resolution, and are scaled up to the channel's resolution so the
+ * usual conversion to millivolts applies.
  */
 
 #include "adc.h"
+#include <zephyr/drivers/adc.h>
 #include <zephyr/logging/log.h>
 
 LOG_MODULE_REGISTER(adc, LOG_LEVEL_DBG);
 
+BUILD_ASSERT(ADC_BURST_INTERVAL_US <= ADC_TIMER_INTERVAL_MAX_US &&
+             ADC_PROBE_INTERVAL_US <= ADC_TIMER_INTERVAL_MAX_US,
+             "Sequences must be timed by the SAADC sample timer");
+
+static const struct adc_dt_spec sensor_channel = ADC_DT_SPEC_GET_BY_IDX(DT_PATH(zephyr_user), 0);
+static const struct adc_dt_spec battery_channel = ADC_DT_SPEC_GET_BY_IDX(DT_PATH(zephyr_user), 1);
+
+static int16_t samples[ADC_BURST_MAX];
+
 int adc_init(void)
 {
-    LOG_INF("ADC initialized (stub)");
+    int ret;
+
+    if (!adc_is_ready_dt(&sensor_channel) || !adc_is_ready_dt(&battery_channel)) {
+        LOG_ERR("ADC device not ready");
+        return -ENODEV;
+    }
+
+    ret = adc_channel_setup_dt(&sensor_channel);
+    if (ret == 0) {
+        ret = adc_channel_setup_dt(&battery_channel);
+    }
+    if (ret < 0) {
+        LOG_ERR("ADC channel setup failed: %d", ret);
+        return ret;
+    }
+
+    LOG_INF("ADC initialized");
     return 0;
 }
 
+static int read_mv(const struct adc_dt_spec *channel, int32_t *value_mv)
+{
+    struct adc_sequence sequence = {
+        .buffer = &samples[0],
+        .buffer_size = sizeof(samples[0]),
+    };
+    int ret;
+
+    adc_sequence_init_dt(channel, &sequence);
+    ret = adc_read_dt(channel, &sequence);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *value_mv = samples[0];
+    return adc_raw_to_millivolts_dt(channel, value_mv);
+}
+
 int adc_read_voltage_mv(int32_t *value_mv)
 {
-    /* Stub: return simulated value */
-    *value_mv = 2500; /* 2.5V */
+    int ret = read_mv(&sensor_channel, value_mv);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    *value_mv *= ADC_SENSOR_DIVIDER;
     return 0;
 }
 
-int adc_read_battery_mv(int32_t *value_mv)
+static int read_sequence_mv(int32_t *values_mv, uint16_t count, uint32_t interval_us,
+                            uint8_t resolution)
 {
-    /* Stub: return simulated battery voltage */
-    *value_mv = 3200; /* 3.2V */
+    const struct adc_sequence_options options = {
+        .interval_us = interval_us,
+        .extra_samplings = count - 1,
+    };
+    struct adc_sequence sequence = {
+        .options = &options,
+        .buffer = samples,
+        .buffer_size = count * sizeof(samples[0]),
+    };
+    int ret;
+
+    if (count == 0 || count > ADC_BURST_MAX) {
+        return -EINVAL;
+    }
+
+    adc_sequence_init_dt(&sensor_channel, &sequence);
+    if (resolution < sequence.resolution) {
+        sequence.resolution = resolution;
+        sequence.oversampling = 0;
+    }
+
+    ret = adc_read_dt(&sensor_channel, &sequence);
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        values_mv[i] = samples[i] * (1 << (sensor_channel.resolution - sequence.resolution));
+        ret = adc_raw_to_millivolts_dt(&sensor_channel, &values_mv[i]);
+        if (ret < 0) {
+            return ret;
+        }
+        values_mv[i] *= ADC_SENSOR_DIVIDER;
+    }
     return 0;
 }
+
+int adc_read_burst_mv(int32_t *values_mv, uint16_t count)
+{
+    return read_sequence_mv(values_mv, count, ADC_BURST_INTERVAL_US, sensor_channel.resolution);
+}
+
+int adc_read_probe_mv(int32_t *values_mv, uint16_t count)
+{
+    return read_sequence_mv(values_mv, count, ADC_PROBE_INTERVAL_US, ADC_PROBE_RESOLUTION);
+}
+
+int adc_read_battery_mv(int32_t *value_mv)
+{
+    return read_mv(&battery_channel, value_mv);
+}
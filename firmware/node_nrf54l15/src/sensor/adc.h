@@ -1,5 +1,6 @@
 /*
- * ADC Module - Stub implementation
+ * ADC Module
+ * SAADC access for the sensor input and the battery
  */
 
 #ifndef ADC_H
@@ -7,8 +8,51 @@
 
 #include <zephyr/kernel.h>
 
+/* Largest burst, the schema's burstCount limit */
+#define ADC_BURST_MAX          100
+
+/*
+ * Longest interval the SAADC's own sample timer can produce: 2047 cycles
+ * of 16 MHz. A longer interval makes the driver trigger each sample from a
+ * kernel timer instead, waking the CPU for every one.
+ */
+#define ADC_TIMER_INTERVAL_MAX_US  127
+
+/*
+ * Spacing of burst samples, timed by the SAADC while the CPU sleeps.
+ * A full burst of 100 spans 12.5 ms.
+ */
+#define ADC_BURST_INTERVAL_US  125
+
+/*
+ * Settling probes: short runs at low resolution and no oversampling, each
+ * run hardware-timed like a burst
+ */
+#define ADC_PROBE_RESOLUTION   10
+#define ADC_PROBE_INTERVAL_US  125
+
+/* Sensor input divider, 0-5 V at the sensor is 0-2.5 V at the pin */
+#define ADC_SENSOR_DIVIDER     2
+
 int adc_init(void);
 int adc_read_voltage_mv(int32_t *value_mv);
+
+/*
+ * Take count sensor samples in one ADC sequence. The SAADC writes them to
+ * RAM by EasyDMA; the calling thread sleeps until the whole burst is in.
+ *
+ * @return 0 on success, -EINVAL if count is 0 or above ADC_BURST_MAX
+ */
+int adc_read_burst_mv(int32_t *values_mv, uint16_t count);
+
+/*
+ * Take count low-resolution sensor samples, ADC_PROBE_INTERVAL_US apart,
+ * to follow the sensor output while it settles
+ *
+ * @return 0 on success, -EINVAL if count is 0 or above ADC_BURST_MAX
+ */
+int adc_read_probe_mv(int32_t *values_mv, uint16_t count);
+
 int adc_read_battery_mv(int32_t *value_mv);
 
 #endif /* ADC_H */
@@ -0,0 +1,125 @@
+/*
+ * Burst Aggregation Implementation
+ *
+ * Mean, min and max come from one pass over the samples. Median and
+ * trimmed mean use quickselect (Hoare partition, median-of-three pivot),
+ * which places the k-th smallest sample at index k with everything
+ * smaller before it, in expected linear time and without extra memory.
+ * The trimmed mean selects both cut points and sums what lies between.
+ */
+
+#include "aggregate.h"
+
+static void swap(int32_t *a, int32_t *b)
+{
+    int32_t t = *a;
+
+    *a = *b;
+    *b = t;
+}
+
+/* Put the k-th smallest of values[lo..hi] at index k */
+static void select_kth(int32_t *values, int lo, int hi, int k)
+{
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        int32_t pivot;
+        int i = lo;
+        int j = hi;
+
+        /* Median of three keeps sorted and reversed bursts linear */
+        if (values[mid] < values[lo]) {
+            swap(&values[mid], &values[lo]);
+        }
+        if (values[hi] < values[lo]) {
+            swap(&values[hi], &values[lo]);
+        }
+        if (values[hi] < values[mid]) {
+            swap(&values[hi], &values[mid]);
+        }
+        pivot = values[mid];
+
+        while (i <= j) {
+            while (values[i] < pivot) {
+                i++;
+            }
+            while (values[j] > pivot) {
+                j--;
+            }
+            if (i <= j) {
+                swap(&values[i], &values[j]);
+                i++;
+                j--;
+            }
+        }
+
+        /* Continue in the side holding k, [j+1, i-1] equals the pivot */
+        if (k <= j) {
+            hi = j;
+        } else if (k >= i) {
+            lo = i;
+        } else {
+            return;
+        }
+    }
+}
+
+static int32_t sum_range(const int32_t *values, int from, int to)
+{
+    int32_t sum = 0;
+
+    for (int i = from; i < to; i++) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+static int32_t trimmed_mean(int32_t *values, uint16_t count)
+{
+    int trim = count * AGGREGATE_TRIM_PERCENT / 100;
+    int last = count - 1 - trim;
+
+    if (trim == 0) {
+        return sum_range(values, 0, count) / count;
+    }
+
+    /* values[trim..last] are the samples left after trimming */
+    select_kth(values, 0, count - 1, trim);
+    select_kth(values, trim, count - 1, last);
+
+    return sum_range(values, trim, last + 1) / (last + 1 - trim);
+}
+
+int32_t aggregate(int32_t *values, uint16_t count, uint8_t mode)
+{
+    int32_t min = values[0];
+    int32_t max = values[0];
+    int32_t sum = 0;
+
+    switch (mode) {
+    case AGGREGATION_MEDIAN:
+        select_kth(values, 0, count - 1, count / 2);
+        return values[count / 2];
+    case AGGREGATION_TRIMMED_MEAN:
+        return trimmed_mean(values, count);
+    default:
+        break;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        int32_t v = values[i];
+
+        sum += v;
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+    }
+
+    switch (mode) {
+    case AGGREGATION_MIN:
+        return min;
+    case AGGREGATION_MAX:
+        return max;
+    default:
+        return sum / count;
+    }
+}
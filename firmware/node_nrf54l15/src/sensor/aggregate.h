@@ -0,0 +1,29 @@
+/*
+ * Burst Aggregation
+ * Reduces a burst of ADC samples to one raw value
+ */
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+
+/* Values of sampling.aggregation, in schema order */
+enum aggregation {
+    AGGREGATION_MEAN,
+    AGGREGATION_MEDIAN,
+    AGGREGATION_MIN,
+    AGGREGATION_MAX,
+    AGGREGATION_TRIMMED_MEAN,
+};
+
+/* Share of samples dropped from each end by the trimmed mean */
+#define AGGREGATE_TRIM_PERCENT  10
+
+/*
+ * Aggregate count samples (count > 0) in O(n). Median and trimmed mean
+ * reorder the samples in place. An unknown mode gives the mean.
+ */
+int32_t aggregate(int32_t *values, uint16_t count, uint8_t mode);
+
+#endif /* AGGREGATE_H */
@@ -0,0 +1,221 @@
+/*
+ * Calibration Implementation
+ *
+ * All float work happens once, when a configuration is compiled. Each
+ * coefficient set gets one Q format, the largest that keeps every value
+ * reachable from the clamped input range within 31 bits, so a reading
+ * costs a multiply-add per polynomial term, or a binary search and one
+ * multiply-add in table mode, plus the final conversion to float.
+ */
+
+#include "calibration.h"
+#include <zephyr/sys/util.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+
+/* Polynomial input t = mV / 2^T_SHIFT; t stays below 2 for the input range */
+#define T_SHIFT      12
+#define MV_PER_T     4.096f
+#define T_MAX        ((float)CALIBRATION_INPUT_MAX_MV / (1 << T_SHIFT))
+
+/* Extra fraction bits of the table segment slopes */
+#define SLOPE_SHIFT  16
+
+/* Largest shift keeping values up to bound below 2^30 */
+static int choose_shift(float bound, struct calibration *cal)
+{
+    int exp;
+
+    frexpf(bound, &exp);
+    if (exp > 30) {
+        return -ERANGE;
+    }
+
+    cal->shift = MIN(30 - exp, 30);
+    cal->scale = ldexpf(1.0f, -cal->shift);
+    return 0;
+}
+
+static int compile_poly(const float *c, uint8_t count, struct calibration *cal)
+{
+    float d[CALIBRATION_POLY_MAX];
+    float mv_pow = 1.0f;
+    float t_pow = 1.0f;
+    float bound = 0.0f;
+    int ret;
+
+    if (count == 0 || count > CALIBRATION_POLY_MAX) {
+        return -EINVAL;
+    }
+
+    /* Trailing zero terms only cost time */
+    while (count > 1 && c[count - 1] == 0.0f) {
+        count--;
+    }
+
+    /*
+     * Rescale from volts to t. The bound also covers every partial Horner
+     * sum, as t_max is above 1.
+     */
+    for (int k = 0; k < count; k++) {
+        d[k] = c[k] * mv_pow;
+        bound += fabsf(d[k]) * t_pow;
+        mv_pow *= MV_PER_T;
+        t_pow *= T_MAX;
+    }
+
+    ret = choose_shift(bound, cal);
+    if (ret) {
+        return ret;
+    }
+
+    for (int k = 0; k < count; k++) {
+        cal->coeff[count - 1 - k] = (int32_t)roundf(ldexpf(d[k], cal->shift));
+    }
+    cal->count = count;
+    return 0;
+}
+
+static int compile_table(const struct calibration_config *config, struct calibration *cal)
+{
+    struct calibration_point points[CALIBRATION_POINTS_MAX];
+    uint8_t count = config->point_count;
+    float first_slope;
+    float last_slope;
+    float bound;
+    int ret;
+
+    if (count < 2 || count > CALIBRATION_POINTS_MAX) {
+        return -EINVAL;
+    }
+
+    /* Insertion sort by voltage, the table is tiny */
+    memcpy(points, config->points, count * sizeof(points[0]));
+    for (int i = 1; i < count; i++) {
+        struct calibration_point p = points[i];
+        int j = i - 1;
+
+        while (j >= 0 && points[j].voltage_mv > p.voltage_mv) {
+            points[j + 1] = points[j];
+            j--;
+        }
+        points[j + 1] = p;
+    }
+
+    bound = 0.0f;
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && points[i].voltage_mv == points[i - 1].voltage_mv) {
+            return -EINVAL;
+        }
+        bound = MAX(bound, fabsf(points[i].value));
+    }
+
+    /* The end segments are extrapolated to the clamped input range */
+    first_slope = (points[1].value - points[0].value) /
+                  (points[1].voltage_mv - points[0].voltage_mv);
+    last_slope = (points[count - 1].value - points[count - 2].value) /
+                 (points[count - 1].voltage_mv - points[count - 2].voltage_mv);
+    bound = MAX(bound, fabsf(points[0].value -
+                             first_slope * (CALIBRATION_INPUT_MAX_MV + points[0].voltage_mv)));
+    bound = MAX(bound, fabsf(points[count - 1].value +
+                             last_slope * (CALIBRATION_INPUT_MAX_MV - points[count - 1].voltage_mv)));
+
+    ret = choose_shift(bound, cal);
+    if (ret) {
+        return ret;
+    }
+
+    for (int i = 0; i < count; i++) {
+        cal->table.x_mv[i] = points[i].voltage_mv;
+        cal->table.y[i] = (int32_t)roundf(ldexpf(points[i].value, cal->shift));
+    }
+
+    /* Slopes from the rounded values, so segments meet exactly */
+    for (int i = 0; i < count - 1; i++) {
+        cal->table.slope[i] = ((int64_t)(cal->table.y[i + 1] - cal->table.y[i]) << SLOPE_SHIFT) /
+                              (cal->table.x_mv[i + 1] - cal->table.x_mv[i]);
+    }
+
+    cal->count = count;
+    return 0;
+}
+
+int calibration_compile(const struct calibration_config *config, struct calibration *cal)
+{
+    struct calibration compiled = { .type = config->type };
+    int ret;
+
+    switch (config->type) {
+    case CALIBRATION_LINEAR: {
+        /* y = mx + b, with the optional Ax^2 + Bx correction folded in */
+        float c[3] = {
+            config->offset,
+            config->slope + config->poly_b,
+            config->poly_a,
+        };
+
+        ret = compile_poly(c, ARRAY_SIZE(c), &compiled);
+        break;
+    }
+    case CALIBRATION_POLYNOMIAL:
+        ret = compile_poly(config->poly, config->poly_count, &compiled);
+        break;
+    case CALIBRATION_TABLE:
+        ret = compile_table(config, &compiled);
+        break;
+    default:
+        ret = -EINVAL;
+        break;
+    }
+
+    if (ret == 0) {
+        *cal = compiled;
+    }
+    return ret;
+}
+
+static int32_t apply_poly(const struct calibration *cal, int32_t mv)
+{
+    int32_t acc = cal->coeff[0];
+
+    for (int i = 1; i < cal->count; i++) {
+        acc = (int32_t)(((int64_t)acc * mv) >> T_SHIFT) + cal->coeff[i];
+    }
+    return acc;
+}
+
+static int32_t apply_table(const struct calibration *cal, int32_t mv)
+{
+    int lo = 0;
+    int hi = cal->count - 2;
+
+    /* Last segment starting at or below mv, end segments extrapolate */
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+
+        if (cal->table.x_mv[mid] <= mv) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return cal->table.y[lo] +
+           (int32_t)((cal->table.slope[lo] * (mv - cal->table.x_mv[lo])) >> SLOPE_SHIFT);
+}
+
+float calibration_apply(const struct calibration *cal, int32_t mv)
+{
+    int32_t value;
+
+    mv = CLAMP(mv, -CALIBRATION_INPUT_MAX_MV, CALIBRATION_INPUT_MAX_MV);
+
+    if (cal->type == CALIBRATION_TABLE) {
+        value = apply_table(cal, mv);
+    } else {
+        value = apply_poly(cal, mv);
+    }
+
+    return (float)value * cal->scale;
+}
@@ -0,0 +1,77 @@
+/*
+ * Calibration
+ * Converts sensor millivolts to engineering units in fixed point
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stdint.h>
+
+/* Polynomial coefficients, up to 5th order */
+#define CALIBRATION_POLY_MAX     6
+
+/* Table breakpoints */
+#define CALIBRATION_POINTS_MAX   16
+
+/* Inputs are clamped to +/- this, which bounds the fixed-point range */
+#define CALIBRATION_INPUT_MAX_MV 8191
+
+/* Values of calibration.type, in schema order */
+enum calibration_type {
+    CALIBRATION_LINEAR,
+    CALIBRATION_POLYNOMIAL,
+    CALIBRATION_TABLE,
+};
+
+struct calibration_point {
+    uint16_t voltage_mv;
+    float value;
+};
+
+/* Calibration as configured */
+struct calibration_config {
+    uint8_t type;                  /* enum calibration_type */
+    float offset;                  /* Linear: offset */
+    float slope;                   /* Linear: slope per volt */
+    float poly_a;                  /* Linear: correction Ax^2 */
+    float poly_b;                  /* Linear: correction Bx */
+    float poly[CALIBRATION_POLY_MAX]; /* Polynomial: in volts, constant first */
+    uint8_t poly_count;
+    struct calibration_point points[CALIBRATION_POINTS_MAX]; /* Table */
+    uint8_t point_count;
+};
+
+/*
+ * Calibration compiled for evaluation. Values are in Q(shift); polynomials
+ * are evaluated in Horner form on t = mV / 4096, so the ADC millivolts are
+ * t in Q12 as they are.
+ */
+struct calibration {
+    uint8_t type;
+    uint8_t count;
+    uint8_t shift;
+    float scale;                   /* 2^-shift */
+    union {
+        int32_t coeff[CALIBRATION_POLY_MAX];          /* Highest order first */
+        struct {
+            int32_t x_mv[CALIBRATION_POINTS_MAX];     /* Ascending */
+            int32_t y[CALIBRATION_POINTS_MAX];
+            int64_t slope[CALIBRATION_POINTS_MAX - 1]; /* Q(shift + 16) per mV */
+        } table;
+    };
+};
+
+/*
+ * Compile a configured calibration. Table points need not be sorted.
+ *
+ * @return 0 on success, -EINVAL for an unknown type, too few or too many
+ *         terms or points, or two points at the same voltage, -ERANGE if
+ *         the values do not fit the fixed-point range
+ */
+int calibration_compile(const struct calibration_config *config, struct calibration *cal);
+
+/* Apply a compiled calibration to a reading in millivolts */
+float calibration_apply(const struct calibration *cal, int32_t mv);
+
+#endif /* CALIBRATION_H */
@@ -0,0 +1,103 @@
+/*
+ * Reporting Implementation
+ *
+ * Steady industrial signals rarely move between readings, so sending each
+ * one spends radio time on repeats. With the on_change policy a reading is
+ * only sent once it leaves the deadband around the last sent value, and a
+ * heartbeat bounds the silence so the hub can tell a flat signal from a
+ * dead node. The adaptive interval uses the same deadband as its scale:
+ * it halves when a step approaches the deadband and creeps back up while
+ * the signal is flat, which also saves sensor power-ups.
+ */
+
+#include "reporting.h"
+#include <zephyr/sys/util.h>
+#include <math.h>
+
+static bool reported;
+static float sent_value;
+static uint8_t sent_faults;
+static int64_t sent_ms;
+
+static bool have_prev;
+static float prev_value;
+
+static struct reporting_stats stats;
+
+static bool heartbeat_due(const struct node_config *config, int64_t now)
+{
+    return !reported ||
+           now - sent_ms >= (int64_t)config->advertisement.heartbeat_seconds * MSEC_PER_SEC;
+}
+
+bool reporting_should_send(const struct node_config *config, const struct sensor_reading *reading)
+{
+    int64_t now = k_uptime_get();
+    bool send;
+
+    stats.samples++;
+
+    switch (config->advertisement.policy) {
+    case REPORT_HEARTBEAT:
+        send = heartbeat_due(config, now) || reading->faults != sent_faults;
+        break;
+    case REPORT_ON_CHANGE:
+        send = heartbeat_due(config, now) || reading->faults != sent_faults ||
+               fabsf(reading->value - sent_value) > config->advertisement.deadband;
+        break;
+    default:
+        send = true;
+        break;
+    }
+
+    if (send) {
+        reported = true;
+        sent_value = reading->value;
+        sent_faults = reading->faults;
+        sent_ms = now;
+        stats.reports++;
+    }
+    return send;
+}
+
+uint32_t reporting_next_interval(const struct node_config *config,
+                                 const struct sensor_reading *reading)
+{
+    uint32_t min_s = config->sampling.min_interval_seconds;
+    uint32_t max_s = config->sampling.max_interval_seconds;
+    uint32_t next;
+
+    if (min_s == 0 || max_s <= min_s) {
+        next = config->sampling.interval_seconds;
+    } else {
+        float step = have_prev ? fabsf(reading->value - prev_value) : 0.0f;
+        float deadband = config->advertisement.deadband;
+
+        next = stats.interval_s ? stats.interval_s : config->sampling.interval_seconds;
+        if (step > deadband / REPORTING_TIGHTEN_DIV) {
+            next /= 2;
+        } else {
+            next += MAX(next / REPORTING_RELAX_DIV, 1);
+        }
+        next = CLAMP(next, min_s, max_s);
+    }
+
+    have_prev = true;
+    prev_value = reading->value;
+    stats.interval_s = next;
+
+    /* Wake in time for the heartbeat */
+    if (config->advertisement.policy != REPORT_EACH_SAMPLE && reported) {
+        int64_t left_ms = (int64_t)config->advertisement.heartbeat_seconds * MSEC_PER_SEC -
+                          (k_uptime_get() - sent_ms);
+
+        next = MIN(next, MAX(DIV_ROUND_UP(left_ms, MSEC_PER_SEC), 1));
+    }
+
+    return MAX(next, 1);
+}
+
+void reporting_get_stats(struct reporting_stats *out)
+{
+    *out = stats;
+}
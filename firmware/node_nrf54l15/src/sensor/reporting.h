@@ -0,0 +1,45 @@
+/*
+ * Reporting
+ * Report-by-exception and adaptive sampling interval
+ */
+
+#ifndef REPORTING_H
+#define REPORTING_H
+
+#include "sensor_control.h"
+
+/* Values of advertisement.policy, in schema order */
+enum report_policy {
+    REPORT_EACH_SAMPLE,             /* Every reading */
+    REPORT_HEARTBEAT,               /* Every heartbeat_seconds */
+    REPORT_ON_CHANGE,               /* Outside the deadband, or heartbeat */
+};
+
+/* Adaptive interval: a step of more than deadband / 2 halves the interval */
+#define REPORTING_TIGHTEN_DIV    2
+
+/* A flatter step grows it by a quarter, at least a second */
+#define REPORTING_RELAX_DIV      4
+
+struct reporting_stats {
+    uint32_t samples;
+    uint32_t reports;
+    uint32_t interval_s;            /* Current sampling interval */
+};
+
+/*
+ * Decide whether a reading is transmitted. A change of fault flags is
+ * always reported.
+ */
+bool reporting_should_send(const struct node_config *config, const struct sensor_reading *reading);
+
+/*
+ * Seconds until the next reading. Fixed at sampling.interval_seconds unless
+ * both adaptive bounds are set; never later than the next heartbeat.
+ */
+uint32_t reporting_next_interval(const struct node_config *config,
+                                 const struct sensor_reading *reading);
+
+void reporting_get_stats(struct reporting_stats *stats);
+
+#endif /* REPORTING_H */
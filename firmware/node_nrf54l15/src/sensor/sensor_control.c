@@ -4,8 +4,10 @@
 
 #include "sensor_control.h"
 #include "adc.h"
+#include "aggregate.h"
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/logging/log.h>
+#include <stdlib.h>
 
 LOG_MODULE_REGISTER(sensor_control, LOG_LEVEL_DBG);
 
@@ -13,6 +15,15 @@ LOG_MODULE_REGISTER(sensor_control, LOG_LEVEL_DBG);
 #define SENSOR_POWER_NODE DT_ALIAS(sensor_power)
 static const struct gpio_dt_spec sensor_power = GPIO_DT_SPEC_GET(SENSOR_POWER_NODE, gpios);
 
+/* Burst samples, too large for the work queue stack at ADC_BURST_MAX */
+static int32_t adc_values[ADC_BURST_MAX];
+
+static struct sensor_timing timing;
+static bool burst_logged;
+
+/* Compiled calibration, raw volts until a valid one is configured */
+static struct calibration calibration;
+
 /**
  * Initialize sensor hardware
  */
@@ -39,29 +50,83 @@ int sensor_init(struct node_config *config)
         return ret;
     }
 
+    /* Start from volts, so a bad calibration still gives usable readings */
+    calibration_compile(&(struct calibration_config){ .slope = 1.0f }, &calibration);
+
+    ret = sensor_configure(config);
+    if (ret < 0) {
+        LOG_WRN("Invalid calibration, reporting volts: %d", ret);
+    }
+
     LOG_INF("Sensor control initialized");
     return 0;
 }
 
 /**
- * Apply calibration to raw ADC value
+ * Compile the configured calibration
  */
-static float apply_calibration(struct node_config *config, int32_t raw_value)
+int sensor_configure(struct node_config *config)
 {
-    float voltage = (float)raw_value / 1000.0f; /* Convert mV to V */
-    float calibrated;
-
-    /* Linear calibration: y = mx + b */
-    calibrated = (voltage * config->calibration.slope) + config->calibration.offset;
+    int ret;
 
-    /* Optional polynomial correction: y = y + Ax^2 + Bx */
-    if (config->calibration.poly_a != 0.0f || config->calibration.poly_b != 0.0f) {
-        float poly = (config->calibration.poly_a * voltage * voltage) + 
-                     (config->calibration.poly_b * voltage);
-        calibrated += poly;
+    ret = calibration_compile(&config->calibration, &calibration);
+    if (ret < 0) {
+        LOG_ERR("Calibration compile failed: %d", ret);
+        return ret;
     }
 
-    return calibrated;
+    LOG_INF("Calibration type %u compiled, Q%u", config->calibration.type, calibration.shift);
+    return 0;
+}
+
+/*
+ * Probe the output in runs until the run mean stops moving, or until max_ms
+ * after power_on. The wait starts with half the learned settle time, so a
+ * sensor that settles the same way each time costs a few runs of probing.
+ */
+static int wait_settled(uint16_t max_ms, uint32_t power_on)
+{
+    int32_t probes[SENSOR_SETTLE_RUN];
+    int32_t mean;
+    int32_t last = 0;
+    uint8_t settled = 0;
+    bool first = true;
+    uint32_t max_us = max_ms * USEC_PER_MSEC;
+    uint32_t elapsed_us;
+    int ret;
+
+    k_usleep(MIN(timing.settle_us / 2, max_us));
+
+    for (;;) {
+        elapsed_us = k_cyc_to_us_floor32(k_cycle_get_32() - power_on);
+        if (elapsed_us >= max_us) {
+            return -ETIMEDOUT;
+        }
+
+        ret = adc_read_probe_mv(probes, SENSOR_SETTLE_RUN);
+        if (ret < 0) {
+            /* Fall back to the fixed warmup */
+            LOG_WRN("Settle probe failed: %d", ret);
+            k_usleep(max_us - elapsed_us);
+            return ret;
+        }
+
+        mean = 0;
+        for (int i = 0; i < SENSOR_SETTLE_RUN; i++) {
+            mean += probes[i];
+        }
+        mean /= SENSOR_SETTLE_RUN;
+
+        if (!first && abs(mean - last) < SENSOR_SETTLE_MV) {
+            if (++settled >= SENSOR_SETTLE_RUNS) {
+                return 0;
+            }
+        } else {
+            settled = 0;
+        }
+        last = mean;
+        first = false;
+    }
 }
 
 /**
@@ -70,65 +135,69 @@ static float apply_calibration(struct node_config *config, int32_t raw_value)
 int sensor_read(struct node_config *config, struct sensor_reading *reading)
 {
     int ret;
-    int32_t adc_values[10];
-    int32_t sum = 0;
     uint8_t burst_count = config->sampling.burst_count;
+    uint32_t power_on;
+    uint32_t acquire_start;
+    uint32_t settle_us;
 
     if (burst_count == 0) {
         burst_count = 1;
     }
-    if (burst_count > 10) {
-        burst_count = 10;
+    if (burst_count > ADC_BURST_MAX) {
+        burst_count = ADC_BURST_MAX;
     }
 
     /* Enable sensor power */
     gpio_pin_set_dt(&sensor_power, 1);
+    power_on = k_cycle_get_32();
     LOG_DBG("Sensor power enabled");
 
     /* Wait for sensor warmup */
-    k_msleep(config->sampling.warmup_ms);
-
-    /* Acquire burst samples */
-    for (int i = 0; i < burst_count; i++) {
-        ret = adc_read_voltage_mv(&adc_values[i]);
-        if (ret < 0) {
-            gpio_pin_set_dt(&sensor_power, 0);
-            LOG_ERR("ADC read failed: %d", ret);
-            return ret;
-        }
-        
-        if (i < burst_count - 1) {
-            k_msleep(10); /* 10ms between samples */
+    if (config->sampling.warmup_mode == WARMUP_SETTLE) {
+        ret = wait_settled(config->sampling.warmup_ms, power_on);
+        settle_us = k_cyc_to_us_floor32(k_cycle_get_32() - power_on);
+        if (ret == 0) {
+            /* Exponential average, 1/4 weight to the new settle time */
+            timing.settle_us = timing.settle_us ?
+                               timing.settle_us - timing.settle_us / 4 + settle_us / 4 :
+                               settle_us;
+            LOG_DBG("Settled after %u us", settle_us);
+        } else if (ret == -ETIMEDOUT) {
+            timing.settle_timeouts++;
+            LOG_DBG("Not settled within %u ms", config->sampling.warmup_ms);
         }
+    } else {
+        k_msleep(config->sampling.warmup_ms);
     }
+    timing.warmup_us = k_cyc_to_us_floor32(k_cycle_get_32() - power_on);
+
+    /* Acquire the burst in one hardware-timed sequence */
+    acquire_start = k_cycle_get_32();
+    ret = adc_read_burst_mv(adc_values, burst_count);
+    timing.acquire_us = k_cyc_to_us_floor32(k_cycle_get_32() - acquire_start);
 
     /* Disable sensor power */
     gpio_pin_set_dt(&sensor_power, 0);
-    LOG_DBG("Sensor power disabled");
+    timing.sensor_on_us = k_cyc_to_us_floor32(k_cycle_get_32() - power_on);
+    LOG_DBG("Sensor power disabled after %u us (%u us acquiring)",
+            timing.sensor_on_us, timing.acquire_us);
+    if (!burst_logged && ret == 0) {
+        /* A burst much longer than its samples means software timing */
+        LOG_INF("Burst of %u took %u us, %u us of sampling", burst_count, timing.acquire_us,
+                burst_count * ADC_BURST_INTERVAL_US);
+        burst_logged = true;
+    }
 
-    /* Aggregate samples */
-    if (config->sampling.aggregation == 0) {
-        /* Mean */
-        for (int i = 0; i < burst_count; i++) {
-            sum += adc_values[i];
-        }
-        reading->raw_value = sum / burst_count;
-    } else {
-        /* Median (simple bubble sort for small arrays) */
-        for (int i = 0; i < burst_count - 1; i++) {
-            for (int j = 0; j < burst_count - i - 1; j++) {
-                if (adc_values[j] > adc_values[j + 1]) {
-                    int32_t temp = adc_values[j];
-                    adc_values[j] = adc_values[j + 1];
-                    adc_values[j + 1] = temp;
-                }
-            }
-        }
-        reading->raw_value = adc_values[burst_count / 2];
+    if (ret < 0) {
+        LOG_ERR("ADC read failed: %d", ret);
+        return ret;
     }
 
+    /* Aggregate samples */
+    reading->raw_value = aggregate(adc_values, burst_count, config->sampling.aggregation);
+
     /* Apply calibration */
-    reading->value = apply_calibration(config, reading->raw_value);
+    reading->value = calibration_apply(&calibration, reading->raw_value);
     
     /* Set unit (hardcoded for now, should come from config) */
     strcpy(reading->unit, "PSI");
@@ -175,3 +244,11 @@ int sensor_get_battery_mv(uint16_t *voltage_mv)
     *voltage_mv = (uint16_t)battery_raw;
     return 0;
 }
+
+/**
+ * Get timing of the last reading
+ */
+void sensor_get_timing(struct sensor_timing *out)
+{
+    *out = timing;
+}
@@ -7,6 +7,26 @@
 #define SENSOR_CONTROL_H
 
 #include <zephyr/kernel.h>
+#include "calibration.h"
+
+/* Values of sampling.warmup_mode, in schema order */
+enum warmup_mode {
+    WARMUP_FIXED,                  /* Wait warmup_ms */
+    WARMUP_SETTLE,                 /* Until the output settles, warmup_ms at most */
+};
+
+/* Settling probes per run, one run per millisecond */
+#define SENSOR_SETTLE_RUN        8
+
+/*
+ * Change of the run mean, in mV at the sensor, below which the output
+ * counts as settled. About half a step of the 10-bit probes, which the
+ * mean of a run resolves.
+ */
+#define SENSOR_SETTLE_MV         4
+
+/* Consecutive settled runs before the burst starts */
+#define SENSOR_SETTLE_RUNS       2
 
 /* Sensor reading structure */
 struct sensor_reading {
@@ -16,23 +36,28 @@ struct sensor_reading {
     uint32_t timestamp_ms; /* Timestamp in milliseconds */
     uint16_t battery_mv;   /* Battery voltage in mV */
     uint8_t faults;        /* Fault flags */
+    uint16_t counter;      /* Advertisement counter, set when reported */
 };
 
 /* Node configuration structure */
 struct node_config {
     struct {
-        uint32_interval_seconds;      /* Sampling interval */
-        uint16_t warmup_ms;            /* Sensor warmup time */
+        uint32_t interval_seconds;     /* Sampling interval */
+        uint32_t min_interval_seconds; /* Adaptive interval bounds, 0 = fixed */
+        uint32_t max_interval_seconds;
+        uint16_t warmup_ms;            /* Sensor warmup time, the limit when settling */
         uint8_t burst_count;           /* Number of samples to average */
-        uint8_t aggregation;           /* 0=mean, 1=median */
+        uint8_t aggregation;           /* enum aggregation */
+        uint8_t warmup_mode;           /* enum warmup_mode */
     } sampling;
     
+    struct calibration_config calibration;
+
     struct {
-        float offset;                  /* Calibration offset */
-        float slope;                   /* Calibration slope */
-        float poly_a;                  /* Polynomial coefficient A */
-        float poly_b;                  /* Polynomial coefficient B */
-    } calibration;
+        uint8_t policy;                /* enum report_policy */
+        uint16_t heartbeat_seconds;    /* Longest silence between reports */
+        float deadband;                /* Change reported by on_change */
+    } advertisement;
     
     struct {
         float high_threshold;          /* High alarm threshold */
@@ -44,11 +69,26 @@ struct node_config {
     uint8_t schema_version;
 };
 
+/* Timing of the last reading */
+struct sensor_timing {
+    uint32_t sensor_on_us;  /* Sensor rail powered, warmup included */
+    uint32_t warmup_us;     /* Rail on to burst start */
+    uint32_t acquire_us;    /* ADC burst */
+    uint32_t settle_us;     /* Learned settle time, 0 until one is seen */
+    uint32_t settle_timeouts; /* Warmups that reached warmup_ms unsettled */
+};
+
 /**
  * Initialize sensor hardware
  */
 int sensor_init(struct node_config *config);
 
+/**
+ * Compile the configured calibration, call after the configuration changes.
+ * An invalid calibration is rejected and the previous one stays in use.
+ */
+int sensor_configure(struct node_config *config);
+
 /**
  * Read sensor with power gating and calibration
  */
@@ -59,4 +99,9 @@ int sensor_read(struct node_config *config, struct sensor_reading *reading);
  */
 int sensor_get_battery_mv(uint16_t *voltage_mv);
 
+/**
+ * Get timing of the last reading
+ */
+void sensor_get_timing(struct sensor_timing *timing);
+
 #endif /* SENSOR_CONTROL_H */
@@ -0,0 +1,225 @@
+/*
+ * Burst Aggregation Tests
+ *
+ * Checks every mode against a reference that sorts a copy of the burst,
+ * over bursts shaped like the ones quickselect handles worst: sorted,
+ * reversed, all equal, few distinct values and spikes. The benchmark
+ * times median and trimmed mean on a full burst against the sort.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sensor/aggregate.h"
+
+#define BURST_MAX  100
+#define BENCH_RUNS 1000
+
+static int32_t burst[BURST_MAX];
+static int32_t work[BURST_MAX];
+static int32_t sorted[BURST_MAX];
+static uint32_t lcg_state;
+
+/* Fixed sequence, so a failure reproduces */
+static int32_t lcg(void)
+{
+    lcg_state = lcg_state * 1664525u + 1013904223u;
+    return lcg_state >> 8;
+}
+
+static int compare(const void *a, const void *b)
+{
+    int32_t x = *(const int32_t *)a;
+    int32_t y = *(const int32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void sort_copy(uint16_t count)
+{
+    memcpy(sorted, burst, count * sizeof(burst[0]));
+    qsort(sorted, count, sizeof(sorted[0]), compare);
+}
+
+static int32_t ref_median(uint16_t count)
+{
+    sort_copy(count);
+    return sorted[count / 2];
+}
+
+static int32_t ref_trimmed_mean(uint16_t count)
+{
+    int trim = count * AGGREGATE_TRIM_PERCENT / 100;
+    int32_t sum = 0;
+
+    sort_copy(count);
+    for (int i = trim; i < count - trim; i++) {
+        sum += sorted[i];
+    }
+    return sum / (count - 2 * trim);
+}
+
+static int32_t run(uint16_t count, uint8_t mode)
+{
+    memcpy(work, burst, count * sizeof(burst[0]));
+    return aggregate(work, count, mode);
+}
+
+/* Median and trimmed mean of burst[0..count) against the references */
+static void check_selecting(uint16_t count)
+{
+    zassert_equal(run(count, AGGREGATION_MEDIAN), ref_median(count),
+                  "median of %u", count);
+    zassert_equal(run(count, AGGREGATION_TRIMMED_MEAN), ref_trimmed_mean(count),
+                  "trimmed mean of %u", count);
+}
+
+static void fill_random(uint16_t count, int32_t range)
+{
+    for (int i = 0; i < count; i++) {
+        burst[i] = lcg() % range;
+    }
+}
+
+static void *setup(void)
+{
+    lcg_state = 12345;
+    return NULL;
+}
+
+ZTEST(aggregate, test_single_pass_modes)
+{
+    static const int32_t values[] = { 1210, 1190, 1250, 1175, 1205 };
+
+    memcpy(burst, values, sizeof(values));
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_MEAN), 1206);
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_MIN), 1175);
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_MAX), 1250);
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_MEDIAN), 1205);
+
+    /* An unknown mode falls back to the mean */
+    zassert_equal(run(ARRAY_SIZE(values), 0xff), 1206);
+}
+
+ZTEST(aggregate, test_single_sample)
+{
+    burst[0] = -42;
+    for (uint8_t mode = AGGREGATION_MEAN; mode <= AGGREGATION_TRIMMED_MEAN; mode++) {
+        zassert_equal(run(1, mode), -42, "mode %u", mode);
+    }
+}
+
+ZTEST(aggregate, test_median_even_count)
+{
+    static const int32_t values[] = { 40, 10, 30, 20 };
+
+    /* The upper of the two middle samples */
+    memcpy(burst, values, sizeof(values));
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_MEDIAN), 30);
+}
+
+ZTEST(aggregate, test_trimmed_mean_drops_spikes)
+{
+    /* 10 of 100 trimmed from each end: the spikes go, the rest averages */
+    for (int i = 0; i < BURST_MAX; i++) {
+        burst[i] = 2000 + (i % 2);
+    }
+    for (int i = 0; i < 10; i++) {
+        burst[i * 10] = i % 2 ? 4095 : 0;
+    }
+    zassert_equal(run(BURST_MAX, AGGREGATION_TRIMMED_MEAN), 2000);
+    zassert_not_equal(run(BURST_MAX, AGGREGATION_MEAN), 2000);
+}
+
+ZTEST(aggregate, test_trimmed_mean_short_burst)
+{
+    /* Below 10 samples nothing is trimmed, it is the plain mean */
+    static const int32_t values[] = { 0, 100, 100, 100, 100, 100, 100, 100, 4000 };
+
+    memcpy(burst, values, sizeof(values));
+    zassert_equal(run(ARRAY_SIZE(values), AGGREGATION_TRIMMED_MEAN),
+                  run(ARRAY_SIZE(values), AGGREGATION_MEAN));
+}
+
+ZTEST(aggregate, test_ordered_bursts)
+{
+    for (uint16_t count = 1; count <= BURST_MAX; count++) {
+        for (int i = 0; i < count; i++) {
+            burst[i] = i * 7;
+        }
+        check_selecting(count);
+
+        for (int i = 0; i < count; i++) {
+            burst[i] = (count - i) * 7;
+        }
+        check_selecting(count);
+    }
+}
+
+ZTEST(aggregate, test_equal_and_duplicate_values)
+{
+    for (uint16_t count = 1; count <= BURST_MAX; count++) {
+        for (int i = 0; i < count; i++) {
+            burst[i] = 1234;
+        }
+        check_selecting(count);
+
+        fill_random(count, 3);
+        check_selecting(count);
+    }
+}
+
+ZTEST(aggregate, test_random_bursts)
+{
+    for (int round = 0; round < 200; round++) {
+        uint16_t count = 1 + lcg() % BURST_MAX;
+
+        fill_random(count, 4096);
+        check_selecting(count);
+    }
+}
+
+ZTEST(aggregate, test_selection_keeps_samples)
+{
+    /* Selection only reorders, no sample is lost or duplicated */
+    fill_random(BURST_MAX, 4096);
+    sort_copy(BURST_MAX);
+    run(BURST_MAX, AGGREGATION_TRIMMED_MEAN);
+    qsort(work, BURST_MAX, sizeof(work[0]), compare);
+    zassert_mem_equal(work, sorted, sizeof(sorted));
+}
+
+ZTEST(aggregate, test_benchmark)
+{
+    static const uint8_t modes[] = { AGGREGATION_MEDIAN, AGGREGATION_TRIMMED_MEAN };
+    volatile int32_t sink;
+
+    fill_random(BURST_MAX, 4096);
+
+    for (int m = 0; m < ARRAY_SIZE(modes); m++) {
+        uint32_t start;
+        uint32_t select_cyc;
+        uint32_t sort_cyc;
+
+        start = k_cycle_get_32();
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            sink = run(BURST_MAX, modes[m]);
+        }
+        select_cyc = (k_cycle_get_32() - start) / BENCH_RUNS;
+
+        start = k_cycle_get_32();
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            sink = modes[m] == AGGREGATION_MEDIAN ? ref_median(BURST_MAX) :
+                                                    ref_trimmed_mean(BURST_MAX);
+        }
+        sort_cyc = (k_cycle_get_32() - start) / BENCH_RUNS;
+
+        TC_PRINT("%s of %d: quickselect %u cycles, qsort %u cycles\n",
+                 modes[m] == AGGREGATION_MEDIAN ? "Median" : "Trimmed mean", BURST_MAX,
+                 select_cyc, sort_cyc);
+    }
+    (void)sink;
+}
+
+ZTEST_SUITE(aggregate, NULL, setup, NULL, NULL, NULL);
@@ -0,0 +1,382 @@
+/*
+ * Calibration Tests
+ *
+ * Compiles linear, polynomial and table calibrations and compares the
+ * fixed-point result with the same curve evaluated in double precision,
+ * across the whole clamped input range. Covers table extrapolation and
+ * input clamping, coefficients near the fixed-point limit and the
+ * configurations compile must reject. The benchmark times one reading per
+ * calibration type against evaluating the configured curve in float.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include "sensor/calibration.h"
+
+#define BENCH_RUNS 10000
+#define INPUT_STEP 7
+
+/* Tolerance relative to the largest value the curve reaches */
+#define REL_TOLERANCE 1e-6
+
+static struct calibration cal;
+
+static double poly_ref(const float *c, int count, int32_t mv)
+{
+    double v = mv / 1000.0;
+    double y = 0.0;
+
+    for (int k = count - 1; k >= 0; k--) {
+        y = y * v + c[k];
+    }
+    return y;
+}
+
+/* Linear interpolation over sorted points, end segments extended */
+static double table_ref(const struct calibration_point *p, int count, int32_t mv)
+{
+    int i = 0;
+
+    while (i < count - 2 && mv >= p[i + 1].voltage_mv) {
+        i++;
+    }
+    return p[i].value + ((double)p[i + 1].value - p[i].value) * (mv - p[i].voltage_mv) /
+                        (p[i + 1].voltage_mv - p[i].voltage_mv);
+}
+
+static int32_t clamp_mv(int32_t mv)
+{
+    return CLAMP(mv, -CALIBRATION_INPUT_MAX_MV, CALIBRATION_INPUT_MAX_MV);
+}
+
+/* Compare with a polynomial in volts, constant first, over every input */
+static void check_poly(const float *c, int count)
+{
+    double bound = 0.0;
+
+    for (int32_t mv = -CALIBRATION_INPUT_MAX_MV; mv <= CALIBRATION_INPUT_MAX_MV;
+         mv += INPUT_STEP) {
+        bound = MAX(bound, fabs(poly_ref(c, count, mv)));
+    }
+    for (int32_t mv = -CALIBRATION_INPUT_MAX_MV; mv <= CALIBRATION_INPUT_MAX_MV;
+         mv += INPUT_STEP) {
+        zassert_within(calibration_apply(&cal, mv), poly_ref(c, count, mv),
+                       bound * REL_TOLERANCE + 1e-6, "at %d mV", mv);
+    }
+}
+
+static void check_table(const struct calibration_point *sorted, int count)
+{
+    double bound = 0.0;
+
+    for (int32_t mv = -CALIBRATION_INPUT_MAX_MV; mv <= CALIBRATION_INPUT_MAX_MV;
+         mv += INPUT_STEP) {
+        bound = MAX(bound, fabs(table_ref(sorted, count, mv)));
+    }
+    for (int32_t mv = -CALIBRATION_INPUT_MAX_MV; mv <= CALIBRATION_INPUT_MAX_MV;
+         mv += INPUT_STEP) {
+        zassert_within(calibration_apply(&cal, mv), table_ref(sorted, count, mv),
+                       bound * REL_TOLERANCE + 1e-6, "at %d mV", mv);
+    }
+}
+
+ZTEST(calibration, test_linear)
+{
+    /* The default configuration, 0-5 V is 0-100 */
+    const struct calibration_config config = {
+        .type = CALIBRATION_LINEAR,
+        .slope = 20.0f,
+    };
+    const float c[] = { 0.0f, 20.0f };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_within(calibration_apply(&cal, 0), 0.0, 1e-6);
+    zassert_within(calibration_apply(&cal, 2500), 50.0, 1e-4);
+    zassert_within(calibration_apply(&cal, 5000), 100.0, 1e-4);
+    check_poly(c, ARRAY_SIZE(c));
+}
+
+ZTEST(calibration, test_linear_correction)
+{
+    /* Ax^2 + Bx fold into the line */
+    const struct calibration_config config = {
+        .type = CALIBRATION_LINEAR,
+        .offset = -12.5f,
+        .slope = 25.0f,
+        .poly_a = 0.35f,
+        .poly_b = -1.25f,
+    };
+    const float c[] = { -12.5f, 25.0f - 1.25f, 0.35f };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_equal(cal.count, 3);
+    check_poly(c, ARRAY_SIZE(c));
+}
+
+ZTEST(calibration, test_polynomial)
+{
+    /* Fifth order, mixed signs, like a fitted thermistor curve */
+    struct calibration_config config = {
+        .type = CALIBRATION_POLYNOMIAL,
+        .poly = { -40.2f, 61.7f, -18.9f, 4.35f, -0.52f, 0.023f },
+        .poly_count = 6,
+    };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_equal(cal.count, 6);
+    check_poly(config.poly, config.poly_count);
+}
+
+ZTEST(calibration, test_polynomial_trailing_zeros)
+{
+    struct calibration_config config = {
+        .type = CALIBRATION_POLYNOMIAL,
+        .poly = { 1.0f, 2.0f, 0.0f, 0.0f },
+        .poly_count = 4,
+    };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_equal(cal.count, 2, "zero terms are dropped");
+    check_poly(config.poly, 2);
+
+    /* A constant stays a constant */
+    memset(config.poly, 0, sizeof(config.poly));
+    config.poly[0] = 3.5f;
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_equal(cal.count, 1);
+    zassert_within(calibration_apply(&cal, 1234), 3.5, 1e-6);
+}
+
+ZTEST(calibration, test_table)
+{
+    /* Given out of order, with uneven spacing and a non-monotonic value */
+    const struct calibration_config config = {
+        .type = CALIBRATION_TABLE,
+        .points = {
+            { 3000, 55.0f }, { 500, 2.0f }, { 4500, 98.0f },
+            { 1000, 12.0f }, { 2000, 60.0f },
+        },
+        .point_count = 5,
+    };
+    const struct calibration_point sorted[] = {
+        { 500, 2.0f }, { 1000, 12.0f }, { 2000, 60.0f }, { 3000, 55.0f }, { 4500, 98.0f },
+    };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    for (int i = 0; i < ARRAY_SIZE(sorted); i++) {
+        zassert_within(calibration_apply(&cal, sorted[i].voltage_mv), sorted[i].value, 1e-5,
+                       "breakpoint %d", i);
+    }
+    zassert_within(calibration_apply(&cal, 2500), 57.5, 1e-5);
+    check_table(sorted, ARRAY_SIZE(sorted));
+}
+
+ZTEST(calibration, test_table_extrapolation)
+{
+    /* Below the first and above the last point the end segments continue */
+    const struct calibration_config config = {
+        .type = CALIBRATION_TABLE,
+        .points = { { 1000, 10.0f }, { 2000, 30.0f }, { 3000, 35.0f } },
+        .point_count = 3,
+    };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_within(calibration_apply(&cal, 0), -10.0, 1e-5);
+    zassert_within(calibration_apply(&cal, -1000), -30.0, 1e-5);
+    zassert_within(calibration_apply(&cal, 5000), 45.0, 1e-5);
+    zassert_within(calibration_apply(&cal, CALIBRATION_INPUT_MAX_MV),
+                   35.0 + 5.0 * (CALIBRATION_INPUT_MAX_MV - 3000) / 1000, 1e-4);
+}
+
+ZTEST(calibration, test_input_clamped)
+{
+    const struct calibration_config config = {
+        .type = CALIBRATION_LINEAR,
+        .offset = 1.0f,
+        .slope = -3.0f,
+    };
+    const struct calibration_config table = {
+        .type = CALIBRATION_TABLE,
+        .points = { { 0, 0.0f }, { 100, 100.0f } },
+        .point_count = 2,
+    };
+
+    zassert_ok(calibration_compile(&config, &cal));
+    zassert_equal(calibration_apply(&cal, INT32_MAX),
+                  calibration_apply(&cal, CALIBRATION_INPUT_MAX_MV));
+    zassert_equal(calibration_apply(&cal, INT32_MIN),
+                  calibration_apply(&cal, -CALIBRATION_INPUT_MAX_MV));
+
+    zassert_ok(calibration_compile(&table, &cal));
+    zassert_within(calibration_apply(&cal, 100000), (double)clamp_mv(100000), 1e-3);
+    zassert_within(calibration_apply(&cal, -100000), (double)clamp_mv(-100000), 1e-3);
+}
+
+ZTEST(calibration, test_fixed_point_limits)
+{
+    /* Up to ~1e9 over the input range still fits, with shift 0 */
+    const struct calibration_config steep = {
+        .type = CALIBRATION_POLYNOMIAL,
+        .poly = { 1.0e8f, -4.0e7f, 8.0e6f },
+        .poly_count = 3,
+    };
+    const struct calibration_config tiny = {
+        .type = CALIBRATION_LINEAR,
+        .offset = 1.0e-6f,
+        .slope = 2.0e-6f,
+    };
+    const struct calibration_config table = {
+        .type = CALIBRATION_TABLE,
+        .points = { { 8191, 1.0e9f }, { 0, 0.0f }, { 4000, 4.0e8f } },
+        .point_count = 3,
+    };
+    const struct calibration_point table_sorted[] = {
+        { 0, 0.0f }, { 4000, 4.0e8f }, { 8191, 1.0e9f },
+    };
+
+    zassert_ok(calibration_compile(&steep, &cal));
+    zassert_equal(cal.shift, 0);
+    check_poly(steep.poly, steep.poly_count);
+
+    /* Small coefficients get the fraction bits instead */
+    zassert_ok(calibration_compile(&tiny, &cal));
+    zassert_equal(cal.shift, 30);
+    zassert_within(calibration_apply(&cal, 5000), 11.0e-6, 1e-8);
+
+    /* 1e9 at the top, the first segment extended to -8.2e8, no wrapping */
+    zassert_ok(calibration_compile(&table, &cal));
+    zassert_equal(cal.shift, 0);
+    check_table(table_sorted, ARRAY_SIZE(table_sorted));
+    zassert_within(calibration_apply(&cal, -CALIBRATION_INPUT_MAX_MV), -8.191e8, 1e3);
+    zassert_within(calibration_apply(&cal, INT32_MAX), 1.0e9, 1e3);
+}
+
+ZTEST(calibration, test_out_of_range)
+{
+    const struct calibration_config huge_poly = {
+        .type = CALIBRATION_POLYNOMIAL,
+        .poly = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0e9f },
+        .poly_count = 6,
+    };
+    const struct calibration_config huge_table = {
+        .type = CALIBRATION_TABLE,
+        .points = { { 0, 0.0f }, { 1, 1.0e6f } },
+        .point_count = 2,
+    };
+
+    zassert_equal(calibration_compile(&huge_poly, &cal), -ERANGE);
+    zassert_equal(calibration_compile(&huge_table, &cal), -ERANGE,
+                  "extrapolating 1e6 per mV to the input limit overflows");
+}
+
+ZTEST(calibration, test_rejected_configs)
+{
+    struct calibration_config config = { 0 };
+    struct calibration before;
+
+    config.type = CALIBRATION_LINEAR;
+    config.slope = 20.0f;
+    zassert_ok(calibration_compile(&config, &cal));
+    before = cal;
+
+    config.type = 7;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "unknown type");
+
+    config.type = CALIBRATION_POLYNOMIAL;
+    config.poly_count = 0;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "no terms");
+    config.poly_count = CALIBRATION_POLY_MAX + 1;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "too many terms");
+
+    config.type = CALIBRATION_TABLE;
+    config.points[0] = (struct calibration_point){ 1000, 1.0f };
+    config.point_count = 1;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "one point");
+    config.point_count = CALIBRATION_POINTS_MAX + 1;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "too many points");
+    config.points[1] = (struct calibration_point){ 1000, 2.0f };
+    config.point_count = 2;
+    zassert_equal(calibration_compile(&config, &cal), -EINVAL, "same voltage twice");
+
+    /* A rejected configuration leaves the compiled one alone */
+    zassert_mem_equal(&cal, &before, sizeof(cal));
+}
+
+static float float_linear(const struct calibration_config *config, int32_t mv)
+{
+    float v = mv / 1000.0f;
+
+    return config->offset + config->slope * v + config->poly_a * v * v + config->poly_b * v;
+}
+
+static float float_poly(const struct calibration_config *config, int32_t mv)
+{
+    float v = mv / 1000.0f;
+    float y = 0.0f;
+
+    for (int k = config->poly_count - 1; k >= 0; k--) {
+        y = y * v + config->poly[k];
+    }
+    return y;
+}
+
+/* Linear search over sorted points, as a float implementation would */
+static float float_table(const struct calibration_config *config, int32_t mv)
+{
+    const struct calibration_point *p = config->points;
+    int i = 0;
+
+    while (i < config->point_count - 2 && mv >= p[i + 1].voltage_mv) {
+        i++;
+    }
+    return p[i].value + (p[i + 1].value - p[i].value) * (mv - p[i].voltage_mv) /
+                        (p[i + 1].voltage_mv - p[i].voltage_mv);
+}
+
+ZTEST(calibration, test_benchmark)
+{
+    static struct calibration_config configs[3] = {
+        { .type = CALIBRATION_LINEAR, .offset = -12.5f, .slope = 25.0f, .poly_a = 0.35f },
+        { .type = CALIBRATION_POLYNOMIAL,
+          .poly = { -40.2f, 61.7f, -18.9f, 4.35f, -0.52f, 0.023f }, .poly_count = 6 },
+        { .type = CALIBRATION_TABLE, .point_count = CALIBRATION_POINTS_MAX },
+    };
+    static float (*const float_eval[3])(const struct calibration_config *, int32_t) = {
+        float_linear, float_poly, float_table,
+    };
+    static const char *const names[3] = { "linear", "polynomial 5th", "table 16" };
+    volatile float sink;
+
+    for (int i = 0; i < CALIBRATION_POINTS_MAX; i++) {
+        configs[2].points[i] = (struct calibration_point){ i * 300, i * i * 0.5f };
+    }
+
+    for (int c = 0; c < ARRAY_SIZE(configs); c++) {
+        uint32_t start;
+        uint32_t fixed_cyc;
+        uint32_t float_cyc;
+
+        zassert_ok(calibration_compile(&configs[c], &cal));
+
+        start = k_cycle_get_32();
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            sink = calibration_apply(&cal, i % 5000);
+        }
+        fixed_cyc = k_cycle_get_32() - start;
+
+        start = k_cycle_get_32();
+        for (int i = 0; i < BENCH_RUNS; i++) {
+            sink = float_eval[c](&configs[c], i % 5000);
+        }
+        float_cyc = k_cycle_get_32() - start;
+
+        TC_PRINT("%s: fixed point %u cycles, float %u cycles (per 100 readings)\n",
+                 names[c], fixed_cyc / (BENCH_RUNS / 100), float_cyc / (BENCH_RUNS / 100));
+    }
+    (void)sink;
+}
+
+ZTEST_SUITE(calibration, NULL, NULL, NULL, NULL, NULL);
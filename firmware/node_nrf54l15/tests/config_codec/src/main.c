@@ -0,0 +1,248 @@
+/*
+ * Configuration Codec Tests
+ *
+ * Round trips a full configuration, with the longest polynomial and table,
+ * applies partial writes over an existing configuration and checks the
+ * values decode must reject. Decode runs in the Bluetooth RX thread, so the
+ * stack test runs the largest decodes on a thread of their own and reads
+ * back how much of its stack they used.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <string.h>
+#include "config/config_codec.h"
+#include "sensor/aggregate.h"
+#include "sensor/reporting.h"
+
+/* Stack of the decode thread, and the most a decode may use of it */
+#define DECODE_STACK_SIZE 4096
+#define DECODE_STACK_MAX  1024
+
+#define ALL_SECTIONS (BIT(NODE_CONFIG_SECTIONS) - 1)
+
+static struct node_config config;
+static struct node_config decoded;
+static uint8_t buf[CONFIG_CODEC_MAX_LEN];
+
+K_THREAD_STACK_DEFINE(decode_stack, DECODE_STACK_SIZE);
+static struct k_thread decode_thread;
+
+static void full_config(struct node_config *c, uint8_t cal_type)
+{
+    static const float poly[CALIBRATION_POLY_MAX] = {
+        -40.2f, 61.7f, -18.9f, 4.35f, -0.52f, 0.023f,
+    };
+
+    memset(c, 0, sizeof(*c));
+    c->sampling.interval_seconds = 60;
+    c->sampling.min_interval_seconds = 10;
+    c->sampling.max_interval_seconds = 3600;
+    c->sampling.warmup_ms = 250;
+    c->sampling.burst_count = 8;
+    c->sampling.aggregation = AGGREGATION_TRIMMED_MEAN;
+    c->sampling.warmup_mode = WARMUP_SETTLE;
+
+    c->calibration.type = cal_type;
+    c->calibration.offset = -12.5f;
+    c->calibration.slope = 25.0f;
+    c->calibration.poly_a = 0.35f;
+    c->calibration.poly_b = 1.5f;
+    memcpy(c->calibration.poly, poly, sizeof(poly));
+    c->calibration.poly_count = CALIBRATION_POLY_MAX;
+    for (int i = 0; i < CALIBRATION_POINTS_MAX; i++) {
+        c->calibration.points[i] = (struct calibration_point){ i * 300, i * i * 0.5f };
+    }
+    c->calibration.point_count = CALIBRATION_POINTS_MAX;
+
+    c->advertisement.policy = REPORT_ON_CHANGE;
+    c->advertisement.heartbeat_seconds = 900;
+    c->advertisement.deadband = 0.25f;
+
+    c->alarms.high_threshold = 150.0f;
+    c->alarms.low_threshold = 5.0f;
+    c->alarms.enable_high = true;
+    c->alarms.enable_low = false;
+}
+
+static void assert_config_equal(const struct node_config *a, const struct node_config *b)
+{
+    zassert_mem_equal(&a->sampling, &b->sampling, sizeof(a->sampling));
+    zassert_mem_equal(&a->calibration, &b->calibration, sizeof(a->calibration));
+    zassert_equal(a->advertisement.policy, b->advertisement.policy);
+    zassert_equal(a->advertisement.heartbeat_seconds, b->advertisement.heartbeat_seconds);
+    zassert_equal(a->advertisement.deadband, b->advertisement.deadband);
+    zassert_equal(a->alarms.high_threshold, b->alarms.high_threshold);
+    zassert_equal(a->alarms.low_threshold, b->alarms.low_threshold);
+    zassert_equal(a->alarms.enable_high, b->alarms.enable_high);
+    zassert_equal(a->alarms.enable_low, b->alarms.enable_low);
+}
+
+/* Version byte, then one record */
+static uint16_t one_record(uint8_t tag, const uint8_t *value, uint8_t len)
+{
+    buf[0] = CONFIG_CODEC_VERSION;
+    buf[1] = tag;
+    buf[2] = len;
+    memcpy(&buf[3], value, len);
+    return 3 + len;
+}
+
+static void before(void *fixture)
+{
+    full_config(&config, CALIBRATION_POLYNOMIAL);
+    memset(&decoded, 0, sizeof(decoded));
+}
+
+ZTEST(config_codec, test_round_trip)
+{
+    uint8_t sections;
+    int len;
+
+    for (uint8_t type = CALIBRATION_LINEAR; type <= CALIBRATION_TABLE; type++) {
+        full_config(&config, type);
+        memset(&decoded, 0, sizeof(decoded));
+
+        len = config_codec_encode(&config, buf, sizeof(buf));
+        zassert_equal(len, CONFIG_CODEC_MAX_LEN, "Full config is %d bytes", len);
+
+        zassert_ok(config_codec_decode(buf, len, &decoded, &sections));
+        zassert_equal(sections, ALL_SECTIONS);
+        assert_config_equal(&config, &decoded);
+    }
+}
+
+ZTEST(config_codec, test_encode_short_buffer)
+{
+    zassert_equal(config_codec_encode(&config, buf, CONFIG_CODEC_MAX_LEN - 1), -ENOMEM);
+    zassert_equal(config_codec_encode(&config, buf, 0), -ENOMEM);
+}
+
+ZTEST(config_codec, test_partial_write)
+{
+    const uint8_t heartbeat[] = { 0x2c, 0x01 };    /* 300 s */
+    struct node_config expected = config;
+    uint8_t sections;
+    uint16_t len;
+
+    len = one_record(CONFIG_TAG_HEARTBEAT, heartbeat, sizeof(heartbeat));
+    decoded = config;
+    zassert_ok(config_codec_decode(buf, len, &decoded, &sections));
+    zassert_equal(sections, BIT(NODE_CONFIG_ADVERTISEMENT));
+
+    expected.advertisement.heartbeat_seconds = 300;
+    assert_config_equal(&expected, &decoded);
+}
+
+ZTEST(config_codec, test_unknown_tag_skipped)
+{
+    const uint8_t value[] = { 1, 2, 3 };
+    uint8_t sections;
+    uint16_t len;
+
+    len = one_record(0x7f, value, sizeof(value));
+    decoded = config;
+    zassert_ok(config_codec_decode(buf, len, &decoded, &sections));
+    zassert_equal(sections, 0);
+    assert_config_equal(&config, &decoded);
+}
+
+ZTEST(config_codec, test_malformed)
+{
+    const uint8_t interval[] = { 60, 0, 0, 0 };
+    const uint8_t poly[(CALIBRATION_POLY_MAX + 1) * sizeof(float)] = { 0 };
+    const uint8_t points[CONFIG_POINT_LEN + 1] = { 0 };
+    uint8_t sections;
+    uint16_t len;
+
+    /* Empty and wrong version */
+    zassert_equal(config_codec_decode(buf, 0, &decoded, &sections), -EINVAL);
+    len = one_record(CONFIG_TAG_INTERVAL, interval, sizeof(interval));
+    buf[0] = CONFIG_CODEC_VERSION + 1;
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -EINVAL);
+
+    /* Record longer than the value, and a header cut short */
+    len = one_record(CONFIG_TAG_INTERVAL, interval, sizeof(interval));
+    zassert_equal(config_codec_decode(buf, len - 1, &decoded, &sections), -EINVAL);
+    zassert_equal(config_codec_decode(buf, 2, &decoded, &sections), -EINVAL);
+
+    /* Scalar of the wrong length */
+    len = one_record(CONFIG_TAG_INTERVAL, interval, 2);
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -EINVAL);
+
+    /* Too many terms, a partial point */
+    len = one_record(CONFIG_TAG_CAL_POLY, poly, sizeof(poly));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -EINVAL);
+    len = one_record(CONFIG_TAG_CAL_POINTS, points, sizeof(points));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -EINVAL);
+}
+
+ZTEST(config_codec, test_out_of_range)
+{
+    const uint8_t zero_interval[] = { 0, 0, 0, 0 };
+    const uint8_t burst[] = { 0 };
+    const uint8_t policy[] = { REPORT_ON_CHANGE + 1 };
+    const uint8_t cal_type[] = { CALIBRATION_TABLE + 1 };
+    uint8_t sections;
+    uint16_t len;
+
+    decoded = config;
+    len = one_record(CONFIG_TAG_INTERVAL, zero_interval, sizeof(zero_interval));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -ERANGE);
+
+    decoded = config;
+    len = one_record(CONFIG_TAG_BURST_COUNT, burst, sizeof(burst));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -ERANGE);
+
+    decoded = config;
+    len = one_record(CONFIG_TAG_POLICY, policy, sizeof(policy));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -ERANGE);
+
+    /* A calibration is checked by compiling it */
+    decoded = config;
+    len = one_record(CONFIG_TAG_CAL_TYPE, cal_type, sizeof(cal_type));
+    zassert_equal(config_codec_decode(buf, len, &decoded, &sections), -ERANGE);
+}
+
+static void decode_entry(void *p1, void *p2, void *p3)
+{
+    uint16_t len = POINTER_TO_UINT(p1);
+    int *ret = p2;
+    uint8_t sections;
+
+    *ret = config_codec_decode(buf, len, &decoded, &sections);
+}
+
+ZTEST(config_codec, test_stack)
+{
+    static const char *const names[] = { "linear", "polynomial 5th", "table 16" };
+    struct config_codec_stats stats;
+
+    for (uint8_t type = CALIBRATION_LINEAR; type <= CALIBRATION_TABLE; type++) {
+        size_t unused;
+        size_t used;
+        int ret = -1;
+        int len;
+
+        full_config(&config, type);
+        len = config_codec_encode(&config, buf, sizeof(buf));
+        zassert_true(len > 0);
+
+        k_thread_create(&decode_thread, decode_stack, K_THREAD_STACK_SIZEOF(decode_stack),
+                        decode_entry, UINT_TO_POINTER(len), &ret, NULL,
+                        K_PRIO_PREEMPT(0), 0, K_NO_WAIT);
+        zassert_ok(k_thread_join(&decode_thread, K_FOREVER));
+        zassert_ok(ret);
+        zassert_ok(k_thread_stack_space_get(&decode_thread, &unused));
+
+        /* The thread entry is counted too */
+        used = K_THREAD_STACK_SIZEOF(decode_stack) - unused;
+        config_codec_get_stats(&stats);
+        TC_PRINT("%s: %u bytes decoded with %zu bytes of stack in %u us\n",
+                 names[type], len, used, stats.decode_us);
+        zassert_true(used <= DECODE_STACK_MAX, "Decode used %zu bytes of stack", used);
+    }
+}
+
+ZTEST_SUITE(config_codec, NULL, NULL, before, NULL, NULL);
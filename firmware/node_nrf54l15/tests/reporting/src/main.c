@@ -0,0 +1,148 @@
+/*
+ * Reporting Trace Replay
+ *
+ * Replays a day of a process signal through report-by-exception and the
+ * adaptive interval in simulated time, the way the sample loop in main.c
+ * drives them. The signal is a pressure line: flat with noise well inside
+ * the deadband, a slow ramp up in the morning, a step and back at noon and
+ * a faster ramp down in the evening. Every second of the day the value
+ * the hub last received is compared with the signal, for the node and for
+ * a fixed 60 s interval sending every reading.
+ */
+
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+#include <math.h>
+#include "sensor/reporting.h"
+
+#define DAY_S         86400
+#define FIXED_S       60
+#define DEADBAND      0.5f
+#define HEARTBEAT_S   900
+#define MIN_S         10
+#define MAX_S         600
+
+static uint32_t lcg_state = 12345;
+
+/* Fixed sequence, so a failure reproduces */
+static float noise(uint32_t t)
+{
+    uint32_t x = t * 1664525u + lcg_state;
+
+    x ^= x >> 13;
+    x *= 1013904223u;
+    return ((float)((x >> 8) % 2001) / 1000.0f - 1.0f) * 0.1f;
+}
+
+static float ramp(uint32_t t, uint32_t start, uint32_t len, float rise)
+{
+    if (t <= start) {
+        return 0.0f;
+    }
+    return t >= start + len ? rise : rise * (t - start) / len;
+}
+
+/* The signal at second t of the day */
+static float trace(uint32_t t)
+{
+    float value = 50.0f + noise(t);
+
+    value += ramp(t, 8 * 3600, 1800, 30.0f);
+    value -= ramp(t, 18 * 3600, 600, 30.0f);
+    if (t >= 12 * 3600 && t < 12 * 3600 + 1200) {
+        value += 5.0f;
+    }
+    return value;
+}
+
+struct tracking {
+    uint32_t off_s;          /* Seconds the hub was more than the deadband off */
+    uint32_t run_s;          /* Of those, the current and the longest run */
+    uint32_t longest_s;
+    float worst;
+};
+
+static void track(struct tracking *trk, uint32_t from, uint32_t to, float received)
+{
+    for (uint32_t s = from; s < to && s < DAY_S; s++) {
+        float err = fabsf(trace(s) - received);
+
+        if (err > DEADBAND) {
+            trk->off_s++;
+            trk->run_s++;
+            trk->longest_s = MAX(trk->longest_s, trk->run_s);
+        } else {
+            trk->run_s = 0;
+        }
+        trk->worst = MAX(trk->worst, err);
+    }
+}
+
+ZTEST(reporting, test_day_replay)
+{
+    struct node_config config = {
+        .sampling = {
+            .interval_seconds = FIXED_S,
+            .min_interval_seconds = MIN_S,
+            .max_interval_seconds = MAX_S,
+        },
+        .advertisement = {
+            .policy = REPORT_ON_CHANGE,
+            .heartbeat_seconds = HEARTBEAT_S,
+            .deadband = DEADBAND,
+        },
+    };
+    struct sensor_reading reading = { 0 };
+    struct reporting_stats stats;
+    struct tracking node = { 0 };
+    struct tracking fixed = { 0 };
+    int64_t start_ms = k_uptime_get();
+    uint32_t sent_s = 0;
+    float sent = 0.0f;
+    uint32_t t = 0;
+
+    while (t < DAY_S) {
+        uint32_t next;
+
+        reading.value = trace(t);
+        reading.timestamp_ms = k_uptime_get_32();
+
+        if (reporting_should_send(&config, &reading)) {
+            zassert_true(t == 0 || t - sent_s <= HEARTBEAT_S,
+                         "%u s of silence at %u", t - sent_s, t);
+            sent = reading.value;
+            sent_s = t;
+        } else {
+            zassert_true(fabsf(reading.value - sent) <= DEADBAND,
+                         "change of %f not sent at %u", (double)(reading.value - sent), t);
+        }
+
+        next = reporting_next_interval(&config, &reading);
+        zassert_true(next >= 1 && next <= MAX_S, "interval %u at %u", next, t);
+
+        track(&node, t, t + next, sent);
+        k_sleep(K_SECONDS(next));
+        t = (k_uptime_get() - start_ms) / MSEC_PER_SEC;
+    }
+
+    for (uint32_t s = 0; s < DAY_S; s += FIXED_S) {
+        track(&fixed, s, s + FIXED_S, trace(s));
+    }
+
+    reporting_get_stats(&stats);
+    TC_PRINT("Node: %u readings, %u sent; off by more than the deadband for %u s, "
+             "at most %u s in a row, worst %.2f\n", stats.samples, stats.reports,
+             node.off_s, node.longest_s, (double)node.worst);
+    TC_PRINT("Fixed %d s: %d readings, %d sent; off by more than the deadband for %u s, "
+             "at most %u s in a row, worst %.2f\n", FIXED_S, DAY_S / FIXED_S,
+             DAY_S / FIXED_S, fixed.off_s, fixed.longest_s, (double)fixed.worst);
+
+    /* The point of both: far fewer power-ups and transmissions */
+    zassert_true(stats.samples < DAY_S / FIXED_S / 2, "%u readings", stats.samples);
+    zassert_true(stats.reports < stats.samples / 2, "%u sent", stats.reports);
+
+    /* The next reading after a change is sent, so the hub catches up in time */
+    zassert_true(node.longest_s < MAX_S, "%u s off in a row", node.longest_s);
+}
+
+ZTEST_SUITE(reporting, NULL, NULL, NULL, NULL, NULL);